@@ -187,6 +187,60 @@ struct txpool_tx_meta_t
   }
 };
 
+/**
+ * @brief a transaction blob as it is stored in the db, without copying it
+ *
+ * Transactions are stored in two parts, which make up the full blob one
+ * after the other. The prunable part is empty when only the pruned blob
+ * was asked for.
+ *
+ * The parts point into the db, and are only valid until the read
+ * transaction they were fetched in ends.
+ */
+struct tx_blob_view
+{
+  cryptonote::blobdata_ref pruned;
+  cryptonote::blobdata_ref prunable;
+
+  size_t size() const { return pruned.size() + prunable.size(); }
+
+  //! copies the blob out of the db, with a single allocation
+  void copy_to(cryptonote::blobdata &bd) const
+  {
+    bd.clear();
+    bd.reserve(size());
+    bd.append(pruned.data(), pruned.size());
+    bd.append(prunable.data(), prunable.size());
+  }
+};
+
+/**
+ * @brief a block and its transactions as stored in the db, without copying them
+ *
+ * Only valid until the read transaction they were fetched in ends.
+ */
+struct block_blob_view
+{
+  cryptonote::blobdata_ref block;
+  crypto::hash miner_tx_hash;  //!< null unless asked for
+  std::vector<std::pair<crypto::hash, tx_blob_view>> txs;
+};
+
+/**
+ * @brief how the db's backing storage has grown, and what it cost readers
+ *
+ * Times are in milliseconds.
+ */
+struct db_resize_stats
+{
+  uint64_t map_size;         //!< bytes the db may currently grow to
+  uint64_t used_size;        //!< bytes currently used
+  uint64_t growth_rate;      //!< bytes per second the db has recently grown by
+  uint64_t resizes;          //!< times the map was grown since startup
+  uint64_t deferred;         //!< background resizes given up on because readers didn't finish in time
+  uint64_t stall_time;       //!< total time new transactions were held up by resizes
+  uint64_t max_stall_time;   //!< longest single hold up
+};
 
 #define DBF_SAFE       1
 #define DBF_FAST       2
@@ -670,6 +724,15 @@ public:
    */
   virtual void safesyncmode(const bool onoff) = 0;
 
+  /**
+   * @brief get how the backing storage was grown since startup
+   *
+   * Backends without a fixed size report zeros.
+   *
+   * @return the sizes and totals
+   */
+  virtual db_resize_stats get_resize_stats() const = 0;
+
   /**
    * @brief Remove everything from the BlockchainDB
    *
@@ -828,6 +891,16 @@ public:
   virtual void block_rtxn_stop() const = 0;
   virtual void block_rtxn_abort() const = 0;
 
+  /**
+   * @brief whether the calling thread has a write txn open
+   *
+   * Reads from other threads don't see what was written in it until it's
+   * committed.
+   *
+   * @return true if a write or batch txn is open on this thread
+   */
+  virtual bool has_write_txn() const = 0;
+
   virtual void set_hard_fork(HardFork* hf);
 
   // adds a block with the given metadata to the top of the blockchain, returns the new height
@@ -937,6 +1010,18 @@ public:
    */
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const = 0;
 
+  /**
+   * @brief fetch a block blob by height, without copying it
+   *
+   * The caller must hold a read transaction (see db_rtxn_guard) or be
+   * adding blocks, for as long as it uses the blob. If the block does not
+   * exist, the subclass should throw BLOCK_DNE
+   *
+   * @param height the height to look for
+   * @param blob return-by-reference the block blob, pointing into the db
+   */
+  virtual void get_block_blob_view(const uint64_t& height, cryptonote::blobdata_ref &blob) const = 0;
+
   /**
    * @brief fetch a block by height
    *
@@ -1292,6 +1377,22 @@ public:
    */
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
 
+  /**
+   * @brief fetches the transaction blob with the given hash, without copying it
+   *
+   * The caller must hold a read transaction (see db_rtxn_guard) or be
+   * adding blocks, for as long as it uses the blob.
+   *
+   * If the transaction does not exist, the subclass should return false.
+   *
+   * @param h the hash to look for
+   * @param tx return-by-reference the transaction's parts, pointing into the db
+   * @param pruned whether to leave out the prunable part
+   *
+   * @return true iff the transaction was found
+   */
+  virtual bool get_tx_blob_view(const crypto::hash& h, tx_blob_view &tx, bool pruned) const = 0;
+
   /**
    * @brief fetches a number of pruned transaction blob from the given hash, in canonical blockchain order
    *
@@ -1327,6 +1428,15 @@ public:
    */
   virtual bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const = 0;
 
+  /**
+   * @brief fetches blocks and transactions from the given height, without copying them
+   *
+   * Same as the above, except that the blobs point into the db. The caller
+   * must hold a read transaction (see db_rtxn_guard) or be adding blocks,
+   * for as long as it uses them.
+   */
+  virtual bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<block_blob_view>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const = 0;
+
   /**
    * @brief fetches the prunable transaction blob with the given hash
    *
@@ -1489,6 +1599,24 @@ public:
    * @param outputs return-by-reference a list of outputs' metadata
    */
   virtual void get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) const = 0;
+
+  /**
+   * @brief gets outputs' data, reading them in db order
+   *
+   * The outputs are looked up sorted by amount and index, so the whole
+   * batch is read in one forward pass over the db however the keys are
+   * ordered, and are returned in the order they were asked for. The same
+   * output may be asked for more than once.
+   *
+   * If any output does not exist, an OUTPUT_DNE is thrown, unless
+   * allow_partial is set, in which case only the outputs before the
+   * first missing one are returned.
+   *
+   * @param keys a list of (amount, amount-specific output index) pairs
+   * @param outputs return-by-reference a list of outputs' metadata
+   * @param allow_partial whether to return what was found up to a missing output
+   */
+  virtual void get_output_keys(const std::vector<std::pair<uint64_t, uint64_t>> &keys, std::vector<output_data_t> &outputs, bool allow_partial = false) const = 0;
   
   /*
    * FIXME: Need to check with git blame and ask what this does to
@@ -1830,6 +1958,28 @@ public:
 
   virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const = 0;
 
+  /**
+   * @brief get how many outputs of a pre-RingCT amount were created at each height
+   *
+   * The histogram is read from its persisted copy if there is one, otherwise
+   * it is built from the amount's outputs. Persisted copies are dropped as
+   * soon as an output of their amount is added or removed.
+   *
+   * @param amount the amount
+   * @param histogram return-by-reference {height, output count} pairs, by increasing height, for heights with outputs
+   *
+   * @return true if the histogram was read from a persisted copy, false if it was built
+   */
+  virtual bool get_output_height_histogram(uint64_t amount, std::vector<std::pair<uint64_t, uint64_t>> &histogram) const = 0;
+
+  /**
+   * @brief persist a histogram returned by get_output_height_histogram
+   *
+   * @param amount the amount
+   * @param histogram the amount's {height, output count} pairs
+   */
+  virtual void add_output_height_histogram(uint64_t amount, const std::vector<std::pair<uint64_t, uint64_t>> &histogram) = 0;
+
   /**
    * @brief is BlockchainDB in read-only mode?
    *
@@ -1855,6 +2005,123 @@ public:
   virtual bool get_service_node_data(std::string& data) = 0;
   virtual void clear_service_node_data() = 0;
 
+  /**
+   * @brief store the serialized state of a single service node
+   *
+   * Overwrites any previous entry for the same key.
+   *
+   * @param pubkey the service node's public key
+   * @param data the serialized service_node_info
+   */
+  virtual void set_service_node_info(const crypto::public_key& pubkey, const std::string& data) = 0;
+
+  /**
+   * @brief remove the stored state of a single service node, if present
+   *
+   * @param pubkey the service node's public key
+   */
+  virtual void remove_service_node_info(const crypto::public_key& pubkey) = 0;
+
+  /**
+   * @brief runs a function over all stored service node states
+   *
+   * @param f the function to run, returning false stops the iteration
+   *
+   * @return false if the function returns false for any entry, otherwise true
+   */
+  virtual bool for_all_service_node_infos(std::function<bool(const crypto::public_key&, const std::string&)> f) const = 0;
+
+  /**
+   * @brief store the serialized service node list changes of a block
+   *
+   * Overwrites any previous entry for the same height.
+   *
+   * @param height the height of the block the changes were made in
+   * @param data the serialized delta
+   */
+  virtual void set_service_node_block_delta(uint64_t height, const std::string& data) = 0;
+
+  /**
+   * @brief remove the service node list deltas with height in [from_height, to_height)
+   *
+   * @param from_height the first height to remove
+   * @param to_height one past the last height to remove
+   */
+  virtual void remove_service_node_block_deltas(uint64_t from_height, uint64_t to_height) = 0;
+
+  /**
+   * @brief runs a function over all stored service node list deltas, by increasing height
+   *
+   * @param f the function to run, returning false stops the iteration
+   *
+   * @return false if the function returns false for any entry, otherwise true
+   */
+  virtual bool for_all_service_node_block_deltas(std::function<bool(uint64_t, const std::string&)> f) const = 0;
+
+  /**
+   * @brief remove all per-node service node states and per-block deltas
+   */
+  virtual void clear_service_node_deltas() = 0;
+
+  /**
+   * @brief store a serialized snapshot of the whole service node list
+   *
+   * Snapshots are kept apart from the current state and survive clearing it.
+   *
+   * @param height the height of the last block the snapshot includes
+   * @param data the serialized snapshot
+   */
+  virtual void set_service_node_snapshot(uint64_t height, const std::string& data) = 0;
+
+  /**
+   * @brief get the most recent service node list snapshot at or below a height
+   *
+   * @param height the highest height to consider, set to the snapshot's height on success
+   * @param data return-by-reference the serialized snapshot
+   *
+   * @return true if such a snapshot exists, otherwise false
+   */
+  virtual bool get_service_node_snapshot(uint64_t& height, std::string& data) const = 0;
+
+  /**
+   * @brief remove the service node list snapshots with height in [from_height, to_height)
+   *
+   * @param from_height the first height to remove
+   * @param to_height one past the last height to remove
+   */
+  virtual void remove_service_node_snapshots(uint64_t from_height, uint64_t to_height) = 0;
+
+  /**
+   * @brief remember the proof of work hash of a block whose proof of work was verified
+   *
+   * Entries are kept for main chain and alternative blocks alike, so that a
+   * restart or reorg does not need to hash the same block again.
+   *
+   * @param height the height of the block
+   * @param id the hash of the block
+   * @param pow the block's proof of work hash
+   */
+  virtual void add_pow_cache_entry(uint64_t height, const crypto::hash& id, const crypto::hash& pow) = 0;
+
+  /**
+   * @brief look up the proof of work hash of a previously verified block
+   *
+   * @param height the height of the block
+   * @param id the hash of the block
+   * @param pow return-by-reference the block's proof of work hash
+   *
+   * @return true if the block's proof of work hash was cached, otherwise false
+   */
+  virtual bool get_pow_cache_entry(uint64_t height, const crypto::hash& id, crypto::hash& pow) const = 0;
+
+  /**
+   * @brief remove the cached proof of work hashes of blocks with height in [from_height, to_height)
+   *
+   * @param from_height the first height to remove
+   * @param to_height one past the last height to remove
+   */
+  virtual void remove_pow_cache_entries(uint64_t from_height, uint64_t to_height) = 0;
+
   /**
    * @brief set whether or not to automatically remove logs
    *
@@ -33,6 +33,7 @@
 #include <boost/circular_buffer.hpp>
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
+#include <numeric>  // std::iota
 
 #include "string_tools.h"
 #include "file_io_utils.h"
@@ -70,6 +71,10 @@ struct pre_rct_output_data_t
 };
 #pragma pack(pop)
 
+// how far apart two requested outputs of an amount can be for the cursor to
+// step from one to the next rather than search the tree again
+const uint64_t MAX_OUTPUT_KEY_STEPS = 16;
+
 template <typename T>
 inline void throw0(const T &e)
 {
@@ -205,6 +210,14 @@ namespace
  *
  * alt_blocks       block hash   {block data, block blob}
  *
+ * service_node_infos   SN pubkey    serialized service node info
+ * service_node_deltas  block height serialized SN list changes of that block
+ * service_node_snapshots block height serialized SN list snapshot after that block
+ *
+ * pow_cache        block height {block hash, PoW hash}
+ *
+ * amount_histograms  amount     {height, output count}[] of a pre-RingCT amount
+ *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
  * key is used when accessing the table; the Key listed above will be
@@ -237,6 +250,11 @@ const char* const LMDB_ALT_BLOCKS = "alt_blocks";
 const char* const LMDB_HF_STARTING_HEIGHTS = "hf_starting_heights";
 const char* const LMDB_HF_VERSIONS = "hf_versions";
 const char* const LMDB_SERVICE_NODE_DATA = "service_node_data";
+const char* const LMDB_SERVICE_NODE_INFOS = "service_node_infos";
+const char* const LMDB_SERVICE_NODE_DELTAS = "service_node_deltas";
+const char* const LMDB_SERVICE_NODE_SNAPSHOTS = "service_node_snapshots";
+const char* const LMDB_POW_CACHE = "pow_cache";
+const char* const LMDB_AMOUNT_HISTOGRAMS = "amount_histograms";
 
 const char* const LMDB_PROPERTIES = "properties";
 
@@ -260,7 +278,7 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
 
 #define CURSOR(name) \
 	if (!m_cur_ ## name) { \
-	  int result = mdb_cursor_open(*m_write_txn, m_ ## name, &m_cur_ ## name); \
+	  int result = mdb_cursor_open(*m_write_txn.load(), m_ ## name, &m_cur_ ## name); \
 	  if (result) \
         throw0(DB_ERROR(lmdb_error("Failed to open cursor: ", result).c_str())); \
 	}
@@ -335,6 +353,11 @@ typedef struct blk_height {
     uint64_t bh_height;
 } blk_height;
 
+typedef struct pow_cache_entry {
+    crypto::hash pc_id;
+    crypto::hash pc_pow;
+} pow_cache_entry;
+
 typedef struct pre_rct_outkey {
     uint64_t amount_index;
     uint64_t output_id;
@@ -457,6 +480,18 @@ void mdb_txn_safe::wait_no_active_txns()
   while (num_active_txns > 0);
 }
 
+bool mdb_txn_safe::wait_no_active_txns(uint64_t timeout_ms)
+{
+  const uint64_t deadline = epee::misc_utils::get_tick_count() + timeout_ms;
+  while (num_active_txns > 0)
+  {
+    if (epee::misc_utils::get_tick_count() >= deadline)
+      return false;
+    boost::this_thread::yield();
+  }
+  return true;
+}
+
 void mdb_txn_safe::allow_new_txns()
 {
   creation_gate.clear();
@@ -513,7 +548,10 @@ inline void BlockchainLMDB::check_open() const
     throw0(DB_ERROR("DB operation attempted on a not-open DB instance"));
 }
 
-void BlockchainLMDB::do_resize(uint64_t increase_size)
+// max_stall is how long new txns may be held up waiting for the active ones
+// to finish, 0 to wait as long as it takes. When it runs out, or a write txn
+// is open, the resize is given up on and false returned.
+bool BlockchainLMDB::do_resize(uint64_t increase_size, uint64_t max_stall)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   CRITICAL_REGION_LOCAL(m_synchronization_lock);
@@ -528,7 +566,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
     {
       MERROR("!! WARNING: Insufficient free space to extend database !!: " <<
           (si.available >> 20L) << " MB available, " << (add_size >> 20L) << " MB needed");
-      return;
+      return false;
     }
   }
   catch(...)
@@ -557,9 +595,14 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   new_mapsize += (new_mapsize % mst.ms_psize);
 
   mdb_txn_safe::prevent_new_txns();
+  TIME_MEASURE_START(stall);
 
   if (m_write_txn != nullptr)
   {
+    mdb_txn_safe::allow_new_txns();
+    // the writer resizes itself when it needs to, before its next batch
+    if (max_stall > 0)
+      return false;
     if (m_batch_active)
     {
       throw0(DB_ERROR("lmdb resizing not yet supported when batch transactions enabled!"));
@@ -570,15 +613,145 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
     }
   }
 
-  mdb_txn_safe::wait_no_active_txns();
+  bool drained = true;
+  if (max_stall > 0)
+    drained = mdb_txn_safe::wait_no_active_txns(max_stall);
+  else
+    mdb_txn_safe::wait_no_active_txns();
+
+  int result = drained ? mdb_env_set_mapsize(m_env, new_mapsize) : 0;
+  mdb_txn_safe::allow_new_txns();
+  TIME_MEASURE_FINISH(stall);
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_resize_mutex);
+    m_resize_stats.stall_time += stall;
+    if (stall > m_resize_stats.max_stall_time)
+      m_resize_stats.max_stall_time = stall;
+    if (!drained)
+      ++m_resize_stats.deferred;
+    else if (!result)
+      ++m_resize_stats.resizes;
+  }
 
-  int result = mdb_env_set_mapsize(m_env, new_mapsize);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to set new mapsize: ", result).c_str()));
+  if (!drained)
+  {
+    MDEBUG("Transactions still active after " << stall << " ms, not resizing now");
+    return false;
+  }
 
-  MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
+  MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB" << ", held up new transactions for " << stall << " ms");
+  return true;
+}
 
-  mdb_txn_safe::allow_new_txns();
+uint64_t BlockchainLMDB::get_used_size() const
+{
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  MDB_stat mst;
+  mdb_env_stat(m_env, &mst);
+  return mst.ms_psize * mei.me_last_pgno;
+}
+
+void BlockchainLMDB::start_resize_monitor()
+{
+#if defined(ENABLE_AUTO_RESIZE)
+  m_resize_stop = false;
+  m_resize_thread = boost::thread([this]() { resize_monitor(); });
+#endif
+}
+
+void BlockchainLMDB::stop_resize_monitor()
+{
+  if (!m_resize_thread.joinable())
+    return;
+  {
+    boost::lock_guard<boost::mutex> lock(m_resize_mutex);
+    m_resize_stop = true;
+  }
+  m_resize_cond.notify_all();
+  m_resize_thread.join();
+}
+
+// Left to the writer, the map is only grown when a batch is about to run out
+// of room, and every reader waits until all active txns have finished. This
+// keeps enough room for the growth seen over the last few minutes, so the
+// writer rarely has to. It only resizes while no write txn is open, and gives
+// up if the readers don't finish within RESIZE_MAX_STALL ms, to try again at
+// the next check.
+void BlockchainLMDB::resize_monitor()
+{
+  uint64_t last_size = get_used_size();
+  uint64_t last_time = epee::misc_utils::get_tick_count();
+  uint64_t growth_rate = 0;
+  const boost::chrono::seconds interval{(uint64_t)RESIZE_MONITOR_INTERVAL};
+
+  boost::unique_lock<boost::mutex> lock(m_resize_mutex);
+  while (!m_resize_stop)
+  {
+    m_resize_cond.wait_for(lock, interval);
+    if (m_resize_stop)
+      break;
+    lock.unlock();
+    try
+    {
+      const uint64_t size = get_used_size();
+      const uint64_t now = epee::misc_utils::get_tick_count();
+
+      // the chain grows in bursts while syncing, so average over a few checks
+      if (now > last_time)
+      {
+        const uint64_t rate = size > last_size ? (size - last_size) * 1000 / (now - last_time) : 0;
+        growth_rate = (growth_rate * 7 + rate) / 8;
+      }
+      last_size = size;
+      last_time = now;
+
+      grow_map_ahead(growth_rate * RESIZE_LOOKAHEAD);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to check the db map size: " << e.what());
+    }
+    lock.lock();
+    m_resize_stats.growth_rate = growth_rate;
+  }
+}
+
+bool BlockchainLMDB::grow_map_ahead(uint64_t headroom)
+{
+  if (m_batch_active || m_write_txn)
+    return false;
+
+  MDB_envinfo mei;
+  mdb_env_info(m_env, &mei);
+  const uint64_t size = get_used_size();
+  const uint64_t free_size = mei.me_mapsize > size ? mei.me_mapsize - size : 0;
+  if (free_size >= headroom && !need_resize())
+    return false;
+
+  const uint64_t increase_size = std::max<uint64_t>(2 * headroom, 1LL << 30);
+  MINFO("Growing the db ahead of use: " << (free_size >> 20) << " MiB left, " << (headroom >> 20) << " MiB wanted");
+  return do_resize(increase_size, RESIZE_MAX_STALL);
+}
+
+db_resize_stats BlockchainLMDB::get_resize_stats() const
+{
+  db_resize_stats stats;
+  {
+    boost::lock_guard<boost::mutex> lock(m_resize_mutex);
+    stats = m_resize_stats;
+  }
+  if (m_open)
+  {
+    MDB_envinfo mei;
+    mdb_env_info(m_env, &mei);
+    stats.map_size = mei.me_mapsize;
+    stats.used_size = get_used_size();
+  }
+  return stats;
 }
 
 // threshold_size is used for batch transactions
@@ -670,9 +843,10 @@ uint64_t BlockchainLMDB::get_estimated_batch_size(uint64_t batch_num_blocks, uin
   // Takes into account "reasonable" block size increases in batch.
   float batch_safety_factor = 1.7f;
   float batch_fudge_factor = batch_safety_factor * batch_num_blocks;
-  // estimate of stored block expanded from raw block, including denormalization and db overhead.
+  // estimate of stored block expanded from raw block, including denormalization and db overhead,
+  // as seen over the batches committed so far.
   // Note that this probably doesn't grow linearly with block size.
-  float db_expand_factor = 4.5f;
+  float db_expand_factor = m_db_expand_factor;
   uint64_t num_prev_blocks = 500;
   // For resizing purposes, allow for at least 4k average block size.
   uint64_t min_block_size = 4 * 1024;
@@ -1078,6 +1252,9 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   if ((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
       throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
 
+  if (tx_output.amount != 0)
+    remove_output_height_histogram(tx_output.amount);
+
   return ok.amount_index;
 }
 
@@ -1163,6 +1340,9 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   result = mdb_cursor_del(m_cur_output_amounts, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting amount for output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
+
+  if (amount != 0)
+    remove_output_height_histogram(amount);
 }
 
 void BlockchainLMDB::prune_outputs(uint64_t amount)
@@ -1217,6 +1397,8 @@ void BlockchainLMDB::prune_outputs(uint64_t amount)
     if (result)
       throw0(DB_ERROR(lmdb_error("Error deleting output: ", result).c_str()));
   }
+
+  remove_output_height_histogram(amount);
 }
 
 void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
@@ -1283,6 +1465,11 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_resize_stop = false;
+  m_resize_stats = db_resize_stats();
+  m_batch_start_size = 0;
+  m_batch_bytes = 0;
+  m_db_expand_factor = DB_EXPAND_FACTOR;
 
   // reset may also need changing when initialize things here
 
@@ -1424,6 +1611,11 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_HF_VERSIONS, MDB_INTEGERKEY | MDB_CREATE, m_hf_versions, "Failed to open db handle for m_hf_versions");
   lmdb_db_open(txn, LMDB_SERVICE_NODE_DATA, MDB_INTEGERKEY | MDB_CREATE, m_service_node_data, "Failed to open db handle for m_service_node_data");
+  lmdb_db_open(txn, LMDB_SERVICE_NODE_INFOS, MDB_CREATE, m_service_node_infos, "Failed to open db handle for m_service_node_infos");
+  lmdb_db_open(txn, LMDB_SERVICE_NODE_DELTAS, MDB_INTEGERKEY | MDB_CREATE, m_service_node_deltas, "Failed to open db handle for m_service_node_deltas");
+  lmdb_db_open(txn, LMDB_SERVICE_NODE_SNAPSHOTS, MDB_INTEGERKEY | MDB_CREATE, m_service_node_snapshots, "Failed to open db handle for m_service_node_snapshots");
+  lmdb_db_open(txn, LMDB_POW_CACHE, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_pow_cache, "Failed to open db handle for m_pow_cache");
+  lmdb_db_open(txn, LMDB_AMOUNT_HISTOGRAMS, MDB_INTEGERKEY | MDB_CREATE, m_amount_histograms, "Failed to open db handle for m_amount_histograms");
 
 
   lmdb_db_open(txn, LMDB_PROPERTIES, MDB_CREATE, m_properties, "Failed to open db handle for m_properties");
@@ -1431,6 +1623,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   mdb_set_dupsort(txn, m_spent_keys, compare_hash32);
   mdb_set_dupsort(txn, m_block_heights, compare_hash32);
   mdb_set_dupsort(txn, m_tx_indices, compare_hash32);
+  mdb_set_dupsort(txn, m_pow_cache, compare_hash32);
   mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
   mdb_set_dupsort(txn, m_output_txs, compare_uint64);
   mdb_set_dupsort(txn, m_block_info, compare_uint64);
@@ -1489,6 +1682,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       txn.commit();
       m_open = true;
       migrate(db_version);
+      start_resize_monitor();
       return;
     }
 #endif
@@ -1535,12 +1729,15 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    start_resize_monitor();
   // from here, init should be finished
 }
 
 void BlockchainLMDB::close()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  stop_resize_monitor();
   if (m_batch_active)
   {
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
@@ -1614,6 +1811,16 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_hf_versions: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_service_node_data, 0))
 	  throw0(DB_ERROR(lmdb_error("Failed to drop m_service_node_data: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_service_node_infos, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_service_node_infos: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_service_node_deltas, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_service_node_deltas: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_service_node_snapshots, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_service_node_snapshots: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_pow_cache, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_pow_cache: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_amount_histograms, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_amount_histograms: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_properties, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_properties: ", result).c_str()));
 
@@ -2456,6 +2663,24 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
   check_open();
 
   TXN_PREFIX_RDONLY();
+
+  blobdata_ref view;
+  get_block_blob_view(height, view);
+  blobdata bd(view.data(), view.size());
+
+  TXN_POSTFIX_RDONLY();
+
+  return bd;
+}
+
+void BlockchainLMDB::get_block_blob_view(const uint64_t& height, blobdata_ref &blob) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  if (my_rtxn)
+    throw0(DB_ERROR("Attempt to view a block blob outside of a read transaction"));
   RCURSOR(blocks);
 
   MDB_val_copy<uint64_t> key(height);
@@ -2468,12 +2693,9 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
   else if (get_result)
     throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
-  blobdata bd;
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  blob = blobdata_ref{reinterpret_cast<const char*>(result.mv_data), result.mv_size};
 
   TXN_POSTFIX_RDONLY();
-
-  return bd;
 }
 
 uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
@@ -3008,30 +3230,11 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-  RCURSOR(txs_pruned);
-  RCURSOR(txs_prunable);
 
-  MDB_val_set(v, h);
-  MDB_val result0, result1;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  if (get_result == 0)
-  {
-    txindex *tip = (txindex *)v.mv_data;
-    MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
-    if (get_result == 0)
-    {
-      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
-    }
-  }
-  if (get_result == MDB_NOTFOUND)
+  tx_blob_view tx;
+  if (!get_tx_blob_view(h, tx, false))
     return false;
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
-
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+  tx.copy_to(bd);
 
   TXN_POSTFIX_RDONLY();
 
@@ -3044,24 +3247,52 @@ bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobd
   check_open();
 
   TXN_PREFIX_RDONLY();
+
+  tx_blob_view tx;
+  if (!get_tx_blob_view(h, tx, true))
+    return false;
+  tx.copy_to(bd);
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
+bool BlockchainLMDB::get_tx_blob_view(const crypto::hash& h, tx_blob_view &tx, bool pruned) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  if (my_rtxn)
+    throw0(DB_ERROR("Attempt to view a tx blob outside of a read transaction"));
   RCURSOR(tx_indices);
   RCURSOR(txs_pruned);
+  if (!pruned)
+  {
+    RCURSOR(txs_prunable);
+  }
 
   MDB_val_set(v, h);
-  MDB_val result;
+  MDB_val result0, result1 = {0, NULL};
   auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
   if (get_result == 0)
   {
     txindex *tip = (txindex *)v.mv_data;
     MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result, MDB_SET);
+    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
+    if (get_result == 0 && !pruned)
+    {
+      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+    }
   }
   if (get_result == MDB_NOTFOUND)
     return false;
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  tx.pruned = blobdata_ref{reinterpret_cast<const char*>(result0.mv_data), result0.mv_size};
+  tx.prunable = blobdata_ref{reinterpret_cast<const char*>(result1.mv_data), result1.mv_size};
 
   TXN_POSTFIX_RDONLY();
 
@@ -3116,6 +3347,39 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_count, si
   check_open();
 
   TXN_PREFIX_RDONLY();
+
+  std::vector<block_blob_view> views;
+  if (!get_blocks_from(start_height, min_count, max_count, max_size, views, pruned, skip_coinbase, get_miner_tx_hash))
+    return false;
+
+  blocks.reserve(blocks.size() + views.size());
+  for (const block_blob_view &view: views)
+  {
+    blocks.resize(blocks.size() + 1);
+    auto &current_block = blocks.back();
+    current_block.first.first.assign(view.block.data(), view.block.size());
+    current_block.first.second = view.miner_tx_hash;
+    current_block.second.resize(view.txs.size());
+    for (size_t i = 0; i < view.txs.size(); ++i)
+    {
+      current_block.second[i].first = view.txs[i].first;
+      view.txs[i].second.copy_to(current_block.second[i].second);
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
+bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<block_blob_view>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  if (my_rtxn)
+    throw0(DB_ERROR("Attempt to view blocks outside of a read transaction"));
   RCURSOR(blocks);
   RCURSOR(tx_indices);
   RCURSOR(txs_pruned);
@@ -3143,13 +3407,13 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_count, si
     blocks.resize(blocks.size() + 1);
     auto &current_block = blocks.back();
 
-    current_block.first.first.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    current_block.block = blobdata_ref{reinterpret_cast<const char*>(v.mv_data), v.mv_size};
     size += v.mv_size;
 
     cryptonote::block b;
-    if (!parse_and_validate_block_from_blob(current_block.first.first, b))
+    if (!parse_and_validate_block_from_blob(current_block.block, b))
       throw0(DB_ERROR("Invalid block"));
-    current_block.first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
+    current_block.miner_tx_hash = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
 
     // get the tx_id for the first tx (the first block's coinbase tx)
     if (h == start_height)
@@ -3181,25 +3445,25 @@ bool BlockchainLMDB::get_blocks_from(uint64_t start_height, size_t min_count, si
 
     op = MDB_NEXT;
 
-    current_block.second.reserve(b.tx_hashes.size());
+    current_block.txs.reserve(b.tx_hashes.size());
     for (const auto &tx_hash: b.tx_hashes)
     {
       // get pruned data
-      cryptonote::blobdata tx_blob;
+      tx_blob_view tx_blob;
       result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &v, op);
       if (result)
         throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-      tx_blob.assign((const char*)v.mv_data, v.mv_size);
+      tx_blob.pruned = blobdata_ref{reinterpret_cast<const char*>(v.mv_data), v.mv_size};
 
       if (!pruned)
       {
         result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &v, op);
         if (result)
           throw0(DB_ERROR(lmdb_error("Error attempting to retrieve transaction data from the db: ", result).c_str()));
-        tx_blob.append(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+        tx_blob.prunable = blobdata_ref{reinterpret_cast<const char*>(v.mv_data), v.mv_size};
       }
-      current_block.second.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
-      size += current_block.second.back().second.size();
+      current_block.txs.push_back(std::make_pair(tx_hash, tx_blob));
+      size += tx_blob.size();
     }
   }
 
@@ -3713,6 +3977,8 @@ bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes
 
   m_writer = boost::this_thread::get_id();
   check_and_resize_for_batch(batch_num_blocks, batch_bytes);
+  m_batch_start_size = get_used_size();
+  m_batch_bytes = batch_bytes;
 
   m_write_batch_txn = new mdb_txn_safe();
 
@@ -3757,7 +4023,7 @@ void BlockchainLMDB::batch_commit()
 
   LOG_PRINT_L3("batch transaction: committing...");
   TIME_MEASURE_START(time1);
-  m_write_txn->commit();
+  m_write_txn.load()->commit();
   TIME_MEASURE_FINISH(time1);
   time_commit1 += time1;
   LOG_PRINT_L3("batch transaction: committed");
@@ -3794,9 +4060,17 @@ void BlockchainLMDB::batch_stop()
   TIME_MEASURE_START(time1);
   try
   {
-    m_write_txn->commit();
+    m_write_txn.load()->commit();
     TIME_MEASURE_FINISH(time1);
     time_commit1 += time1;
+    if (m_batch_bytes > 0)
+    {
+      // freed pages get reused, so this undershoots now and then: only let it move slowly
+      const uint64_t size = get_used_size();
+      const float expand_factor = size > m_batch_start_size ? (size - m_batch_start_size) / (float)m_batch_bytes : 0.0f;
+      m_db_expand_factor = std::min(std::max(m_db_expand_factor * 0.75f + expand_factor * 0.25f, 1.0f), 2 * DB_EXPAND_FACTOR);
+      MDEBUG("batch grew the db by " << expand_factor << " bytes per block byte, estimating " << m_db_expand_factor);
+    }
     cleanup_batch();
   }
   catch (const std::exception &e)
@@ -3847,7 +4121,7 @@ bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) co
  bool ret = false;
   mdb_threadinfo *tinfo;
   if (m_write_txn && m_writer == boost::this_thread::get_id()) {
-    *mtxn = m_write_txn->m_txn;
+    *mtxn = m_write_txn.load()->m_txn;
     *mcur = (mdb_txn_cursors *)&m_wcursors;
     return ret;
   }
@@ -3909,7 +4183,7 @@ void BlockchainLMDB::block_wtxn_start()
   {
     m_writer = boost::this_thread::get_id();
     m_write_txn = new mdb_txn_safe();
-    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn))
+    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn.load()))
     {
       delete m_write_txn;
       m_write_txn = nullptr;
@@ -3937,7 +4211,7 @@ void BlockchainLMDB::block_wtxn_stop()
     if (! m_batch_active)
 	{
       TIME_MEASURE_START(time1);
-      m_write_txn->commit();
+      m_write_txn.load()->commit();
       TIME_MEASURE_FINISH(time1);
       time_commit1 += time1;
 
@@ -3964,6 +4238,11 @@ void BlockchainLMDB::block_wtxn_abort()
   }
 }
 
+bool BlockchainLMDB::has_write_txn() const
+{
+  return m_write_txn && m_writer == boost::this_thread::get_id();
+}
+
 void BlockchainLMDB::block_rtxn_abort() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -4051,45 +4330,80 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
   if (amounts.size() != 1 && amounts.size() != offsets.size())
     throw0(DB_ERROR("Invalid sizes of amounts and offets"));
 
+  std::vector<std::pair<uint64_t, uint64_t>> keys;
+  keys.reserve(offsets.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+    keys.emplace_back(amounts.size() == 1 ? amounts[0] : amounts[i], offsets[i]);
+  get_output_keys(keys, outputs, allow_partial);
+}
+
+void BlockchainLMDB::get_output_keys(const std::vector<std::pair<uint64_t, uint64_t>> &keys, std::vector<output_data_t> &outputs, bool allow_partial) const
+{
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   TIME_MEASURE_START(db3);
   check_open();
   outputs.clear();
-  outputs.reserve(offsets.size());
+  outputs.resize(keys.size());
+
+  // visit the keys in db order, so the cursor only ever moves forward and
+  // close ring members are reached by stepping rather than a new search
+  std::vector<size_t> order(keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+  // first missing key, in request order
+  size_t found = keys.size();
 
   TXN_PREFIX_RDONLY();
 
   RCURSOR(output_amounts);
 
-  for (size_t i = 0; i < offsets.size(); ++i)
+  MDB_val k, v;
+  const std::pair<uint64_t, uint64_t> *at = NULL;  // where the cursor is
+  for (size_t n = 0; n < order.size(); ++n)
   {
-    const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[i];
-    MDB_val_set(k, amount);
-    MDB_val_set(v, offsets[i]);
+    const size_t i = order[n];
+    const uint64_t amount = keys[i].first;
+    const uint64_t index = keys[i].second;
+    if (i >= found)
+      continue;
 
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    int get_result = 0;
+    if (at && at->first == amount && index - at->second <= MAX_OUTPUT_KEY_STEPS)
+    {
+      for (uint64_t step = at->second; step < index && get_result == 0; ++step)
+        get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_NEXT_DUP);
+    }
+    else
+    {
+      k = MDB_val{sizeof(amount), (void *)&amount};
+      v = MDB_val{sizeof(index), (void *)&index};
+      get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    }
+    at = get_result == 0 ? &keys[i] : NULL;
+    if (get_result == 0 && *(const uint64_t *)v.mv_data != index)
+      throw0(DB_ERROR("Unexpected output amount index in the db"));
     if (get_result == MDB_NOTFOUND)
     {
       if (allow_partial)
       {
-        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
-        break;
+        found = i;
+        continue;
       }
-      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[i]) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(index) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
     }
     else if (get_result)
       throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
 
+    output_data_t &data = outputs[i];
     if (amount == 0)
     {
       const outkey *okp = (const outkey *)v.mv_data;
-      outputs.push_back(okp->data);
+      data = okp->data;
     }
     else
     {
       const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
-      outputs.resize(outputs.size() + 1);
-      output_data_t &data = outputs.back();
       memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
       data.commitment = rct::zeroCommit(amount);
     }
@@ -4097,6 +4411,12 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
 
   TXN_POSTFIX_RDONLY();
 
+  if (found < keys.size())
+  {
+    MDEBUG("Partial result: " << found << "/" << keys.size());
+    outputs.resize(found);
+  }
+
   TIME_MEASURE_FINISH(db3);
   LOG_PRINT_L3("db3: " << db3);
 }
@@ -4920,7 +5240,7 @@ void BlockchainLMDB::migrate_0_1()
     hk.mv_size = sizeof(crypto::hash);
     set_batch_transactions(true);
     batch_start(1000);
-    txn.m_txn = m_write_txn->m_txn;
+    txn.m_txn = m_write_txn.load()->m_txn;
     m_height = 0;
 
     while(1) {
@@ -4938,7 +5258,7 @@ void BlockchainLMDB::migrate_0_1()
           result = mdb_txn_begin(m_env, NULL, 0, txn);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-          m_write_txn->m_txn = txn.m_txn;
+          m_write_txn.load()->m_txn = txn.m_txn;
           m_write_batch_txn->m_txn = txn.m_txn;
           memset(&m_wcursors, 0, sizeof(m_wcursors));
         }
@@ -5714,5 +6034,374 @@ void BlockchainLMDB::clear_service_node_data()
 		throw1(DB_ERROR(lmdb_error("Failed to add removal of service node data to db transaction: ", result).c_str()));
 }
 
+void BlockchainLMDB::set_service_node_info(const crypto::public_key& pubkey, const std::string& data)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_infos)
+
+  MDB_val k = {sizeof(pubkey), (void *)&pubkey};
+  MDB_val v = {data.size(), (void *)data.data()};
+  if (auto result = mdb_cursor_put(m_cur_service_node_infos, &k, &v, 0))
+    throw1(DB_ERROR(lmdb_error("Failed to add service node info to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_service_node_info(const crypto::public_key& pubkey)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_infos)
+
+  MDB_val k = {sizeof(pubkey), (void *)&pubkey};
+  int result = mdb_cursor_get(m_cur_service_node_infos, &k, NULL, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return;
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error locating service node info in the db: ", result).c_str()));
+  if ((result = mdb_cursor_del(m_cur_service_node_infos, 0)))
+    throw1(DB_ERROR(lmdb_error("Failed to add removal of service node info to db transaction: ", result).c_str()));
+}
+
+bool BlockchainLMDB::for_all_service_node_infos(std::function<bool(const crypto::public_key&, const std::string&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(service_node_infos);
+
+  MDB_val k;
+  MDB_val v;
+  bool ret = true;
+
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int result = mdb_cursor_get(m_cur_service_node_infos, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate service node infos: ", result).c_str()));
+    if (k.mv_size != sizeof(crypto::public_key))
+      throw0(DB_ERROR("service_node_infos key has unexpected size"));
+    const crypto::public_key &pubkey = *(const crypto::public_key*)k.mv_data;
+    const std::string data(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+    if (!f(pubkey, data)) {
+      ret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+void BlockchainLMDB::set_service_node_block_delta(uint64_t height, const std::string& data)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_deltas)
+
+  MDB_val_set(k, height);
+  MDB_val v = {data.size(), (void *)data.data()};
+  if (auto result = mdb_cursor_put(m_cur_service_node_deltas, &k, &v, 0))
+    throw1(DB_ERROR(lmdb_error("Failed to add service node delta to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_service_node_block_deltas(uint64_t from_height, uint64_t to_height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_deltas)
+
+  MDB_val_set(k, from_height);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_service_node_deltas, &k, &v, MDB_SET_RANGE);
+  while (result == 0)
+  {
+    if (*(const uint64_t*)k.mv_data >= to_height)
+      break;
+    if ((result = mdb_cursor_del(m_cur_service_node_deltas, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of service node delta to db transaction: ", result).c_str()));
+    result = mdb_cursor_get(m_cur_service_node_deltas, &k, &v, MDB_NEXT);
+  }
+  if (result && result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Failed to enumerate service node deltas: ", result).c_str()));
+}
+
+bool BlockchainLMDB::for_all_service_node_block_deltas(std::function<bool(uint64_t, const std::string&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(service_node_deltas);
+
+  MDB_val k;
+  MDB_val v;
+  bool ret = true;
+
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int result = mdb_cursor_get(m_cur_service_node_deltas, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate service node deltas: ", result).c_str()));
+    const uint64_t height = *(const uint64_t*)k.mv_data;
+    const std::string data(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+    if (!f(height, data)) {
+      ret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+void BlockchainLMDB::clear_service_node_deltas()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (auto result = mdb_drop(*m_write_txn.load(), m_service_node_infos, 0))
+    throw1(DB_ERROR(lmdb_error("Failed to drop m_service_node_infos: ", result).c_str()));
+  if (auto result = mdb_drop(*m_write_txn.load(), m_service_node_deltas, 0))
+    throw1(DB_ERROR(lmdb_error("Failed to drop m_service_node_deltas: ", result).c_str()));
+}
+
+void BlockchainLMDB::set_service_node_snapshot(uint64_t height, const std::string& data)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_snapshots)
+
+  MDB_val_set(k, height);
+  MDB_val v = {data.size(), (void *)data.data()};
+  if (auto result = mdb_cursor_put(m_cur_service_node_snapshots, &k, &v, 0))
+    throw1(DB_ERROR(lmdb_error("Failed to add service node snapshot to db transaction: ", result).c_str()));
+}
+
+bool BlockchainLMDB::get_service_node_snapshot(uint64_t& height, std::string& data) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(service_node_snapshots);
+
+  // Position on the first snapshot at or above height, then step back if it is above
+  MDB_val_set(k, height);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_service_node_snapshots, &k, &v, MDB_SET_RANGE);
+  if (result == MDB_NOTFOUND)
+    result = mdb_cursor_get(m_cur_service_node_snapshots, &k, &v, MDB_LAST);
+  else if (result == 0 && *(const uint64_t*)k.mv_data > height)
+    result = mdb_cursor_get(m_cur_service_node_snapshots, &k, &v, MDB_PREV);
+
+  bool ret = false;
+  if (result == 0)
+  {
+    height = *(const uint64_t*)k.mv_data;
+    data.assign(reinterpret_cast<const char*>(v.mv_data), v.mv_size);
+    ret = true;
+  }
+  else if (result != MDB_NOTFOUND)
+  {
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve service node snapshot: ", result).c_str()));
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+void BlockchainLMDB::remove_service_node_snapshots(uint64_t from_height, uint64_t to_height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(service_node_snapshots)
+
+  MDB_val_set(k, from_height);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_service_node_snapshots, &k, &v, MDB_SET_RANGE);
+  while (result == 0)
+  {
+    if (*(const uint64_t*)k.mv_data >= to_height)
+      break;
+    if ((result = mdb_cursor_del(m_cur_service_node_snapshots, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of service node snapshot to db transaction: ", result).c_str()));
+    result = mdb_cursor_get(m_cur_service_node_snapshots, &k, &v, MDB_NEXT);
+  }
+  if (result && result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Failed to enumerate service node snapshots: ", result).c_str()));
+}
+
+void BlockchainLMDB::add_pow_cache_entry(uint64_t height, const crypto::hash& id, const crypto::hash& pow)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(pow_cache)
+
+  MDB_val_set(k, height);
+  pow_cache_entry pc = {id, pow};
+  MDB_val_set(v, pc);
+  int result = mdb_cursor_put(m_cur_pow_cache, &k, &v, MDB_NODUPDATA);
+  if (result && result != MDB_KEYEXIST)
+    throw1(DB_ERROR(lmdb_error("Failed to add PoW cache entry to db transaction: ", result).c_str()));
+}
+
+bool BlockchainLMDB::get_pow_cache_entry(uint64_t height, const crypto::hash& id, crypto::hash& pow) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(pow_cache);
+
+  // entries of a height are sorted by their leading block hash, so the block
+  // hash alone finds the entry
+  MDB_val_set(k, height);
+  MDB_val_set(v, id);
+  int result = mdb_cursor_get(m_cur_pow_cache, &k, &v, MDB_GET_BOTH);
+  bool ret = false;
+  if (result == 0)
+  {
+    pow = ((const pow_cache_entry*)v.mv_data)->pc_pow;
+    ret = true;
+  }
+  else if (result != MDB_NOTFOUND)
+  {
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve PoW cache entry: ", result).c_str()));
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return ret;
+}
+
+void BlockchainLMDB::remove_pow_cache_entries(uint64_t from_height, uint64_t to_height)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(pow_cache)
+
+  MDB_val_set(k, from_height);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_pow_cache, &k, &v, MDB_SET_RANGE);
+  while (result == 0)
+  {
+    if (*(const uint64_t*)k.mv_data >= to_height)
+      break;
+    if ((result = mdb_cursor_del(m_cur_pow_cache, MDB_NODUPDATA)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of PoW cache entries to db transaction: ", result).c_str()));
+    result = mdb_cursor_get(m_cur_pow_cache, &k, &v, MDB_NEXT_NODUP);
+  }
+  if (result && result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Failed to enumerate PoW cache entries: ", result).c_str()));
+}
+
+bool BlockchainLMDB::get_output_height_histogram(uint64_t amount, std::vector<std::pair<uint64_t, uint64_t>> &histogram) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(amount_histograms);
+  RCURSOR(output_amounts);
+
+  histogram.clear();
+  MDB_val_set(k, amount);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_amount_histograms, &k, &v, MDB_SET);
+  if (result == 0)
+  {
+    const std::pair<uint64_t, uint64_t> *counts = (const std::pair<uint64_t, uint64_t>*)v.mv_data;
+    histogram.assign(counts, counts + v.mv_size / sizeof(*counts));
+    TXN_POSTFIX_RDONLY();
+    return true;
+  }
+  if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve amount histogram: ", result).c_str()));
+
+  // outputs of an amount are stored in the order they were added, so their
+  // heights never go down
+  MDB_cursor_op op = MDB_SET;
+  while (1)
+  {
+    result = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT_DUP;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", result).c_str()));
+    const uint64_t height = ((const pre_rct_outkey*)v.mv_data)->data.height;
+    if (histogram.empty() || histogram.back().first != height)
+      histogram.emplace_back(height, 1);
+    else
+      ++histogram.back().second;
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return false;
+}
+
+void BlockchainLMDB::add_output_height_histogram(uint64_t amount, const std::vector<std::pair<uint64_t, uint64_t>> &histogram)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(amount_histograms)
+
+  MDB_val_set(k, amount);
+  MDB_val v;
+  v.mv_size = histogram.size() * sizeof(histogram[0]);
+  v.mv_data = histogram.empty() ? (void*)"" : (void*)histogram.data();
+  int result = mdb_cursor_put(m_cur_amount_histograms, &k, &v, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Failed to add amount histogram to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_output_height_histogram(uint64_t amount)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(amount_histograms)
+
+  MDB_val_set(k, amount);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_amount_histograms, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return;
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Failed to retrieve amount histogram: ", result).c_str()));
+  if ((result = mdb_cursor_del(m_cur_amount_histograms, 0)))
+    throw1(DB_ERROR(lmdb_error("Failed to add removal of amount histogram to db transaction: ", result).c_str()));
+}
 
 }  // namespace cryptonote
@@ -31,6 +31,9 @@
 #include "blockchain_db/blockchain_db.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/thread/tss.hpp>
 
 #include <lmdb.h>
@@ -71,6 +74,11 @@ typedef struct mdb_txn_cursors
 
   MDB_cursor *m_txc_hf_versions;
   MDB_cursor *m_txc_service_node_data;
+  MDB_cursor *m_txc_service_node_infos;
+  MDB_cursor *m_txc_service_node_deltas;
+  MDB_cursor *m_txc_service_node_snapshots;
+  MDB_cursor *m_txc_pow_cache;
+  MDB_cursor *m_txc_amount_histograms;
   MDB_cursor *m_txc_properties;
 } mdb_txn_cursors;
 
@@ -92,6 +100,11 @@ typedef struct mdb_txn_cursors
 #define m_cur_alt_blocks	m_cursors->m_txc_alt_blocks
 #define m_cur_hf_versions	m_cursors->m_txc_hf_versions
 #define m_cur_service_node_data	m_cursors->m_txc_service_node_data
+#define m_cur_service_node_infos	m_cursors->m_txc_service_node_infos
+#define m_cur_service_node_deltas	m_cursors->m_txc_service_node_deltas
+#define m_cur_service_node_snapshots	m_cursors->m_txc_service_node_snapshots
+#define m_cur_pow_cache	m_cursors->m_txc_pow_cache
+#define m_cur_amount_histograms	m_cursors->m_txc_amount_histograms
 #define m_cur_properties	m_cursors->m_txc_properties
 
 typedef struct mdb_rflags
@@ -115,6 +128,11 @@ typedef struct mdb_rflags
   bool m_rf_alt_blocks;
   bool m_rf_hf_versions;
   bool m_rf_service_node_data;
+  bool m_rf_service_node_infos;
+  bool m_rf_service_node_deltas;
+  bool m_rf_service_node_snapshots;
+  bool m_rf_pow_cache;
+  bool m_rf_amount_histograms;
 
   bool m_rf_properties;
 } mdb_rflags;
@@ -156,6 +174,7 @@ struct mdb_txn_safe
 
   static void prevent_new_txns();
   static void wait_no_active_txns();
+  static bool wait_no_active_txns(uint64_t timeout_ms);
   static void allow_new_txns();
 
   mdb_threadinfo* m_tinfo;
@@ -196,6 +215,22 @@ public:
 
   void safesyncmode(const bool onoff) override;
 
+  db_resize_stats get_resize_stats() const override;
+
+  /**
+   * @brief grows the map if less than headroom bytes of it are free, or it
+   * is nearly full, unless a write txn is open
+   *
+   * This is what the resize monitor does at each check. Active txns hold
+   * the resize up for at most RESIZE_MAX_STALL ms, after which it is given
+   * up on.
+   *
+   * @param headroom the free space wanted, in bytes
+   *
+   * @return true if the map was grown
+   */
+  bool grow_map_ahead(uint64_t headroom);
+
   void reset() override;
 
   std::vector<std::string> get_filenames() const override;
@@ -217,6 +252,7 @@ public:
   cryptonote::blobdata get_block_blob(const crypto::hash& h) const override;
 
   cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const override;
+  void get_block_blob_view(const uint64_t& height, cryptonote::blobdata_ref &blob) const override;
 
   std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const override;
 
@@ -257,8 +293,10 @@ public:
 
   bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override;
   bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override;
+  bool get_tx_blob_view(const crypto::hash& h, tx_blob_view &tx, bool pruned) const override;
   bool get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const override;
   bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const override;
+  bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<block_blob_view>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const override;
   bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override;
   bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const override;
 
@@ -272,6 +310,7 @@ public:
 
   output_data_t get_output_key(const uint64_t& amount, const uint64_t& index, bool include_commitmemt) const override;
   void get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) const override;
+  void get_output_keys(const std::vector<std::pair<uint64_t, uint64_t>> &keys, std::vector<output_data_t> &outputs, bool allow_partial = false) const override;
 
   tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const override;
   void get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices, std::vector<tx_out_index> &tx_out_indices) const;
@@ -331,6 +370,7 @@ public:
   bool block_rtxn_start() const override;
   void block_rtxn_stop() const override;
   void block_rtxn_abort() const override;
+  bool has_write_txn() const override;
 
   bool block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const;
 
@@ -358,9 +398,13 @@ public:
   static int compare_string(const MDB_val *a, const MDB_val *b);
 
 private:
-  void do_resize(uint64_t size_increase=0);
+  bool do_resize(uint64_t size_increase=0, uint64_t max_stall=0);
 
   bool need_resize(uint64_t threshold_size=0) const;
+  uint64_t get_used_size() const;
+  void start_resize_monitor();
+  void stop_resize_monitor();
+  void resize_monitor();
   void check_and_resize_for_batch(uint64_t batch_num_blocks, uint64_t batch_bytes);
   uint64_t get_estimated_batch_size(uint64_t batch_num_blocks, uint64_t batch_bytes) const;
 
@@ -396,6 +440,8 @@ private:
 
   void prune_outputs(uint64_t amount) override;
 
+  void remove_output_height_histogram(uint64_t amount);
+
   void add_spent_key(const crypto::key_image& k_image) override;
 
   void remove_spent_key(const crypto::key_image& k_image) override;
@@ -447,6 +493,23 @@ private:
   bool get_service_node_data(std::string& data) override;
   void clear_service_node_data() override;
 
+  void set_service_node_info(const crypto::public_key& pubkey, const std::string& data) override;
+  void remove_service_node_info(const crypto::public_key& pubkey) override;
+  bool for_all_service_node_infos(std::function<bool(const crypto::public_key&, const std::string&)> f) const override;
+  void set_service_node_block_delta(uint64_t height, const std::string& data) override;
+  void remove_service_node_block_deltas(uint64_t from_height, uint64_t to_height) override;
+  bool for_all_service_node_block_deltas(std::function<bool(uint64_t, const std::string&)> f) const override;
+  void clear_service_node_deltas() override;
+  void set_service_node_snapshot(uint64_t height, const std::string& data) override;
+  bool get_service_node_snapshot(uint64_t& height, std::string& data) const override;
+  void remove_service_node_snapshots(uint64_t from_height, uint64_t to_height) override;
+  void add_pow_cache_entry(uint64_t height, const crypto::hash& id, const crypto::hash& pow) override;
+  bool get_pow_cache_entry(uint64_t height, const crypto::hash& id, crypto::hash& pow) const override;
+  void remove_pow_cache_entries(uint64_t from_height, uint64_t to_height) override;
+
+  bool get_output_height_histogram(uint64_t amount, std::vector<std::pair<uint64_t, uint64_t>> &histogram) const override;
+  void add_output_height_histogram(uint64_t amount, const std::vector<std::pair<uint64_t, uint64_t>> &histogram) override;
+
 private:
   MDB_env* m_env;
 
@@ -475,22 +538,38 @@ private:
   MDB_dbi m_hf_starting_heights;
   MDB_dbi m_hf_versions;
   MDB_dbi m_service_node_data;
+  MDB_dbi m_service_node_infos;
+  MDB_dbi m_service_node_deltas;
+  MDB_dbi m_service_node_snapshots;
+  MDB_dbi m_pow_cache;
+  MDB_dbi m_amount_histograms;
 
   MDB_dbi m_properties;
 
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
   std::string m_folder;
-  mdb_txn_safe* m_write_txn; // may point to either a short-lived txn or a batch txn
+  std::atomic<mdb_txn_safe*> m_write_txn; // may point to either a short-lived txn or a batch txn, read by the resize monitor
   mdb_txn_safe* m_write_batch_txn; // persist batch txn outside of BlockchainLMDB
   boost::thread::id m_writer;
 
   bool m_batch_transactions; // support for batch transactions
-  bool m_batch_active; // whether batch transaction is in progress
+  std::atomic<bool> m_batch_active; // whether batch transaction is in progress
 
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  // grows the map ahead of the writer, see resize_monitor
+  boost::thread m_resize_thread;
+  mutable boost::mutex m_resize_mutex;
+  boost::condition_variable m_resize_cond;
+  bool m_resize_stop;
+  db_resize_stats m_resize_stats;
+
+  uint64_t m_batch_start_size;  // used size when the batch started
+  uint64_t m_batch_bytes;       // block bytes the batch was started for
+  float m_db_expand_factor;     // db bytes per block byte, as seen over past batches
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -503,6 +582,10 @@ private:
 #endif
 
   constexpr static float RESIZE_PERCENT = 0.9f;
+  constexpr static float DB_EXPAND_FACTOR = 4.5f;           // db bytes per block byte, until batches are seen
+  constexpr static uint64_t RESIZE_MONITOR_INTERVAL = 10;   // seconds between checks of the map size
+  constexpr static uint64_t RESIZE_LOOKAHEAD = 600;         // seconds of growth the map is kept ahead by
+  constexpr static uint64_t RESIZE_MAX_STALL = 50;          // ms a background resize may hold up new transactions
 };
 
 }  // namespace cryptonote
@@ -46,6 +46,7 @@ public:
   virtual void close() override {}
   virtual void sync() override {}
   virtual void safesyncmode(const bool onoff) override {}
+  virtual cryptonote::db_resize_stats get_resize_stats() const override { return cryptonote::db_resize_stats(); }
   virtual void reset() override {}
   virtual std::vector<std::string> get_filenames() const override { return std::vector<std::string>(); }
   virtual bool remove_data_file(const std::string& folder) const override { return true; }
@@ -62,15 +63,19 @@ public:
   virtual bool block_rtxn_start() const override { return true; }
   virtual void block_rtxn_stop() const override {}
   virtual void block_rtxn_abort() const override {}
+  virtual bool has_write_txn() const override { return false; }
 
   virtual void drop_hard_fork_info() override {}
   virtual bool block_exists(const crypto::hash& h, uint64_t *height) const override { return false; }
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const override { return cryptonote::t_serializable_object_to_blob(get_block_from_height(height)); }
+  virtual void get_block_blob_view(const uint64_t& height, cryptonote::blobdata_ref &blob) const override { blob = cryptonote::blobdata_ref(); }
   virtual cryptonote::blobdata get_block_blob(const crypto::hash& h) const override { return cryptonote::blobdata(); }
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override { return false; }
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override { return false; }
+  virtual bool get_tx_blob_view(const crypto::hash& h, cryptonote::tx_blob_view &tx, bool pruned) const override { return false; }
   virtual bool get_pruned_tx_blobs_from(const crypto::hash& h, size_t count, std::vector<cryptonote::blobdata> &bd) const { return false; }
   virtual bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const { return false; }
+  virtual bool get_blocks_from(uint64_t start_height, size_t min_count, size_t max_count, size_t max_size, std::vector<cryptonote::block_blob_view>& blocks, bool pruned, bool skip_coinbase, bool get_miner_tx_hash) const override { return false; }
   virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const override { return false; }
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const override { return false; }
   virtual uint64_t get_block_height(const crypto::hash& h) const override { return 0; }
@@ -106,6 +111,7 @@ public:
   virtual cryptonote::tx_out_index get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const override { return cryptonote::tx_out_index(); }
   virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<cryptonote::tx_out_index> &indices) const override {}
   virtual void get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<cryptonote::output_data_t> &outputs, bool allow_partial = false) const override {}
+  virtual void get_output_keys(const std::vector<std::pair<uint64_t, uint64_t>> &keys, std::vector<cryptonote::output_data_t> &outputs, bool allow_partial = false) const override {}
   virtual bool can_thread_bulk_indices() const override { return false; }
   virtual std::vector<std::vector<uint64_t>> get_tx_amount_output_indices(const uint64_t tx_index, size_t n_txes) const override { return std::vector<std::vector<uint64_t>>(); }
   virtual bool has_key_image(const crypto::key_image& img) const override { return false; }
@@ -125,6 +131,8 @@ public:
   virtual bool is_read_only() const override { return false; }
   virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const override { return std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>(); }
   virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const override { return false; }
+  virtual bool get_output_height_histogram(uint64_t amount, std::vector<std::pair<uint64_t, uint64_t>> &histogram) const override { return false; }
+  virtual void add_output_height_histogram(uint64_t amount, const std::vector<std::pair<uint64_t, uint64_t>> &histogram) override {}
 
   virtual void add_txpool_tx(const crypto::hash &txid, const cryptonote::blobdata &blob, const cryptonote::txpool_tx_meta_t& details) override {}
   virtual void update_txpool_tx(const crypto::hash &txid, const cryptonote::txpool_tx_meta_t& details) override {}
@@ -165,6 +173,23 @@ public:
   virtual uint64_t get_alt_block_count() override { return 0; }
   virtual void drop_alt_blocks() override {}
   virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob = false) const override { return true; }
+
+  virtual void set_service_node_data(const std::string& data) override {}
+  virtual bool get_service_node_data(std::string& data) override { return false; }
+  virtual void clear_service_node_data() override {}
+  virtual void set_service_node_info(const crypto::public_key& pubkey, const std::string& data) override {}
+  virtual void remove_service_node_info(const crypto::public_key& pubkey) override {}
+  virtual bool for_all_service_node_infos(std::function<bool(const crypto::public_key&, const std::string&)> f) const override { return true; }
+  virtual void set_service_node_block_delta(uint64_t height, const std::string& data) override {}
+  virtual void remove_service_node_block_deltas(uint64_t from_height, uint64_t to_height) override {}
+  virtual bool for_all_service_node_block_deltas(std::function<bool(uint64_t, const std::string&)> f) const override { return true; }
+  virtual void clear_service_node_deltas() override {}
+  virtual void set_service_node_snapshot(uint64_t height, const std::string& data) override {}
+  virtual bool get_service_node_snapshot(uint64_t& height, std::string& data) const override { return false; }
+  virtual void remove_service_node_snapshots(uint64_t from_height, uint64_t to_height) override {}
+  virtual void add_pow_cache_entry(uint64_t height, const crypto::hash& id, const crypto::hash& pow) override {}
+  virtual bool get_pow_cache_entry(uint64_t height, const crypto::hash& id, crypto::hash& pow) const override { return false; }
+  virtual void remove_pow_cache_entries(uint64_t from_height, uint64_t to_height) override {}
 };
 
 }
@@ -0,0 +1,265 @@
+// Copyright (c) 2014-2019, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <boost/filesystem.hpp>
+#include "common/command_line.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "blockchain_db/blockchain_db.h"
+#include "file_io_utils.h"
+#include "version.h"
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  struct group_hashes
+  {
+    crypto::hash ids;
+    crypto::hash weights;
+    crypto::hash txs;
+  };
+
+  crypto::hash get_ids_hash(BlockchainDB *db, uint64_t start)
+  {
+    std::vector<crypto::hash> ids;
+    ids.reserve(HASH_OF_HASHES_STEP);
+    for (uint64_t h = start; h < start + HASH_OF_HASHES_STEP; ++h)
+      ids.push_back(db->get_block_hash_from_height(h));
+    crypto::hash hash;
+    cn_fast_hash(ids.data(), ids.size() * sizeof(crypto::hash), hash);
+    return hash;
+  }
+
+  bool get_group_hashes(BlockchainDB *db, uint64_t start, group_hashes &hashes)
+  {
+    std::vector<uint64_t> weights;
+    std::vector<crypto::hash> tx_hashes;
+    weights.reserve(HASH_OF_HASHES_STEP);
+    for (uint64_t h = start; h < start + HASH_OF_HASHES_STEP; ++h)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(db->get_block_blob_from_height(h), b))
+      {
+        LOG_PRINT_L0("Bad block from db at height " << h);
+        return false;
+      }
+      weights.push_back(db->get_block_weight(h));
+      tx_hashes.insert(tx_hashes.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+    }
+    hashes.ids = get_ids_hash(db, start);
+    cn_fast_hash(weights.data(), weights.size() * sizeof(uint64_t), hashes.weights);
+    hashes.txs = Blockchain::get_txs_hash_of_hashes(tx_hashes);
+    return true;
+  }
+
+  void write_uint32(std::string &data, uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i)
+      data.push_back((char)((v >> (8 * i)) & 0xff));
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+  uint64_t block_stop = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_output_file = {"output-file", "Specify output file", "", true};
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop at block number", block_stop};
+  const command_line::arg_descriptor<bool> arg_refresh = {"refresh", "Extend an existing output file, keeping the hashes it has for blocks still in the db", false};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, arg_output_file);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_refresh);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Equilibria '" << XEQ_RELEASE_NAME << "' (v" << XEQ_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("equilibria-blockchain-fast-sync.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+  block_stop = command_line::get_arg(vm, arg_block_stop);
+
+  LOG_PRINT_L0("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+  bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
+  if (opt_testnet && opt_stagenet)
+  {
+    std::cerr << "Can't specify more than one of --testnet and --stagenet" << std::endl;
+    return 1;
+  }
+  bool opt_refresh = command_line::get_arg(vm, arg_refresh);
+  std::string opt_data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+
+  boost::filesystem::path output_file_path;
+  if (command_line::has_arg(vm, arg_output_file))
+    output_file_path = boost::filesystem::path(command_line::get_arg(vm, arg_output_file));
+  else
+    output_file_path = boost::filesystem::path(opt_data_dir) / "export" / "fastsync.dat";
+  LOG_PRINT_L0("Output file: " << output_file_path.string());
+
+  LOG_PRINT_L0("Initializing source blockchain (BlockchainDB)");
+  BlockchainDB *db = new_db();
+  if (db == NULL)
+  {
+    LOG_ERROR("Failed to initialize a database");
+    throw std::runtime_error("Failed to initialize a database");
+  }
+  LOG_PRINT_L0("database: LMDB");
+
+  const std::string filename = (boost::filesystem::path(opt_data_dir) / db->get_db_name()).string();
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+  if (db->get_blockchain_pruning_seed())
+  {
+    LOG_PRINT_L0("Blockchain is pruned, cannot get the tx hashes of all blocks");
+    return 1;
+  }
+
+  // only whole groups are hashed, and the top ones are left out since they
+  // could still be reorganized
+  uint64_t stop = db->height() > CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE ? db->height() - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE : 0;
+  if (block_stop > 0 && block_stop < stop)
+    stop = block_stop;
+  const uint64_t ngroups = stop / HASH_OF_HASHES_STEP;
+  if (ngroups == 0 || ngroups > std::numeric_limits<uint32_t>::max())
+  {
+    LOG_PRINT_L0("Not enough blocks to hash, or too many");
+    return 1;
+  }
+
+  std::vector<group_hashes> groups;
+  groups.reserve(ngroups);
+  if (opt_refresh && boost::filesystem::exists(output_file_path))
+  {
+    std::string data;
+    std::vector<std::pair<crypto::hash, crypto::hash>> hashes;
+    std::vector<crypto::hash> txs_hashes;
+    if (!epee::file_io_utils::load_file_to_string(output_file_path.string(), data) ||
+        !Blockchain::parse_block_hashes({reinterpret_cast<const unsigned char*>(data.data()), data.size()}, hashes, txs_hashes))
+    {
+      LOG_PRINT_L0("Failed to load " << output_file_path.string());
+      return 1;
+    }
+    // the file was made from a db we trusted, so its groups are kept as long
+    // as this db has the same blocks, which is much cheaper than hashing them
+    for (size_t n = 0; n < txs_hashes.size() && n < ngroups; ++n)
+    {
+      if (get_ids_hash(db, n * HASH_OF_HASHES_STEP) != hashes[n].first)
+      {
+        LOG_PRINT_L0("Blocks " << n * HASH_OF_HASHES_STEP << " - " << ((n + 1) * HASH_OF_HASHES_STEP - 1) << " differ from the file, hashing from there");
+        break;
+      }
+      groups.push_back({hashes[n].first, hashes[n].second, txs_hashes[n]});
+    }
+    LOG_PRINT_L0("Kept " << groups.size() << " groups from " << output_file_path.string());
+  }
+
+  while (groups.size() < ngroups)
+  {
+    group_hashes hashes;
+    if (!get_group_hashes(db, groups.size() * HASH_OF_HASHES_STEP, hashes))
+      return 1;
+    groups.push_back(hashes);
+    if (groups.size() % 100 == 0)
+      LOG_PRINT_L0("Hashed " << groups.size() * HASH_OF_HASHES_STEP << "/" << ngroups * HASH_OF_HASHES_STEP << " blocks");
+  }
+
+  std::string data(FAST_SYNC_FILE_MAGIC);
+  write_uint32(data, FAST_SYNC_FILE_VERSION);
+  write_uint32(data, groups.size());
+  for (const group_hashes &hashes: groups)
+  {
+    data.append(hashes.ids.data, sizeof(hashes.ids.data));
+    data.append(hashes.weights.data, sizeof(hashes.weights.data));
+    data.append(hashes.txs.data, sizeof(hashes.txs.data));
+  }
+
+  if (output_file_path.has_parent_path())
+    boost::filesystem::create_directories(output_file_path.parent_path());
+  if (!epee::file_io_utils::save_string_to_file(output_file_path.string(), data))
+  {
+    LOG_PRINT_L0("Failed to write " << output_file_path.string());
+    return 1;
+  }
+  LOG_PRINT_L0("Wrote the hashes of " << groups.size() * HASH_OF_HASHES_STEP << " blocks to " << output_file_path.string());
+  db->close();
+  delete db;
+  return 0;
+
+  CATCH_ENTRY("Fast sync file error", 1);
+}
@@ -0,0 +1,193 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem/path.hpp>
+#include "common/command_line.h"
+#include "file_io_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/service_node_list.h"
+#include "blockchain_db/blockchain_db.h"
+#include "version.h"
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+typedef service_nodes::service_node_list::snapshot_for_serialization snapshot_t;
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<std::string> arg_export_file  = {"export", "Write the newest service node snapshot at or below --height to this file", ""};
+  const command_line::arg_descriptor<std::string> arg_import_file  = {"import", "Store the service node snapshot in this file in the database", ""};
+  const command_line::arg_descriptor<uint64_t> arg_height  = {"height", "Highest snapshot height to export, defaults to the chain tip", 0};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_export_file);
+  command_line::add_arg(desc_cmd_sett, arg_import_file);
+  command_line::add_arg(desc_cmd_sett, arg_height);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    auto parser = po::command_line_parser(argc, argv).options(desc_options);
+    po::store(parser.run(), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Equilibria '" << XEQ_RELEASE_NAME << "' (v" << XEQ_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("equilibria-blockchain-sn-snapshot.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  std::string opt_data_dir = command_line::get_arg(vm, cryptonote::arg_data_dir);
+  const std::string opt_export_file = command_line::get_arg(vm, arg_export_file);
+  const std::string opt_import_file = command_line::get_arg(vm, arg_import_file);
+
+  if (opt_export_file.empty() == opt_import_file.empty())
+  {
+    std::cerr << "Exactly one of --export and --import must be given" << std::endl;
+    return 1;
+  }
+  const bool importing = !opt_import_file.empty();
+
+  // Snapshots are checked before anything touches the database
+  std::string blob;
+  snapshot_t snapshot;
+  if (importing)
+  {
+    if (!epee::file_io_utils::load_file_to_string(opt_import_file, blob))
+    {
+      std::cerr << "Failed to read " << opt_import_file << std::endl;
+      return 1;
+    }
+    if (!service_nodes::service_node_list::parse_snapshot(blob, snapshot))
+    {
+      std::cerr << opt_import_file << " is not a valid service node snapshot" << std::endl;
+      return 1;
+    }
+  }
+
+  BlockchainDB *db = new_db();
+  if (db == NULL)
+  {
+    LOG_ERROR("Attempted to use non-existent database type: LMDB");
+    throw std::runtime_error("Attempting to use non-existent database type");
+  }
+
+  const std::string filename = (boost::filesystem::path(opt_data_dir) / db->get_db_name()).string();
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+
+  try
+  {
+    db->open(filename, importing ? 0 : DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+
+  const uint64_t db_height = db->height();
+  if (importing)
+  {
+    // The daemon stores its own snapshot over one above the chain when it
+    // gets there, so it couldn't be used
+    if (snapshot.height >= db_height)
+    {
+      LOG_PRINT_L0("The chain is only " << db_height << " blocks high; import the snapshot at height " << snapshot.height << " once that block is in the chain");
+      db->close();
+      return 1;
+    }
+    if (db->get_block_hash_from_height(snapshot.height) != snapshot.block_hash)
+    {
+      LOG_PRINT_L0("The snapshot at height " << snapshot.height << " is for block " << snapshot.block_hash << ", which is not on this chain");
+      db->close();
+      return 1;
+    }
+
+    {
+      db_wtxn_guard txn_guard(db);
+      db->set_service_node_snapshot(snapshot.height, blob);
+    }
+    LOG_PRINT_L0("Imported the service node snapshot at height " << snapshot.height << "; the daemon restores the list from it on startup if its stored list is missing or older than the snapshot");
+  }
+  else
+  {
+    uint64_t height = command_line::is_arg_defaulted(vm, arg_height) ? db_height : command_line::get_arg(vm, arg_height);
+    if (!db->get_service_node_snapshot(height, blob) || !service_nodes::service_node_list::parse_snapshot(blob, snapshot))
+    {
+      LOG_PRINT_L0("No usable service node snapshot found");
+      db->close();
+      return 1;
+    }
+    if (!epee::file_io_utils::save_string_to_file(opt_export_file, blob))
+    {
+      LOG_PRINT_L0("Failed to write " << opt_export_file);
+      db->close();
+      return 1;
+    }
+    LOG_PRINT_L0("Exported the service node snapshot at height " << height << " to " << opt_export_file);
+  }
+
+  db->close();
+  return 0;
+
+  CATCH_ENTRY("SN snapshot error", 1);
+}
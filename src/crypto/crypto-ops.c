@@ -3742,3 +3742,34 @@ int ge_p3_is_point_at_infinity(const ge_p3 *p) {
   }
   return 1;
 }
+
+/* Same as ge_tobytes on each of the n points, sharing a single field
+   inversion between them (Montgomery's trick). scratch holds n elements. */
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, fe *scratch, size_t n) {
+  fe inv;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0)
+    return;
+
+  fe_copy(scratch[0], h[0].Z);
+  for (i = 1; i < n; ++i)
+    fe_mul(scratch[i], scratch[i - 1], h[i].Z);
+  fe_invert(inv, scratch[n - 1]);
+
+  for (i = n; i-- > 0;) {
+    if (i > 0) {
+      fe_mul(recip, inv, scratch[i - 1]);
+      fe_mul(inv, inv, h[i].Z);
+    } else {
+      fe_copy(recip, inv);
+    }
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+}
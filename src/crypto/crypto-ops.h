@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -161,3 +163,4 @@ void fe_tobytes(unsigned char *, const fe);
 void fe_invert(fe out, const fe z);
 
 int ge_p3_is_point_at_infinity(const ge_p3 *p);
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, fe *scratch, size_t n);
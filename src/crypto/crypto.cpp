@@ -29,11 +29,13 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
@@ -321,6 +323,49 @@ namespace crypto {
     return sc_isnonzero(&c) == 0;
   }
 
+  bool crypto_ops::check_signatures(const std::vector<signature_check> &checks, std::vector<bool> *results) {
+    // Same checks as check_signature, except that the commitments c*P + r*G of
+    // all signatures are computed first and converted to bytes together.
+    std::vector<bool> valid(checks.size(), false);
+    std::vector<size_t> indexes;
+    std::vector<ge_p2> comms(checks.size());
+    indexes.reserve(checks.size());
+    for (size_t i = 0; i < checks.size(); ++i) {
+      const signature_check &check = checks[i];
+      ge_p3 tmp3;
+      if (ge_frombytes_vartime(&tmp3, &check.pub) != 0)
+        continue;
+      if (sc_check(&check.sig.c) != 0 || sc_check(&check.sig.r) != 0 || !sc_isnonzero(&check.sig.c))
+        continue;
+      ge_double_scalarmult_base_vartime(&comms[indexes.size()], &check.sig.c, &tmp3, &check.sig.r);
+      indexes.push_back(i);
+    }
+
+    std::vector<ec_point> comm_bytes(indexes.size());
+    std::unique_ptr<fe[]> scratch(new fe[indexes.size()]);
+    ge_tobytes_batch(reinterpret_cast<unsigned char*>(comm_bytes.data()), comms.data(), scratch.get(), indexes.size());
+
+    static const ec_point infinity = {{ 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    for (size_t k = 0; k < indexes.size(); ++k) {
+      const signature_check &check = checks[indexes[k]];
+      if (memcmp(&comm_bytes[k], &infinity, 32) == 0)
+        continue;
+      s_comm buf;
+      ec_scalar c;
+      buf.h = check.prefix_hash;
+      buf.key = check.pub;
+      buf.comm = comm_bytes[k];
+      hash_to_scalar(&buf, sizeof(s_comm), c);
+      sc_sub(&c, &c, &check.sig.c);
+      valid[indexes[k]] = sc_isnonzero(&c) == 0;
+    }
+
+    const bool all_valid = std::find(valid.begin(), valid.end(), false) == valid.end();
+    if (results)
+      *results = std::move(valid);
+    return all_valid;
+  }
+
   void crypto_ops::generate_tx_proof(const hash &prefix_hash, const public_key &R, const public_key &A, const boost::optional<public_key> &B, const public_key &D, const secret_key &r, signature &sig) {
     // sanity check
     ge_p3 R_p3;
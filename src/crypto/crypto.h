@@ -99,6 +99,14 @@ namespace crypto {
   void hash_to_scalar(const void *data, size_t length, ec_scalar &res);
   void random32_unbiased(unsigned char *bytes);
 
+  /* A signature of a prefix hash by a public key, as verified by check_signature.
+   */
+  struct signature_check {
+    hash prefix_hash;
+    public_key pub;
+    signature sig;
+  };
+
   static_assert(sizeof(ec_point) == 32 && sizeof(ec_scalar) == 32 &&
     sizeof(public_key) == 32 && sizeof(secret_key) == 32 &&
     sizeof(key_derivation) == 32 && sizeof(key_image) == 32 &&
@@ -130,6 +138,8 @@ namespace crypto {
     friend void generate_signature(const hash &, const public_key &, const secret_key &, signature &);
     static bool check_signature(const hash &, const public_key &, const signature &);
     friend bool check_signature(const hash &, const public_key &, const signature &);
+    static bool check_signatures(const std::vector<signature_check> &, std::vector<bool> *);
+    friend bool check_signatures(const std::vector<signature_check> &, std::vector<bool> *);
     static void generate_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const secret_key &, signature &);
     friend void generate_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const secret_key &, signature &);
     static bool check_tx_proof(const hash &, const public_key &, const public_key &, const boost::optional<public_key> &, const public_key &, const signature &);
@@ -241,6 +251,14 @@ namespace crypto {
     return crypto_ops::check_signature(prefix_hash, pub, sig);
   }
 
+  /* Checks a batch of standard signatures; cheaper than calling check_signature on
+   * each as the recomputed commitments share one field inversion. Returns true if
+   * all are valid; results, when given, receives the outcome of each check.
+   */
+  inline bool check_signatures(const std::vector<signature_check> &checks, std::vector<bool> *results = nullptr) {
+    return crypto_ops::check_signatures(checks, results);
+  }
+
   /* Generation and checking of a tx proof; given a tx pubkey R, the recipient's view pubkey A, and the key 
    * derivation D, the signature proves the knowledge of the tx secret key r such that R=r*G and D=r*A
    * When the recipient's address is a subaddress, the tx pubkey R is defined as R=r*B where B is the recipient's spend pubkey
@@ -56,6 +56,15 @@ using cn_v1_hash = cn_v1_hash_t;
 using cn_v7l_hash = cn_v7l_hash_t;
 using cn_gpu_hash = cn_gpu_hash_t;
 
+// Implementations a hash can run on, hash() picks the fastest the CPU supports
+enum class cn_kernel
+{
+	soft,  // software AES, SSE2 or NEON cn_gpu loop
+	aes,   // AES-NI or ARMv8 AES, SSE2 or NEON cn_gpu loop
+	avx2,  // AES-NI, AVX2 cn_gpu loop
+	avx512 // VAES, AVX-512 cn_gpu loop
+};
+
 #ifdef HAS_INTEL_HW
 inline void cpuid(uint32_t eax, int32_t ecx, int32_t val[4])
 {
@@ -87,6 +96,29 @@ inline bool check_avx2()
 	const bool osxsave = (cpu_info[2] & (1 << 27)) != 0;
 	return has_avx2 && osxsave;
 }
+
+inline uint64_t xgetbv0()
+{
+#if defined(HAS_WIN_INTRIN_API)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+// AVX-512F, AVX-512BW and VAES, with the OS saving the opmask and zmm registers
+inline bool check_avx512()
+{
+	int32_t cpu_info[4];
+	cpuid(7, 0, cpu_info);
+	const bool has_avx512 = (cpu_info[1] & (1 << 16)) != 0 && (cpu_info[1] & (1 << 30)) != 0;
+	const bool has_vaes = (cpu_info[2] & (1 << 9)) != 0;
+	cpuid(1, 0, cpu_info);
+	const bool osxsave = (cpu_info[2] & (1 << 27)) != 0;
+	return has_avx512 && has_vaes && osxsave && (xgetbv0() & 0xe6) == 0xe6;
+}
 #endif
 
 #ifdef HAS_ARM_HW
@@ -190,22 +222,61 @@ class cn_slow_hash
 
 	void hash(const void* in, size_t len, void* out)
 	{
+		hash(in, len, out, best_kernel());
+	}
+
+	// The kernel has to be available, see kernel_available()
+	void hash(const void* in, size_t len, void* out, cn_kernel k)
+	{
+		kernel = k;
 		if(VERSION <= 1)
 		{
-			if(hw_check_aes() && !check_override())
+			if(k != cn_kernel::soft)
 				hardware_hash(in, len, out);
 			else
 				software_hash(in, len, out);
 		}
 		else
 		{
-			if(hw_check_aes() && !check_override())
+			if(k != cn_kernel::soft)
 				hardware_hash_3(in, len, out);
 			else
 				software_hash_3(in, len, out);
 		}
 	}
 
+	static cn_kernel best_kernel()
+	{
+		if(!hw_check_aes() || check_override())
+			return cn_kernel::soft;
+#ifdef HAS_INTEL_HW
+		if(check_avx512())
+			return cn_kernel::avx512;
+		if(check_avx2())
+			return cn_kernel::avx2;
+#endif
+		return cn_kernel::aes;
+	}
+
+	static bool kernel_available(cn_kernel k)
+	{
+		switch(k)
+		{
+		case cn_kernel::soft:
+			return true;
+		case cn_kernel::aes:
+			return hw_check_aes();
+#ifdef HAS_INTEL_HW
+		case cn_kernel::avx2:
+			return hw_check_aes() && check_avx2();
+		case cn_kernel::avx512:
+			return hw_check_aes() && check_avx512();
+#endif
+		default:
+			return false;
+		}
+	}
+
 	void software_hash(const void* in, size_t len, void* out);
 	void software_hash_3(const void* in, size_t len, void* pout);
 
@@ -235,7 +306,7 @@ private:
 		borrowed_pad = true;
 	}
 
-	inline bool check_override()
+	static inline bool check_override()
 	{
 		const char* env = getenv("RYO_USE_SOFTWARE_AES");
 		if(!env)
@@ -279,6 +350,10 @@ private:
 	void explode_scratchpad_hard();
 	void implode_scratchpad_hard();
 #endif
+#ifdef HAS_INTEL_HW
+	void explode_scratchpad_vaes();
+	void implode_scratchpad_vaes();
+#endif
 
 	void explode_scratchpad_3();
 	void explode_scratchpad_soft();
@@ -286,10 +361,12 @@ private:
 
 	void inner_hash_3();
 	void inner_hash_3_avx();
+	void inner_hash_3_avx512();
 
 	cn_sptr lpad;
 	cn_sptr spad;
 	bool borrowed_pad;
+	cn_kernel kernel = cn_kernel::soft;
 };
 
 extern template class cn_v1_hash_t;
@@ -332,7 +332,10 @@ void cn_slow_hash<MEMORY, ITER, VERSION>::hardware_hash(const void* in, size_t l
 		mc0 ^=  *(spad.as_uqword()+24);
 	}
 
-	explode_scratchpad_hard();
+	if(kernel == cn_kernel::avx512)
+		explode_scratchpad_vaes();
+	else
+		explode_scratchpad_hard();
 
 	uint64_t* h0 = spad.as_uqword();
 
@@ -378,7 +381,10 @@ void cn_slow_hash<MEMORY, ITER, VERSION>::hardware_hash(const void* in, size_t l
 		idx0 = al0;
 	}
 
-	implode_scratchpad_hard();
+	if(kernel == cn_kernel::avx512)
+		implode_scratchpad_vaes();
+	else
+		implode_scratchpad_hard();
 
 	keccakf(spad.as_uqword());
 
@@ -583,11 +589,19 @@ void cn_slow_hash<MEMORY, ITER, VERSION>::hardware_hash_3(const void* in, size_t
 	keccak((const uint8_t*)in, len, spad.as_byte(), 200);
 
 	explode_scratchpad_3();
-	if(check_avx2())
-		inner_hash_3_avx();
+	if(kernel == cn_kernel::avx512)
+	{
+		inner_hash_3_avx512();
+		implode_scratchpad_vaes();
+	}
 	else
-		inner_hash_3();
-	implode_scratchpad_hard();
+	{
+		if(kernel == cn_kernel::avx2)
+			inner_hash_3_avx();
+		else
+			inner_hash_3();
+		implode_scratchpad_hard();
+	}
 
 	keccakf(spad.as_uqword());
 	memcpy(pout, spad.as_byte(), 32);
@@ -599,10 +613,7 @@ void cn_slow_hash<MEMORY, ITER, VERSION>::software_hash_3(const void* in, size_t
 	keccak((const uint8_t*)in, len, spad.as_byte(), 200);
 
 	explode_scratchpad_3();
-	if(check_avx2())
-		inner_hash_3_avx();
-	else
-		inner_hash_3();
+	inner_hash_3();
 	implode_scratchpad_soft();
 
 	keccakf(spad.as_uqword());
@@ -0,0 +1,353 @@
+// Copyright (c) 2019, Ryo Currency Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define CN_ADD_TARGETS_AND_HEADERS
+#define INTEL_AVX512
+
+#include "../keccak.h"
+#include "aux_hash.h"
+#include "cn_slow_hash.hpp"
+
+#ifdef HAS_INTEL_HW
+
+inline __m512 _mm512_and_ps_epi32(const __m512& x, uint32_t mask)
+{
+	return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(mask)));
+}
+
+inline __m512 _mm512_or_ps_epi32(const __m512& x, uint32_t mask)
+{
+	return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(x), _mm512_set1_epi32(mask)));
+}
+
+inline __m512 _mm512_set_m256(const __m256& hi, const __m256& lo)
+{
+	return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+
+inline __m256 _mm512_extract_high_ps(const __m512& x)
+{
+	return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1));
+}
+
+inline __m512 fma_break(const __m512& x)
+{
+	// Break the dependency chain by setitng the exp to ?????01
+	return _mm512_or_ps_epi32(_mm512_and_ps_epi32(x, 0xFEFFFFFF), 0x00800000);
+}
+
+inline void sub_round(const __m512& n0, const __m512& n1, const __m512& n2, const __m512& n3, const __m512& rnd_c, __m512& n, __m512& d, __m512& c)
+{
+	__m512 nn = _mm512_mul_ps(n0, c);
+	nn = _mm512_mul_ps(_mm512_add_ps(n1, c), _mm512_mul_ps(nn, nn));
+	nn = fma_break(nn);
+	n = _mm512_add_ps(n, nn);
+
+	__m512 dd = _mm512_mul_ps(n2, c);
+	dd = _mm512_mul_ps(_mm512_sub_ps(n3, c), _mm512_mul_ps(dd, dd));
+	dd = fma_break(dd);
+	d = _mm512_add_ps(d, dd);
+
+	//Constant feedback
+	c = _mm512_add_ps(c, rnd_c);
+	c = _mm512_add_ps(c, _mm512_set1_ps(0.734375f));
+	__m512 r = _mm512_add_ps(nn, dd);
+	r = _mm512_and_ps_epi32(r, 0x807FFFFF);
+	r = _mm512_or_ps_epi32(r, 0x40000000);
+	c = _mm512_add_ps(c, r);
+}
+
+inline void round_compute(const __m512& n0, const __m512& n1, const __m512& n2, const __m512& n3, const __m512& rnd_c, __m512& c, __m512& r)
+{
+	__m512 n = _mm512_setzero_ps(), d = _mm512_setzero_ps();
+
+	sub_round(n0, n1, n2, n3, rnd_c, n, d, c);
+	sub_round(n1, n2, n3, n0, rnd_c, n, d, c);
+	sub_round(n2, n3, n0, n1, rnd_c, n, d, c);
+	sub_round(n3, n0, n1, n2, rnd_c, n, d, c);
+	sub_round(n3, n2, n1, n0, rnd_c, n, d, c);
+	sub_round(n2, n1, n0, n3, rnd_c, n, d, c);
+	sub_round(n1, n0, n3, n2, rnd_c, n, d, c);
+	sub_round(n0, n3, n2, n1, rnd_c, n, d, c);
+
+	// Make sure abs(d) > 2.0 - this prevents division by zero and accidental overflows by division by < 1.0
+	d = _mm512_and_ps_epi32(d, 0xFF7FFFFF);
+	d = _mm512_or_ps_epi32(d, 0x40000000);
+	r = _mm512_add_ps(r, _mm512_div_ps(n, d));
+}
+
+// The counters are set per 128 bit lane, lowest lane first
+template <bool add>
+inline __m512i quad_comupte(const __m512& n0, const __m512& n1, const __m512& n2, const __m512& n3,
+							float cnt0, float cnt1, float cnt2, float cnt3, const __m512& rnd_c, __m512& sum)
+{
+	__m512 c = _mm512_setr_ps(cnt0, cnt0, cnt0, cnt0, cnt1, cnt1, cnt1, cnt1, cnt2, cnt2, cnt2, cnt2, cnt3, cnt3, cnt3, cnt3);
+	__m512 r = _mm512_setzero_ps();
+
+	round_compute(n0, n1, n2, n3, rnd_c, c, r);
+	round_compute(n0, n1, n2, n3, rnd_c, c, r);
+	round_compute(n0, n1, n2, n3, rnd_c, c, r);
+	round_compute(n0, n1, n2, n3, rnd_c, c, r);
+
+	// do a quick fmod by setting exp to 2
+	r = _mm512_and_ps_epi32(r, 0x807FFFFF);
+	r = _mm512_or_ps_epi32(r, 0x40000000);
+
+	if(add)
+		sum = _mm512_add_ps(sum, r);
+	else
+		sum = r;
+
+	r = _mm512_mul_ps(r, _mm512_set1_ps(536870880.0f)); // 35
+	return _mm512_cvttps_epi32(r);
+}
+
+template <size_t rot>
+inline void quad_comupte_wrap(const __m512& n0, const __m512& n1, const __m512& n2, const __m512& n3,
+							  float cnt0, float cnt1, float cnt2, float cnt3, const __m512& rnd_c, __m512& sum, __m512i& out)
+{
+	__m512i r = quad_comupte<rot % 2 != 0>(n0, n1, n2, n3, cnt0, cnt1, cnt2, cnt3, rnd_c, sum);
+	if(rot != 0)
+		r = _mm512_or_si512(_mm512_bslli_epi128(r, 16 - rot), _mm512_bsrli_epi128(r, rot));
+
+	out = _mm512_xor_si512(out, r);
+}
+
+// Same rounds as inner_hash_3_avx, which computes the results for idx0 and
+// idx2 one after the other; here the low 256 bits work on idx0 and the high
+// 256 bits on idx2 at the same time.
+template <size_t MEMORY, size_t ITER, size_t VERSION>
+void cn_slow_hash<MEMORY, ITER, VERSION>::inner_hash_3_avx512()
+{
+	uint32_t s = spad.as_dword(0) >> 8;
+	cn_sptr idx0 = scratchpad_ptr(s, 0);
+	cn_sptr idx2 = scratchpad_ptr(s, 2);
+	__m256 sum0 = _mm256_setzero_ps();
+
+	for(size_t i = 0; i < ITER; i++)
+	{
+		__m256i v01 = _mm256_load_si256(idx0.as_ptr<__m256i>());
+		__m256i v23 = _mm256_load_si256(idx2.as_ptr<__m256i>());
+		__m256 n01 = _mm256_cvtepi32_ps(v01);
+		__m256 n23 = _mm256_cvtepi32_ps(v23);
+
+		__m256 n10, n22, n33, n11, n02, n30;
+		n10 = _mm256_permute2f128_ps(n01, n01, 0x01);
+		n22 = _mm256_permute2f128_ps(n23, n23, 0x00);
+		n33 = _mm256_permute2f128_ps(n23, n23, 0x11);
+		n11 = _mm256_permute2f128_ps(n01, n01, 0x11);
+		n02 = _mm256_permute2f128_ps(n01, n23, 0x20);
+		n30 = _mm256_permute2f128_ps(n01, n23, 0x03);
+
+		__m512 na = _mm512_set_m256(n23, n01);
+		__m512 nb = _mm512_set_m256(n11, n10);
+		__m512 nc = _mm512_set_m256(n02, n22);
+		__m512 nd = _mm512_set_m256(n30, n33);
+		__m512 rc = _mm512_set_m256(sum0, sum0);
+
+		__m512 suma, sumb;
+		__m512i out = _mm512_setzero_si512();
+		quad_comupte_wrap<0>(na, nb, nc, nd, 1.3437500f, 1.4296875f, 1.4140625f, 1.3203125f, rc, suma, out);
+		quad_comupte_wrap<1>(na, nc, nd, nb, 1.2812500f, 1.3984375f, 1.2734375f, 1.3515625f, rc, suma, out);
+		quad_comupte_wrap<2>(na, nd, nb, nc, 1.3593750f, 1.3828125f, 1.2578125f, 1.3359375f, rc, sumb, out);
+		quad_comupte_wrap<3>(na, nd, nc, nb, 1.3671875f, 1.3046875f, 1.2890625f, 1.4609375f, rc, sumb, out);
+
+		__m256i out0 = _mm512_castsi512_si256(out);
+		__m256i out1 = _mm512_extracti64x4_epi64(out, 1);
+		_mm256_store_si256(idx0.as_ptr<__m256i>(), _mm256_xor_si256(v01, out0));
+		_mm256_store_si256(idx2.as_ptr<__m256i>(), _mm256_xor_si256(v23, out1));
+
+		__m512 sum01 = _mm512_add_ps(suma, sumb);
+		sum0 = _mm512_castps512_ps256(sum01);
+		__m256 sum1 = _mm512_extract_high_ps(sum01);
+
+		__m256i out2 = _mm256_xor_si256(out0, out1);
+		out2 = _mm256_xor_si256(_mm256_permute2x128_si256(out2, out2, 0x41), out2);
+		__m256 sum2 = _mm256_permute2f128_ps(sum0, sum1, 0x30);
+		__m256 sum3 = _mm256_permute2f128_ps(sum0, sum1, 0x21);
+		sum0 = _mm256_add_ps(sum2, sum3);
+		sum0 = _mm256_add_ps(sum0, _mm256_permute2f128_ps(sum0, sum0, 0x41));
+
+		// Clear the high 128 bits
+		__m128 sum = _mm256_castps256_ps128(sum0);
+
+		sum = _mm_and_ps(_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)), sum); // take abs(va) by masking the float sign bit
+		// vs range 0 - 64
+		__m128i v0 = _mm_cvttps_epi32(_mm_mul_ps(sum, _mm_set1_ps(16777216.0f)));
+		v0 = _mm_xor_si128(v0, _mm256_castsi256_si128(out2));
+		__m128i v1 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(0, 1, 2, 3));
+		v0 = _mm_xor_si128(v0, v1);
+		v1 = _mm_shuffle_epi32(v0, _MM_SHUFFLE(0, 1, 0, 1));
+		v0 = _mm_xor_si128(v0, v1);
+
+		// vs is now between 0 and 1
+		sum = _mm_div_ps(sum, _mm_set1_ps(64.0f));
+		sum0 = _mm256_insertf128_ps(_mm256_castps128_ps256(sum), sum, 1);
+		uint32_t n = _mm_cvtsi128_si32(v0);
+		idx0 = scratchpad_ptr(n, 0);
+		idx2 = scratchpad_ptr(n, 2);
+	}
+}
+
+// VAES explode and implode, the eight AES states being held four to a register
+inline __m128i vaes_sl_xor(__m128i tmp1)
+{
+	__m128i tmp4;
+	tmp4 = _mm_slli_si128(tmp1, 0x04);
+	tmp1 = _mm_xor_si128(tmp1, tmp4);
+	tmp4 = _mm_slli_si128(tmp4, 0x04);
+	tmp1 = _mm_xor_si128(tmp1, tmp4);
+	tmp4 = _mm_slli_si128(tmp4, 0x04);
+	tmp1 = _mm_xor_si128(tmp1, tmp4);
+	return tmp1;
+}
+
+template <uint8_t rcon>
+inline void vaes_genkey_sub(__m128i& xout0, __m128i& xout2)
+{
+	__m128i xout1 = _mm_aeskeygenassist_si128(xout2, rcon);
+	xout1 = _mm_shuffle_epi32(xout1, 0xFF);
+	xout0 = vaes_sl_xor(xout0);
+	xout0 = _mm_xor_si128(xout0, xout1);
+	xout1 = _mm_aeskeygenassist_si128(xout0, 0x00);
+	xout1 = _mm_shuffle_epi32(xout1, 0xAA);
+	xout2 = vaes_sl_xor(xout2);
+	xout2 = _mm_xor_si128(xout2, xout1);
+}
+
+inline void vaes_genkey(const __m128i* memory, __m512i (&k)[10])
+{
+	__m128i xout0 = _mm_load_si128(memory);
+	__m128i xout2 = _mm_load_si128(memory + 1);
+	k[0] = _mm512_broadcast_i32x4(xout0);
+	k[1] = _mm512_broadcast_i32x4(xout2);
+
+	vaes_genkey_sub<0x01>(xout0, xout2);
+	k[2] = _mm512_broadcast_i32x4(xout0);
+	k[3] = _mm512_broadcast_i32x4(xout2);
+
+	vaes_genkey_sub<0x02>(xout0, xout2);
+	k[4] = _mm512_broadcast_i32x4(xout0);
+	k[5] = _mm512_broadcast_i32x4(xout2);
+
+	vaes_genkey_sub<0x04>(xout0, xout2);
+	k[6] = _mm512_broadcast_i32x4(xout0);
+	k[7] = _mm512_broadcast_i32x4(xout2);
+
+	vaes_genkey_sub<0x08>(xout0, xout2);
+	k[8] = _mm512_broadcast_i32x4(xout0);
+	k[9] = _mm512_broadcast_i32x4(xout2);
+}
+
+inline void vaes_round10(const __m512i (&k)[10], __m512i& x0, __m512i& x1)
+{
+	for(size_t i = 0; i < 10; i++)
+	{
+		x0 = _mm512_aesenc_epi128(x0, k[i]);
+		x1 = _mm512_aesenc_epi128(x1, k[i]);
+	}
+}
+
+// x0 ^= x1, x1 ^= x2, ..., x7 ^= x0 across the two registers
+inline void vaes_xor_shift(__m512i& x0, __m512i& x1)
+{
+	__m512i t0 = _mm512_alignr_epi32(x1, x0, 4);
+	__m512i t1 = _mm512_alignr_epi32(x0, x1, 4);
+	x0 = _mm512_xor_si512(x0, t0);
+	x1 = _mm512_xor_si512(x1, t1);
+}
+
+template <size_t MEMORY, size_t ITER, size_t VERSION>
+void cn_slow_hash<MEMORY, ITER, VERSION>::implode_scratchpad_vaes()
+{
+	__m512i k[10];
+	vaes_genkey(spad.as_ptr<__m128i>() + 2, k);
+
+	__m512i x0 = _mm512_load_si512(spad.as_ptr<__m128i>() + 4);
+	__m512i x1 = _mm512_load_si512(spad.as_ptr<__m128i>() + 8);
+
+	for(size_t i = 0; i < MEMORY / sizeof(__m512i); i += 2)
+	{
+		x0 = _mm512_xor_si512(_mm512_load_si512(lpad.as_ptr<__m512i>() + i + 0), x0);
+		x1 = _mm512_xor_si512(_mm512_load_si512(lpad.as_ptr<__m512i>() + i + 1), x1);
+
+		vaes_round10(k, x0, x1);
+
+		if(VERSION == 2)
+			vaes_xor_shift(x0, x1);
+	}
+
+	for(size_t i = 0; VERSION == 2 && i < MEMORY / sizeof(__m512i); i += 2)
+	{
+		x0 = _mm512_xor_si512(_mm512_load_si512(lpad.as_ptr<__m512i>() + i + 0), x0);
+		x1 = _mm512_xor_si512(_mm512_load_si512(lpad.as_ptr<__m512i>() + i + 1), x1);
+
+		vaes_round10(k, x0, x1);
+		vaes_xor_shift(x0, x1);
+	}
+
+	for(size_t i = 0; VERSION == 2 && i < 16; i++)
+	{
+		vaes_round10(k, x0, x1);
+		vaes_xor_shift(x0, x1);
+	}
+
+	_mm512_store_si512(spad.as_ptr<__m128i>() + 4, x0);
+	_mm512_store_si512(spad.as_ptr<__m128i>() + 8, x1);
+}
+
+template <size_t MEMORY, size_t ITER, size_t VERSION>
+void cn_slow_hash<MEMORY, ITER, VERSION>::explode_scratchpad_vaes()
+{
+	__m512i k[10];
+	vaes_genkey(spad.as_ptr<__m128i>(), k);
+
+	__m512i x0 = _mm512_load_si512(spad.as_ptr<__m128i>() + 4);
+	__m512i x1 = _mm512_load_si512(spad.as_ptr<__m128i>() + 8);
+
+	for(size_t i = 0; i < MEMORY / sizeof(__m512i); i += 2)
+	{
+		vaes_round10(k, x0, x1);
+
+		_mm512_store_si512(lpad.as_ptr<__m512i>() + i + 0, x0);
+		_mm512_store_si512(lpad.as_ptr<__m512i>() + i + 1, x1);
+	}
+}
+
+// Only the members defined here are instantiated, so none of the class's
+// inline members can end up compiled for AVX-512
+template void cn_v1_hash::explode_scratchpad_vaes();
+template void cn_v1_hash::implode_scratchpad_vaes();
+template void cn_v1_hash::inner_hash_3_avx512();
+template void cn_v7l_hash::explode_scratchpad_vaes();
+template void cn_v7l_hash::implode_scratchpad_vaes();
+template void cn_v7l_hash::inner_hash_3_avx512();
+template void cn_gpu_hash::explode_scratchpad_vaes();
+template void cn_gpu_hash::implode_scratchpad_vaes();
+template void cn_gpu_hash::inner_hash_3_avx512();
+#endif
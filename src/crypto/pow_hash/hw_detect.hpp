@@ -78,6 +78,10 @@
 #pragma GCC target("fpu=vfpv4")
 #endif
 #include "arm_vfp.hpp"
+#elif defined(HAS_INTEL_HW) && defined(INTEL_AVX512)
+#ifndef __clang__
+#pragma GCC target("aes,avx2,avx512f,avx512bw,vaes")
+#endif
 #elif defined(HAS_INTEL_HW) && defined(INTEL_AVX2)
 #ifndef __clang__
 #pragma GCC target("aes,avx2")
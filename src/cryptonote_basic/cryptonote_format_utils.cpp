@@ -517,6 +517,37 @@ namespace cryptonote
     return r;
   }
   //---------------------------------------------------------------
+  namespace
+  {
+    // Reads tx_extra in place instead of copying it into an istringstream
+    class tx_extra_streambuf : public std::streambuf
+    {
+    public:
+      explicit tx_extra_streambuf(const std::vector<uint8_t>& tx_extra)
+      {
+        char *begin = const_cast<char *>(reinterpret_cast<const char *>(tx_extra.data()));
+        setg(begin, begin, begin + tx_extra.size());
+      }
+
+      size_t position() const { return gptr() - eback(); }
+
+    protected:
+      pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+      {
+        char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+        if (off < eback() - base || off > egptr() - base)
+          return pos_type(off_type(-1));
+        setg(eback(), base + off, egptr());
+        return pos_type(position());
+      }
+
+      pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+      {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+      }
+    };
+  }
+  //---------------------------------------------------------------
   bool parse_tx_extra(const std::vector<uint8_t>& tx_extra, std::vector<tx_extra_field>& tx_extra_fields)
   {
     tx_extra_fields.clear();
@@ -524,8 +555,8 @@ namespace cryptonote
     if(tx_extra.empty())
       return true;
 
-    std::string extra_str(reinterpret_cast<const char *>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
+    tx_extra_streambuf buf(tx_extra);
+    std::istream iss(&buf);
     binary_archive<false> ar(iss);
 
     bool eof = false;
@@ -545,6 +576,11 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  tx_extra_index::tx_extra_index(const std::vector<uint8_t>& tx_extra)
+  {
+    parse_tx_extra(tx_extra, m_fields);
+  }
+  //---------------------------------------------------------------
   template<typename T>
   static bool pick(binary_archive<true> &ar, std::vector<tx_extra_field> &fields, uint8_t tag)
   {
@@ -642,18 +678,20 @@ namespace cryptonote
     return true;
   }
     //---------------------------------------------------------------
-  crypto::public_key get_tx_pub_key_from_extra(const std::vector<uint8_t>& tx_extra, size_t pk_index)
+  crypto::public_key get_tx_pub_key_from_extra(const tx_extra_index& tx_extra, size_t pk_index)
   {
-    std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx_extra, tx_extra_fields);
-
     tx_extra_pub_key pub_key_field;
-    if(!find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, pk_index))
+    if(!tx_extra.find(pub_key_field, pk_index))
       return null_pkey;
 
     return pub_key_field.pub_key;
   }
   //---------------------------------------------------------------
+  crypto::public_key get_tx_pub_key_from_extra(const std::vector<uint8_t>& tx_extra, size_t pk_index)
+  {
+    return get_tx_pub_key_from_extra(tx_extra_index(tx_extra), pk_index);
+  }
+  //---------------------------------------------------------------
   crypto::public_key get_tx_pub_key_from_extra(const transaction_prefix& tx_prefix, size_t pk_index)
   {
     return get_tx_pub_key_from_extra(tx_prefix.extra, pk_index);
@@ -772,35 +810,41 @@ namespace cryptonote
    add_data_to_tx_extra(tx_extra, reinterpret_cast<const char *>(&pubkey), sizeof(pubkey), TX_EXTRA_TAG_SERVICE_NODE_PUBKEY);
  }
  //---------------------------------------------------------------
- bool get_service_node_pubkey_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::public_key& pubkey)
+ bool get_service_node_pubkey_from_tx_extra(const tx_extra_index& tx_extra, crypto::public_key& pubkey)
  {
-   std::vector<tx_extra_field> tx_extra_fields;
-   parse_tx_extra(tx_extra, tx_extra_fields);
    tx_extra_service_node_pubkey service_node_pubkey;
-   bool result = find_tx_extra_field_by_type(tx_extra_fields, service_node_pubkey);
+   bool result = tx_extra.find(service_node_pubkey);
    if (!result)
      return false;
    pubkey = service_node_pubkey.m_service_node_key;
    return true;
  }
  //---------------------------------------------------------------
+ bool get_service_node_pubkey_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::public_key& pubkey)
+ {
+   return get_service_node_pubkey_from_tx_extra(tx_extra_index(tx_extra), pubkey);
+ }
+ //---------------------------------------------------------------
  void add_service_node_contributor_to_tx_extra(std::vector<uint8_t>& tx_extra, const cryptonote::account_public_address& address)
  {
    add_data_to_tx_extra(tx_extra, reinterpret_cast<const char *>(&address), sizeof(address), TX_EXTRA_TAG_SERVICE_NODE_CONTRIBUTOR);
  }
  //---------------------------------------------------------------
- bool get_tx_secret_key_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::secret_key& key)
+ bool get_tx_secret_key_from_tx_extra(const tx_extra_index& tx_extra, crypto::secret_key& key)
   {
-  std::vector<tx_extra_field> tx_extra_fields;
-  parse_tx_extra(tx_extra, tx_extra_fields);
   tx_extra_tx_secret_key seckey;
-  bool result = find_tx_extra_field_by_type(tx_extra_fields, seckey);
+  bool result = tx_extra.find(seckey);
   if (!result)
     return false;
   key = seckey.key;
   return true;
   }
   //---------------------------------------------------------------
+ bool get_tx_secret_key_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::secret_key& key)
+  {
+  return get_tx_secret_key_from_tx_extra(tx_extra_index(tx_extra), key);
+  }
+  //---------------------------------------------------------------
   void add_tx_secret_key_to_tx_extra(std::vector<uint8_t>& tx_extra, const crypto::secret_key& key)
   {
   add_data_to_tx_extra(tx_extra, reinterpret_cast<const char *>(&key), sizeof(key), TX_EXTRA_TAG_TX_SECRET_KEY);
@@ -808,10 +852,13 @@ namespace cryptonote
   //---------------------------------------------------------------
  bool get_service_node_contributor_from_tx_extra(const std::vector<uint8_t>& tx_extra, cryptonote::account_public_address& address)
  {
-   std::vector<tx_extra_field> tx_extra_fields;
-   parse_tx_extra(tx_extra, tx_extra_fields);
+   return get_service_node_contributor_from_tx_extra(tx_extra_index(tx_extra), address);
+ }
+ //---------------------------------------------------------------
+ bool get_service_node_contributor_from_tx_extra(const tx_extra_index& tx_extra, cryptonote::account_public_address& address)
+ {
    tx_extra_service_node_contributor contributor;
-   bool result = find_tx_extra_field_by_type(tx_extra_fields, contributor);
+   bool result = tx_extra.find(contributor);
    if (!result)
      return false;
    address.m_spend_public_key = contributor.m_spend_public_key;
@@ -819,14 +866,17 @@ namespace cryptonote
    return true;
  }
  //---------------------------------------------------------------
-  bool get_service_node_register_from_tx_extra(const std::vector<uint8_t>& tx_extra, tx_extra_service_node_register &registration)
+  bool get_service_node_register_from_tx_extra(const tx_extra_index& tx_extra, tx_extra_service_node_register &registration)
   {
-    std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx_extra, tx_extra_fields);
-    bool result = find_tx_extra_field_by_type(tx_extra_fields, registration);
+    bool result = tx_extra.find(registration);
     return result && registration.m_public_spend_keys.size() == registration.m_public_view_keys.size();
   }
   //---------------------------------------------------------------
+  bool get_service_node_register_from_tx_extra(const std::vector<uint8_t>& tx_extra, tx_extra_service_node_register &registration)
+  {
+    return get_service_node_register_from_tx_extra(tx_extra_index(tx_extra), registration);
+  }
+  //---------------------------------------------------------------
   bool add_service_node_register_to_tx_extra(
     std::vector<uint8_t>& tx_extra,
     const std::vector<cryptonote::account_public_address>& addresses,
@@ -876,29 +926,37 @@ namespace cryptonote
 	  add_data_to_tx_extra(tx_extra, reinterpret_cast<const char *>(&winner), sizeof(winner), TX_EXTRA_TAG_SERVICE_NODE_WINNER);
   }
   //---------------------------------------------------------------
+  bool get_service_node_deregister_from_tx_extra(const tx_extra_index& tx_extra, tx_extra_service_node_deregister &deregistration)
+  {
+	  return tx_extra.find(deregistration);
+  }
+  //---------------------------------------------------------------
   bool get_service_node_deregister_from_tx_extra(const std::vector<uint8_t>& tx_extra, tx_extra_service_node_deregister &deregistration)
   {
-	  std::vector<tx_extra_field> tx_extra_fields;
-	  parse_tx_extra(tx_extra, tx_extra_fields);
-	  bool result = find_tx_extra_field_by_type(tx_extra_fields, deregistration);
-	  return result;
+	  return get_service_node_deregister_from_tx_extra(tx_extra_index(tx_extra), deregistration);
   }
   //---------------------------------------------------------------
-  crypto::public_key get_service_node_winner_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  crypto::public_key get_service_node_winner_from_tx_extra(const tx_extra_index& tx_extra)
   {
-  std::vector<tx_extra_field> tx_extra_fields;
-  parse_tx_extra(tx_extra, tx_extra_fields);
   tx_extra_service_node_winner winner;
-  if (!find_tx_extra_field_by_type(tx_extra_fields, winner))
+  if (!tx_extra.find(winner))
     return crypto::null_pkey;
   return winner.m_service_node_key;
   }
   //---------------------------------------------------------------
+  crypto::public_key get_service_node_winner_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  {
+  return get_service_node_winner_from_tx_extra(tx_extra_index(tx_extra));
+  }
+  //---------------------------------------------------------------
+  bool get_memo_from_tx_extra(const tx_extra_index& tx_extra, cryptonote::tx_extra_memo& memo)
+  {
+    return tx_extra.find(memo);
+  }
+  //---------------------------------------------------------------
   bool get_memo_from_tx_extra(const std::vector<uint8_t>& tx_extra, cryptonote::tx_extra_memo& memo)
   {
-    std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx_extra, tx_extra_fields);
-    return find_tx_extra_field_by_type(tx_extra_fields, memo);
+    return get_memo_from_tx_extra(tx_extra_index(tx_extra), memo);
   }
   //---------------------------------------------------------------
   bool add_memo_to_tx_extra(std::vector<uint8_t>& tx_extra, cryptonote::tx_extra_memo& extra_memo)
@@ -980,17 +1038,19 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
-    uint64_t get_burned_amount_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  uint64_t get_burned_amount_from_tx_extra(const tx_extra_index& tx_extra)
   {
-    std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx_extra, tx_extra_fields);
-
     tx_extra_burn burn;
-    if (find_tx_extra_field_by_type(tx_extra_fields, burn))
+    if (tx_extra.find(burn))
       return burn.amount;
     return 0;
   }
   //---------------------------------------------------------------
+  uint64_t get_burned_amount_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  {
+    return get_burned_amount_from_tx_extra(tx_extra_index(tx_extra));
+  }
+  //---------------------------------------------------------------
   bool add_burned_amount_to_tx_extra(std::vector<uint8_t>& tx_extra, const uint64_t &burn)
   {
     tx_extra_field field = tx_extra_burn{burn};
@@ -1015,17 +1075,19 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
-  std::string get_contract_info_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  std::string get_contract_info_from_tx_extra(const tx_extra_index& tx_extra)
   {
-    std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx_extra, tx_extra_fields);
-
     tx_extra_contract_info contract_info;
-    if (find_tx_extra_field_by_type(tx_extra_fields, contract_info))
+    if (tx_extra.find(contract_info))
       return contract_info.contract_json;
     return "";
   }
   //---------------------------------------------------------------
+  std::string get_contract_info_from_tx_extra(const std::vector<uint8_t>& tx_extra)
+  {
+    return get_contract_info_from_tx_extra(tx_extra_index(tx_extra));
+  }
+  //---------------------------------------------------------------
   bool add_contract_info_to_tx_extra(std::vector<uint8_t>& tx_extra, const std::string &contract_info)
   {
     if (contract_info == "")
@@ -1656,10 +1718,10 @@ namespace cryptonote
     return res;
   }
   //---------------------------------------------------------------
-  bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash)
+  static bool parse_and_validate_block_from_blob(const blobdata_ref& b_blob, block& b, crypto::hash *block_hash)
   {
     std::stringstream ss;
-    ss << b_blob;
+    ss.write(b_blob.data(), b_blob.size());
     binary_archive<false> ba(ss);
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
@@ -1674,11 +1736,21 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash)
+  {
+    return parse_and_validate_block_from_blob(blobdata_ref{b_blob.data(), b_blob.size()}, b, block_hash);
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
   {
     return parse_and_validate_block_from_blob(b_blob, b, NULL);
   }
   //---------------------------------------------------------------
+  bool parse_and_validate_block_from_blob(const blobdata_ref& b_blob, block& b)
+  {
+    return parse_and_validate_block_from_blob(b_blob, b, NULL);
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash &block_hash)
   {
     return parse_and_validate_block_from_blob(b_blob, b, &block_hash);
@@ -76,8 +76,27 @@ namespace cryptonote
   }
 
   bool parse_tx_extra(const std::vector<uint8_t>& tx_extra, std::vector<tx_extra_field>& tx_extra_fields);
+
+  // Parses a tx_extra once so that code looking up several of its fields doesn't
+  // decode the whole extra again for each one. Parsing stops at the first field
+  // which fails to decode, as parse_tx_extra does.
+  class tx_extra_index
+  {
+  public:
+    explicit tx_extra_index(const std::vector<uint8_t>& tx_extra);
+
+    const std::vector<tx_extra_field>& fields() const { return m_fields; }
+
+    template<typename T>
+    bool find(T& field, size_t index = 0) const { return find_tx_extra_field_by_type(m_fields, field, index); }
+
+  private:
+    std::vector<tx_extra_field> m_fields;
+  };
+
   bool sort_tx_extra(const std::vector<uint8_t>& tx_extra, std::vector<uint8_t> &sorted_tx_extra, bool allow_partial = false);
   crypto::public_key get_tx_pub_key_from_extra(const std::vector<uint8_t>& tx_extra, size_t pk_index = 0);
+  crypto::public_key get_tx_pub_key_from_extra(const tx_extra_index& tx_extra, size_t pk_index = 0);
   crypto::public_key get_tx_pub_key_from_extra(const transaction_prefix& tx, size_t pk_index = 0);
   crypto::public_key get_tx_pub_key_from_extra(const transaction& tx, size_t pk_index = 0);
   void add_tx_pub_key_to_extra(transaction& tx, const crypto::public_key& tx_pub_key);
@@ -86,16 +105,22 @@ namespace cryptonote
 
   bool add_service_node_deregister_to_tx_extra(std::vector<uint8_t>& tx_extra, const tx_extra_service_node_deregister& deregistration);
   bool get_service_node_register_from_tx_extra(const std::vector<uint8_t>& tx_extra, tx_extra_service_node_register& registration);
+  bool get_service_node_register_from_tx_extra(const tx_extra_index& tx_extra, tx_extra_service_node_register& registration);
   bool get_service_node_deregister_from_tx_extra(const std::vector<uint8_t>& tx_extra, tx_extra_service_node_deregister& deregistration);
+  bool get_service_node_deregister_from_tx_extra(const tx_extra_index& tx_extra, tx_extra_service_node_deregister& deregistration);
   bool get_service_node_pubkey_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::public_key& pubkey);
+  bool get_service_node_pubkey_from_tx_extra(const tx_extra_index& tx_extra, crypto::public_key& pubkey);
   bool get_service_node_contributor_from_tx_extra(const std::vector<uint8_t>& tx_extra, cryptonote::account_public_address& address);
+  bool get_service_node_contributor_from_tx_extra(const tx_extra_index& tx_extra, cryptonote::account_public_address& address);
   bool add_service_node_register_to_tx_extra(std::vector<uint8_t>& tx_extra, const std::vector<cryptonote::account_public_address>& addresses, uint64_t portions_for_operator, const std::vector<uint64_t >& portions, uint64_t expiration_timestamp, const crypto::signature& signature);
 
   bool get_tx_secret_key_from_tx_extra(const std::vector<uint8_t>& tx_extra, crypto::secret_key& key);
+  bool get_tx_secret_key_from_tx_extra(const tx_extra_index& tx_extra, crypto::secret_key& key);
   void add_tx_secret_key_to_tx_extra(std::vector<uint8_t>& tx_extra, const crypto::secret_key& key);
 
   void add_service_node_winner_to_tx_extra(std::vector<uint8_t>& tx_extra, const crypto::public_key& winner);
   crypto::public_key get_service_node_winner_from_tx_extra(const std::vector<uint8_t>& tx_extra);
+  crypto::public_key get_service_node_winner_from_tx_extra(const tx_extra_index& tx_extra);
   void add_service_node_pubkey_to_tx_extra(std::vector<uint8_t>& tx_extra, const crypto::public_key& pubkey);
   void add_service_node_contributor_to_tx_extra(std::vector<uint8_t>& tx_extra, const cryptonote::account_public_address& address);
   std::vector<crypto::public_key> get_additional_tx_pub_keys_from_extra(const std::vector<uint8_t>& tx_extra);
@@ -112,10 +137,12 @@ namespace cryptonote
 
   bool add_burned_amount_to_tx_extra(std::vector<uint8_t>& tx_extra, const uint64_t &burn);
   uint64_t get_burned_amount_from_tx_extra(const std::vector<uint8_t>& tx_extra);
+  uint64_t get_burned_amount_from_tx_extra(const tx_extra_index& tx_extra);
   bool check_burned_amount_from_tx_extra(const std::vector<uint8_t>& tx_extra);
 
   bool add_contract_info_to_tx_extra(std::vector<uint8_t>& tx_extra, const std::string &contract_info);
   std::string get_contract_info_from_tx_extra(const std::vector<uint8_t>& tx_extra);
+  std::string get_contract_info_from_tx_extra(const tx_extra_index& tx_extra);
 
   bool is_out_to_acc(const account_keys& acc, const txout_to_key& out_key, const crypto::public_key& tx_pub_key, const std::vector<crypto::public_key>& additional_tx_public_keys, size_t output_index);
   struct subaddress_receive_info
@@ -137,6 +164,7 @@ namespace cryptonote
   std::string short_hash_str(const crypto::hash& h);
   bool add_memo_to_tx_extra(std::vector<uint8_t>& tx_extra, cryptonote::tx_extra_memo& extra_memo);
   bool get_memo_from_tx_extra(const std::vector<uint8_t>& tx_extra, cryptonote::tx_extra_memo& memo);
+  bool get_memo_from_tx_extra(const tx_extra_index& tx_extra, cryptonote::tx_extra_memo& memo);
   bool get_registration_hash(const std::vector<cryptonote::account_public_address>& addresses, uint64_t operator_portions, const std::vector<uint64_t>& portions, uint64_t expiration_timestamp, crypto::hash& hash);
 
   crypto::hash get_transaction_hash(const transaction& t);
@@ -156,6 +184,7 @@ namespace cryptonote
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash *block_hash);
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b);
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash &block_hash);
+  bool parse_and_validate_block_from_blob(const blobdata_ref& b_blob, block& b);
   bool get_inputs_money_amount(const transaction& tx, uint64_t& money);
   uint64_t get_outs_money_amount(const transaction& tx);
   bool check_inputs_types_supported(const transaction& tx);
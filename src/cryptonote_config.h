@@ -152,6 +152,9 @@ static_assert(STAKING_PORTIONS % 3 == 0, "Use a multiple of three, so that it di
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_MAX_COUNT                  2048   //must be a power of 2, greater than 128, equal to SEEDHASH_EPOCH_BLOCKS
 
+#define POW_CACHE_BLOCKS                                10000  //verified PoW hashes are kept for blocks this far below the top
+#define POW_CACHE_PRUNE_INTERVAL                        100    //blocks between removals of expired PoW cache entries
+
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    (86400*3) //seconds, three days
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
 
@@ -200,7 +203,12 @@ static_assert(STAKING_PORTIONS % 3 == 0, "Use a multiple of three, so that it di
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_SN_GOSSIP                      0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_SN_GOSSIP)
+
+#define P2P_SN_GOSSIP_INTERVAL                          2000       // ms between uptime proof and deregister vote relays
+#define P2P_SN_GOSSIP_LIFETIME                          (60*60)    // seconds an uptime proof or deregister vote is relayed for
+#define P2P_SN_GOSSIP_MAX_ITEMS                         20000      // uptime proofs and deregister votes held for relaying
 
 #define RPC_IP_FAILS_BEFORE_BLOCK                       3
 
@@ -232,10 +240,13 @@ static_assert(STAKING_PORTIONS % 3 == 0, "Use a multiple of three, so that it di
 #define HF_VERSION_EFFECTIVE_SHORT_TERM_MEDIAN_IN_PENALTY 100
 
 #define HF_VERSION_FEE_BURNING                  9
+#define HF_VERSION_SWARM_INDEX                  100 // swarm_index's tie-breaks differ from older nodes' swarm assignment
 
 #define PER_KB_FEE_QUANTIZATION_DECIMALS        4
 
 #define HASH_OF_HASHES_STEP                     512
+#define FAST_SYNC_FILE_MAGIC                    "xeqfsync" // block hashes file which also covers tx hashes
+#define FAST_SYNC_FILE_VERSION                  1
 
 #define DEFAULT_TXPOOL_MAX_WEIGHT               648000000ull // 3 days at 300000, in bytes
 
@@ -90,7 +90,8 @@ DISABLE_VS_WARNINGS(4267)
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool, service_nodes::service_node_list& service_node_list, service_nodes::deregister_vote_pool& deregister_vote_pool) :
   m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_reset_timestamps_and_difficulties_height(true), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(0), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0),
+  m_pow_cache_hits(0), m_pow_cache_misses(0), m_cancel(false),
   m_long_term_block_weights_window(CRYPTONOTE_LONG_TERM_BLOCK_WEIGHT_WINDOW_SIZE),
   m_long_term_effective_median_block_weight(0),
   m_long_term_block_weights_cache_tip_hash(crypto::null_hash),
@@ -100,7 +101,8 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool, service_nodes::service_node_list
   m_service_node_list(service_node_list),
   m_deregister_vote_pool(deregister_vote_pool),
   m_btc_valid(false),
-  m_batch_success(true)
+  m_batch_success(true),
+  m_batch_start_time(0), m_sync_in_flight(false), m_sync_failed(false), m_commit_stats()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -446,6 +448,8 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
       return false;
   }
 
+  m_output_distribution.init(m_db);
+
   for (InitHook* hook : m_init_hooks) hook->init();
 
   return true;
@@ -488,9 +492,63 @@ bool Blockchain::store_blockchain()
   TIME_MEASURE_FINISH(save);
   if(m_show_time_stats)
     MINFO("Blockchain stored OK, took: " << save << " ms");
+  {
+    boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+    m_commit_stats.sync_time += save;
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::start_background_sync()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+    if (m_sync_in_flight)
+      return false;
+    m_sync_in_flight = true;
+  }
+  m_async_service.dispatch(boost::bind(&Blockchain::background_sync, this));
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::background_sync()
+{
+  bool failed = false;
+  try
+  {
+    store_blockchain();
+  }
+  catch (...)
+  {
+    // already logged, and reported to the thread adding blocks
+    failed = true;
+  }
+
+  boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+  m_sync_in_flight = false;
+  m_sync_failed = m_sync_failed || failed;
+  m_sync_cond.notify_all();
+}
+//------------------------------------------------------------------
+bool Blockchain::wait_for_background_sync()
+{
+  TIME_MEASURE_START(wait);
+  boost::unique_lock<boost::mutex> lock(m_sync_mutex);
+  while (m_sync_in_flight)
+    m_sync_cond.wait(lock);
+  TIME_MEASURE_FINISH(wait);
+  m_commit_stats.sync_wait_time += wait;
+  const bool synced = !m_sync_failed;
+  m_sync_failed = false;
+  return synced;
+}
+//------------------------------------------------------------------
+Blockchain::db_commit_stats Blockchain::get_commit_stats() const
+{
+  boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+  return m_commit_stats;
+}
+//------------------------------------------------------------------
 bool Blockchain::deinit()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -498,7 +556,7 @@ bool Blockchain::deinit()
 
   MTRACE("Stopping blockchain read/write activity");
 
- // stop async service
+ // stop async service, after it has run a flush still queued
   m_async_work_idle.reset();
   m_async_pool.join_all();
   m_async_service.stop();
@@ -592,6 +650,7 @@ block Blockchain::pop_block_from_blockchain()
   try
   {
     m_db->pop_block(popped_block, popped_txs);
+    m_output_distribution.block_popped(m_db->height(), popped_block, popped_txs);
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
@@ -1864,7 +1923,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     crypto::hash proof_of_work = crypto::null_hash;
     memset(proof_of_work.data, 0xff, sizeof(proof_of_work.data));
 
-    get_block_longhash(bei.bl, proof_of_work, m_pow_ctx);
+    const bool pow_cached = get_cached_block_longhash(bei.bl, id, bei.height, proof_of_work, m_pow_ctx);
 
     if(!check_hash(proof_of_work, current_diff))
     {
@@ -1873,6 +1932,8 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
       bvc.m_bad_pow = true;
       return false;
     }
+    if (!pow_cached)
+      m_db->add_pow_cache_entry(bei.height, id, proof_of_work);
 
     if(!prevalidate_miner_transaction(b, bei.height, hf_version))
     {
@@ -2045,12 +2106,34 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   db_rtxn_guard rtxn_guard (m_db);
   rsp.current_blockchain_height = get_current_blockchain_height();
-  std::vector<std::pair<cryptonote::blobdata,block>> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
 
-  for (size_t i = 0; i < blocks.size(); ++i)
+  // blobs are only copied out of the db into the response
+  rsp.blocks.reserve(arg.blocks.size());
+  for (const crypto::hash &block_hash: arg.blocks)
   {
-    auto& bl = blocks[i];
+    uint64_t height = 0;
+    std::pair<blobdata_ref, block> bl;
+    try
+    {
+      if (!m_db->block_exists(block_hash, &height))
+      {
+        rsp.missed_ids.push_back(block_hash);
+        continue;
+      }
+      m_db->get_block_blob_view(height, bl.first);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Error getting block " << block_hash << " for a peer: " << e.what());
+      return false;
+    }
+    if (!parse_and_validate_block_from_blob(bl.first, bl.second))
+    {
+      LOG_ERROR("Invalid block: " << block_hash);
+      rsp.missed_ids.push_back(block_hash);
+      continue;
+    }
+
     std::vector<crypto::hash> missed_tx_ids;
 
     rsp.blocks.push_back(block_complete_entry());
@@ -2080,10 +2163,8 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
     }
 
     //pack block
-    e.block = std::move(bl.first);
-    e.block_weight = 0;
-    if (arg.prune && m_db->block_exists(arg.blocks[i]))
-      e.block_weight = m_db->get_block_weight(m_db->get_block_height(arg.blocks[i]));
+    e.block.assign(bl.first.data(), bl.first.size());
+    e.block_weight = arg.prune ? m_db->get_block_weight(height) : 0;
   }
 
   return true;
@@ -2159,40 +2240,36 @@ crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_i
 }
 std::vector<uint64_t> Blockchain::get_random_outputs(uint64_t amount, uint64_t count) const
 {
-	uint64_t num_outs = get_num_mature_outputs(amount);
-
 	std::vector<uint64_t> indices;
+	std::vector<output_data_t> outputs;
+	pick_random_outputs(amount, get_num_mature_outputs(amount), count, indices, outputs);
+	return indices;
+}
+//------------------------------------------------------------------
+void Blockchain::pick_random_outputs(uint64_t amount, uint64_t num_outs, uint64_t count, std::vector<uint64_t> &indices, std::vector<output_data_t> &outputs) const
+{
+	indices.clear();
+	outputs.clear();
 
-	std::unordered_set<uint64_t> seen_indices;
+	std::vector<std::pair<uint64_t, uint64_t>> keys;
+	std::vector<output_data_t> data;
 
 	// if there aren't enough outputs to mix with (or just enough),
 	// use all of them.  Eventually this should become impossible.
 	if (num_outs <= count)
 	{
+		keys.reserve(num_outs);
 		for (uint64_t i = 0; i < num_outs; i++)
-		{ 
-			// if tx is unlocked, add output to indices
-			if (is_output_spendtime_unlocked(m_db->get_output_unlock_time(amount, i)))
-			{
-				indices.push_back(i);
-			}
-		}
+			keys.emplace_back(amount, i);
 	}
-	else
+
+	std::unordered_set<uint64_t> seen_indices;
+	while (true)
 	{
-		// while we still need more mixins
-		while (indices.size() < count)
+		// draw as many new outputs as are still needed. If we've gone through
+		// every possible output, we've gotten all we can
+		while (num_outs > count && indices.size() + keys.size() < count && seen_indices.size() < num_outs)
 		{
-			// if we've gone through every possible output, we've gotten all we can
-			if (seen_indices.size() == num_outs)
-			{
-				break;
-			}
-
-			// get a random output index from the DB.  If we've already seen it,
-			// return to the top of the loop and try again, otherwise add it to the
-			// list of output indices we've seen.
-
 			// triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
 			uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
 			double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
@@ -2201,22 +2278,25 @@ std::vector<uint64_t> Blockchain::get_random_outputs(uint64_t amount, uint64_t c
 			if (i == num_outs)
 				--i;
 
-			if (seen_indices.count(i))
-			{
-				continue;
-			}
-			seen_indices.emplace(i);
+			if (seen_indices.emplace(i).second)
+				keys.emplace_back(amount, i);
+		}
+		if (keys.empty())
+			break;
 
-			// if the output's transaction is unlocked, add the output's index to
-			// our list.
-			if (is_output_spendtime_unlocked(m_db->get_output_unlock_time(0, i)))
+		// read them all at once, and keep those whose transaction is unlocked.
+		// Draw again for the locked ones
+		m_db->get_output_keys(keys, data);
+		for (size_t n = 0; n < keys.size(); ++n)
+		{
+			if (is_output_spendtime_unlocked(data[n].unlock_time))
 			{
-				indices.push_back(i);
+				indices.push_back(keys[n].second);
+				outputs.push_back(data[n]);
 			}
 		}
+		keys.clear();
 	}
-
-	return indices;
 }
 
 //------------------------------------------------------------------
@@ -2237,14 +2317,16 @@ bool Blockchain::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUT
 		COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
 		result_outs.amount = amount;
 
-		std::vector<uint64_t> indices = get_random_outputs(amount, req.outs_count);
+		std::vector<uint64_t> indices;
+		std::vector<output_data_t> outputs;
+		pick_random_outputs(amount, get_num_mature_outputs(amount), req.outs_count, indices, outputs);
 
-		for (auto i : indices)
+		for (size_t n = 0; n < indices.size(); ++n)
 		{
 			COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oe = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
 
-			oe.global_amount_index = i;
-			oe.out_key = get_output_key(amount, i);
+			oe.global_amount_index = indices[n];
+			oe.out_key = outputs[n].pubkey;
 		}
 	}
 	return true;
@@ -2274,71 +2356,20 @@ bool Blockchain::get_random_rct_outs(const COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::r
 	LOG_PRINT_L3("Blockchain::" << __func__);
 	CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-	// for each amount that we need to get mixins for, get <n> random outputs
-	// from BlockchainDB where <n> is req.outs_count (number of mixins).
-	auto num_outs = m_db->get_num_outputs(0);
 	// ensure we don't include outputs that aren't yet eligible to be used
-	// outpouts are sorted by height
-	while (num_outs > 0)
-	{
-		const tx_out_index toi = m_db->get_output_tx_and_index(0, num_outs - 1);
-		const uint64_t height = m_db->get_tx_block_height(toi.first);
-		if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= m_db->height())
-			break;
-		--num_outs;
-	}
+	const uint64_t num_outs = get_num_mature_outputs(0);
 
-	std::unordered_set<uint64_t> seen_indices;
+	std::vector<uint64_t> indices;
+	std::vector<output_data_t> outputs;
+	pick_random_outputs(0, num_outs, req.outs_count, indices, outputs);
 
-	// if there aren't enough outputs to mix with (or just enough),
-	// use all of them.  Eventually this should become impossible.
-	if (num_outs <= req.outs_count)
+	for (size_t n = 0; n < indices.size(); ++n)
 	{
-		for (uint64_t i = 0; i < num_outs; i++)
-		{
-			// if tx is unlocked, add output to result_outs
-			if (is_output_spendtime_unlocked(m_db->get_output_unlock_time(0, i)))
-			{
-				add_out_to_get_rct_random_outs(res.outs, 0, i);
-			}
-		}
-	}
-	else
-	{
-		// while we still need more mixins
-		while (res.outs.size() < req.outs_count)
-		{
-			// if we've gone through every possible output, we've gotten all we can
-			if (seen_indices.size() == num_outs)
-			{
-				break;
-			}
-
-			// get a random output index from the DB.  If we've already seen it,
-			// return to the top of the loop and try again, otherwise add it to the
-			// list of output indices we've seen.
-
-			// triangular distribution over [a,b) with a=0, mode c=b=up_index_limit
-			uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
-			double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
-			uint64_t i = (uint64_t)(frac*num_outs);
-			// just in case rounding up to 1 occurs after sqrt
-			if (i == num_outs)
-				--i;
-
-			if (seen_indices.count(i))
-			{
-				continue;
-			}
-			seen_indices.emplace(i);
-
-			// if the output's transaction is unlocked, add the output's index to
-			// our list.
-			if (is_output_spendtime_unlocked(m_db->get_output_unlock_time(0, i)))
-			{
-				add_out_to_get_rct_random_outs(res.outs, 0, i);
-			}
-		}
+		COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry& oen = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry());
+		oen.amount = 0;
+		oen.global_amount_index = indices[n];
+		oen.out_key = outputs[n].pubkey;
+		oen.commitment = outputs[n].commitment;
 	}
 
 	if (res.outs.size() < req.outs_count)
@@ -2388,15 +2419,11 @@ bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMA
   std::vector<cryptonote::output_data_t> data;
   try
   {
-    std::vector<uint64_t> amounts, offsets;
-    amounts.reserve(req.outputs.size());
-    offsets.reserve(req.outputs.size());
+    std::vector<std::pair<uint64_t, uint64_t>> keys;
+    keys.reserve(req.outputs.size());
     for (const auto &i: req.outputs)
-    {
-      amounts.push_back(i.amount);
-      offsets.push_back(i.index);
-    }
-    m_db->get_output_key(epee::span<const uint64_t>(amounts.data(), amounts.size()), offsets, data);
+      keys.emplace_back(i.amount, i.index);
+    m_db->get_output_keys(keys, data);
     if (data.size() != req.outputs.size())
     {
       MERROR("Unexpected output data size: expected " << req.outputs.size() << ", got " << data.size());
@@ -2431,6 +2458,9 @@ void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint
 //------------------------------------------------------------------
 bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
 {
+  if (m_output_distribution.get(amount, from_height, to_height, start_height, distribution, base))
+    return true;
+
   start_height = 0;
   base = 0;
 
@@ -2603,21 +2633,24 @@ static bool fill(BlockchainDB *db, const crypto::hash &tx_hash, cryptonote::blob
 //------------------------------------------------------------------
 static bool fill(BlockchainDB *db, const crypto::hash &tx_hash, tx_blob_entry &tx, bool pruned)
 {
-  if (!fill(db, tx_hash, tx.blob, pruned))
+  // the blob is copied out of the db once, whole, so the caller must hold a read txn
+  tx_blob_view view;
+  if (!db->get_tx_blob_view(tx_hash, view, pruned))
+  {
+    MDEBUG((pruned ? "Pruned transaction" : "Transaction") << " blob not found for " << tx_hash);
     return false;
+  }
+  tx.prunable_hash = crypto::null_hash;
   if (pruned)
   {
-    if (is_v1_tx(tx.blob))
+    if (is_v1_tx(view.pruned))
     {
       // v1 txes aren't pruned, so fetch the whole thing
-      cryptonote::blobdata prunable_blob;
-      if (!db->get_prunable_tx_blob(tx_hash, prunable_blob))
+      if (!db->get_tx_blob_view(tx_hash, view, false))
       {
         MDEBUG("Prunable transaction blob not found for " << tx_hash);
         return false;
       }
-      tx.blob.append(prunable_blob);
-      tx.prunable_hash = crypto::null_hash;
     }
     else
     {
@@ -2628,6 +2661,7 @@ static bool fill(BlockchainDB *db, const crypto::hash &tx_hash, tx_blob_entry &t
       }
     }
   }
+  view.copy_to(tx.blob);
   return true;
 }
 //------------------------------------------------------------------
@@ -2661,6 +2695,7 @@ bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>& txs_ids
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
 
   txs.reserve(txs_ids.size());
   for (const auto& tx_hash : txs_ids)
@@ -3074,6 +3109,66 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::check_txs_inputs(std::vector<tx_inputs_check> &checks) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  PERF_TIMER(check_txs_inputs);
+
+  std::vector<std::vector<const rct::rctSig*>> rct_sigs(checks.size());
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    const uint64_t height = m_db->height();
+    tools::threadpool::waiter waiter;
+    for (size_t n = 0; n < checks.size(); ++n)
+    {
+      tpool.submit(&waiter, [this, &checks, &rct_sigs, height, n]() {
+        tx_inputs_check &check = checks[n];
+        check.max_used_block_height = 0;
+        check.max_used_block_id = crypto::null_hash;
+        check.tvc = tx_verification_context{};
+        try
+        {
+          db_rtxn_guard rtxn_guard(m_db);
+          check.valid = check_tx_inputs(*check.tx, check.tvc, &check.max_used_block_height, &rct_sigs[n]);
+          if (check.valid)
+          {
+            CHECK_AND_ASSERT_THROW_MES(check.max_used_block_height < height, "internal error: max used block index=" << check.max_used_block_height << " is not less then blockchain size = " << height);
+            check.max_used_block_id = m_db->get_block_hash_from_height(check.max_used_block_height);
+          }
+        }
+        catch (const std::exception &e)
+        {
+          MERROR_VER("Failed to check inputs of tx " << get_transaction_hash(*check.tx) << ": " << e.what());
+          check.valid = false;
+        }
+        if (!check.valid)
+          rct_sigs[n].clear();
+      });
+    }
+    waiter.wait(&tpool);
+  }
+
+  // the MLSAGs don't depend on the chain once the ring members are known, so
+  // they're left until blocks can be added again
+  std::vector<const rct::rctSig*> all_rct_sigs;
+  for (const auto &sigs: rct_sigs)
+    all_rct_sigs.insert(all_rct_sigs.end(), sigs.begin(), sigs.end());
+  if (all_rct_sigs.empty() || rct::verRctNonSemanticsSimple(all_rct_sigs))
+    return;
+
+  LOG_PRINT_L1("One transaction among this group has bad ringct signatures, verifying one at a time");
+  for (size_t n = 0; n < checks.size(); ++n)
+  {
+    if (rct_sigs[n].empty() || rct::verRctNonSemanticsSimple(rct_sigs[n]))
+      continue;
+    MERROR_VER("Failed to check ringct signatures of tx " << get_transaction_hash(*checks[n].tx));
+    checks[n].valid = false;
+    checks[n].max_used_block_height = 0;
+    checks[n].max_used_block_id = crypto::null_hash;
+  }
+}
+//------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3265,7 +3360,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height) const
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, std::vector<const rct::rctSig*>* deferred_rct_sigs) const
 {
 	PERF_TIMER(check_tx_inputs);
 	LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3554,7 +3649,9 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 				}
 			}
 
-			if (!rct::verRctNonSemanticsSimple(rv))
+			if (deferred_rct_sigs)
+				deferred_rct_sigs->push_back(&rv);
+			else if (!rct::verRctNonSemanticsSimple(rv))
 			{
 				MERROR_VER("Failed to check ringct signatures!");
 				return false;
@@ -3675,7 +3772,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 			MERROR_VER("tx " << get_transaction_hash(tx) << ": version 3 deregister_tx could not be completely verified reason: " << print_vote_verification_context(tvc.m_vote_ctx));
 			return false;
 		}
-    const auto deregister_lifetime = hf_version >= 8 ? service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT_V2 : service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT;
+    const uint64_t deregister_lifetime = service_nodes::get_deregister_lifetime(hf_version);
 
 		// Check if deregister is too old or too new to hold onto
 		{
@@ -4196,14 +4293,16 @@ leave:
 #endif
   if (!fast_check)
   {
+    bool pow_cached;
     auto it = m_blocks_longhash_table.find(id);
     if (it != m_blocks_longhash_table.end())
     {
       precomputed = true;
-      proof_of_work = it->second;
+      proof_of_work = it->second.first;
+      pow_cached = it->second.second;
     }
     else
-      get_block_longhash(bl, proof_of_work, m_pow_ctx);
+      pow_cached = get_cached_block_longhash(bl, id, blockchain_height, proof_of_work, m_pow_ctx);
 
 
     // validate proof_of_work versus difficulty target
@@ -4214,6 +4313,8 @@ leave:
       bvc.m_bad_pow = true;
       goto leave;
     }
+    if (!pow_cached)
+      m_db->add_pow_cache_entry(blockchain_height, id, proof_of_work);
   }
 
   // If we're at a checkpoint, ensure that our hardcoded checkpoint hash
@@ -4246,6 +4347,7 @@ leave:
   size_t cumulative_block_weight = coinbase_weight;
 
   std::vector<std::pair<transaction, blobdata>> txs;
+  std::vector<const rct::rctSig*> rct_sigs;
   key_images_container keys;
 
   uint64_t fee_summary = 0;
@@ -4328,7 +4430,7 @@ leave:
     {
       // validate that transaction inputs and the keys spending them are correct.
       tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      if(!check_tx_inputs(tx, tvc, NULL, &rct_sigs))
       {
         MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
 
@@ -4365,6 +4467,24 @@ leave:
     cumulative_block_weight += tx_weight;
   }
 
+  // the MLSAGs of all the block's transactions are left to here, so the
+  // threadpool gets all of them at once rather than one tx's inputs at a time
+  if (!rct_sigs.empty())
+  {
+    TIME_MEASURE_START(cc);
+    if (!rct::verRctNonSemanticsSimple(rct_sigs))
+    {
+      MERROR_VER("Block with id: " << id << " has at least one transaction with invalid ringct signatures.");
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verification_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+    TIME_MEASURE_FINISH(cc);
+    t_checktx += cc;
+  }
+
   if (n_pruned > 0)
   {
     if (blockchain_height >= m_blocks_hash_check.size() || m_blocks_hash_check[blockchain_height].second == 0)
@@ -4425,6 +4545,8 @@ leave:
       uint64_t long_term_block_weight = get_next_long_term_block_weight(block_weight);
       cryptonote::blobdata bd = cryptonote::block_to_blob(bl);
       new_height = m_db->add_block(std::make_pair(std::move(bl), std::move(bd)), block_weight, long_term_block_weight, cumulative_difficulty, already_generated_coins, txs);
+      if (new_height % POW_CACHE_PRUNE_INTERVAL == 0 && new_height > POW_CACHE_BLOCKS)
+        m_db->remove_pow_cache_entries(0, new_height - POW_CACHE_BLOCKS);
     }
     catch (const KEY_IMAGE_EXISTS& e)
     {
@@ -4454,6 +4576,8 @@ leave:
   for(std::pair<transaction, blobdata> const &tx_pair : txs)
     xeq_txs.push_back(tx_pair.first);
 
+  m_output_distribution.block_added(new_height - 1, bl, xeq_txs);
+
   for (BlockAddedHook* hook : m_block_added_hooks)
     hook->block_added(bl, xeq_txs);
   TIME_MEASURE_FINISH(addblock);
@@ -4731,21 +4855,66 @@ void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
 }
 
 //------------------------------------------------------------------
-void Blockchain::block_longhash_worker(cn_gpu_hash &hash_ctx, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const
+void Blockchain::prepare_blocks_worker(prepare_blocks_context &context) const
 {
-  TIME_MEASURE_START(t);
+  for (size_t i = context.next_block++; i < context.entries.size(); i = context.next_block++)
+  {
+    if (m_cancel || context.failed)
+      break;
 
-	for(const auto &block : blocks)
-	{
-		if(m_cancel)
-			break;
-		crypto::hash id = get_block_hash(block);
-		crypto::hash pow;
-		get_block_longhash(block, pow, hash_ctx);
-		map.emplace(id, pow);
-	}
+    const block_complete_entry &entry = context.entries[i];
+    if (i > 0 && !parse_and_validate_block_from_blob(entry.block, context.blocks[i], context.ids[i]))
+    {
+      context.failed = true;
+      break;
+    }
+
+    // a tx that fails here is reported by the scan table, as before
+    for (size_t n = 0; n < entry.txs.size(); ++n)
+    {
+      std::pair<transaction, crypto::hash> &tx = context.txes[context.tx_offsets[i] + n];
+      if (parse_and_validate_tx_base_from_blob(entry.txs[n].blob, tx.first))
+      {
+        get_transaction_prefix_hash(tx.first, tx.second);
+        context.tx_parsed[context.tx_offsets[i] + n] = 1;
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------
+void Blockchain::prepare_blocks_longhash_worker(cn_gpu_hash &hash_ctx, prepare_blocks_context &context) const
+{
+  for (size_t i = context.next_block++; i < context.entries.size(); i = context.next_block++)
+  {
+    if (m_cancel)
+      break;
 
-	TIME_MEASURE_FINISH(t);
+    if (context.use_pow_cache)
+      context.pows_cached[i] = get_cached_block_longhash(context.blocks[i], context.ids[i], context.start_height + i, context.pows[i], hash_ctx);
+    else
+      get_block_longhash(context.blocks[i], context.pows[i], hash_ctx);
+  }
+}
+
+//------------------------------------------------------------------
+bool Blockchain::get_cached_block_longhash(const block &b, const crypto::hash &id, uint64_t height, crypto::hash &pow, cn_gpu_hash &hash_ctx) const
+{
+  if (m_db->get_pow_cache_entry(height, id, pow))
+  {
+    ++m_pow_cache_hits;
+    return true;
+  }
+  ++m_pow_cache_misses;
+  get_block_longhash(b, pow, hash_ctx);
+  return false;
+}
+
+//------------------------------------------------------------------
+void Blockchain::get_pow_cache_stats(uint64_t &hits, uint64_t &misses) const
+{
+  hits = m_pow_cache_hits;
+  misses = m_pow_cache_misses;
 }
 
 //------------------------------------------------------------------
@@ -4757,9 +4926,26 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
   TIME_MEASURE_START(t1);
 
+  if (m_batch_start_time)
+  {
+    const uint64_t validate = epee::misc_utils::get_tick_count() - m_batch_start_time;
+    m_batch_start_time = 0;
+    boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+    ++m_commit_stats.batches;
+    m_commit_stats.validate_time += validate;
+  }
+
+  // in sync mode, the previous batch's flush overlapped this batch's checks,
+  // but has to be on disk before this batch is committed, and this batch
+  // isn't committed on top of one which failed to
+  bool synced = m_db_sync_mode != db_sync || wait_for_background_sync();
+  if (!synced)
+    MERROR("Failed to sync the blockchain db, aborting the batch");
+
+  TIME_MEASURE_START(write);
   try
   {
-    if (m_batch_success)
+    if (m_batch_success && synced)
     {
       m_db->batch_stop();
       if (m_reset_timestamps_and_difficulties_height)
@@ -4776,27 +4962,47 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   {
     MERROR("Exception in cleanup_handle_incoming_blocks: " << e.what());
   }
+  TIME_MEASURE_FINISH(write);
+  {
+    boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+    m_commit_stats.write_time += write;
+  }
+
+  // a failed flush from the async thread is reported on the next batch
+  if (m_db_sync_mode == db_async)
+  {
+    boost::lock_guard<boost::mutex> lock(m_sync_mutex);
+    synced = !m_sync_failed;
+    m_sync_failed = false;
+    if (!synced)
+      MERROR("Failed to sync the blockchain db");
+  }
+  if (!synced)
+    success = false;
 
   if (success && m_sync_counter > 0)
   {
     if (force_sync)
     {
       if(m_db_sync_mode != db_nosync)
+      {
+        wait_for_background_sync();
         store_blockchain();
+      }
       m_sync_counter = 0;
     }
     else if (m_db_sync_threshold && ((m_db_sync_on_blocks && m_sync_counter >= m_db_sync_threshold) || (!m_db_sync_on_blocks && m_bytes_to_sync >= m_db_sync_threshold)))
     {
-      MDEBUG("Sync threshold met, syncing");
-      if(m_db_sync_mode == db_async)
-      {
-        m_sync_counter = 0;
-        m_bytes_to_sync = 0;
-        m_async_service.dispatch(boost::bind(&Blockchain::store_blockchain, this));
-      }
-      else if(m_db_sync_mode == db_sync)
+      // both modes flush on the async thread, while the next batch is checked.
+      // In async mode, a flush still running is left to cover this batch too
+      if(m_db_sync_mode == db_async || m_db_sync_mode == db_sync)
       {
-        store_blockchain();
+        if (start_background_sync())
+        {
+          MDEBUG("Sync threshold met, syncing");
+          m_sync_counter = 0;
+          m_bytes_to_sync = 0;
+        }
       }
       else // db_nosync
       {
@@ -4805,6 +5011,13 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
     }
   }
 
+  if (m_show_time_stats)
+  {
+    const db_commit_stats stats = get_commit_stats();
+    MINFO("Batch committed in " << write << " ms; totals over " << stats.batches << " batches: validate " << stats.validate_time
+        << " ms, write " << stats.write_time << " ms, sync " << stats.sync_time << " ms, waiting for sync " << stats.sync_wait_time << " ms");
+  }
+
   TIME_MEASURE_FINISH(t1);
   m_blocks_longhash_table.clear();
   m_scan_table.clear();
@@ -4816,6 +5029,8 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
     MINFO("Dumping block hashes, we're now 4k past " << m_blocks_hash_check.size());
     m_blocks_hash_check.clear();
     m_blocks_hash_check.shrink_to_fit();
+    m_blocks_txs_hash_of_hashes.clear();
+    m_fast_sync_txs.clear();
   }
 
   CRITICAL_REGION_END();
@@ -4961,6 +5176,115 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   return usable;
 }
 
+bool Blockchain::prepare_fast_sync_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks)
+{
+  const uint64_t height = m_db->height();
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+
+  // parsed here on all threads, so adding them only has to check them
+  blocks.resize(blocks_entry.size());
+  std::vector<crypto::hash> ids(blocks_entry.size());
+  std::atomic<bool> failed(false);
+  for (size_t i = 0; i < blocks_entry.size(); ++i)
+  {
+    tpool.submit(&waiter, [&, i]() {
+      if (!parse_and_validate_block_from_blob(blocks_entry[i].block, blocks[i], ids[i]))
+        failed = true;
+    });
+  }
+  waiter.wait(&tpool);
+  if (failed)
+  {
+    MERROR_VER("Failed to parse a block at height " << height << " or above");
+    blocks.clear();
+    return false;
+  }
+  if (blocks.front().prev_id != m_db->top_block_hash())
+  {
+    MDEBUG("Skipping prepare blocks. New blocks don't belong to chain.");
+    blocks.clear();
+    return true;
+  }
+
+  if (m_blocks_txs_hash_of_hashes.empty())
+    return true;
+
+  // The tx hashes of a group are checked once the span ending it arrives,
+  // and each group the span ends is hashed on its own thread. Blocks don't
+  // have to come in the same spans each time, so the tx hashes are kept by
+  // height, and read back from the db for blocks added before a restart.
+  const uint64_t first_group = height / HASH_OF_HASHES_STEP;
+  m_fast_sync_txs.erase(m_fast_sync_txs.begin(), m_fast_sync_txs.lower_bound(first_group * HASH_OF_HASHES_STEP));
+  for (size_t i = 0; i < blocks.size(); ++i)
+    m_fast_sync_txs[height + i] = blocks[i].tx_hashes;
+
+  std::vector<uint64_t> groups;
+  for (uint64_t n = first_group; (n + 1) * HASH_OF_HASHES_STEP <= height + blocks.size(); ++n)
+    if (n < m_blocks_txs_hash_of_hashes.size() && m_blocks_txs_hash_of_hashes[n] != crypto::null_hash)
+      groups.push_back(n);
+  if (groups.empty())
+    return true;
+
+  try
+  {
+    for (uint64_t h = groups.front() * HASH_OF_HASHES_STEP; h < height; ++h)
+      if (m_fast_sync_txs.find(h) == m_fast_sync_txs.end())
+        m_fast_sync_txs[h] = m_db->get_block_from_height(h).tx_hashes;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to read the tx hashes of blocks below " << height << ": " << e.what());
+    return true;
+  }
+
+  std::vector<char> valid(groups.size(), 0);
+  for (size_t g = 0; g < groups.size(); ++g)
+  {
+    tpool.submit(&waiter, [&, g]() {
+      const uint64_t start = groups[g] * HASH_OF_HASHES_STEP;
+      std::vector<crypto::hash> tx_hashes;
+      for (uint64_t h = start; h < start + HASH_OF_HASHES_STEP; ++h)
+      {
+        const std::vector<crypto::hash> &block_tx_hashes = m_fast_sync_txs.find(h)->second;
+        tx_hashes.insert(tx_hashes.end(), block_tx_hashes.begin(), block_tx_hashes.end());
+      }
+      valid[g] = get_txs_hash_of_hashes(tx_hashes) == m_blocks_txs_hash_of_hashes[groups[g]];
+    });
+  }
+  waiter.wait(&tpool);
+
+  for (size_t g = 0; g < groups.size(); ++g)
+  {
+    const uint64_t start = groups[g] * HASH_OF_HASHES_STEP;
+    if (!valid[g])
+    {
+      for (uint64_t h = std::max(start, height); h < start + HASH_OF_HASHES_STEP; ++h)
+      {
+        if (ids[h - height] != m_blocks_hash_check[h].first)
+        {
+          MERROR_VER("Block with id " << ids[h - height] << " at height " << h << " does not match the expected hash");
+          blocks.clear();
+          return false;
+        }
+      }
+
+      // block ids commit to their tx hashes, so with the expected ids it's
+      // the file which disagrees with itself: it isn't trusted any further,
+      // and blocks from this group on are verified in full
+      MERROR("Transactions of blocks " << start << " - " << (start + HASH_OF_HASHES_STEP - 1) << " do not match the fast sync file, which disagrees with its block hashes; rejecting the file and verifying blocks from height " << start << " in full");
+      m_blocks_hash_of_hashes.resize(groups[g]);
+      m_blocks_hash_check.resize(start);
+      m_blocks_txs_hash_of_hashes.clear();
+      m_fast_sync_txs.clear();
+      return true;
+    }
+    MDEBUG("Transactions of blocks " << start << " - " << (start + HASH_OF_HASHES_STEP - 1) << " match the fast sync file");
+  }
+  m_fast_sync_txs.erase(m_fast_sync_txs.begin(), m_fast_sync_txs.lower_bound((groups.back() + 1) * HASH_OF_HASHES_STEP));
+  return true;
+}
+
 bool Blockchain::has_block_weights(uint64_t height, uint64_t nblocks) const
 {
   CHECK_AND_ASSERT_MES(nblocks > 0, false, "nblocks is 0");
@@ -4975,7 +5299,7 @@ bool Blockchain::has_block_weights(uint64_t height, uint64_t nblocks) const
 
 //------------------------------------------------------------------
 // ND: Speedups:
-// 1. Thread long_hash computations if possible (m_max_prepare_blocks_threads = nthreads, default = 4)
+// 1. Parse blocks and txes and compute long_hashes in one threaded stage (m_max_prepare_blocks_threads = nthreads, default = 0 = all)
 // 2. Group all amounts (from txs) and related absolute offsets and form a table of tx_prefix_hash
 //    vs [k_image, output_keys] (m_scan_table). This is faster because it takes advantage of bulk queries
 //    and is threaded if possible. The table (m_scan_table) will be used later when querying output
@@ -5027,108 +5351,103 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     m_blockchain_lock.lock();
   }
   m_batch_success = true;
+  m_batch_start_time = epee::misc_utils::get_tick_count();
 
   const uint64_t height = m_db->height();
   if ((height + blocks_entry.size()) < m_blocks_hash_check.size())
-    return true;
+    return prepare_fast_sync_blocks(blocks_entry, blocks);
 
   bool blocks_exist = false;
   tools::threadpool& tpool = tools::threadpool::getInstance();
   unsigned threads = tpool.get_max_concurrency();
   blocks.resize(blocks_entry.size());
+  std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
 
-  if (1)
+  // parsing, hashing and the tx pre-parse all happen in one parallel stage,
+  // 0 threads meaning as many as the hardware has
+  if (m_max_prepare_blocks_threads > 0 && threads > m_max_prepare_blocks_threads)
+    threads = m_max_prepare_blocks_threads;
+  if (threads > blocks_entry.size())
+    threads = blocks_entry.size();
+  MDEBUG("prepare blocks threads: " << threads);
+
+  // the workers may only look blocks up in the PoW cache if the db can be
+  // read from other threads
+  prepare_blocks_context context{blocks_entry, blocks, {}, {}, {}, {}, txes, {}, {0}, {false}, height, m_db->can_thread_bulk_indices()};
+  context.ids.resize(blocks_entry.size());
+  context.pows.resize(blocks_entry.size());
+  context.pows_cached.resize(blocks_entry.size(), 0);
+  context.tx_parsed.resize(total_txs, 0);
+  size_t tx_offset = 0;
+  for (const auto &entry : blocks_entry)
   {
-    // limit threads, default limit = 4
-    if(threads > m_max_prepare_blocks_threads)
-      threads = m_max_prepare_blocks_threads;
+    context.tx_offsets.push_back(tx_offset);
+    tx_offset += entry.txs.size();
+  }
 
-    unsigned int batches = blocks_entry.size() / threads;
-    unsigned int extra = blocks_entry.size() % threads;
-    MDEBUG("block_batches: " << batches);
-    std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
-    auto it = blocks_entry.begin();
-    unsigned blockidx = 0;
+  // check the first block before any work, and skip all blocks if it's not chained properly
+  if (!parse_and_validate_block_from_blob(blocks_entry.front().block, blocks.front(), context.ids.front()))
+    return false;
+  if (blocks.front().prev_id != m_db->top_block_hash())
+  {
+    MDEBUG("Skipping prepare blocks. New blocks don't belong to chain.");
+    blocks.clear();
+    return true;
+  }
 
-    const crypto::hash tophash = m_db->top_block_hash();
-    for (unsigned i = 0; i < threads; i++)
+  // runs one pass of workers over all the blocks
+  const auto run_workers = [&](const std::function<void(unsigned int)> &worker) {
+    context.next_block = 0;
+    if (threads > 1)
     {
-      for (unsigned int j = 0; j < batches; j++, ++blockidx)
-      {
-        block &block = blocks[blockidx];
-        crypto::hash block_hash;
-
-        if (!parse_and_validate_block_from_blob(it->block, block, block_hash))
-          return false;
-
-        // check first block and skip all blocks if its not chained properly
-        if (blockidx == 0)
-        {
-          if (block.prev_id != tophash)
-          {
-            MDEBUG("Skipping prepare blocks. New blocks don't belong to chain.");
-            blocks.clear();
-            return true;
-          }
-        }
-        if (have_block(block_hash))
-          blocks_exist = true;
-
-        std::advance(it, 1);
-      }
+      tools::threadpool::waiter waiter;
+      for (unsigned int i = 0; i < threads; i++)
+        tpool.submit(&waiter, [&worker, i]() { worker(i); });
+      waiter.wait(&tpool);
     }
-
-    for (unsigned i = 0; i < extra && !blocks_exist; i++, blockidx++)
+    else
     {
-      block &block = blocks[blockidx];
-      crypto::hash block_hash;
-
-      if (!parse_and_validate_block_from_blob(it->block, block, block_hash))
-        return false;
-
-      if (have_block(block_hash))
-        blocks_exist = true;
-
-      std::advance(it, 1);
+      worker(0);
     }
+  };
 
-      if (!blocks_exist)
-    {
-      m_blocks_longhash_table.clear();
-      uint64_t thread_height = height;
-      tools::threadpool::waiter waiter;
-      if(m_hash_ctxes_multi.size() < threads)
-				m_hash_ctxes_multi.resize(threads);
-      for (unsigned int i = 0; i < threads; i++)
-      {
-        unsigned nblocks = batches;
-        if (i < extra)
-          ++nblocks;
-				tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, std::ref(m_hash_ctxes_multi[i]),  epee::span<const block>(&blocks[thread_height - height], nblocks), std::ref(maps[i])));
-        thread_height += nblocks;
-      }
-
-      waiter.wait(&tpool);
+  // the first block was parsed above
+  run_workers([this, &context](unsigned int) { prepare_blocks_worker(context); });
 
-      if (m_cancel)
-         return false;
+  if (m_cancel)
+    return false;
+  if (context.failed)
+    return false;
 
-      for (const auto & map : maps)
-      {
-        m_blocks_longhash_table.insert(map.begin(), map.end());
-      }
+  // spans we already have are common while syncing from several peers, so
+  // they're checked for before the costly "long" hashes.
+  // have_block needs the blockchain lock, which this thread holds
+  for (const crypto::hash &id : context.ids)
+  {
+    if (have_block(id))
+    {
+      blocks_exist = true;
+      break;
     }
   }
 
-  if (m_cancel)
-    return false;
-
   if (blocks_exist)
   {
     MDEBUG("Skipping remainder of prepare blocks. Blocks exist.");
     return true;
   }
 
+  if (m_hash_ctxes_multi.size() < threads)
+    m_hash_ctxes_multi.resize(threads);
+  run_workers([this, &context](unsigned int i) { prepare_blocks_longhash_worker(m_hash_ctxes_multi[i], context); });
+
+  if (m_cancel)
+    return false;
+
+  m_blocks_longhash_table.clear();
+  for (size_t i = 0; i < blocks_entry.size(); ++i)
+    m_blocks_longhash_table.emplace(context.ids[i], std::make_pair(context.pows[i], context.pows_cached[i] != 0));
+
   m_fake_scan_time = 0;
   m_fake_pow_calc_time = 0;
 
@@ -5148,7 +5467,6 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   std::map<uint64_t, std::vector<uint64_t>> offset_map;
   // [output] stores all output_data_t for each absolute_offset
   std::map<uint64_t, std::vector<output_data_t>> tx_map;
-  std::vector<std::pair<cryptonote::transaction, crypto::hash>> txes(total_txs);
 
 #define SCAN_TABLE_QUIT(m) \
         do { \
@@ -5168,13 +5486,11 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     {
       if (tx_index >= txes.size())
         SCAN_TABLE_QUIT("tx_index is out of sync");
-      transaction &tx = txes[tx_index].first;
-      crypto::hash &tx_prefix_hash = txes[tx_index].second;
-      ++tx_index;
-
-      if (!parse_and_validate_tx_base_from_blob(tx_blob.blob, tx))
+      const transaction &tx = txes[tx_index].first;
+      const crypto::hash &tx_prefix_hash = txes[tx_index].second;
+      if (!context.tx_parsed[tx_index])
         SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
-      cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
+      ++tx_index;
 
       auto its = m_scan_table.find(tx_prefix_hash);
       if (its != m_scan_table.end())
@@ -5283,25 +5599,16 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
         const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
         auto needed_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
 
+        const std::vector<uint64_t> &offsets_found = offset_map[in_to_key.amount];
+        const std::vector<output_data_t> &outputs_found = tx_map[in_to_key.amount];
         std::vector<output_data_t> outputs;
         for (const uint64_t & offset_needed : needed_offsets)
         {
-          size_t pos = 0;
-          bool found = false;
-
-          for (const uint64_t &offset_found : offset_map[in_to_key.amount])
-          {
-            if (offset_needed == offset_found)
-            {
-              found = true;
-              break;
-            }
-
-            ++pos;
-          }
-
-          if (found && pos < tx_map[in_to_key.amount].size())
-            outputs.push_back(tx_map[in_to_key.amount].at(pos));
+          // offsets_found is sorted, and outputs_found is its prefix that was in the db
+          const auto it = std::lower_bound(offsets_found.begin(), offsets_found.end(), offset_needed);
+          const size_t pos = it - offsets_found.begin();
+          if (it != offsets_found.end() && *it == offset_needed && pos < outputs_found.size())
+            outputs.push_back(outputs_found[pos]);
           else
             break;
         }
@@ -5475,15 +5782,131 @@ void Blockchain::cancel()
   m_cancel = true;
 }
 
+bool Blockchain::parse_block_hashes(const epee::span<const unsigned char> &data, std::vector<std::pair<crypto::hash, crypto::hash>> &hashes, std::vector<crypto::hash> &txs_hashes)
+{
+  hashes.clear();
+  txs_hashes.clear();
+
+  const unsigned char *p = data.data();
+  size_t size = data.size();
+  const size_t magic_size = sizeof(FAST_SYNC_FILE_MAGIC) - 1;
+  const bool with_txs = size >= magic_size && memcmp(p, FAST_SYNC_FILE_MAGIC, magic_size) == 0;
+  if (with_txs)
+  {
+    if (size < magic_size + 4)
+    {
+      MERROR("Block hash data is truncated");
+      return false;
+    }
+    p += magic_size;
+    const uint32_t version = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+    if (version != FAST_SYNC_FILE_VERSION)
+    {
+      MERROR("Unknown block hash data version: " << version);
+      return false;
+    }
+    p += sizeof(uint32_t);
+    size -= magic_size + 4;
+  }
+
+  if (size <= 4)
+    return true;
+
+  const size_t group_size = sizeof(crypto::hash) * (with_txs ? 3 : 2);
+  const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+  if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / group_size)
+  {
+    MERROR("Block hash data is too large");
+    return false;
+  }
+  if (size != 4 + nblocks * group_size)
+  {
+    MERROR("Failed to load hashes - unexpected data size");
+    return false;
+  }
+
+  p += sizeof(uint32_t);
+  hashes.reserve(nblocks);
+  if (with_txs)
+    txs_hashes.reserve(nblocks);
+  for (uint32_t i = 0; i < nblocks; i++)
+  {
+    crypto::hash hash_hashes, hash_weights;
+    memcpy(hash_hashes.data, p, sizeof(hash_hashes.data));
+    p += sizeof(hash_hashes.data);
+    memcpy(hash_weights.data, p, sizeof(hash_weights.data));
+    p += sizeof(hash_weights.data);
+    hashes.push_back(std::make_pair(hash_hashes, hash_weights));
+    if (with_txs)
+    {
+      crypto::hash hash_txs;
+      memcpy(hash_txs.data, p, sizeof(hash_txs.data));
+      p += sizeof(hash_txs.data);
+      txs_hashes.push_back(hash_txs);
+    }
+  }
+  return true;
+}
+
+bool Blockchain::load_fast_sync_file(const std::string &path, std::vector<std::pair<crypto::hash, crypto::hash>> &hashes, std::vector<crypto::hash> &txs_hashes)
+{
+  std::string data;
+  if (!epee::file_io_utils::load_file_to_string(path, data))
+  {
+    MERROR("Failed to load fast sync file " << path);
+    return false;
+  }
+
+  std::vector<std::pair<crypto::hash, crypto::hash>> file_hashes;
+  std::vector<crypto::hash> file_txs_hashes;
+  if (!parse_block_hashes({reinterpret_cast<const unsigned char*>(data.data()), data.size()}, file_hashes, file_txs_hashes))
+  {
+    MERROR("Fast sync file " << path << " is invalid, ignoring it");
+    return false;
+  }
+
+  // the compiled-in hashes are trusted, a file disagreeing with them is for
+  // another chain or was tampered with
+  const size_t common = std::min(hashes.size(), file_hashes.size());
+  for (size_t n = 0; n < common; ++n)
+  {
+    if (hashes[n] != file_hashes[n])
+    {
+      MERROR("Fast sync file " << path << " disagrees with the embedded block hashes at height " << n * HASH_OF_HASHES_STEP << ", ignoring it");
+      return false;
+    }
+  }
+
+  if (!file_txs_hashes.empty())
+  {
+    txs_hashes.resize(std::max(hashes.size(), file_hashes.size()), crypto::null_hash);
+    std::copy(file_txs_hashes.begin(), file_txs_hashes.end(), txs_hashes.begin());
+  }
+  if (file_hashes.size() > hashes.size())
+    hashes = std::move(file_hashes);
+  MINFO(hashes.size() * HASH_OF_HASHES_STEP << " block hashes known after loading " << path);
+  return true;
+}
+
+crypto::hash Blockchain::get_txs_hash_of_hashes(const std::vector<crypto::hash> &tx_hashes)
+{
+  crypto::hash hash;
+  cn_fast_hash(tx_hashes.data(), tx_hashes.size() * sizeof(crypto::hash), hash);
+  return hash;
+}
+
 #if defined(PER_BLOCK_CHECKPOINT)
 static const char expected_block_hashes_hash[] = "ae324a90b8498518249a6ea800694034914772871968a5b68a94d07faa2e9df5";
 void Blockchain::load_compiled_in_block_hashes(const GetCheckpointsCallback& get_checkpoints)
 {
-  if (get_checkpoints == nullptr || !m_fast_sync)
+  if (!m_fast_sync)
   {
     return;
   }
-  const epee::span<const unsigned char> &checkpoints = get_checkpoints(m_nettype);
+
+  std::vector<std::pair<crypto::hash, crypto::hash>> hashes;
+  std::vector<crypto::hash> txs_hashes;
+  const epee::span<const unsigned char> checkpoints = get_checkpoints ? get_checkpoints(m_nettype) : epee::span<const unsigned char>();
   if (!checkpoints.empty())
   {
     MINFO("Loading precomputed blocks (" << checkpoints.size() << " bytes)");
@@ -5511,58 +5934,42 @@ void Blockchain::load_compiled_in_block_hashes(const GetCheckpointsCallback& get
       }
     }
 
-    if (checkpoints.size() > 4)
+    if (!parse_block_hashes(checkpoints, hashes, txs_hashes))
+      return;
+  }
+
+  if (!m_fast_sync_file.empty())
+    load_fast_sync_file(m_fast_sync_file, hashes, txs_hashes);
+
+  const size_t nblocks = hashes.size();
+  if (nblocks > 0 && nblocks > (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP)
+  {
+    m_blocks_hash_of_hashes = std::move(hashes);
+    m_blocks_txs_hash_of_hashes = std::move(txs_hashes);
+    if (!m_blocks_txs_hash_of_hashes.empty())
+      m_blocks_txs_hash_of_hashes.resize(nblocks, crypto::null_hash);
+    m_blocks_hash_check.resize(m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP, std::make_pair(crypto::null_hash, 0));
+    MINFO(nblocks << " block hashes loaded");
+
+    // FIXME: clear tx_pool because the process might have been
+    // terminated and caused it to store txs kept by blocks.
+    // The core will not call check_tx_inputs(..) for these
+    // transactions in this case. Consequently, the sanity check
+    // for tx hashes will fail in handle_block_to_main_chain(..)
+    CRITICAL_REGION_LOCAL(m_tx_pool);
+
+    std::vector<transaction> txs;
+    m_tx_pool.get_transactions(txs, true);
+
+    size_t tx_weight;
+    uint64_t fee;
+    bool relayed, do_not_relay, double_spend_seen, pruned;
+    transaction pool_tx;
+    blobdata txblob;
+    for(const transaction &tx : txs)
     {
-      const unsigned char *p = checkpoints.data();
-      const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
-      if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / sizeof(hash))
-      {
-        MERROR("Block hash data is too large");
-        return;
-      }
-      const size_t size_needed = 4 + nblocks * (sizeof(crypto::hash) * 2);
-      if(checkpoints.size() != size_needed)
-      {
-        MERROR("Failed to load hashes - unexpected data size");
-        return;
-      }
-      else if(nblocks > 0 && nblocks > (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP)
-      {
-        p += sizeof(uint32_t);
-        m_blocks_hash_of_hashes.reserve(nblocks);
-        for (uint32_t i = 0; i < nblocks; i++)
-        {
-          crypto::hash hash_hashes, hash_weights;
-          memcpy(hash_hashes.data, p, sizeof(hash_hashes.data));
-          p += sizeof(hash_hashes.data);
-          memcpy(hash_weights.data, p, sizeof(hash_weights.data));
-          p += sizeof(hash_weights.data);
-          m_blocks_hash_of_hashes.push_back(std::make_pair(hash_hashes, hash_weights));
-        }
-        m_blocks_hash_check.resize(m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP, std::make_pair(crypto::null_hash, 0));
-        MINFO(nblocks << " block hashes loaded");
-
-        // FIXME: clear tx_pool because the process might have been
-        // terminated and caused it to store txs kept by blocks.
-        // The core will not call check_tx_inputs(..) for these
-        // transactions in this case. Consequently, the sanity check
-        // for tx hashes will fail in handle_block_to_main_chain(..)
-        CRITICAL_REGION_LOCAL(m_tx_pool);
-
-        std::vector<transaction> txs;
-        m_tx_pool.get_transactions(txs, true);
-
-        size_t tx_weight;
-        uint64_t fee;
-        bool relayed, do_not_relay, double_spend_seen, pruned;
-        transaction pool_tx;
-        blobdata txblob;
-        for(const transaction &tx : txs)
-        {
-          crypto::hash tx_hash = get_transaction_hash(tx);
-          m_tx_pool.take_tx(tx_hash, pool_tx, txblob, tx_weight, fee, relayed, do_not_relay, double_spend_seen, pruned);
-        }
-      }
+      crypto::hash tx_hash = get_transaction_hash(tx);
+      m_tx_pool.take_tx(tx_hash, pool_tx, txblob, tx_weight, fee, relayed, do_not_relay, double_spend_seen, pruned);
     }
   }
 }
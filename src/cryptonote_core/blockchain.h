@@ -30,6 +30,8 @@
 
 #pragma once
 #include <boost/asio/io_service.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/serialization/serialization.hpp>
 #if BOOST_VERSION >= 107400
 #include <boost/serialization/library_version_type.hpp>
@@ -42,6 +44,7 @@
 #include <boost/multi_index/member.hpp>
 #include <atomic>
 #include <functional>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -60,6 +63,7 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "output_distribution.h"
 
 namespace service_nodes
 {
@@ -80,7 +84,7 @@ namespace cryptonote
   enum blockchain_db_sync_mode
   {
     db_defaultsync, //!< user didn't specify, use db_async
-    db_sync,  //!< handle syncing calls instead of the backing db, synchronously
+    db_sync,  //!< handle syncing calls instead of the backing db, finishing each before the next batch is committed
     db_async, //!< handle syncing calls instead of the backing db, asynchronously
     db_nosync //!< Leave syncing up to the backing db (safest, but slowest because of disk I/O)
   };
@@ -119,6 +123,18 @@ namespace cryptonote
       uint64_t already_generated_coins; //!< the total coins minted after that block
     };
 
+    /**
+     * @brief a transaction to check with check_txs_inputs, and the results
+     */
+    struct tx_inputs_check
+    {
+      transaction *tx; //!< the transaction, its rct signatures are expanded
+      bool valid; //!< false if any input is invalid
+      uint64_t max_used_block_height; //!< the height of the most recent block with a ring member
+      crypto::hash max_used_block_id; //!< the hash of that block
+      tx_verification_context tvc; //!< information about the verification
+    };
+
     /**
      * @brief Blockchain constructor
      *
@@ -605,6 +621,18 @@ namespace cryptonote
      */
     bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
 
+    /**
+     * @brief validates the inputs of several transactions at once
+     *
+     * Gives the same results as check_tx_inputs for each transaction, for
+     * transactions not kept by block. The ring members of all of them are
+     * read on the threadpool under the blockchain lock, then the lock is
+     * released and their MLSAGs are verified together.
+     *
+     * @param checks the transactions to validate, and the results
+     */
+    void check_txs_inputs(std::vector<tx_inputs_check> &checks) const;
+
     /**
      * @brief get fee quantization mask
      *
@@ -775,7 +803,7 @@ namespace cryptonote
     /**
      * @brief sets various performance options
      *
-     * @param maxthreads max number of threads when preparing blocks for addition
+     * @param maxthreads max number of threads when preparing blocks for addition, 0 for all hardware threads
      * @param sync_on_blocks whether to sync based on blocks or bytes
      * @param sync_threshold number of blocks/bytes to cache before syncing to database
      * @param sync_mode the ::blockchain_db_sync_mode to use
@@ -784,6 +812,56 @@ namespace cryptonote
     void set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint64_t sync_threshold,
         blockchain_db_sync_mode sync_mode, bool fast_sync);
 
+    /**
+     * @brief sets a file of block hashes to sync up to with fast sync
+     *
+     * The file extends the compiled-in block hashes, which it must agree
+     * with, and may cover transaction hashes too. Blocks it covers are
+     * trusted like the compiled-in ones, so it must come from a trusted db.
+     *
+     * @param path the file, as written by blockchain-fast-sync
+     */
+    void set_fast_sync_file(const std::string &path) { m_fast_sync_file = path; }
+
+    /**
+     * @brief reads block hashes in the compiled-in or fast sync file format
+     *
+     * The compiled-in format has, for each group of HASH_OF_HASHES_STEP
+     * blocks, the hash of their ids and the hash of their weights. The fast
+     * sync file starts with FAST_SYNC_FILE_MAGIC and a version, and adds the
+     * hash of the group's transaction hashes, see get_txs_hash_of_hashes.
+     *
+     * @param data the file's contents
+     * @param hashes return-by-reference the id and weight hashes of each group
+     * @param txs_hashes return-by-reference the tx hashes hash of each group, empty if the data has none
+     *
+     * @return false if the data is malformed
+     */
+    static bool parse_block_hashes(const epee::span<const unsigned char> &data, std::vector<std::pair<crypto::hash, crypto::hash>> &hashes, std::vector<crypto::hash> &txs_hashes);
+
+    /**
+     * @brief adds the block hashes from a fast sync file to the compiled-in ones
+     *
+     * The file is ignored if it can't be read or parsed, or disagrees with
+     * the compiled-in hashes.
+     *
+     * @param path the file, as written by blockchain-fast-sync
+     * @param hashes the compiled-in id and weight hashes, extended if the file is longer
+     * @param txs_hashes the tx hashes hashes, set from the file if it has them
+     *
+     * @return false if the file was ignored
+     */
+    static bool load_fast_sync_file(const std::string &path, std::vector<std::pair<crypto::hash, crypto::hash>> &hashes, std::vector<crypto::hash> &txs_hashes);
+
+    /**
+     * @brief hashes the transaction hashes of a group of blocks
+     *
+     * @param tx_hashes the non-coinbase tx hashes of each block in the group, in order
+     *
+     * @return the hash
+     */
+    static crypto::hash get_txs_hash_of_hashes(const std::vector<crypto::hash> &tx_hashes);
+
     /**
      * @brief sets a block notify object to call for every new block
      *
@@ -882,6 +960,47 @@ namespace cryptonote
      */
     bool get_hard_fork_voting_info(uint8_t version, uint32_t &window, uint32_t &votes, uint32_t &threshold, uint64_t &earliest_height, uint8_t &voting) const;
 
+    /**
+     * @brief get how often a block's PoW hash was found in the PoW cache
+     *
+     * @param hits return-by-reference the lookups answered from the cache
+     * @param misses return-by-reference the lookups that had to hash the block
+     */
+    void get_pow_cache_stats(uint64_t &hits, uint64_t &misses) const;
+
+    /**
+     * @brief where the time adding blocks in batches went, in milliseconds
+     */
+    struct db_commit_stats
+    {
+      uint64_t batches;         //!< batches committed or aborted
+      uint64_t validate_time;   //!< from starting a batch to committing it, checking and adding its blocks
+      uint64_t write_time;      //!< committing batches, which includes the flush in safe mode
+      uint64_t sync_time;       //!< flushing the db to disk, on whichever thread did it
+      uint64_t sync_wait_time;  //!< the thread adding blocks waiting for a flush to finish
+    };
+
+    /**
+     * @brief get how long adding blocks in batches took, since startup
+     *
+     * @return the totals
+     */
+    db_commit_stats get_commit_stats() const;
+
+    /**
+     * @brief queues a flush of the db on the async thread
+     *
+     * @return false if one is still running, in which case nothing is queued
+     */
+    bool start_background_sync();
+
+    /**
+     * @brief waits for a queued flush to finish, if any
+     *
+     * @return false if a flush failed since this was last called
+     */
+    bool wait_for_background_sync();
+
     /**
      * @brief get difficulty target based on chain and hardfork version
      *
@@ -990,14 +1109,58 @@ namespace cryptonote
         std::vector<output_data_t> &outputs) const;
 
     /**
-     * @brief computes the "short" and "long" hashes for a set of blocks
+     * @brief what the workers of prepare_handle_incoming_blocks share
+     *
+     * Each block is taken by whichever worker is free next, so slow blocks
+     * don't hold up a fixed share of the span.
+     */
+    struct prepare_blocks_context
+    {
+      const std::vector<block_complete_entry> &entries;
+      std::vector<block> &blocks;
+      std::vector<crypto::hash> ids;
+      std::vector<crypto::hash> pows;
+      std::vector<uint8_t> pows_cached;  // whether pows came from the PoW cache
+      std::vector<size_t> tx_offsets;
+      std::vector<std::pair<transaction, crypto::hash>> &txes;
+      std::vector<uint8_t> tx_parsed;
+      std::atomic<size_t> next_block;
+      std::atomic<bool> failed;
+      uint64_t start_height;
+      bool use_pow_cache;
+    };
+
+    /**
+     * @brief parses blocks and their txes and computes the block ids,
+     * taking blocks from context until there are none left
+     *
+     * The first block is expected to be parsed already.
      *
-     * @param height the height of the first block
-     * @param blocks the blocks to be hashed
-     * @param map return-by-reference the hashes for each block
+     * @param context the blocks, and where the results go
      */
-    void block_longhash_worker(cn_gpu_hash &hash_ctx, const epee::span<const block> &blocks,
-        std::unordered_map<crypto::hash, crypto::hash> &map) const;
+    void prepare_blocks_worker(prepare_blocks_context &context) const;
+
+    /**
+     * @brief computes the "long" hashes of parsed blocks, taking blocks from
+     * context until there are none left
+     *
+     * @param hash_ctx the hash context for this worker
+     * @param context the blocks, and where the results go
+     */
+    void prepare_blocks_longhash_worker(cn_gpu_hash &hash_ctx, prepare_blocks_context &context) const;
+
+    /**
+     * @brief gets a block's "long" hash from the PoW cache, or computes it
+     *
+     * @param b the block
+     * @param id the block's hash
+     * @param height the block's height
+     * @param pow return-by-reference the block's "long" hash
+     * @param hash_ctx the hash context to compute with on a cache miss
+     *
+     * @return true if the hash came from the cache, otherwise false
+     */
+    bool get_cached_block_longhash(const block &b, const crypto::hash &id, uint64_t height, crypto::hash &pow, cn_gpu_hash &hash_ctx) const;
 
     /**
      * @brief returns a set of known alternate chains
@@ -1102,12 +1265,17 @@ namespace cryptonote
 
     // metadata containers
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
-    std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
+    std::unordered_map<crypto::hash, std::pair<crypto::hash, bool>> m_blocks_longhash_table;  // PoW, and whether it came from the PoW cache
 
     // Keccak hashes for each block and for fast pow checking
     std::vector<std::pair<crypto::hash, crypto::hash>> m_blocks_hash_of_hashes;
     std::vector<std::pair<crypto::hash, uint64_t>> m_blocks_hash_check;
     std::vector<crypto::hash> m_blocks_txs_check;
+    std::vector<crypto::hash> m_blocks_txs_hash_of_hashes;  // null for groups without one
+    std::map<uint64_t, std::vector<crypto::hash>> m_fast_sync_txs;  // tx hashes of the group being checked, by height
+    std::string m_fast_sync_file;
+
+    output_distribution m_output_distribution;
 
     blockchain_db_sync_mode m_db_sync_mode;
     bool m_fast_sync;
@@ -1120,6 +1288,8 @@ namespace cryptonote
     uint64_t m_fake_scan_time;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
+    mutable std::atomic<uint64_t> m_pow_cache_hits;
+    mutable std::atomic<uint64_t> m_pow_cache_misses;
     std::vector<uint64_t> m_timestamps;
     std::vector<difficulty_type> m_difficulties;
     uint64_t m_timestamps_and_difficulties_height;
@@ -1170,10 +1340,23 @@ namespace cryptonote
 
 
     bool m_batch_success;
+    uint64_t m_batch_start_time;
+
+    // flushes run on m_async_service, overlapping the next batch
+    mutable boost::mutex m_sync_mutex;
+    boost::condition_variable m_sync_cond;
+    bool m_sync_in_flight;
+    bool m_sync_failed;
+    db_commit_stats m_commit_stats;
 
     std::shared_ptr<tools::Notify> m_block_notify;
     std::shared_ptr<tools::Notify> m_reorg_notify;
 
+    /**
+     * @brief flushes the db, on the async thread
+     */
+    void background_sync();
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1230,15 +1413,18 @@ namespace cryptonote
      * of the most recent block which contains an output used in any input set
      *
      * Currently this function calls ring signature validation for each
-     * transaction.
+     * transaction, unless deferred_rct_sigs is given: simple RingCT
+     * signatures are then only checked up to their MLSAGs, and appended
+     * there for the caller to verify in one batch.
      *
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred_rct_sigs if not NULL, collects the expanded rctSigs whose MLSAGs are left to verify
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL) const;
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, std::vector<const rct::rctSig*>* deferred_rct_sigs = NULL) const;
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1380,6 +1566,20 @@ namespace cryptonote
 	* @param i the rct output index
 	*/
 	void add_out_to_get_rct_random_outs(std::list<COMMAND_RPC_GET_RANDOM_RCT_OUTPUTS::out_entry>& outs, uint64_t amount, size_t i) const;
+
+	/**
+	* @brief picks random unlocked outputs of an amount to use as ring members
+	*
+	* Outputs are drawn as many at a time as are still needed, and each
+	* draw is read from the db in one batch.
+	*
+	* @param amount the output amount (0 for rct inputs)
+	* @param num_outs the number of outputs to pick from, from index 0
+	* @param count the number of outputs to pick
+	* @param indices return-by-reference the outputs' indices (indexed to amount)
+	* @param outputs return-by-reference the outputs' data, matching indices
+	*/
+	void pick_random_outputs(uint64_t amount, uint64_t num_outs, uint64_t count, std::vector<uint64_t> &indices, std::vector<output_data_t> &outputs) const;
 	/**
      * @brief reverts the blockchain to its previous state following a failed switch
      *
@@ -1554,6 +1754,20 @@ namespace cryptonote
      */
     void load_compiled_in_block_hashes(const GetCheckpointsCallback& get_checkpoints);
 
+    /**
+     * @brief prepares a span within the fast sync area
+     *
+     * Blocks there are checked against the known hashes rather than
+     * verified, so this only parses them, and checks the tx hashes of any
+     * group of blocks the span completes.
+     *
+     * @param blocks_entry the span
+     * @param blocks return-by-reference the parsed blocks, empty if they don't follow the chain
+     *
+     * @return false if a block can't be parsed
+     */
+    bool prepare_fast_sync_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &blocks);
+
     /**
      * @brief expands v2 transaction data from blockchain
      *
@@ -156,8 +156,8 @@ namespace cryptonote
   };
   static const command_line::arg_descriptor<uint64_t> arg_prep_blocks_threads = {
     "prep-blocks-threads"
-  , "Max number of threads to use when preparing block hashes in groups."
-  , 4
+  , "Max number of threads to use when parsing and hashing incoming blocks (0 = all hardware threads)."
+  , 0
   };
   static const command_line::arg_descriptor<uint64_t> arg_show_time_stats  = {
     "show-time-stats"
@@ -189,6 +189,11 @@ namespace cryptonote
   , "Set maximum txpool weight in bytes."
   , DEFAULT_TXPOOL_MAX_WEIGHT
   };
+  static const command_line::arg_descriptor<std::string> arg_fast_sync_file = {
+    "fast-sync-file"
+  , "File of block and tx hashes, from equilibria-blockchain-fast-sync, to sync up to without verifying"
+  , ""
+  };
   static const command_line::arg_descriptor<std::string> arg_block_notify = {
     "block-notify"
   , "Run a program for each new block, '%s' will be replaced by the block hash"
@@ -248,6 +253,7 @@ namespace cryptonote
               m_update_available(false)
   {
     m_checkpoints_updating.clear();
+    m_uptime_proofs_verifying.clear();
     set_cryptonote_protocol(pprotocol);
   }
   void core::set_cryptonote_protocol(i_cryptonote_protocol* pprotocol)
@@ -343,6 +349,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_block_download_max_size);
     command_line::add_arg(desc, arg_sync_pruned_blocks);
     command_line::add_arg(desc, arg_max_txpool_weight);
+    command_line::add_arg(desc, arg_fast_sync_file);
     command_line::add_arg(desc, arg_block_notify);
     command_line::add_arg(desc, arg_service_node);
     command_line::add_arg(desc, arg_prune_blockchain);
@@ -635,6 +642,8 @@ namespace cryptonote
 
     m_blockchain_storage.set_user_options(blocks_threads,
         sync_on_blocks, sync_threshold, sync_mode, fast_sync);
+    if (fast_sync)
+      m_blockchain_storage.set_fast_sync_file(command_line::get_arg(vm, arg_fast_sync_file));
 
     try
     {
@@ -795,6 +804,10 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::deinit()
   {
+    // let a batch of uptime proofs being checked on the threadpool finish, and keep
+    // others from starting
+    while (m_uptime_proofs_verifying.test_and_set())
+      epee::misc_utils::sleep_no_w(10);
     m_service_node_list.store();
     m_service_node_list.set_db_pointer(nullptr);
     m_miner.stop();
@@ -1098,6 +1111,18 @@ namespace cryptonote
     if (!tx_info.empty())
       handle_incoming_tx_accumulated_batch(tx_info, tx_relay == relay_method::block);
 
+    // the inputs of txes from a block were checked with it, and might not be
+    // valid anymore after a reorg
+    if (tx_relay != relay_method::block)
+    {
+      std::vector<std::pair<transaction*, crypto::hash>> txs;
+      for (size_t i = 0; i < tx_blobs.size(); i++)
+        if (results[i].res && !already_have[i])
+          txs.emplace_back(&results[i].tx, results[i].hash);
+      if (!txs.empty())
+        m_mempool.precheck_tx_inputs(txs);
+    }
+
     bool ok = true;
     it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -1413,9 +1438,54 @@ namespace cryptonote
 	  return result;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof, bool &my_uptime_proof_confirmation)
+  bool core::handle_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof)
   {
-	  return m_quorum_cop.handle_uptime_proof(proof, my_uptime_proof_confirmation);
+	  if (!m_quorum_cop.handle_uptime_proof(proof))
+		  return false;
+	  // a full batch is checked on the threadpool rather than the p2p thread which got the
+	  // proof, once at a time; the timer checks the rest
+	  if (m_quorum_cop.get_queued_uptime_proof_count() >= service_nodes::UPTIME_PROOF_VERIFY_BATCH_SIZE && !m_uptime_proofs_verifying.test_and_set())
+	  {
+		  tools::threadpool::getInstance().submit(nullptr, [this]() {
+			  relay_uptime_proofs();
+			  m_uptime_proofs_verifying.clear();
+		  });
+	  }
+	  return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::relay_uptime_proofs()
+  {
+    std::vector<NOTIFY_UPTIME_PROOF::request> rejected;
+    for (NOTIFY_UPTIME_PROOF::request& proof : m_quorum_cop.verify_uptime_proofs(rejected))
+    {
+      // NOTE: Don't relay your own uptime proof, otherwise we have the following situation
+
+      // Node1 sends uptime ->
+      // Node2 receives uptime and relays it back to Node1 for acknowledgement ->
+      // Node1 receives it, accepts it to acknowledge, Node1 tries to resend to the same peers again
+
+      // Instead, if we receive our own uptime proof, then acknowledge but don't
+      // send on. If the we are missing an uptime proof it will have been
+      // submitted automatically by the daemon itself instead of
+      // using my own proof relayed by other nodes.
+      if (m_service_node && proof.pubkey == m_service_node_pubkey)
+      {
+        MGINFO("Received uptime-proof confirmation back from network for Service Node (yours): " << proof.pubkey);
+        continue;
+      }
+
+      LOG_PRINT_L2("Accepted uptime proof from " << proof.pubkey);
+      // NOTE: The default exclude context contains the peer who sent us this
+      // uptime proof, we want to ensure we relay it back so they know that the
+      // peer they relayed to received their uptime and confirm it, so send in an
+      // empty context so we don't omit the source peer from the relay back.
+      cryptonote_connection_context empty_context = {};
+      get_protocol()->relay_uptime_proof(proof, empty_context);
+    }
+    if (!rejected.empty())
+      get_protocol()->on_uptime_proofs_rejected(rejected);
+    return true;
   }
   //-----------------------------------------------------------------------------------------------
   void core::on_transactions_relayed(const epee::span<const cryptonote::blobdata> tx_blobs, const relay_method tx_relay)
@@ -1831,6 +1901,7 @@ namespace cryptonote
     }
 
 	  m_uptime_proof_pruner.do_call(boost::bind(&service_nodes::quorum_cop::prune_uptime_proof, &m_quorum_cop));
+    m_uptime_proof_verifier.do_call(boost::bind(&core::relay_uptime_proofs, this));
     m_block_rate_interval.do_call(boost::bind(&core::check_block_rate, this));
     m_blockchain_pruning_interval.do_call(boost::bind(&core::update_blockchain_pruning, this));
     m_miner.on_idle();
@@ -2143,6 +2214,11 @@ namespace cryptonote
 	  return m_service_node_list.get_service_node_list_state(service_node_pubkeys);
   }
   //-----------------------------------------------------------------------------------------------
+  size_t core::get_quorum_cache_memory_usage() const
+  {
+	  return m_service_node_list.get_quorum_cache_memory_usage();
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::add_deregister_vote(const service_nodes::deregister_vote& vote, vote_verification_context &vvc)
   {
 	  uint64_t latest_block_height = std::max(get_current_blockchain_height(), get_target_blockchain_height());
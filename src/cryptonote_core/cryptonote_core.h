@@ -117,11 +117,13 @@ namespace cryptonote
      /**
      * @brief handles an incoming uptime proof
      *
-     * Parses an incoming uptime proof
+     * Queues an incoming uptime proof; its signature is checked along with
+     * others by relay_uptime_proofs, which also relays it once accepted.
+     * A full batch is checked on the threadpool.
      *
-     * @return true if we haven't seen it before and thus need to relay.
+     * @return true if we haven't seen it before and it has been queued
      */
-	  bool handle_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof, bool &my_uptime_proof_confirmation);
+	  bool handle_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof);
       
 	 /**
       * @brief handles an incoming transaction
@@ -848,6 +850,13 @@ namespace cryptonote
 	* @return All the service nodes that can be matched from pubkeys in param
 	*/
 	std::vector<service_nodes::service_node_pubkey_info> get_service_node_list_state(const std::vector<crypto::public_key>& service_node_pubkeys) const;
+
+	/**
+	* @brief get the approximate memory used by the cached service node quorums
+	*
+	* @return the size in bytes
+	*/
+	size_t get_quorum_cache_memory_usage() const;
 	/**
 	* @brief get whether `pubkey` is known as a service node
 	*
@@ -1087,6 +1096,12 @@ namespace cryptonote
     * @return true, necessary for binding this function to a periodic invoker
     */
    bool relay_deregister_votes();
+     /**
+    * @brief check the queued uptime proofs and relay the accepted ones
+    *
+    * @return true, necessary for binding this function to a periodic invoker
+    */
+   bool relay_uptime_proofs();
      /**
       * @brief checks DNS versions
       *
@@ -1149,6 +1164,7 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<60*10, true> m_check_disk_space_interval; //!< interval for checking for disk space
 	    epee::math_helper::once_a_time_seconds<UPTIME_PROOF_BUFFER_IN_SECONDS, true> m_check_uptime_proof_interval; //!< interval for checking our own uptime proof
 	    epee::math_helper::once_a_time_seconds<30, true> m_uptime_proof_pruner;
+     epee::math_helper::once_a_time_seconds<1, false> m_uptime_proof_verifier; //!< interval for checking and relaying queued uptime proofs
      epee::math_helper::once_a_time_seconds<90, false> m_block_rate_interval; //!< interval for checking block rate
      epee::math_helper::once_a_time_seconds<60*60*5, true> m_blockchain_pruning_interval; //!< interval for incremental blockchain pruning
 
@@ -1165,6 +1181,7 @@ namespace cryptonote
      time_t m_last_json_checkpoints_update; //!< time when json checkpoints were last updated
 
      std::atomic_flag m_checkpoints_updating; //!< set if checkpoints are currently updating to avoid multiple threads attempting to update at once
+     std::atomic_flag m_uptime_proofs_verifying; //!< set while a full batch of uptime proofs is being checked on the threadpool
      bool m_disable_dns_checkpoints;
      bool m_service_node;
      crypto::secret_key m_service_node_key;
@@ -0,0 +1,193 @@
+#include "output_distribution.h"
+#include "blockchain_db/blockchain_db.h"
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+
+#include <numeric>
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "blockchain"
+
+namespace cryptonote
+{
+  namespace
+  {
+    // histograms built per block at most, so clients asking for made up
+    // amounts can't hold up adding blocks
+    const size_t MAX_HISTOGRAMS_PER_BLOCK = 64;
+  }
+
+  output_distribution::output_distribution(): m_db(NULL), m_height(0), m_rct_valid(false)
+  {
+  }
+
+  void output_distribution::init(BlockchainDB *db)
+  {
+    m_db = db;
+    {
+      boost::lock_guard<boost::mutex> wanted_lock(m_wanted_mutex);
+      m_wanted.clear();
+    }
+    rebuild();
+  }
+
+  // Only the thread adding blocks changes m_db, m_height and what's in the
+  // db, so the db is read without the lock, which is only taken to swap the
+  // results in.
+  void output_distribution::rebuild()
+  {
+    uint64_t height = 0;
+    std::vector<uint64_t> cumulative;
+    bool valid = false;
+    try
+    {
+      height = m_db->height();
+      std::vector<uint64_t> heights(height);
+      std::iota(heights.begin(), heights.end(), 0);
+      cumulative = m_db->get_block_cumulative_rct_outputs(heights);
+      valid = cumulative.size() == height;
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to read the RingCT output distribution: " << e.what());
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    m_height = height;
+    m_rct_cumulative = std::move(cumulative);
+    m_rct_valid = valid;
+    m_histograms.clear();
+  }
+
+  void output_distribution::drop_amounts(const block &b, const std::vector<transaction> &txs)
+  {
+    // coinbase outputs of v2+ miner txes are stored as RingCT outputs
+    const auto drop = [this](const transaction &tx) {
+      if (is_coinbase(tx) && tx.version >= txversion::v2)
+        return;
+      for (const tx_out &out: tx.vout)
+        if (out.amount != 0)
+          m_histograms.erase(out.amount);
+    };
+    drop(b.miner_tx);
+    for (const transaction &tx: txs)
+      drop(tx);
+  }
+
+  void output_distribution::block_added(uint64_t height, const block &b, const std::vector<transaction> &txs)
+  {
+    if (!m_db)
+      return;
+    if (height != m_height)
+    {
+      MDEBUG("Output distribution at height " << m_height << " but block added at " << height << ", rebuilding");
+      rebuild();
+      return;
+    }
+
+    std::unordered_set<uint64_t> wanted;
+    {
+      boost::lock_guard<boost::mutex> wanted_lock(m_wanted_mutex);
+      wanted.swap(m_wanted);
+    }
+
+    std::vector<uint64_t> cumulative;
+    std::unordered_map<uint64_t, histogram> histograms;
+    try
+    {
+      if (m_rct_valid)
+        cumulative = m_db->get_block_cumulative_rct_outputs(std::vector<uint64_t>(1, height));
+      for (uint64_t amount: wanted)
+      {
+        histogram &h = histograms[amount];
+        if (!m_db->get_output_height_histogram(amount, h) && !h.empty())
+          m_db->add_output_height_histogram(amount, h);
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to update the output distribution: " << e.what());
+      cumulative.clear();
+      histograms.clear();
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    ++m_height;
+    if (m_rct_valid && cumulative.size() == 1)
+      m_rct_cumulative.push_back(cumulative[0]);
+    else
+      m_rct_valid = false;
+    drop_amounts(b, txs);
+    for (auto &e: histograms)
+      if (!e.second.empty())
+        m_histograms[e.first] = std::move(e.second);
+  }
+
+  void output_distribution::block_popped(uint64_t height, const block &b, const std::vector<transaction> &txs)
+  {
+    if (!m_db)
+      return;
+    if (height + 1 != m_height)
+    {
+      MDEBUG("Output distribution at height " << m_height << " but block popped from " << height << ", rebuilding");
+      rebuild();
+      return;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    --m_height;
+    if (m_rct_valid)
+      m_rct_cumulative.pop_back();
+    drop_amounts(b, txs);
+  }
+
+  bool output_distribution::get(uint64_t amount, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+    if (to_height > 0 && to_height < from_height)
+      return false;
+    if (m_height == 0 || from_height >= m_height || to_height >= m_height)
+      return false;
+
+    start_height = from_height;
+    base = 0;
+    distribution.clear();
+
+    if (amount == 0)
+    {
+      if (!m_rct_valid)
+        return false;
+      if (start_height > 0)
+      {
+        if (start_height - 1 > to_height)
+          return false;
+        base = m_rct_cumulative[start_height - 1];
+      }
+      if (to_height >= start_height)
+        distribution.assign(m_rct_cumulative.begin() + start_height, m_rct_cumulative.begin() + to_height + 1);
+      return true;
+    }
+
+    const auto it = m_histograms.find(amount);
+    if (it == m_histograms.end())
+    {
+      boost::lock_guard<boost::mutex> wanted_lock(m_wanted_mutex);
+      if (m_wanted.size() < MAX_HISTOGRAMS_PER_BLOCK)
+        m_wanted.insert(amount);
+      return false;
+    }
+
+    // same layout as the db gives: one entry per height up to the top, with
+    // the outputs below start_height counted in the first
+    distribution.resize(m_height - start_height, 0);
+    for (const auto &count: it->second)
+    {
+      if (to_height > 0 && count.first > to_height)
+        break;
+      distribution[count.first > start_height ? count.first - start_height : 0] += count.second;
+    }
+    for (size_t n = 1; n < distribution.size(); ++n)
+      distribution[n] += distribution[n - 1];
+    return true;
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "cryptonote_basic/cryptonote_basic.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cryptonote
+{
+  class BlockchainDB;
+
+  /**
+   * @brief per block output counts, as served to wallets picking decoys
+   *
+   * The cumulative number of RingCT outputs at each height is kept for the
+   * whole chain and follows blocks as they are added and popped. Pre-RingCT
+   * amounts get a histogram of the heights of their outputs. It is built,
+   * or loaded from the db where it is persisted, once a block is added after
+   * the amount was first asked for. It is dropped when a block adds or
+   * removes an output of that amount. Until then, queries for the amount are
+   * left to the db.
+   *
+   * Readers share a lock and only copy the range they ask for, so any number
+   * of RPC threads can be answered at once. The db is only used by the thread
+   * adding and popping blocks, within its write transaction.
+   */
+  class output_distribution
+  {
+  public:
+    output_distribution();
+
+    /**
+     * @brief reads the RingCT distribution of the whole chain and drops any histograms
+     *
+     * @param db the db blocks are added to
+     */
+    void init(BlockchainDB *db);
+
+    /**
+     * @brief appends a block that was just added to the db
+     *
+     * Also builds the histograms of the amounts asked for since the last block.
+     *
+     * @param height the height of the block
+     * @param b the block
+     * @param txs the block's transactions
+     */
+    void block_added(uint64_t height, const block &b, const std::vector<transaction> &txs);
+
+    /**
+     * @brief drops a block that was just popped from the db
+     *
+     * @param height the height the block had
+     * @param b the block
+     * @param txs the block's transactions
+     */
+    void block_popped(uint64_t height, const block &b, const std::vector<transaction> &txs);
+
+    /**
+     * @brief gets a distribution from memory
+     *
+     * Arguments and results are those of Blockchain::get_output_distribution.
+     *
+     * @return false if the request is invalid, or the amount's histogram isn't built yet
+     */
+    bool get(uint64_t amount, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const;
+
+  private:
+    typedef std::vector<std::pair<uint64_t, uint64_t>> histogram;
+
+    void rebuild();
+    void drop_amounts(const block &b, const std::vector<transaction> &txs);
+
+    mutable boost::shared_mutex m_mutex;
+    BlockchainDB *m_db;
+    uint64_t m_height;
+    bool m_rct_valid;
+    std::vector<uint64_t> m_rct_cumulative;  //!< RingCT outputs up to and including each height
+    std::unordered_map<uint64_t, histogram> m_histograms;
+
+    mutable boost::mutex m_wanted_mutex;
+    mutable std::unordered_set<uint64_t> m_wanted;  //!< amounts asked for but without a histogram
+  };
+}
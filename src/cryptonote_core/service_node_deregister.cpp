@@ -78,15 +78,11 @@ namespace service_nodes
 	bool deregister_vote::verify_votes_signature(uint64_t block_height, uint32_t service_node_index, const std::vector<std::pair<crypto::public_key, crypto::signature>>& keys_and_sigs)
 	{
 		crypto::hash hash = make_hash_from(block_height, service_node_index);
-		for (auto& key_and_sig : keys_and_sigs)
-		{
-			if (!crypto::check_signature(hash, key_and_sig.first, key_and_sig.second))
-			{
-				return false;
-			}
-		}
+		std::vector<crypto::signature_check> checks(keys_and_sigs.size());
+		for (size_t i = 0; i < keys_and_sigs.size(); ++i)
+			checks[i] = { hash, keys_and_sigs[i].first, keys_and_sigs[i].second };
 
-		return true;
+		return crypto::check_signatures(checks);
 	}
 
 	static bool verify_votes_helper(cryptonote::network_type nettype, const cryptonote::tx_extra_service_node_deregister& deregister,
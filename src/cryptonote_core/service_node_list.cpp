@@ -27,6 +27,8 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <functional>
+#include <unordered_set>
+#include <limits>
 #include <random>
 #include <algorithm>
 
@@ -34,6 +36,7 @@
 #include "wallet/wallet2.h"
 #include "cryptonote_tx_utils.h"
 #include "cryptonote_basic/tx_extra.h"
+#include "serialization/binary_utils.h"
 #include "int-util.h"
 #include "blockchain.h"
 #include "common/scoped_message_writer.h"
@@ -58,8 +61,76 @@ namespace service_nodes
 		return result;
 	}
 
+	namespace
+	{
+		bool to_serializable_event(const service_node_list::rollback_event& event, service_node_list::rollback_event_variant& result)
+		{
+			switch (event.type)
+			{
+			case service_node_list::rollback_event::change_type:
+				result = static_cast<const service_node_list::rollback_change&>(event);
+				return true;
+			case service_node_list::rollback_event::new_type:
+				result = static_cast<const service_node_list::rollback_new&>(event);
+				return true;
+			case service_node_list::rollback_event::prevent_type:
+				result = static_cast<const service_node_list::prevent_rollback&>(event);
+				return true;
+			default:
+				MERROR("On storing service node data, unknown rollback event type encountered");
+				return false;
+			}
+		}
+
+		std::unique_ptr<service_node_list::rollback_event> from_serializable_event(const service_node_list::rollback_event_variant& event)
+		{
+			if (event.type() == typeid(service_node_list::rollback_change))
+			{
+				service_node_list::rollback_change *i = new service_node_list::rollback_change(boost::get<service_node_list::rollback_change>(event));
+				i->type = service_node_list::rollback_event::change_type;
+				return std::unique_ptr<service_node_list::rollback_event>(i);
+			}
+			else if (event.type() == typeid(service_node_list::rollback_new))
+			{
+				service_node_list::rollback_new *i = new service_node_list::rollback_new(boost::get<service_node_list::rollback_new>(event));
+				i->type = service_node_list::rollback_event::new_type;
+				return std::unique_ptr<service_node_list::rollback_event>(i);
+			}
+			else if (event.type() == typeid(service_node_list::prevent_rollback))
+			{
+				service_node_list::prevent_rollback *i = new service_node_list::prevent_rollback(boost::get<service_node_list::prevent_rollback>(event));
+				i->type = service_node_list::rollback_event::prevent_type;
+				return std::unique_ptr<service_node_list::rollback_event>(i);
+			}
+
+			MERROR("Unhandled rollback event type in restoring data to service node list.");
+			return nullptr;
+		}
+
+		const crypto::public_key* get_event_key(const service_node_list::rollback_event& event)
+		{
+			switch (event.type)
+			{
+			case service_node_list::rollback_event::change_type:
+				return &static_cast<const service_node_list::rollback_change&>(event).m_key;
+			case service_node_list::rollback_event::new_type:
+				return &static_cast<const service_node_list::rollback_new&>(event).m_key;
+			default:
+				return nullptr;
+			}
+		}
+	}
+
+	struct service_node_list::rebuild_batch
+	{
+		std::vector<cryptonote::block> blocks;
+		std::vector<std::vector<cryptonote::transaction>> txs;
+		std::vector<std::vector<contribution_precomputed>> contributions;
+		std::vector<std::vector<uint8_t>> contributions_valid;
+	};
+
 	service_node_list::service_node_list(cryptonote::Blockchain& blockchain)
-		: m_blockchain(blockchain), m_height(0), m_db(nullptr), m_service_node_pubkey(nullptr)
+		: m_blockchain(blockchain), m_height(0), m_db(nullptr), m_service_node_pubkey(nullptr), m_quorums(std::make_shared<quorum_cache>()), m_state(std::make_shared<list_state>()), m_state_reset(true)
 	{
 	}
 
@@ -71,6 +142,7 @@ namespace service_nodes
 	void service_node_list::init()
 	{
 		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
+		const auto publish_on_exit = epee::misc_utils::create_scope_leave_handler([this]() { publish_state(collect_active_pubkeys()); });
 		if (m_blockchain.get_current_hard_fork_version() < 5)
 		{
 			clear(true);
@@ -85,89 +157,191 @@ namespace service_nodes
 
 		if (!loaded || m_height > current_height) clear(true);
 
+		// Skip replaying the blocks a stored snapshot already covers
+		if (current_height > 0 && load_snapshot(m_height, current_height - 1) && m_height == current_height)
+		{
+			store();
+			return;
+		}
+
 		LOG_PRINT_L0("Recalculating service nodes list, scanning blockchain from height " << m_height << " to: " << current_height);
 		LOG_PRINT_L0("This may take some time...");
 
-		std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> blocks;
-		for (uint64_t i = 0; m_height < current_height; i++)
-		{
-		  if (i > 0 && i % 10 == 0)
-		    LOG_PRINT_L0("... scanning height " << m_height);
+		// The rescan runs as a pipeline over batches of blocks: while one batch goes
+		// through process_block, which depends on the state left by the previous
+		// block, the contribution outputs of the next batch are decoded on the
+		// threadpool and the batch after that is read from the db.
+		const uint64_t batch_size = 1000;
+		tools::threadpool& tpool = tools::threadpool::getInstance();
+
+		rebuild_batch current, next, ahead;
+		bool next_ok = true, ahead_ok = true;
+		tools::threadpool::waiter precompute_waiter, fetch_waiter;
+
+		// The threadpool reads through its own read txns, which don't see the blocks
+		// of a write txn this thread has open, as when a reorg gets here while blocks
+		// are being added: the blocks are then read on this thread instead.
+		const bool fetch_in_pool = m_db && !m_db->has_write_txn();
+		const auto fetch = [&](uint64_t start, bool& ok, rebuild_batch& batch) {
+			const uint64_t end = std::min(start + batch_size, current_height);
+			if (fetch_in_pool)
+				tpool.submit(&fetch_waiter, [this, start, end, &ok, &batch]() { ok = fetch_rebuild_batch(start, end, batch); });
+			else
+				ok = fetch_rebuild_batch(start, end, batch);
+		};
 
-			blocks.clear();
-			if (!m_blockchain.get_blocks(m_height, 1000, blocks))
+		if (m_height < current_height)
+		{
+			if (!fetch_rebuild_batch(m_height, std::min(m_height + batch_size, current_height), current))
 			{
 				LOG_ERROR("Unable to initialize service nodes list");
 				return;
 			}
+			precompute_rebuild_batch(current, precompute_waiter);
+			const uint64_t next_start = m_height + current.blocks.size();
+			if (next_start < current_height)
+				fetch(next_start, next_ok, next);
+			precompute_waiter.wait(&tpool);
+			fetch_waiter.wait(&tpool);
+		}
+
+		std::vector<crypto::public_key> active_pubkeys; // only published once the rescan is done
+		for (uint64_t i = 0; !current.blocks.empty(); i++)
+		{
+			if (i > 0 && i % 10 == 0)
+				LOG_PRINT_L0("... scanning height " << m_height);
 
-			std::vector<cryptonote::transaction> txs;
-			std::vector<crypto::hash> missed_txs;
-			for (const auto& block_pair : blocks)
+			if (!next_ok)
 			{
-				txs.clear();
-				missed_txs.clear();
+				LOG_ERROR("Unable to initialize service nodes list");
+				return;
+			}
+
+			precompute_rebuild_batch(next, precompute_waiter);
+			const uint64_t ahead_start = m_height + current.blocks.size() + next.blocks.size();
+			if (!next.blocks.empty() && ahead_start < current_height)
+				fetch(ahead_start, ahead_ok, ahead);
 
-				const cryptonote::block& block = block_pair.second;
-				if (!m_blockchain.get_transactions(block.tx_hashes, txs, missed_txs))
+			for (size_t b = 0; b < current.blocks.size(); ++b)
+			{
+				const cryptonote::block& block = current.blocks[b];
+				for (size_t t = 0; t < block.tx_hashes.size(); ++t)
 				{
-					LOG_ERROR("Unable to get transactions for block " << block.hash);
-					return;
+					if (current.contributions_valid[b][t])
+						m_contribution_cache[block.tx_hashes[t]] = std::move(current.contributions[b][t]);
 				}
 
-				process_block(block, txs);
+				process_block(block, current.txs[b], active_pubkeys);
+				m_contribution_cache.clear();
 			}
+
+			precompute_waiter.wait(&tpool);
+			fetch_waiter.wait(&tpool);
+
+			current = std::move(next);
+			next = std::move(ahead);
+			ahead = rebuild_batch();
+			next_ok = ahead_ok;
+			ahead_ok = true;
 		}
+
+		store();
 	}
 
-	std::vector<crypto::public_key> service_node_list::get_service_nodes_pubkeys() const
+	// Reads blocks [start_height, end_height) and their transactions straight
+	// from the db; this runs on the threadpool while init() holds the blockchain
+	// lock, unless init()'s thread has a write txn open.
+	bool service_node_list::fetch_rebuild_batch(uint64_t start_height, uint64_t end_height, rebuild_batch& batch) const
 	{
-		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(m_height);
-		std::vector<crypto::public_key> result;
-		for (const auto& iter : m_service_nodes_infos)
+		batch = rebuild_batch();
+		if (!m_db)
+			return false;
+
+		try
 		{
-			//if(iter.second.is_valid())
-			if ((iter.second.is_valid() && hard_fork_version > 9) || iter.second.is_fully_funded())
-				result.push_back(iter.first);
-		}
+			batch.blocks.reserve(end_height - start_height);
+			batch.txs.reserve(end_height - start_height);
+			for (uint64_t height = start_height; height < end_height; ++height)
+			{
+				batch.blocks.push_back(m_db->get_block_from_height(height));
+				const cryptonote::block& block = batch.blocks.back();
 
-		std::sort(result.begin(), result.end(),
-			[](const crypto::public_key &a, const crypto::public_key &b) {
-			return memcmp(reinterpret_cast<const void*>(&a), reinterpret_cast<const void*>(&b), sizeof(a)) < 0;
-		});
-		return result;
+				batch.txs.emplace_back();
+				std::vector<cryptonote::transaction>& txs = batch.txs.back();
+				txs.resize(block.tx_hashes.size());
+				for (size_t i = 0; i < block.tx_hashes.size(); ++i)
+				{
+					if (!m_db->get_tx(block.tx_hashes[i], txs[i]))
+					{
+						LOG_ERROR("Unable to get transaction " << block.tx_hashes[i] << " for block at height " << height);
+						return false;
+					}
+					txs[i].set_hash(block.tx_hashes[i]);
+				}
+			}
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR("Unable to read blocks " << start_height << " to " << end_height << " from the db: " << e.what());
+			return false;
+		}
+		return true;
 	}
 
-	const std::shared_ptr<const quorum_state> service_node_list::get_quorum_state(uint64_t height) const
+	void service_node_list::precompute_rebuild_batch(rebuild_batch& batch, tools::threadpool::waiter& waiter) const
 	{
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
-		const auto &it = m_quorum_states.find(height);
-		if (it == m_quorum_states.end())
+		tools::threadpool& tpool = tools::threadpool::getInstance();
+		batch.contributions.resize(batch.blocks.size());
+		batch.contributions_valid.resize(batch.blocks.size());
+		for (size_t b = 0; b < batch.blocks.size(); ++b)
 		{
-			// TODO(triton): Not being able to find the quorum is going to be a fatal error.
+			tpool.submit(&waiter, [this, &batch, b]() {
+				const std::vector<cryptonote::transaction>& txs = batch.txs[b];
+				batch.contributions[b].resize(txs.size());
+				batch.contributions_valid[b].resize(txs.size());
+				for (size_t t = 0; t < txs.size(); ++t)
+				{
+					// only stakes (standard txs before v18) can be contributions
+					if (txs[t].type != cryptonote::txtype::stake && txs[t].type != cryptonote::txtype::standard)
+						continue;
+					batch.contributions_valid[b][t] = precompute_contribution(txs[t], cryptonote::tx_extra_index(txs[t].extra), 0, batch.contributions[b][t]);
+				}
+			}, true);
 		}
-		else
+	}
+
+	bool list_state::is_service_node(const crypto::public_key& pubkey) const
+	{
+		auto it = infos.find(pubkey);
+		return it != infos.end() && is_active(*it->second);
+	}
+
+	std::shared_ptr<const quorum_state> list_state::get_quorum_state(uint64_t height) const
+	{
+		std::shared_ptr<const quorum_state> result = quorums ? quorums->get(height) : nullptr;
+		if (!result)
 		{
-			return it->second;
+			// TODO(triton): Not being able to find the quorum is going to be a fatal error.
+			static const std::shared_ptr<const quorum_state> empty_quorum_state = std::make_shared<quorum_state>();
+			return empty_quorum_state;
 		}
 
-		return std::make_shared<quorum_state>();
+		return result;
 	}
 
-	std::vector<service_node_pubkey_info> service_node_list::get_service_node_list_state(const std::vector<crypto::public_key> &service_node_pubkeys) const
+	std::vector<service_node_pubkey_info> list_state::get_service_node_list_state(const std::vector<crypto::public_key> &service_node_pubkeys) const
 	{
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
 		std::vector<service_node_pubkey_info> result;
 
 		if (service_node_pubkeys.empty())
 		{
-			result.reserve(m_service_nodes_infos.size());
+			result.reserve(infos.size());
 
-			for (const auto &it : m_service_nodes_infos)
+			for (const auto &it : infos)
 			{
 				service_node_pubkey_info entry = {};
 				entry.pubkey = it.first;
-				entry.info = it.second;
+				entry.info = *it.second;
 				result.push_back(entry);
 			}
 		}
@@ -176,13 +350,13 @@ namespace service_nodes
 			result.reserve(service_node_pubkeys.size());
 			for (const auto &it : service_node_pubkeys)
 			{
-				const auto &find_it = m_service_nodes_infos.find(it);
-				if (find_it == m_service_nodes_infos.end())
+				const auto &find_it = infos.find(it);
+				if (find_it == infos.end())
 					continue;
 
 				service_node_pubkey_info entry = {};
 				entry.pubkey = (*find_it).first;
-				entry.info = (*find_it).second;
+				entry.info = *(*find_it).second;
 				result.push_back(entry);
 			}
 		}
@@ -190,6 +364,91 @@ namespace service_nodes
 		return result;
 	}
 
+	std::shared_ptr<const list_state> service_node_list::get_state() const
+	{
+		return std::atomic_load(&m_state);
+	}
+
+	std::vector<crypto::public_key> service_node_list::get_service_nodes_pubkeys() const
+	{
+		return get_state()->active_pubkeys;
+	}
+
+	const std::shared_ptr<const quorum_state> service_node_list::get_quorum_state(uint64_t height) const
+	{
+		return get_state()->get_quorum_state(height);
+	}
+
+	std::vector<service_node_pubkey_info> service_node_list::get_service_node_list_state(const std::vector<crypto::public_key> &service_node_pubkeys) const
+	{
+		return get_state()->get_service_node_list_state(service_node_pubkeys);
+	}
+
+	std::vector<crypto::public_key> service_node_list::collect_active_pubkeys() const
+	{
+		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(m_height);
+		std::vector<crypto::public_key> result;
+		for (const auto& iter : m_service_nodes_infos)
+		{
+			//if(iter.second.is_valid())
+			if ((iter.second.is_valid() && hard_fork_version > 9) || iter.second.is_fully_funded())
+				result.push_back(iter.first);
+		}
+
+		std::sort(result.begin(), result.end(),
+			[](const crypto::public_key &a, const crypto::public_key &b) {
+			return memcmp(reinterpret_cast<const void*>(&a), reinterpret_cast<const void*>(&b), sizeof(a)) < 0;
+		});
+		return result;
+	}
+
+	std::shared_ptr<const quorum_state> service_node_list::find_quorum_state(uint64_t height) const
+	{
+		return m_quorums->get(height);
+	}
+
+	size_t service_node_list::get_quorum_cache_memory_usage() const
+	{
+		return m_quorums->get_memory_usage();
+	}
+
+	// Only ever called with m_sn_mutex held, so the load/store pair cannot race another writer
+	void service_node_list::publish_state(std::vector<crypto::public_key> active_pubkeys)
+	{
+		const std::shared_ptr<const list_state> previous = get_state();
+		auto state = std::make_shared<list_state>();
+		state->height = m_height;
+		state->hard_fork_version = m_blockchain.get_hard_fork_version(m_height);
+
+		if (m_state_reset)
+		{
+			state->infos.reserve(m_service_nodes_infos.size());
+			for (const auto& kv_pair : m_service_nodes_infos)
+				state->infos.emplace(kv_pair.first, std::make_shared<service_node_info>(kv_pair.second));
+		}
+		else
+		{
+			// Nodes that did not change keep sharing their info with the previous state
+			state->infos = previous->infos;
+			for (const crypto::public_key& pubkey : m_changed_nodes)
+			{
+				const auto it = m_service_nodes_infos.find(pubkey);
+				if (it == m_service_nodes_infos.end())
+					state->infos.erase(pubkey);
+				else
+					state->infos[pubkey] = std::make_shared<service_node_info>(it->second);
+			}
+		}
+		m_changed_nodes.clear();
+		m_state_reset = false;
+
+		state->active_pubkeys = std::move(active_pubkeys);
+		state->quorums = m_quorums->get_snapshot();
+		state->winner = m_winner_index.select(m_service_nodes_infos, state->hard_fork_version);
+
+		std::atomic_store(&m_state, std::shared_ptr<const list_state>(std::move(state)));
+	}
+
 	void service_node_list::set_db_pointer(cryptonote::BlockchainDB* db)
 	{
 		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
@@ -204,10 +463,7 @@ namespace service_nodes
 
 	bool service_node_list::is_service_node(const crypto::public_key& pubkey) const
 	{
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
-		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(m_height);
-		auto it = m_service_nodes_infos.find(pubkey);
-		return it != m_service_nodes_infos.end() && ((hard_fork_version > 9 && it->second.is_valid()) || it->second.is_fully_funded());
+		return get_state()->is_service_node(pubkey);
 	}
 
 	bool service_node_list::contribution_tx_output_has_correct_unlock_time(const cryptonote::transaction& tx, size_t i, uint64_t block_height) const
@@ -220,12 +476,12 @@ namespace service_nodes
 		return unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER && unlock_time >= block_height + get_staking_requirement_lock_blocks(m_blockchain.nettype());
 	}
 
-	bool reg_tx_extract_fields(const cryptonote::transaction& tx, std::vector<cryptonote::account_public_address>& addresses, uint64_t& portions_for_operator, std::vector<uint64_t>& portions, uint64_t& expiration_timestamp, crypto::public_key& service_node_key, crypto::signature& signature, crypto::public_key& tx_pub_key)
+	bool reg_tx_extract_fields(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, std::vector<cryptonote::account_public_address>& addresses, uint64_t& portions_for_operator, std::vector<uint64_t>& portions, uint64_t& expiration_timestamp, crypto::public_key& service_node_key, crypto::signature& signature, crypto::public_key& tx_pub_key)
 	{
 		cryptonote::tx_extra_service_node_register registration;
-		if (!get_service_node_register_from_tx_extra(tx.extra, registration))
+		if (!get_service_node_register_from_tx_extra(extra, registration))
 			return false;
-		if (!cryptonote::get_service_node_pubkey_from_tx_extra(tx.extra, service_node_key))
+		if (!cryptonote::get_service_node_pubkey_from_tx_extra(extra, service_node_key))
 			return false;
 
 		addresses.clear();
@@ -237,7 +493,7 @@ namespace service_nodes
 		portions = registration.m_portions;
 		expiration_timestamp = registration.m_expiration_timestamp;
 		signature = registration.m_service_node_signature;
-		tx_pub_key = cryptonote::get_tx_pub_key_from_extra(tx.extra);
+		tx_pub_key = cryptonote::get_tx_pub_key_from_extra(extra);
 		return true;
 	}
 
@@ -279,19 +535,19 @@ namespace service_nodes
 		return money_transferred;
 	}
 
-	bool service_node_list::process_deregistration_tx(const cryptonote::transaction& tx, uint64_t block_height)
+	bool service_node_list::process_deregistration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height)
 	{
 		if (tx.type != cryptonote::txtype::deregister)
 			return false;
 
 		cryptonote::tx_extra_service_node_deregister deregister;
-		if (!cryptonote::get_service_node_deregister_from_tx_extra(tx.extra, deregister))
+		if (!cryptonote::get_service_node_deregister_from_tx_extra(extra, deregister))
 		{
 			LOG_ERROR("Transaction deregister did not have deregister data in tx extra, possibly corrupt tx in blockchain");
 			return false;
 		}
 
-		const auto state = get_quorum_state(deregister.block_height);
+		const auto state = find_quorum_state(deregister.block_height);
 
 		if (!state)
 		{
@@ -323,45 +579,57 @@ namespace service_nodes
 
 		m_rollback_events.push_back(std::unique_ptr<rollback_event>(new rollback_change(block_height, key, iter->second)));
 		m_service_nodes_infos.erase(iter);
+		update_node_indexes(key, nullptr);
 
 		return true;
 	}
 
-	void service_node_list::update_swarms(uint64_t height)
+	void service_node_list::update_swarms(uint64_t height, uint8_t hard_fork_version)
 	{
 		crypto::hash hash = m_blockchain.get_block_id_by_height(height);
 		uint64_t seed = 0;
 		std::memcpy(&seed, hash.data, sizeof(seed));
 
-		/// Gather existing swarms from infos
-		swarm_snode_map_t existing_swarms;
-
-		for (const auto& entry : m_service_nodes_infos) {
-			const auto id = entry.second.swarm_id;
-			existing_swarms[id].push_back(entry.first);
+		std::vector<std::pair<crypto::public_key, swarm_id_t>> changes;
+		if (hard_fork_version >= HF_VERSION_SWARM_INDEX)
+		{
+			/// The swarm index already holds every node's swarm
+			m_swarm_index.calc_changes(seed, changes);
 		}
+		else
+		{
+			/// Gather existing swarms from infos, in the order older nodes do
+			swarm_snode_map_t existing_swarms;
 
-		calc_swarm_changes(existing_swarms, seed);
-
-		/// Apply changes
-		for (const auto &entry : existing_swarms) {
+			for (const auto& entry : m_service_nodes_infos) {
+				const auto id = entry.second.swarm_id;
+				existing_swarms[id].push_back(entry.first);
+			}
 
-			const swarm_id_t swarm_id = entry.first;
-			const std::vector<crypto::public_key>& snodes = entry.second;
+			calc_swarm_changes(existing_swarms, seed);
 
-			for (const auto &snode : snodes) {
+			for (const auto &entry : existing_swarms) {
+				for (const auto &snode : entry.second) {
+					if (m_service_nodes_infos.at(snode).swarm_id != entry.first)
+						changes.emplace_back(snode, entry.first);
+				}
+			}
+		}
 
-				auto& sn_info = m_service_nodes_infos.at(snode);
-				if (sn_info.swarm_id == swarm_id) continue; /// nothing changed for this snode
+		/// Apply changes
+		for (const auto &change : changes) {
+			auto& sn_info = m_service_nodes_infos.at(change.first);
 
-															/// modify info and record the change
-				m_rollback_events.push_back(std::unique_ptr<rollback_event>(new rollback_change(height, snode, sn_info)));
-				sn_info.swarm_id = swarm_id;
-			}
+			/// modify info and record the change
+			m_rollback_events.push_back(std::unique_ptr<rollback_event>(new rollback_change(height, change.first, sn_info)));
+			sn_info.swarm_id = change.second;
+			m_swarm_index.set(change.first, change.second);
+			if (!m_state_reset)
+				m_changed_nodes.insert(change.first);
 		}
 	}
 
-	bool service_node_list::is_registration_tx(const cryptonote::transaction& tx, uint64_t block_timestamp, uint64_t block_height, uint32_t index, crypto::public_key& key, service_node_info& info) const
+	bool service_node_list::is_registration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_timestamp, uint64_t block_height, uint32_t index, crypto::public_key& key, service_node_info& info) const
 	{
 		crypto::public_key tx_pub_key, service_node_key;
 		std::vector<cryptonote::account_public_address> service_node_addresses;
@@ -372,7 +640,7 @@ namespace service_nodes
 
 		uint8_t hf_version = m_blockchain.get_hard_fork_version(block_height);
 
-		if (!reg_tx_extract_fields(tx, service_node_addresses, portions_for_operator, service_node_portions, expiration_timestamp, service_node_key, signature, tx_pub_key))
+		if (!reg_tx_extract_fields(tx, extra, service_node_addresses, portions_for_operator, service_node_portions, expiration_timestamp, service_node_key, signature, tx_pub_key))
 			return false;
 
 		if (service_node_portions.size() != service_node_addresses.size() || service_node_portions.empty())
@@ -403,7 +671,7 @@ namespace service_nodes
 		cryptonote::account_public_address address;
 		uint64_t transferred = 0;
 
-		if (!get_contribution(tx, block_height, address, transferred))
+		if (!get_contribution(tx, extra, block_height, address, transferred))
 			return false;
 		int is_this_a_new_address = 0;
 		if (std::find(service_node_addresses.begin(), service_node_addresses.end(), address) == service_node_addresses.end())
@@ -418,7 +686,7 @@ namespace service_nodes
 
 		if (hf_version >= 12)
 		{
-			uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(tx.extra);
+			uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(extra);
 			uint64_t total_fee = tx.rct_signatures.txnFee;
 		  uint64_t miner_fee = get_tx_miner_fee(tx, hf_version, true);
 			uint64_t burn_fee = total_fee - miner_fee;
@@ -482,11 +750,11 @@ namespace service_nodes
 		return true;
 	}
 
-	bool service_node_list::process_registration_tx(const cryptonote::transaction& tx, uint64_t block_timestamp, uint64_t block_height, uint32_t index)
+	bool service_node_list::process_registration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_timestamp, uint64_t block_height, uint32_t index)
 	{
 		crypto::public_key key;
 		service_node_info info = {};
-		if (!is_registration_tx(tx, block_timestamp, block_height, index, key, info))
+		if (!is_registration_tx(tx, extra, block_timestamp, block_height, index, key, info))
 			return false;
 
 		// NOTE: A node doesn't expire until registration_height + lock blocks excess now which acts as the grace period
@@ -532,48 +800,75 @@ namespace service_nodes
 
 		m_rollback_events.push_back(std::unique_ptr<rollback_event>(new rollback_new(block_height, key)));
 		m_service_nodes_infos[key] = info;
+		update_node_indexes(key, &info);
 
 		return true;
 	}
 
-	bool service_node_list::get_contribution(const cryptonote::transaction& tx, uint64_t block_height, cryptonote::account_public_address& address, uint64_t& transferred) const
+	// Decodes the outputs that carry a stake when counted at min_block_height or
+	// later. The rebuild passes 0 so that get_contribution can pick the ones that
+	// count once the height the contribution is checked against is known.
+	bool service_node_list::precompute_contribution(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t min_block_height, contribution_precomputed& result) const
 	{
 		crypto::secret_key tx_key;
 
-		if (!cryptonote::get_service_node_contributor_from_tx_extra(tx.extra, address))
+		if (!cryptonote::get_service_node_contributor_from_tx_extra(extra, result.address))
 			return false;
-		if (!cryptonote::get_tx_secret_key_from_tx_extra(tx.extra, tx_key))
+		if (!cryptonote::get_tx_secret_key_from_tx_extra(extra, tx_key))
 			return false;
 
 		crypto::key_derivation derivation;
-		if (!crypto::generate_key_derivation(address.m_view_public_key, tx_key, derivation))
+		if (!crypto::generate_key_derivation(result.address.m_view_public_key, tx_key, derivation))
 			return false;
 
 		hw::device& hwdev = hw::get_device("default");
 
+		result.output_amounts.assign(tx.vout.size(), 0);
+		for (size_t i = 0; i < tx.vout.size(); i++)
+		{
+			if (contribution_tx_output_has_correct_unlock_time(tx, i, min_block_height)) {
+				result.output_amounts[i] = get_reg_tx_staking_output_contribution(tx, i, derivation, hwdev);
+			}
+		}
+
+		return true;
+	}
+
+	bool service_node_list::get_contribution(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, cryptonote::account_public_address& address, uint64_t& transferred) const
+	{
+		contribution_precomputed computed;
+		const contribution_precomputed* contribution = &computed;
+
+		const auto it = m_contribution_cache.empty() ? m_contribution_cache.end() : m_contribution_cache.find(cryptonote::get_transaction_hash(tx));
+		if (it != m_contribution_cache.end())
+			contribution = &it->second;
+		else if (!precompute_contribution(tx, extra, block_height, computed))
+			return false;
+
+		address = contribution->address;
 		transferred = 0;
 		for (size_t i = 0; i < tx.vout.size(); i++)
 		{
 			if (contribution_tx_output_has_correct_unlock_time(tx, i, block_height)) {
-				transferred += get_reg_tx_staking_output_contribution(tx, i, derivation, hwdev);
+				transferred += contribution->output_amounts[i];
 			}
 		}
 
 		return true;
 	}
 
-	bool service_node_list::process_swap_tx(const cryptonote::transaction& tx, uint64_t block_height, uint32_t index)
+	bool service_node_list::process_swap_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, uint32_t index)
 	{
 		cryptonote::account_public_address address;
 		std::string swap_amount;
 		cryptonote::tx_extra_memo memo;
 
-		if(!get_memo_from_tx_extra(tx.extra, memo))
+		if(!get_memo_from_tx_extra(extra, memo))
 			return false;
 
 		crypto::secret_key tx_key;
 
-		if (!cryptonote::get_tx_secret_key_from_tx_extra(tx.extra, tx_key))
+		if (!cryptonote::get_tx_secret_key_from_tx_extra(extra, tx_key))
 			return false;
 
 		crypto::key_derivation derivation;
@@ -611,13 +906,13 @@ namespace service_nodes
 		return true;
 	}
 
-	void service_node_list::process_contribution_tx(const cryptonote::transaction& tx, uint64_t block_height, uint32_t index)
+	void service_node_list::process_contribution_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, uint32_t index)
 	{
 		crypto::public_key pubkey;
 		cryptonote::account_public_address address;
 		uint64_t transferred;
 
-		if (!cryptonote::get_service_node_pubkey_from_tx_extra(tx.extra, pubkey))
+		if (!cryptonote::get_service_node_pubkey_from_tx_extra(extra, pubkey))
 			return;
 
 		auto iter = m_service_nodes_infos.find(pubkey);
@@ -629,7 +924,7 @@ namespace service_nodes
 
 		const uint64_t block_for_unlock = hf_version >= 12 ? info.registration_height : block_height;
 
-		if (!get_contribution(tx, block_for_unlock, address, transferred))
+		if (!get_contribution(tx, extra, block_for_unlock, address, transferred))
 			return;
 
 		if (info.is_fully_funded())
@@ -637,7 +932,7 @@ namespace service_nodes
 
 		if (hf_version >= 12)
 		{
-			uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(tx.extra);
+			uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(extra);
 			uint64_t total_fee = tx.rct_signatures.txnFee;
 		        uint64_t miner_fee = get_tx_miner_fee(tx, hf_version, true);
 			uint64_t burn_fee = total_fee - miner_fee;
@@ -703,6 +998,7 @@ namespace service_nodes
 
 		info.last_reward_block_height = block_height;
 		info.last_reward_transaction_index = index;
+		update_node_indexes(pubkey, &info);
 
 		LOG_PRINT_L1("Contribution of " << transferred << " received for Oracle Node " << pubkey);
 
@@ -712,22 +1008,29 @@ namespace service_nodes
 	void service_node_list::block_added(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs)
 	{
 		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
-		process_block(block, txs);
-		store();
+		std::vector<crypto::public_key> active_pubkeys;
+		process_block(block, txs, active_pubkeys);
+		publish_state(std::move(active_pubkeys));
+		const uint64_t height = cryptonote::get_block_height(block);
+		store_block_delta(height);
+		if (height > 0 && height % STATE_SNAPSHOT_INTERVAL == 0)
+			store_snapshot(height, cryptonote::get_block_hash(block));
 	}
 
-	void service_node_list::process_block(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs)
+	void service_node_list::process_block(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs, std::vector<crypto::public_key>& active_pubkeys)
 	{
 		uint64_t block_height = cryptonote::get_block_height(block);
 		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(block_height);
 
 		if (hard_fork_version < 5)
+		{
+			active_pubkeys = collect_active_pubkeys();
 			return;
+		}
 
 		{
 		  assert(m_height == block_height);
 		  ++m_height;
-			const size_t ROLLBACK_EVENT_EXPIRATION_BLOCKS = 30;
 			uint64_t cull_height = (block_height < ROLLBACK_EVENT_EXPIRATION_BLOCKS) ? block_height : block_height - ROLLBACK_EVENT_EXPIRATION_BLOCKS;
 
 			while (!m_rollback_events.empty() && m_rollback_events.front()->m_block_height < cull_height)
@@ -757,6 +1060,7 @@ namespace service_nodes
 
 				expired_count++;
 				m_service_nodes_infos.erase(i);
+				update_node_indexes(pubkey, nullptr);
 			}
 			// Service nodes may expire early if they double staked by accident, so
 			// expiration doesn't mean the node is in the list.
@@ -769,6 +1073,7 @@ namespace service_nodes
 			// set the winner as though it was re-registering at transaction index=UINT32_MAX for this block
 			m_service_nodes_infos[winner_pubkey].last_reward_block_height = block_height;
 			m_service_nodes_infos[winner_pubkey].last_reward_transaction_index = UINT32_MAX;
+			update_node_indexes(winner_pubkey, &m_service_nodes_infos[winner_pubkey]);
 		}
 
 		size_t registrations = 0;
@@ -776,44 +1081,50 @@ namespace service_nodes
 		uint32_t index = 0;
 		for (const cryptonote::transaction& tx : txs)
 		{
-		  if ((hard_fork_version >= 18 && tx.type == cryptonote::txtype::stake) ||
-		      (hard_fork_version <= 17 && tx.type == cryptonote::txtype::standard))
-		  {
-			if (process_registration_tx(tx, block.timestamp, block_height, index))
-				registrations++;
-
-			process_contribution_tx(tx, block_height, index);
-         	  }
-	          else if ((hard_fork_version >= 18 && tx.type == cryptonote::txtype::swap) || (hard_fork_version <= 17 && tx.type == cryptonote::txtype::standard))
-	          {
-                	process_swap_tx(tx, block_height, index);
-              	  }
-              	  else if (tx.type == cryptonote::txtype::deregister)
-              	  {
-                	if (process_deregistration_tx(tx, block_height))
-        		    deregistrations++;
-      		  }
-                  index++;
-			
+			// only the txs handled below need their extra indexed
+			if ((hard_fork_version >= 18 && tx.type == cryptonote::txtype::stake) ||
+			    (hard_fork_version <= 17 && tx.type == cryptonote::txtype::standard))
+			{
+				const cryptonote::tx_extra_index extra(tx.extra);
+				if (process_registration_tx(tx, extra, block.timestamp, block_height, index))
+					registrations++;
+
+				process_contribution_tx(tx, extra, block_height, index);
+			}
+			else if (hard_fork_version >= 18 && tx.type == cryptonote::txtype::swap)
+			{
+				process_swap_tx(tx, cryptonote::tx_extra_index(tx.extra), block_height, index);
+			}
+			else if (tx.type == cryptonote::txtype::deregister)
+			{
+				if (process_deregistration_tx(tx, cryptonote::tx_extra_index(tx.extra), block_height))
+					deregistrations++;
+			}
+			index++;
 		}
 
 		if (registrations || deregistrations || expired_count) {
-			update_swarms(block_height);
+			update_swarms(block_height, hard_fork_version);
 		}
 
-    const auto deregister_lifetime = hard_fork_version >= 8 ? service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT_V2 : service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT;
-		const size_t QUORUM_LIFETIME = (6 * deregister_lifetime);
-		const size_t cache_state_from_height = (block_height < QUORUM_LIFETIME) ? 0 : block_height - QUORUM_LIFETIME;
-		store_quorum_state_from_rewards_list(block_height);
-		while (!m_quorum_states.empty() && m_quorum_states.begin()->first < cache_state_from_height)
-		{
-			m_quorum_states.erase(m_quorum_states.begin());
-		}
+		const uint64_t cache_state_from_height = get_quorum_cache_start_height(block_height);
+		active_pubkeys = collect_active_pubkeys();
+		store_quorum_state_from_rewards_list(block_height, active_pubkeys);
+		m_quorums->remove_below(cache_state_from_height);
+	}
+
+	uint64_t service_node_list::get_quorum_cache_start_height(uint64_t block_height) const
+	{
+		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(block_height);
+		const uint64_t deregister_lifetime = get_deregister_lifetime(hard_fork_version);
+		const uint64_t QUORUM_LIFETIME = (6 * deregister_lifetime);
+		return (block_height < QUORUM_LIFETIME) ? 0 : block_height - QUORUM_LIFETIME;
 	}
 
 	void service_node_list::blockchain_detached(uint64_t height)
 	{
 		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
+		std::unordered_set<crypto::public_key> rolled_back_keys;
 		while (!m_rollback_events.empty() && m_rollback_events.back()->m_block_height >= height)
 		{
 			if (!m_rollback_events.back()->apply(m_service_nodes_infos))
@@ -821,94 +1132,101 @@ namespace service_nodes
 				init();
 				break;
 			}
+			if (const crypto::public_key* key = get_event_key(*m_rollback_events.back()))
+			{
+				const auto it = m_service_nodes_infos.find(*key);
+				update_node_indexes(*key, it == m_service_nodes_infos.end() ? nullptr : &it->second);
+				rolled_back_keys.insert(*key);
+			}
 			m_rollback_events.pop_back();
 		}
 
-		while (!m_quorum_states.empty() && (--m_quorum_states.end())->first >= height)
-		{
-			m_quorum_states.erase(--m_quorum_states.end());
-		}
+		m_quorums->remove_from(height);
 
 		m_height = height;
 
-		store();
+		publish_state(collect_active_pubkeys());
+		if (height > 0)
+			store_block_delta(height - 1, &rolled_back_keys);
+	}
+
+	// Nodes are only ever processed from hard fork 5 on, so the lock period always includes the excess
+	uint64_t service_node_list::get_expiry_height(const service_node_info& info) const
+	{
+		return info.registration_height + get_staking_requirement_lock_blocks(m_blockchain.nettype()) + STAKING_REQUIREMENT_LOCK_BLOCKS_EXCESS;
 	}
 
 	std::vector<crypto::public_key> service_node_list::get_expired_nodes(uint64_t block_height) const
 	{
 		std::vector<crypto::public_key> expired_nodes;
-		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(block_height);
-
-		uint64_t lock_blocks = get_staking_requirement_lock_blocks(m_blockchain.nettype());
-		if (hard_fork_version >= 5)
-			lock_blocks += STAKING_REQUIREMENT_LOCK_BLOCKS_EXCESS;
+		for (auto it = m_nodes_by_expiry_height.begin(); it != m_nodes_by_expiry_height.end() && it->first < block_height; ++it)
+			expired_nodes.insert(expired_nodes.end(), it->second.begin(), it->second.end());
+		return expired_nodes;
+	}
 
-		if (block_height < lock_blocks)
-			return expired_nodes;
+	void service_node_list::update_node_indexes(const crypto::public_key& pubkey, const service_node_info* info)
+	{
+		m_winner_index.update(pubkey, info);
+		if (info)
+			m_swarm_index.set(pubkey, info->swarm_id);
+		else
+			m_swarm_index.remove(pubkey);
+		if (!m_state_reset)
+			m_changed_nodes.insert(pubkey);
 
-		if (hard_fork_version >= 5)
+		const uint64_t expiry_height = info ? get_expiry_height(*info) : 0;
+		const auto it = m_expiry_heights.find(pubkey);
+		if (it != m_expiry_heights.end())
 		{
-			for (auto &it : m_service_nodes_infos)
+			if (info && it->second == expiry_height)
+				return;
+			const auto bucket = m_nodes_by_expiry_height.find(it->second);
+			bucket->second.erase(pubkey);
+			if (bucket->second.empty())
+				m_nodes_by_expiry_height.erase(bucket);
+			if (!info)
 			{
-				crypto::public_key const &pubkey = it.first;
-				service_node_info  const &info = it.second;
-
-				uint64_t node_expiry_height = info.registration_height + lock_blocks;
-				if (block_height > node_expiry_height)
-				{
-					expired_nodes.push_back(pubkey);
-				}
+				m_expiry_heights.erase(it);
+				return;
 			}
+			it->second = expiry_height;
+		}
+		else if (!info)
+		{
+			return;
 		}
 		else
 		{
-			const uint64_t expired_nodes_block_height = block_height - lock_blocks;
-			std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> blocks;
-			std::vector<cryptonote::blobdata> tx_blobs;
-
-			if (!m_blockchain.get_blocks(expired_nodes_block_height, 1, blocks, tx_blobs))
-			{
-				LOG_ERROR("Unable to get historical blocks");
-				return expired_nodes;
-			}
-
-			const cryptonote::block& block = blocks.begin()->second;
-
-			std::vector<cryptonote::transaction> txs;
-			std::vector<crypto::hash> missed_txs;
-			if (!m_blockchain.get_transactions(block.tx_hashes, txs, missed_txs))
-			{
-				LOG_ERROR("Unable to get transactions for block " << block.hash);
-				return expired_nodes;
-			}
-
-			uint32_t index = 0;
-			for (const cryptonote::transaction& tx : txs)
-			{
-				crypto::public_key key;
-				service_node_info info = {};
-				if (is_registration_tx(tx, block.timestamp, expired_nodes_block_height, index, key, info))
-				{
-					expired_nodes.push_back(key);
-				}
-				index++;
-			}
+			m_expiry_heights.emplace(pubkey, expiry_height);
 		}
+		m_nodes_by_expiry_height[expiry_height].insert(pubkey);
+	}
 
-		return expired_nodes;
+	void service_node_list::rebuild_node_indexes()
+	{
+		m_winner_index.clear();
+		m_swarm_index.clear();
+		m_nodes_by_expiry_height.clear();
+		m_expiry_heights.clear();
+		for (const auto& kv_pair : m_service_nodes_infos)
+			update_node_indexes(kv_pair.first, &kv_pair.second);
 	}
 
 	std::vector<std::pair<cryptonote::account_public_address, uint64_t>> service_node_list::get_winner_addresses_and_portions() const
 	{
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
-		crypto::public_key key = select_winner();
+		return get_winner_addresses_and_portions(*get_state());
+	}
+
+	std::vector<std::pair<cryptonote::account_public_address, uint64_t>> service_node_list::get_winner_addresses_and_portions(const list_state& state) const
+	{
+		const crypto::public_key& key = state.winner;
 
 		if (key == crypto::null_pkey)
 			return { std::make_pair(null_address, STAKING_PORTIONS) };
 
 		std::vector<std::pair<cryptonote::account_public_address, uint64_t>> winners;
 
-		const service_node_info& info = m_service_nodes_infos.at(key);
+		const service_node_info& info = *state.infos.at(key);
 
 		uint8_t hard_fork_version = m_blockchain.get_current_hard_fork_version();
 
@@ -955,51 +1273,26 @@ namespace service_nodes
 
 	crypto::public_key service_node_list::select_winner() const
 	{
-		uint8_t hard_fork_version = m_blockchain.get_hard_fork_version(m_height);
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
-		auto oldest_waiting = std::pair<uint64_t, uint32_t>(std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint32_t>::max());
-		crypto::public_key key = crypto::null_pkey;
-		bool overPortioned = false;
-		for (const auto& info : m_service_nodes_infos)
-		{
-			if(hard_fork_version == 12)
-			{
-				uint64_t amount_operator_needs_to_stake = portions_to_amount(info.second.portions_for_operator, info.second.staking_requirement);
-
-				if(info.second.total_contributed < amount_operator_needs_to_stake)
-				{
-					overPortioned = true;
-				}
-			}
-
-			if ((info.second.is_valid() && hard_fork_version > 9) || (info.second.is_fully_funded() && !overPortioned))
-			{
-				auto waiting_since = std::make_pair(info.second.last_reward_block_height, info.second.last_reward_transaction_index);
-				if (waiting_since < oldest_waiting)
-				{
-					oldest_waiting = waiting_since;
-					key = info.first;
-				}
-			}
-		}
-		return key;
+		return get_state()->winner;
 	}
 
 	/// validates the miner TX for the next block
 	//
 	bool service_node_list::validate_miner_tx(const crypto::hash& prev_id, const cryptonote::transaction& miner_tx, uint64_t height, uint8_t hard_fork_version, cryptonote::block_reward_parts const &reward_parts) const
 	{
-		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
 		if (hard_fork_version < 5)
 			return true;
 
+		// Winner and payouts come from one state so they cannot straddle a block
+		const std::shared_ptr<const list_state> state = get_state();
+
 		// NOTE(triton): Service node reward distribution is calculated from the
 		// original amount, i.e. 50% of the original base reward goes to service
 		// nodes not 50% of the reward after removing the governance component (the
 		// adjusted base reward post hardfork 10).
 		uint64_t base_reward = reward_parts.adjusted_base_reward;
 		uint64_t total_service_node_reward = cryptonote::service_node_reward_formula(base_reward, hard_fork_version);
-		crypto::public_key winner = select_winner();
+		const crypto::public_key& winner = state->winner;
 
 		crypto::public_key check_winner_pubkey = cryptonote::get_service_node_winner_from_tx_extra(miner_tx.extra);
 		if (check_winner_pubkey != winner)
@@ -1008,7 +1301,7 @@ namespace service_nodes
 			return false;
 		}
 
-		const std::vector<std::pair<cryptonote::account_public_address, uint64_t>> addresses_and_portions = get_winner_addresses_and_portions();
+		const std::vector<std::pair<cryptonote::account_public_address, uint64_t>> addresses_and_portions = get_winner_addresses_and_portions(*state);
 
 		if (miner_tx.vout.size() - 1 < addresses_and_portions.size())
 		{
@@ -1064,7 +1357,8 @@ namespace service_nodes
 		return true;
 	}
 
-	void service_node_list::store_quorum_state_from_rewards_list(uint64_t height)
+	// The quorum itself is only drawn once something asks for it
+	void service_node_list::store_quorum_state_from_rewards_list(uint64_t height, const std::vector<crypto::public_key>& active_pubkeys)
 	{
 		const crypto::hash block_hash = m_blockchain.get_block_id_by_height(height);
 		if (block_hash == crypto::null_hash)
@@ -1073,52 +1367,7 @@ namespace service_nodes
 			return;
 		}
 
-		std::vector<crypto::public_key> full_node_list = get_service_nodes_pubkeys();
-		std::vector<size_t>                              pub_keys_indexes(full_node_list.size());
-		{
-			size_t index = 0;
-			for (size_t i = 0; i < full_node_list.size(); i++) { pub_keys_indexes[i] = i; }
-
-			// Shuffle indexes
-			uint64_t seed = 0;
-			std::memcpy(&seed, block_hash.data, std::min(sizeof(seed), sizeof(block_hash.data)));
-
-			xeq_shuffle(pub_keys_indexes, seed);
-		}
-
-		// Assign indexes from shuffled list into quorum and list of nodes to test
-
-		auto new_state = std::make_shared<quorum_state>();
-		{
-			std::vector<crypto::public_key>& quorum = new_state->quorum_nodes;
-			{
-				quorum.resize(std::min(full_node_list.size(), QUORUM_SIZE));
-				for (size_t i = 0; i < quorum.size(); i++)
-				{
-					size_t node_index = pub_keys_indexes[i];
-					const crypto::public_key &key = full_node_list[node_index];
-					quorum[i] = key;
-				}
-			}
-
-			std::vector<crypto::public_key>& nodes_to_test = new_state->nodes_to_test;
-			{
-				size_t num_remaining_nodes = pub_keys_indexes.size() - quorum.size();
-				size_t num_nodes_to_test = std::max(num_remaining_nodes / NTH_OF_THE_NETWORK_TO_TEST, std::min(MIN_NODES_TO_TEST, num_remaining_nodes));
-
-				nodes_to_test.resize(num_nodes_to_test);
-
-				const int pub_keys_offset = quorum.size();
-				for (size_t i = 0; i < nodes_to_test.size(); i++)
-				{
-					size_t node_index = pub_keys_indexes[pub_keys_offset + i];
-					const crypto::public_key &key = full_node_list[node_index];
-					nodes_to_test[i] = key;
-				}
-			}
-		}
-
-		m_quorum_states[height] = new_state;
+		m_quorums->add(height, block_hash, active_pubkeys);
 	}
 
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1165,6 +1414,9 @@ namespace service_nodes
 		return false;
 	}
 
+	// Writes the complete list state as per-node infos and per-block deltas,
+	// replacing whatever was stored before. This is also what compacts the delta
+	// table after a rescan or a reorg.
 	bool service_node_list::store()
 	{
 		if (!m_db)
@@ -1174,63 +1426,170 @@ namespace service_nodes
     if (hard_fork_version < 5)
       return true;
 
-		data_members_for_serialization data_to_store;
+		std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
+
+		std::map<block_height, block_delta_for_serialization> deltas;
+		if (m_height > 0)
+			deltas[m_height - 1].height = m_height - 1;
+
+		const std::vector<uint64_t> quorum_heights = m_quorums->get_heights();
+		for (uint64_t height : quorum_heights)
 		{
-			std::lock_guard<boost::recursive_mutex> lock(m_sn_mutex);
+			block_delta_for_serialization& delta = deltas[height];
+			delta.height = height;
+			fill_delta_quorum(delta, height == quorum_heights.front());
+		}
 
-			quorum_state_for_serialization quorum;
-			for (const auto& kv_pair : m_quorum_states)
-			{
-				quorum.height = kv_pair.first;
-				quorum.state = *kv_pair.second;
-				data_to_store.quorum_states.push_back(quorum);
-			}
+		for (const auto& event_ptr : m_rollback_events)
+		{
+			// The leading prevent_rollback is recreated from the height on load
+			if (event_ptr->type == rollback_event::prevent_type)
+				continue;
 
-			node_info_for_serialization info;
-			for (const auto& kv_pair : m_service_nodes_infos)
+			rollback_event_variant event;
+			if (!to_serializable_event(*event_ptr, event))
+				return false;
+			block_delta_for_serialization& delta = deltas[event_ptr->m_block_height];
+			delta.height = event_ptr->m_block_height;
+			delta.events.push_back(std::move(event));
+		}
+
+		cryptonote::db_wtxn_guard txn_guard(m_db);
+		m_db->clear_service_node_data();
+		m_db->clear_service_node_deltas();
+
+		for (auto& kv_pair : m_service_nodes_infos)
+		{
+			std::string blob;
+			bool r = ::serialization::dump_binary(kv_pair.second, blob);
+			CHECK_AND_ASSERT_MES(r, false, "Failed to store service node info: failed to serialize data");
+			m_db->set_service_node_info(kv_pair.first, blob);
+		}
+
+		for (auto& kv_pair : deltas)
+		{
+			std::string blob;
+			bool r = ::serialization::dump_binary(kv_pair.second, blob);
+			CHECK_AND_ASSERT_MES(r, false, "Failed to store service node delta: failed to serialize data");
+			m_db->set_service_node_block_delta(kv_pair.first, blob);
+		}
+
+		return true;
+	}
+
+	// Writes only what the block at the given height changed: its rollback
+	// events, its quorum state and the current infos of the nodes it touched.
+	// After a detach, detached_keys holds the nodes the rollback restored; the
+	// deltas of the detached blocks above the height are dropped.
+	bool service_node_list::store_block_delta(uint64_t height, const std::unordered_set<crypto::public_key>* detached_keys)
+	{
+		if (!m_db)
+		  return false;
+
+		if (m_blockchain.get_hard_fork_version(height) < 5)
+			return true;
+
+		block_delta_for_serialization delta;
+		delta.height = height;
+
+		std::unordered_set<crypto::public_key> changed_keys;
+		if (detached_keys)
+			changed_keys = *detached_keys;
+		auto it = m_rollback_events.end();
+		while (it != m_rollback_events.begin() && (*std::prev(it))->m_block_height == height)
+			--it;
+		for (; it != m_rollback_events.end(); ++it)
+		{
+			if ((*it)->type == rollback_event::prevent_type)
+				continue;
+
+			rollback_event_variant event;
+			if (!to_serializable_event(**it, event))
+				return false;
+			delta.events.push_back(std::move(event));
+
+			if (const crypto::public_key* key = get_event_key(**it))
+				changed_keys.insert(*key);
+		}
+
+		fill_delta_quorum(delta, false);
+
+		std::string blob;
+		bool r = ::serialization::dump_binary(delta, blob);
+		CHECK_AND_ASSERT_MES(r, false, "Failed to store service node delta: failed to serialize data");
+
+		cryptonote::db_wtxn_guard txn_guard(m_db);
+		if (detached_keys)
+			m_db->remove_service_node_block_deltas(height + 1, std::numeric_limits<uint64_t>::max());
+		m_db->set_service_node_block_delta(height, blob);
+
+		for (const crypto::public_key& key : changed_keys)
+		{
+			const auto info_it = m_service_nodes_infos.find(key);
+			if (info_it == m_service_nodes_infos.end())
 			{
-				info.key = kv_pair.first;
-				info.info = kv_pair.second;
-				data_to_store.infos.push_back(info);
+				m_db->remove_service_node_info(key);
+				continue;
 			}
 
-			rollback_event_variant event;
-			for (const auto& event_ptr : m_rollback_events)
+			r = ::serialization::dump_binary(info_it->second, blob);
+			CHECK_AND_ASSERT_MES(r, false, "Failed to store service node info: failed to serialize data");
+			m_db->set_service_node_info(key, blob);
+		}
+
+		if (height % STATE_DELTA_COMPACTION_INTERVAL == 0)
+		{
+			uint64_t keep_from_height = m_rollback_events.empty() ? height : m_rollback_events.front()->m_block_height;
+			const std::vector<uint64_t> quorum_heights = m_quorums->get_heights();
+			if (!quorum_heights.empty())
+				keep_from_height = std::min(keep_from_height, quorum_heights.front());
+			m_db->remove_service_node_block_deltas(0, keep_from_height);
+
+			// The oldest quorum kept may have been stored as changes to a delta just removed
+			if (!quorum_heights.empty() && quorum_heights.front() != height)
 			{
-				switch (event_ptr->type)
+				block_delta_for_serialization first;
+				first.height = quorum_heights.front();
+				for (const auto& event_ptr : m_rollback_events)
 				{
-				case rollback_event::change_type:
-					event = *reinterpret_cast<rollback_change *>(event_ptr.get());
-					data_to_store.events.push_back(*reinterpret_cast<rollback_change *>(event_ptr.get()));
-					break;
-				case rollback_event::new_type:
-					event = *reinterpret_cast<rollback_new *>(event_ptr.get());
-					data_to_store.events.push_back(*reinterpret_cast<rollback_new *>(event_ptr.get()));
-					break;
-				case rollback_event::prevent_type:
-					event = *reinterpret_cast<prevent_rollback *>(event_ptr.get());
-					data_to_store.events.push_back(*reinterpret_cast<prevent_rollback *>(event_ptr.get()));
-					break;
-				default:
-					MERROR("On storing service node data, unknown rollback event type encountered");
-					return false;
+					if (event_ptr->m_block_height != first.height || event_ptr->type == rollback_event::prevent_type)
+						continue;
+					rollback_event_variant event;
+					if (!to_serializable_event(*event_ptr, event))
+						return false;
+					first.events.push_back(std::move(event));
 				}
+				fill_delta_quorum(first, true);
+
+				r = ::serialization::dump_binary(first, blob);
+				CHECK_AND_ASSERT_MES(r, false, "Failed to store service node delta: failed to serialize data");
+				m_db->set_service_node_block_delta(first.height, blob);
 			}
 		}
 
-		data_to_store.height = m_height;
-
-		std::stringstream ss;
-		binary_archive<true> ba(ss);
-
-		bool r = ::serialization::serialize(ba, data_to_store);
-		CHECK_AND_ASSERT_MES(r, false, "Failed to store service node info: failed to serialize data");
+		return true;
+	}
 
-		std::string blob = ss.str();
-		cryptonote::db_wtxn_guard txn_guard(m_db);
-		m_db->set_service_node_data(blob);
+	void service_node_list::fill_delta_quorum(block_delta_for_serialization& delta, bool full_active_nodes) const
+	{
+		delta.active_nodes = block_delta_for_serialization::active_nodes_none;
+		delta.active_added.clear();
+		delta.active_removed.clear();
+		delta.quorum_states.clear();
 
-		return true;
+		if (!full_active_nodes && m_quorums->get_active_changes(delta.height, delta.active_added, delta.active_removed))
+		{
+			delta.active_nodes = block_delta_for_serialization::active_nodes_changes;
+		}
+		else if (m_quorums->get_active_pubkeys(delta.height, delta.active_added))
+		{
+			delta.active_nodes = block_delta_for_serialization::active_nodes_full;
+		}
+		else if (std::shared_ptr<const quorum_state> state = m_quorums->get(delta.height))
+		{
+			// Only known as a computed quorum, e.g. after loading a snapshot
+			delta.quorum_states.push_back({ delta.height, *state });
+		}
 	}
 
 	bool service_node_list::load()
@@ -1239,80 +1598,263 @@ namespace service_nodes
 		clear(false);
 		if (!m_db) return false;
 
-		std::stringstream ss;
+		cryptonote::db_rtxn_guard txn_guard(m_db);
 
+		bool found = false;
+		std::unordered_set<crypto::public_key> active_nodes;
+		bool have_active_nodes = false;
+		bool r = m_db->for_all_service_node_block_deltas([this, &found, &active_nodes, &have_active_nodes](uint64_t height, const std::string& blob) {
+			block_delta_for_serialization delta;
+			if (!::serialization::parse_binary(blob, delta))
+			{
+				MERROR("Failed to parse service node delta for height " << height);
+				return false;
+			}
+
+			for (const auto& quorum : delta.quorum_states)
+				m_quorums->add_computed(quorum.height, quorum.state);
+
+			// Changes only apply on top of the previous height; ones older than the
+			// first full list are from before the quorum window and left out.
+			if (delta.active_nodes == block_delta_for_serialization::active_nodes_full)
+			{
+				active_nodes.clear();
+				have_active_nodes = true;
+			}
+			if (delta.active_nodes != block_delta_for_serialization::active_nodes_none && have_active_nodes)
+			{
+				active_nodes.insert(delta.active_added.begin(), delta.active_added.end());
+				for (const crypto::public_key& pubkey : delta.active_removed)
+					active_nodes.erase(pubkey);
+				m_quorums->add(height, m_db->get_block_hash_from_height(height), { active_nodes.begin(), active_nodes.end() });
+			}
+			else
+			{
+				have_active_nodes = false;
+			}
+
+			for (const auto& event : delta.events)
+			{
+				std::unique_ptr<rollback_event> event_ptr = from_serializable_event(event);
+				if (!event_ptr)
+					return false;
+				m_rollback_events.push_back(std::move(event_ptr));
+			}
+
+			m_height = height + 1;
+			found = true;
+			return true;
+		});
+		CHECK_AND_ASSERT_MES(r, false, "Failed to load service node deltas");
+
+		if (!found)
+		{
+			txn_guard.stop();
+			if (!load_legacy_blob())
+				return false;
+
+			// Move the state over into the per-node/per-block tables
+			return store();
+		}
+
+		r = m_db->for_all_service_node_infos([this](const crypto::public_key& key, const std::string& blob) {
+			service_node_info info;
+			if (!::serialization::parse_binary(blob, info))
+			{
+				MERROR("Failed to parse service node info for " << key);
+				return false;
+			}
+			m_service_nodes_infos[key] = std::move(info);
+			return true;
+		});
+		CHECK_AND_ASSERT_MES(r, false, "Failed to load service node infos");
+
+		// Recreate the rollback window and quorum cache as process_block leaves them
+		// after the last stored block; the table may still hold older, uncompacted deltas.
+		const uint64_t last_height = m_height - 1;
+		const uint64_t cull_height = (last_height < ROLLBACK_EVENT_EXPIRATION_BLOCKS) ? last_height : last_height - ROLLBACK_EVENT_EXPIRATION_BLOCKS;
+		while (!m_rollback_events.empty() && m_rollback_events.front()->m_block_height < cull_height)
+			m_rollback_events.pop_front();
+		m_rollback_events.push_front(std::unique_ptr<rollback_event>(new prevent_rollback(cull_height)));
+
+		const uint64_t cache_state_from_height = get_quorum_cache_start_height(last_height);
+		m_quorums->remove_below(cache_state_from_height);
+
+		// Votes must find the quorum of every height in the window
+		const std::vector<uint64_t> quorum_heights = m_quorums->get_heights();
+		if (!quorum_heights.empty() && quorum_heights.back() - quorum_heights.front() + 1 != quorum_heights.size())
+		{
+			MERROR("Stored service node quorums have gaps, rescanning");
+			return false;
+		}
+
+		rebuild_node_indexes();
+
+		MGINFO("Service node data loaded successfully, m_height: " << m_height);
+		MGINFO(m_service_nodes_infos.size() << " nodes and " << m_rollback_events.size() << " rollback events loaded.");
+
+		LOG_PRINT_L1("service_node_list::load() returning success");
+		return true;
+	}
+
+	// Loads the single-blob state written by older versions
+	bool service_node_list::load_legacy_blob()
+	{
 		data_members_for_serialization data_in;
 		std::string blob;
 
-    cryptonote::db_rtxn_guard txn_guard(m_db);
-		if (!m_db->get_service_node_data(blob)) return false;
+		{
+			cryptonote::db_rtxn_guard txn_guard(m_db);
+			if (!m_db->get_service_node_data(blob)) return false;
+		}
 
-		ss << blob;
-		binary_archive<false> ba(ss);
-		bool r = ::serialization::serialize(ba, data_in);
+		bool r = ::serialization::parse_binary(blob, data_in);
 		CHECK_AND_ASSERT_MES(r, false, "Failed to parse service node data from blob");
 
+		if (!load_state(data_in))
+			return false;
+
+		MGINFO("Legacy service node data loaded successfully, m_height: " << m_height);
+		return true;
+	}
+
+	bool service_node_list::load_state(const data_members_for_serialization& data_in)
+	{
 		m_height = data_in.height;
 
-		for (const auto& quorum : data_in.quorum_states) m_quorum_states[quorum.height] = std::make_shared<quorum_state>(quorum.state);
+		for (const auto& quorum : data_in.quorum_states) m_quorums->add_computed(quorum.height, quorum.state);
 
 		for (const auto& info : data_in.infos) m_service_nodes_infos[info.key] = info.info;
+		rebuild_node_indexes();
 
 		for (const auto& event : data_in.events)
 		{
-			if (event.type() == typeid(rollback_change))
-			{
-				rollback_change *i = new rollback_change();
-				const rollback_change& from = boost::get<rollback_change>(event);
-				i->m_block_height = from.m_block_height;
-				i->m_key = from.m_key;
-				i->m_info = from.m_info;
-				i->type = rollback_event::change_type;
-				m_rollback_events.push_back(std::unique_ptr<rollback_event>(i));
-			}
-			else if (event.type() == typeid(rollback_new))
-			{
-				rollback_new *i = new rollback_new();
-				const rollback_new& from = boost::get<rollback_new>(event);
-				i->m_block_height = from.m_block_height;
-				i->m_key = from.m_key;
-				i->type = rollback_event::new_type;
-				m_rollback_events.push_back(std::unique_ptr<rollback_event>(i));
-			}
-			else if (event.type() == typeid(prevent_rollback))
-			{
-				prevent_rollback *i = new prevent_rollback();
-				const prevent_rollback& from = boost::get<prevent_rollback>(event);
-				i->m_block_height = from.m_block_height;
-				i->type = rollback_event::prevent_type;
-				m_rollback_events.push_back(std::unique_ptr<rollback_event>(i));
-			}
-			else
+			std::unique_ptr<rollback_event> event_ptr = from_serializable_event(event);
+			if (!event_ptr)
+				return false;
+			m_rollback_events.push_back(std::move(event_ptr));
+		}
+		return true;
+	}
+
+	bool service_node_list::parse_snapshot(const std::string& blob, snapshot_for_serialization& snapshot)
+	{
+		if (!::serialization::parse_binary(blob, snapshot))
+		{
+			MERROR("Failed to parse service node snapshot");
+			return false;
+		}
+		if (snapshot.version != 0)
+		{
+			MERROR("Unsupported service node snapshot version " << (int)snapshot.version);
+			return false;
+		}
+		if (crypto::cn_fast_hash(snapshot.state.data(), snapshot.state.size()) != snapshot.checksum)
+		{
+			MERROR("Service node snapshot for height " << snapshot.height << " failed its checksum");
+			return false;
+		}
+		return true;
+	}
+
+	// Replaces the current state with the newest snapshot in [min_height, max_height]
+	// that is still on the main chain, leaving the state alone if there is none
+	bool service_node_list::load_snapshot(uint64_t min_height, uint64_t max_height)
+	{
+		if (!m_db)
+			return false;
+
+		// get_service_node_snapshot moves height down to the snapshot it finds
+		uint64_t height = max_height;
+		std::string blob;
+		while (m_db->get_service_node_snapshot(height, blob) && height >= min_height)
+		{
+			snapshot_for_serialization snapshot;
+			data_members_for_serialization data_in;
+			if (parse_snapshot(blob, snapshot) && snapshot.height == height &&
+			    snapshot.block_hash == m_db->get_block_hash_from_height(height) &&
+			    ::serialization::parse_binary(snapshot.state, data_in) && data_in.height == height + 1)
 			{
-				MERROR("Unhandled rollback event type in restoring data to service node list.");
+				clear(false);
+				if (load_state(data_in))
+				{
+					MGINFO("Service node list restored from the snapshot at height " << height);
+					return true;
+				}
+				clear(true);
 				return false;
 			}
+
+			MWARNING("Skipping unusable service node snapshot at height " << height);
+			if (height == 0)
+				break;
+			--height;
 		}
+		return false;
+	}
 
-		MGINFO("Service node data loaded successfully, m_height: " << m_height);
-		MGINFO(m_service_nodes_infos.size() << " nodes and " << m_rollback_events.size() << " rollback events loaded.");
+	bool service_node_list::store_snapshot(uint64_t height, const crypto::hash& block_hash)
+	{
+		if (!m_db)
+			return false;
 
-		LOG_PRINT_L1("service_node_list::load() returning success");
+		data_members_for_serialization data_out;
+		data_out.height = m_height;
+
+		for (uint64_t quorum_height : m_quorums->get_heights())
+			data_out.quorum_states.push_back({ quorum_height, *m_quorums->get(quorum_height) });
+
+		for (const auto& kv_pair : m_service_nodes_infos)
+			data_out.infos.push_back({ kv_pair.first, kv_pair.second });
+
+		for (const auto& event_ptr : m_rollback_events)
+		{
+			rollback_event_variant event;
+			if (!to_serializable_event(*event_ptr, event))
+				return false;
+			data_out.events.push_back(std::move(event));
+		}
+
+		snapshot_for_serialization snapshot;
+		snapshot.height = height;
+		snapshot.block_hash = block_hash;
+		bool r = ::serialization::dump_binary(data_out, snapshot.state);
+		CHECK_AND_ASSERT_MES(r, false, "Failed to store service node snapshot: failed to serialize state");
+		snapshot.checksum = crypto::cn_fast_hash(snapshot.state.data(), snapshot.state.size());
+
+		std::string blob;
+		r = ::serialization::dump_binary(snapshot, blob);
+		CHECK_AND_ASSERT_MES(r, false, "Failed to store service node snapshot: failed to serialize data");
+
+		cryptonote::db_wtxn_guard txn_guard(m_db);
+		m_db->set_service_node_snapshot(height, blob);
+		const uint64_t kept = STATE_SNAPSHOT_INTERVAL * (STATE_SNAPSHOTS_KEPT - 1);
+		if (height > kept)
+			m_db->remove_service_node_snapshots(0, height - kept);
+
+		LOG_PRINT_L1("Stored service node snapshot at height " << height);
 		return true;
 	}
 
 	void service_node_list::clear(bool delete_db_entry)
 	{
 		m_service_nodes_infos.clear();
+		m_changed_nodes.clear();
+		m_state_reset = true;
+		m_winner_index.clear();
+		m_swarm_index.clear();
+		m_nodes_by_expiry_height.clear();
+		m_expiry_heights.clear();
 		m_rollback_events.clear();
 
 		if (m_db && delete_db_entry)
 		{
 		  cryptonote::db_wtxn_guard txn_guard(m_db);
 			m_db->clear_service_node_data();
+			m_db->clear_service_node_deltas();
 		}
 
-		m_quorum_states.clear();
+		m_quorums->clear();
 
 		uint64_t hardfork_5_from_height = 0;
 		{
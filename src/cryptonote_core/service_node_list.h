@@ -29,14 +29,21 @@
 #pragma once
 
 #include <boost/variant.hpp>
+#include <memory>
 #include <mutex>
+#include "common/threadpool.h"
 #include "serialization/serialization.h"
 #include "cryptonote_core/service_node_rules.h"
 #include "cryptonote_core/service_node_deregister.h"
+#include "cryptonote_core/service_node_winner.h"
+#include "cryptonote_core/service_node_quorum_cache.h"
+#include "cryptonote_core/service_node_swarm.h"
 // #include "eth_adapter/eth_adapter.h"
 #include <list>
+#include <map>
+#include <unordered_set>
 
-namespace cryptonote { class Blockchain; class BlockchainDB; }
+namespace cryptonote { class Blockchain; class BlockchainDB; class tx_extra_index; }
 namespace service_nodes
 {
 	class quorum_cop;
@@ -135,6 +142,23 @@ namespace service_nodes
 		service_node_info  info;
 	};
 
+	// An immutable copy of the list as of one height. service_node_list publishes
+	// a new one after every change, so queries never wait on block processing.
+	struct list_state
+	{
+		uint64_t height = 0;
+		uint8_t hard_fork_version = 0;
+		std::unordered_map<crypto::public_key, std::shared_ptr<const service_node_info>> infos;
+		std::vector<crypto::public_key> active_pubkeys; // sorted
+		std::shared_ptr<const quorum_cache::snapshot> quorums;
+		crypto::public_key winner = crypto::null_pkey;
+
+		bool is_active(const service_node_info& info) const { return (hard_fork_version > 9 && info.is_valid()) || info.is_fully_funded(); }
+		bool is_service_node(const crypto::public_key& pubkey) const;
+		std::shared_ptr<const quorum_state> get_quorum_state(uint64_t height) const;
+		std::vector<service_node_pubkey_info> get_service_node_list_state(const std::vector<crypto::public_key> &service_node_pubkeys) const;
+	};
+
 	template<typename T>
   void xeq_shuffle(std::vector<T>& a, uint64_t seed)
   {
@@ -169,12 +193,16 @@ namespace service_nodes
 
 		std::vector<crypto::public_key> get_service_nodes_pubkeys() const;
 		bool is_service_node(const crypto::public_key& pubkey) const;
-		void update_swarms(uint64_t height);
+		void update_swarms(uint64_t height, uint8_t hard_fork_version);
 
 		/// Note(maxim): this should not affect thread-safety as the returned object is const
 		const std::shared_ptr<const quorum_state> get_quorum_state(uint64_t height) const;
 		std::vector<service_node_pubkey_info> get_service_node_list_state(const std::vector<crypto::public_key> &service_node_pubkeys) const;
 
+		/// The list as of the last processed block; taking it does not lock the list
+		std::shared_ptr<const list_state> get_state() const;
+		size_t get_quorum_cache_memory_usage() const;
+
 		void set_db_pointer(cryptonote::BlockchainDB* db);
 		void set_my_service_node_keys(crypto::public_key const *pub_key);
 		bool store();
@@ -298,29 +326,125 @@ namespace service_nodes
 			END_SERIALIZE()
 		};
 
+		// The changes made to the list by a single block: the rollback events it
+		// produced and what its quorum is drawn from. The infos touched by those
+		// events are stored separately, keyed by pubkey.
+		struct block_delta_for_serialization
+		{
+			enum active_nodes_type
+			{
+				active_nodes_none,    // no quorum at this height, or it is in quorum_states
+				active_nodes_changes, // active_added/active_removed relative to the previous height
+				active_nodes_full     // active_added holds all the active nodes
+			};
+
+			uint8_t version = 1;
+			uint64_t height;
+			std::vector<rollback_event_variant> events;
+			std::vector<quorum_state_for_serialization> quorum_states; // fully computed quorums, as written by version 0
+			uint8_t active_nodes = active_nodes_none;
+			std::vector<crypto::public_key> active_added;
+			std::vector<crypto::public_key> active_removed;
+
+			BEGIN_SERIALIZE()
+				VARINT_FIELD(version)
+				VARINT_FIELD(height)
+				FIELD(events)
+				FIELD(quorum_states)
+				if (version >= 1)
+				{
+					VARINT_FIELD(active_nodes)
+					FIELD(active_added)
+					FIELD(active_removed)
+				}
+			END_SERIALIZE()
+		};
+
+		// The whole list as it was after the block at height, written every
+		// STATE_SNAPSHOT_INTERVAL blocks so that a daemon which lost its state
+		// only replays the blocks since. It is also what blockchain_sn_snapshot
+		// exports and imports.
+		struct snapshot_for_serialization
+		{
+			uint8_t version = 0;
+			uint64_t height;
+			crypto::hash block_hash;
+			crypto::hash checksum; // cn_fast_hash of state
+			std::string state;     // a serialized data_members_for_serialization
+
+			BEGIN_SERIALIZE()
+				VARINT_FIELD(version)
+				VARINT_FIELD(height)
+				FIELD(block_hash)
+				FIELD(checksum)
+				FIELD(state)
+			END_SERIALIZE()
+		};
+
+		/// Parses a snapshot, failing on an unknown version or a checksum mismatch
+		static bool parse_snapshot(const std::string& blob, snapshot_for_serialization& snapshot);
+
 	private:
 
+		// The decoded staking outputs of a contribution tx, computed ahead of
+		// process_block when rebuilding the list
+		struct contribution_precomputed
+		{
+			cryptonote::account_public_address address;
+			std::vector<uint64_t> output_amounts;
+		};
+
+		struct rebuild_batch;
+
 		// Note(maxim): private methods don't have to be protected the mutex
-		bool get_contribution(const cryptonote::transaction& tx, uint64_t block_height, cryptonote::account_public_address& address, uint64_t& transferred) const;
-		bool process_registration_tx(const cryptonote::transaction& tx, uint64_t block_timestamp, uint64_t block_height, uint32_t index);
-		void process_contribution_tx(const cryptonote::transaction& tx, uint64_t block_height, uint32_t index);
-		bool process_deregistration_tx(const cryptonote::transaction& tx, uint64_t block_height);
-		bool process_swap_tx(const cryptonote::transaction& tx, uint64_t block_height, uint32_t index);
-		void process_block(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs);
+		bool precompute_contribution(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t min_block_height, contribution_precomputed& result) const;
+		bool fetch_rebuild_batch(uint64_t start_height, uint64_t end_height, rebuild_batch& batch) const;
+		void precompute_rebuild_batch(rebuild_batch& batch, tools::threadpool::waiter& waiter) const;
+		bool get_contribution(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, cryptonote::account_public_address& address, uint64_t& transferred) const;
+		bool process_registration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_timestamp, uint64_t block_height, uint32_t index);
+		void process_contribution_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, uint32_t index);
+		bool process_deregistration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height);
+		bool process_swap_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_height, uint32_t index);
+		// active_pubkeys gets the nodes active once the block is applied, as its quorum was cached with
+		void process_block(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs, std::vector<crypto::public_key>& active_pubkeys);
 
 		bool contribution_tx_output_has_correct_unlock_time(const cryptonote::transaction& tx, size_t i, uint64_t block_height) const;
 
-		void store_quorum_state_from_rewards_list(uint64_t height);
+		void store_quorum_state_from_rewards_list(uint64_t height, const std::vector<crypto::public_key>& active_pubkeys);
+		uint64_t get_quorum_cache_start_height(uint64_t block_height) const;
 
-		bool is_registration_tx(const cryptonote::transaction& tx, uint64_t block_timestamp, uint64_t block_height, uint32_t index, crypto::public_key& key, service_node_info& info) const;
+		bool is_registration_tx(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, uint64_t block_timestamp, uint64_t block_height, uint32_t index, crypto::public_key& key, service_node_info& info) const;
 		std::vector<crypto::public_key> get_expired_nodes(uint64_t block_height) const;
+		uint64_t get_expiry_height(const service_node_info& info) const;
+
+		// Keeps the winner and expiry indexes in step with m_service_nodes_infos; info is null once the node is gone
+		void update_node_indexes(const crypto::public_key& pubkey, const service_node_info* info);
+		void rebuild_node_indexes();
+
+		std::vector<crypto::public_key> collect_active_pubkeys() const;
+		std::shared_ptr<const quorum_state> find_quorum_state(uint64_t height) const;
+		std::vector<std::pair<cryptonote::account_public_address, uint64_t>> get_winner_addresses_and_portions(const list_state& state) const;
+
+		// Copies the nodes changed since the last call into a new list_state and swaps it into m_state;
+		// active_pubkeys are the nodes collect_active_pubkeys gives now
+		void publish_state(std::vector<crypto::public_key> active_pubkeys);
 
 		void clear(bool delete_db_entry = false);
 		bool load();
+		bool load_legacy_blob();
+		bool load_state(const data_members_for_serialization& data_in);
+		bool load_snapshot(uint64_t min_height, uint64_t max_height);
+		bool store_snapshot(uint64_t height, const crypto::hash& block_hash);
+		bool store_block_delta(uint64_t height, const std::unordered_set<crypto::public_key>* detached_keys = nullptr);
+		void fill_delta_quorum(block_delta_for_serialization& delta, bool full_active_nodes) const;
 
 		using block_height = uint64_t;
 
 		std::unordered_map<crypto::public_key, service_node_info> m_service_nodes_infos;
+		winner_index m_winner_index;
+		swarm_index m_swarm_index;
+		std::map<uint64_t, std::unordered_set<crypto::public_key>> m_nodes_by_expiry_height;
+		std::unordered_map<crypto::public_key, uint64_t> m_expiry_heights;
 		std::list<std::unique_ptr<rollback_event>> m_rollback_events;
 		cryptonote::Blockchain& m_blockchain;
 		block_height m_height;
@@ -330,13 +454,20 @@ namespace service_nodes
 		crypto::public_key const *m_service_node_pubkey;
 		cryptonote::BlockchainDB* m_db;
 
-		std::map<block_height, std::shared_ptr<const quorum_state>> m_quorum_states;
+		std::shared_ptr<quorum_cache> m_quorums;
 
 		std::vector<contract> m_contracts;
+
+		std::unordered_map<crypto::hash, contribution_precomputed> m_contribution_cache;
+
+		// Only accessed through std::atomic_load/std::atomic_store
+		std::shared_ptr<const list_state> m_state;
+		std::unordered_set<crypto::public_key> m_changed_nodes;
+		bool m_state_reset;
 	};
 
 	uint64_t get_reg_tx_staking_output_contribution(const cryptonote::transaction& tx, int i, crypto::key_derivation derivation, hw::device& hwdev);
-	bool reg_tx_extract_fields(const cryptonote::transaction& tx, std::vector<cryptonote::account_public_address>& addresses, uint64_t& portions_for_operator, std::vector<uint64_t>& portions, uint64_t& expiration_timestamp, crypto::public_key& service_node_key, crypto::signature& signature, crypto::public_key& tx_pub_key);
+	bool reg_tx_extract_fields(const cryptonote::transaction& tx, const cryptonote::tx_extra_index& extra, std::vector<cryptonote::account_public_address>& addresses, uint64_t& portions_for_operator, std::vector<uint64_t>& portions, uint64_t& expiration_timestamp, crypto::public_key& service_node_key, crypto::signature& signature, crypto::public_key& tx_pub_key);
 
   bool convert_registration_args(cryptonote::network_type nettype,
                                  std::vector<std::string> args,
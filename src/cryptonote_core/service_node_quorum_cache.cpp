@@ -0,0 +1,491 @@
+#include "service_node_quorum_cache.h"
+#include "service_node_list.h"
+#include "service_node_rules.h"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_set>
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "service_nodes"
+
+namespace service_nodes
+{
+  namespace
+  {
+    bool test_bit(const std::vector<uint64_t>& bits, uint32_t i)
+    {
+      return i / 64 < bits.size() && ((bits[i / 64] >> (i % 64)) & 1);
+    }
+
+    void set_bit(std::vector<uint64_t>& bits, uint32_t i)
+    {
+      if (i / 64 >= bits.size())
+        bits.resize(i / 64 + 1, 0);
+      bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    uint64_t get_word(const std::vector<uint64_t>& bits, size_t i)
+    {
+      return i < bits.size() ? bits[i] : 0;
+    }
+
+    bool bits_equal(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b)
+    {
+      for (size_t i = 0; i < std::max(a.size(), b.size()); ++i)
+        if (get_word(a, i) != get_word(b, i))
+          return false;
+      return true;
+    }
+
+    template<typename F>
+    void for_each_bit(const std::vector<uint64_t>& bits, F f)
+    {
+      for (size_t w = 0; w < bits.size(); ++w)
+        for (uint64_t word = bits[w]; word; word &= word - 1)
+          f(static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+    }
+  }
+
+  uint32_t quorum_cache::get_table_index(const crypto::public_key& pubkey, std::vector<crypto::public_key>& new_keys)
+  {
+    auto it = m_table_indexes.find(pubkey);
+    if (it != m_table_indexes.end())
+      return it->second;
+    const uint32_t index = m_table_size + new_keys.size();
+    new_keys.push_back(pubkey);
+    m_table_indexes.emplace(pubkey, index);
+    return index;
+  }
+
+  void quorum_cache::append_to_table(const std::vector<crypto::public_key>& new_keys)
+  {
+    if (new_keys.empty())
+      return;
+    auto t = std::make_shared<table>(*m_table);
+    std::shared_ptr<table_chunk> chunk;
+    if (m_table_size % TABLE_CHUNK_SIZE)
+    {
+      // the last chunk isn't full, so it's replaced by a copy with more keys
+      chunk = std::make_shared<table_chunk>(*t->back());
+      t->pop_back();
+    }
+    for (const crypto::public_key& pubkey : new_keys)
+    {
+      if (!chunk)
+      {
+        chunk = std::make_shared<table_chunk>();
+        chunk->reserve(TABLE_CHUNK_SIZE);
+      }
+      chunk->push_back(pubkey);
+      if (chunk->size() == TABLE_CHUNK_SIZE)
+        t->push_back(std::move(chunk));
+    }
+    if (chunk)
+      t->push_back(std::move(chunk));
+    m_table_size += new_keys.size();
+    m_table = std::move(t);
+  }
+
+  std::shared_ptr<const quorum_cache::entry> quorum_cache::find_entry(const entry_map& entries, uint64_t height)
+  {
+    const auto it = entries.find(height / ENTRY_CHUNK_SIZE);
+    return it == entries.end() ? nullptr : (*it->second)[height % ENTRY_CHUNK_SIZE];
+  }
+
+  template<typename F>
+  void quorum_cache::for_each_entry(const entry_map& entries, F f)
+  {
+    for (const auto& kv_pair : entries)
+      for (size_t i = 0; i < ENTRY_CHUNK_SIZE; ++i)
+        if ((*kv_pair.second)[i])
+          f(kv_pair.first * ENTRY_CHUNK_SIZE + i, *(*kv_pair.second)[i]);
+  }
+
+  // Copies only the outer map and the chunk holding height
+  void quorum_cache::set_entry(uint64_t height, std::shared_ptr<const entry> e)
+  {
+    auto entries = std::make_shared<entry_map>(*m_entries);
+    std::shared_ptr<const entry_chunk>& chunk_ptr = (*entries)[height / ENTRY_CHUNK_SIZE];
+    auto chunk = chunk_ptr ? std::make_shared<entry_chunk>(*chunk_ptr) : std::make_shared<entry_chunk>();
+    (*chunk)[height % ENTRY_CHUNK_SIZE] = std::move(e);
+    chunk_ptr = std::move(chunk);
+    m_entries = std::move(entries);
+    m_snapshot.reset();
+  }
+
+  // Removes the heights in [from_height, to_height); whole chunks are dropped,
+  // the ones at either end replaced by copies
+  bool quorum_cache::remove_entries(uint64_t from_height, uint64_t to_height)
+  {
+    auto entries = std::make_shared<entry_map>();
+    bool removed = false;
+    for (const auto& kv_pair : *m_entries)
+    {
+      const uint64_t chunk_begin = kv_pair.first * ENTRY_CHUNK_SIZE;
+      const uint64_t begin = std::max(from_height, chunk_begin);
+      const uint64_t end = std::min(to_height, chunk_begin + ENTRY_CHUNK_SIZE);
+      if (begin >= end)
+      {
+        entries->emplace_hint(entries->end(), kv_pair);
+        continue;
+      }
+
+      auto chunk = std::make_shared<entry_chunk>(*kv_pair.second);
+      for (uint64_t height = begin; height < end; ++height)
+      {
+        removed |= (bool)(*chunk)[height - chunk_begin];
+        (*chunk)[height - chunk_begin] = nullptr;
+      }
+      if (std::any_of(chunk->begin(), chunk->end(), [](const std::shared_ptr<const entry>& e) { return (bool)e; }))
+        entries->emplace_hint(entries->end(), kv_pair.first, std::move(chunk));
+    }
+    if (!removed)
+      return false;
+    m_entries = std::move(entries);
+    m_snapshot.reset();
+    return true;
+  }
+
+  void quorum_cache::add(uint64_t height, const crypto::hash& block_hash, const std::vector<crypto::public_key>& active_pubkeys)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto active = std::make_shared<bitmap>();
+    std::vector<crypto::public_key> new_keys;
+    for (const crypto::public_key& pubkey : active_pubkeys)
+      set_bit(*active, get_table_index(pubkey, new_keys));
+    append_to_table(new_keys);
+
+    auto e = std::make_shared<entry>();
+    e->seed_hash = block_hash;
+    e->active = std::move(active);
+    e->keys = m_table;
+    if (height > 0)
+    {
+      const std::shared_ptr<const entry> prev = find_entry(*m_entries, height - 1);
+      if (prev && prev->active && bits_equal(*prev->active, *e->active))
+        e->active = prev->active;
+    }
+    set_entry(height, std::move(e));
+  }
+
+  void quorum_cache::add_computed(uint64_t height, const quorum_state& state)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto quorum = std::make_shared<quorum_indexes>();
+    std::vector<crypto::public_key> new_keys;
+    for (const crypto::public_key& pubkey : state.quorum_nodes)
+      quorum->quorum_nodes.push_back(get_table_index(pubkey, new_keys));
+    for (const crypto::public_key& pubkey : state.nodes_to_test)
+      quorum->nodes_to_test.push_back(get_table_index(pubkey, new_keys));
+    append_to_table(new_keys);
+
+    auto e = std::make_shared<entry>();
+    e->seed_hash = crypto::null_hash;
+    e->keys = m_table;
+    e->quorum = std::move(quorum);
+    set_entry(height, std::move(e));
+  }
+
+  // Same shuffle as the quorums have always been drawn with: the active nodes
+  // sorted by pubkey, shuffled with a seed taken from the block hash, the
+  // first QUORUM_SIZE of them voting on the next ones.
+  std::shared_ptr<const quorum_state> quorum_cache::entry::get_state() const
+  {
+    const table& t = *keys;
+    std::shared_ptr<const quorum_indexes> indexes;
+    {
+      std::lock_guard<std::mutex> lock(quorum_mutex);
+      if (!quorum)
+      {
+        std::vector<uint32_t> nodes;
+        for_each_bit(*active, [&nodes](uint32_t i) { nodes.push_back(i); });
+        std::sort(nodes.begin(), nodes.end(), [&t](uint32_t a, uint32_t b) {
+          return memcmp(&get_key(t, a), &get_key(t, b), sizeof(crypto::public_key)) < 0;
+        });
+
+        std::vector<size_t> pub_keys_indexes(nodes.size());
+        std::iota(pub_keys_indexes.begin(), pub_keys_indexes.end(), 0);
+        uint64_t seed = 0;
+        std::memcpy(&seed, seed_hash.data, std::min(sizeof(seed), sizeof(seed_hash.data)));
+        xeq_shuffle(pub_keys_indexes, seed);
+
+        auto result = std::make_shared<quorum_indexes>();
+        result->quorum_nodes.resize(std::min(nodes.size(), QUORUM_SIZE));
+        for (size_t i = 0; i < result->quorum_nodes.size(); i++)
+          result->quorum_nodes[i] = nodes[pub_keys_indexes[i]];
+
+        const size_t num_remaining_nodes = nodes.size() - result->quorum_nodes.size();
+        const size_t num_nodes_to_test = std::max(num_remaining_nodes / NTH_OF_THE_NETWORK_TO_TEST, std::min(MIN_NODES_TO_TEST, num_remaining_nodes));
+        result->nodes_to_test.resize(num_nodes_to_test);
+        for (size_t i = 0; i < result->nodes_to_test.size(); i++)
+          result->nodes_to_test[i] = nodes[pub_keys_indexes[result->quorum_nodes.size() + i]];
+
+        quorum = std::move(result);
+      }
+      indexes = quorum;
+    }
+
+    auto state = std::make_shared<quorum_state>();
+    state->quorum_nodes.reserve(indexes->quorum_nodes.size());
+    for (uint32_t i : indexes->quorum_nodes)
+      state->quorum_nodes.push_back(get_key(t, i));
+    state->nodes_to_test.reserve(indexes->nodes_to_test.size());
+    for (uint32_t i : indexes->nodes_to_test)
+      state->nodes_to_test.push_back(get_key(t, i));
+    return state;
+  }
+
+  std::shared_ptr<const quorum_state> quorum_cache::snapshot::get(uint64_t height) const
+  {
+    const std::shared_ptr<const entry> e = find_entry(*m_entries, height);
+    return e ? e->get_state() : nullptr;
+  }
+
+  std::shared_ptr<const quorum_state> quorum_cache::get(uint64_t height) const
+  {
+    std::shared_ptr<const entry> e;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      e = find_entry(*m_entries, height);
+      if (!e)
+        return nullptr;
+    }
+    return e->get_state();
+  }
+
+  std::shared_ptr<const quorum_cache::snapshot> quorum_cache::get_snapshot() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_snapshot)
+    {
+      auto s = std::make_shared<snapshot>();
+      s->m_entries = m_entries;
+      m_snapshot = std::move(s);
+    }
+    return m_snapshot;
+  }
+
+  bool quorum_cache::get_active_pubkeys(uint64_t height, std::vector<crypto::public_key>& active_pubkeys) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const std::shared_ptr<const entry> e = find_entry(*m_entries, height);
+    if (!e || !e->active)
+      return false;
+
+    const table& t = *e->keys;
+    active_pubkeys.clear();
+    for_each_bit(*e->active, [&](uint32_t i) { active_pubkeys.push_back(get_key(t, i)); });
+    return true;
+  }
+
+  bool quorum_cache::get_active_changes(uint64_t height, std::vector<crypto::public_key>& added, std::vector<crypto::public_key>& removed) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (height == 0)
+      return false;
+    const std::shared_ptr<const entry> e = find_entry(*m_entries, height);
+    const std::shared_ptr<const entry> prev = find_entry(*m_entries, height - 1);
+    if (!e || !prev || !e->active || !prev->active)
+      return false;
+
+    added.clear();
+    removed.clear();
+    if (e->active == prev->active)
+      return true;
+
+    // the later entry's table holds all the earlier one's keys, at the same indexes
+    const table& t = *e->keys;
+    const bitmap& now = *e->active;
+    const bitmap& before = *prev->active;
+    for (size_t w = 0; w < std::max(now.size(), before.size()); ++w)
+    {
+      const uint64_t diff = get_word(now, w) ^ get_word(before, w);
+      for (uint64_t word = diff; word; word &= word - 1)
+      {
+        const uint32_t i = w * 64 + __builtin_ctzll(word);
+        (test_bit(now, i) ? added : removed).push_back(get_key(t, i));
+      }
+    }
+    return true;
+  }
+
+  void quorum_cache::remove_below(uint64_t height)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (remove_entries(0, height))
+      maybe_rebuild_table();
+  }
+
+  void quorum_cache::remove_from(uint64_t height)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (remove_entries(height, UINT64_MAX))
+      maybe_rebuild_table();
+  }
+
+  void quorum_cache::clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries = std::make_shared<entry_map>();
+    m_snapshot.reset();
+    m_table = std::make_shared<table>();
+    m_table_size = 0;
+    m_table_indexes.clear();
+    m_table_size_after_rebuild = 0;
+    ++m_epoch;
+  }
+
+  // Drops the keys no cached height refers to any more. Only looked at once the
+  // table has doubled since the last time, so this stays off the per-block path.
+  // Entries are replaced rather than changed, as snapshots may still use them.
+  void quorum_cache::maybe_rebuild_table()
+  {
+    if (m_table_size < 2 * m_table_size_after_rebuild + 64)
+      return;
+
+    std::vector<bool> live(m_table_size, false);
+    const bitmap* last_active = nullptr;
+    for_each_entry(*m_entries, [&](uint64_t, const entry& e) {
+      if (e.active && e.active.get() != last_active)
+      {
+        for_each_bit(*e.active, [&live](uint32_t i) { live[i] = true; });
+        last_active = e.active.get();
+      }
+      std::lock_guard<std::mutex> quorum_lock(e.quorum_mutex);
+      if (!e.active && e.quorum)
+      {
+        for (uint32_t i : e.quorum->quorum_nodes)
+          live[i] = true;
+        for (uint32_t i : e.quorum->nodes_to_test)
+          live[i] = true;
+      }
+    });
+
+    const size_t live_count = std::count(live.begin(), live.end(), true);
+    if (live_count * 2 > m_table_size)
+    {
+      m_table_size_after_rebuild = m_table_size;
+      return;
+    }
+
+    std::vector<uint32_t> remap(m_table_size, UINT32_MAX);
+    std::vector<crypto::public_key> live_keys;
+    live_keys.reserve(live_count);
+    for (size_t i = 0; i < m_table_size; ++i)
+    {
+      if (!live[i])
+        continue;
+      remap[i] = live_keys.size();
+      live_keys.push_back(get_key(*m_table, i));
+    }
+    m_table = std::make_shared<table>();
+    m_table_size = 0;
+    append_to_table(live_keys);
+
+    auto remap_all = [&remap](const std::vector<uint32_t>& indexes) {
+      std::vector<uint32_t> result;
+      result.reserve(indexes.size());
+      for (uint32_t i : indexes)
+        result.push_back(remap[i]);
+      return result;
+    };
+
+    std::unordered_map<const bitmap*, std::shared_ptr<const bitmap>> remapped;
+    auto entries = std::make_shared<entry_map>();
+    for (const auto& kv_pair : *m_entries)
+    {
+      auto chunk = std::make_shared<entry_chunk>();
+      for (size_t slot = 0; slot < ENTRY_CHUNK_SIZE; ++slot)
+      {
+        if (!(*kv_pair.second)[slot])
+          continue;
+        const entry& old_entry = *(*kv_pair.second)[slot];
+
+        auto e = std::make_shared<entry>();
+        e->seed_hash = old_entry.seed_hash;
+        e->keys = m_table;
+        if (old_entry.active)
+        {
+          std::shared_ptr<const bitmap>& active = remapped[old_entry.active.get()];
+          if (!active)
+          {
+            auto bits = std::make_shared<bitmap>();
+            for_each_bit(*old_entry.active, [&](uint32_t i) { set_bit(*bits, remap[i]); });
+            active = std::move(bits);
+          }
+          e->active = active;
+        }
+        {
+          std::lock_guard<std::mutex> quorum_lock(old_entry.quorum_mutex);
+          if (old_entry.quorum)
+          {
+            auto quorum = std::make_shared<quorum_indexes>();
+            quorum->quorum_nodes = remap_all(old_entry.quorum->quorum_nodes);
+            quorum->nodes_to_test = remap_all(old_entry.quorum->nodes_to_test);
+            e->quorum = std::move(quorum);
+          }
+        }
+        (*chunk)[slot] = std::move(e);
+      }
+      entries->emplace_hint(entries->end(), kv_pair.first, std::move(chunk));
+    }
+    m_entries = std::move(entries);
+    m_snapshot.reset();
+
+    m_table_indexes.clear();
+    for (size_t i = 0; i < live_keys.size(); ++i)
+      m_table_indexes.emplace(live_keys[i], i);
+    m_table_size_after_rebuild = m_table_size;
+    ++m_epoch;
+    MDEBUG("Quorum pubkey table rebuilt with " << m_table_size << " keys, epoch " << m_epoch);
+  }
+
+  std::vector<uint64_t> quorum_cache::get_heights() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint64_t> heights;
+    for_each_entry(*m_entries, [&heights](uint64_t height, const entry&) { heights.push_back(height); });
+    return heights;
+  }
+
+  bool quorum_cache::empty() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries->empty();
+  }
+
+  uint64_t quorum_cache::get_epoch() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_epoch;
+  }
+
+  size_t quorum_cache::get_memory_usage() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // map/hash nodes are counted as their payload plus three pointers
+    const size_t node_overhead = 3 * sizeof(void*);
+    size_t bytes = m_table_indexes.size() * (sizeof(std::pair<crypto::public_key, uint32_t>) + node_overhead);
+    bytes += m_table_indexes.bucket_count() * sizeof(void*);
+    bytes += m_entries->size() * (sizeof(entry_map::value_type) + node_overhead + sizeof(entry_chunk));
+
+    std::unordered_set<const void*> counted;
+    for_each_entry(*m_entries, [&](uint64_t, const entry& e) {
+      bytes += sizeof(entry);
+      if (e.active && counted.insert(e.active.get()).second)
+        bytes += e.active->capacity() * sizeof(uint64_t) + sizeof(bitmap);
+      if (e.keys && counted.insert(e.keys.get()).second)
+      {
+        bytes += e.keys->capacity() * sizeof(std::shared_ptr<const table_chunk>) + sizeof(table);
+        for (const auto& chunk : *e.keys)
+          if (counted.insert(chunk.get()).second)
+            bytes += chunk->capacity() * sizeof(crypto::public_key) + sizeof(table_chunk);
+      }
+      std::lock_guard<std::mutex> quorum_lock(e.quorum_mutex);
+      if (e.quorum)
+        bytes += (e.quorum->quorum_nodes.capacity() + e.quorum->nodes_to_test.capacity()) * sizeof(uint32_t) + sizeof(quorum_indexes);
+    });
+    return bytes;
+  }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "crypto/crypto.h"
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace service_nodes {
+    struct quorum_state;
+
+    /// Quorum states for the window of heights votes and deregistrations may
+    /// refer to. A height only records which nodes were active (a bitmap over
+    /// a pubkey table shared by the whole window, and shared with the previous
+    /// height when nothing changed) and the block hash seeding the shuffle; the
+    /// quorum is computed on its first request and kept, as table indexes, for
+    /// later ones. The table is rebuilt, starting a new epoch, once most of its
+    /// keys are no longer referenced. All methods are thread safe.
+    class quorum_cache
+    {
+        struct entry;
+        // Heights are kept in fixed chunks which are replaced rather than
+        // changed, so a snapshot shares the entry map instead of copying it
+        static constexpr uint64_t ENTRY_CHUNK_SIZE = 64;
+        using entry_chunk = std::array<std::shared_ptr<const entry>, ENTRY_CHUNK_SIZE>;
+        using entry_map = std::map<uint64_t, std::shared_ptr<const entry_chunk>>;  // by height / ENTRY_CHUNK_SIZE
+
+    public:
+        /// The quorums as of one call to get_snapshot. Later changes to the
+        /// cache don't show in it, so it can be read without locking.
+        class snapshot
+        {
+        public:
+            /// Null if nothing was cached for height
+            std::shared_ptr<const quorum_state> get(uint64_t height) const;
+
+        private:
+            friend class quorum_cache;
+            std::shared_ptr<const entry_map> m_entries;
+        };
+
+        /// Records the nodes active after the block at height; heights must be added in order
+        void add(uint64_t height, const crypto::hash& block_hash, const std::vector<crypto::public_key>& active_pubkeys);
+        /// Records an already computed quorum, as found in snapshots and older stored states
+        void add_computed(uint64_t height, const quorum_state& state);
+
+        /// Null if nothing is cached for height
+        std::shared_ptr<const quorum_state> get(uint64_t height) const;
+        /// The quorums cached now; the same snapshot is returned until the cache changes
+        std::shared_ptr<const snapshot> get_snapshot() const;
+
+        /// The nodes active at height; false for heights added through add_computed
+        bool get_active_pubkeys(uint64_t height, std::vector<crypto::public_key>& active_pubkeys) const;
+        /// The nodes that became active and inactive from height - 1 to height; false if either isn't known
+        bool get_active_changes(uint64_t height, std::vector<crypto::public_key>& added, std::vector<crypto::public_key>& removed) const;
+
+        void remove_below(uint64_t height);
+        void remove_from(uint64_t height);
+        void clear();
+
+        std::vector<uint64_t> get_heights() const;
+        bool empty() const;
+        uint64_t get_epoch() const;
+        /// Approximate heap usage in bytes
+        size_t get_memory_usage() const;
+
+    private:
+        using bitmap = std::vector<uint64_t>;
+        // Keys are only ever appended, in chunks which aren't changed once
+        // full, so a table version copies little more than its chunk pointers
+        static constexpr size_t TABLE_CHUNK_SIZE = 64;
+        using table_chunk = std::vector<crypto::public_key>;
+        using table = std::vector<std::shared_ptr<const table_chunk>>;
+
+        struct quorum_indexes
+        {
+            std::vector<uint32_t> quorum_nodes;
+            std::vector<uint32_t> nodes_to_test;
+        };
+
+        // Never changed once added, but for the quorum, computed under its own
+        // lock, so snapshots can share entries with the cache
+        struct entry
+        {
+            crypto::hash seed_hash;
+            std::shared_ptr<const bitmap> active;
+            std::shared_ptr<const table> keys;  // the table version the entry was added with
+            mutable std::mutex quorum_mutex;
+            mutable std::shared_ptr<const quorum_indexes> quorum;  // into keys
+
+            /// The quorum with its indexes looked up in keys
+            std::shared_ptr<const quorum_state> get_state() const;
+        };
+
+        static const crypto::public_key& get_key(const table& t, uint32_t i) { return (*t[i / TABLE_CHUNK_SIZE])[i % TABLE_CHUNK_SIZE]; }
+        uint32_t get_table_index(const crypto::public_key& pubkey, std::vector<crypto::public_key>& new_keys);
+        void append_to_table(const std::vector<crypto::public_key>& new_keys);
+        void maybe_rebuild_table();
+
+        static std::shared_ptr<const entry> find_entry(const entry_map& entries, uint64_t height);
+        template<typename F> static void for_each_entry(const entry_map& entries, F f);
+        void set_entry(uint64_t height, std::shared_ptr<const entry> e);
+        bool remove_entries(uint64_t from_height, uint64_t to_height);
+
+        std::shared_ptr<const table> m_table = std::make_shared<table>();
+        size_t m_table_size = 0;
+        std::unordered_map<crypto::public_key, uint32_t> m_table_indexes;
+        size_t m_table_size_after_rebuild = 0;
+        uint64_t m_epoch = 0;
+        std::shared_ptr<const entry_map> m_entries = std::make_shared<entry_map>();
+        mutable std::shared_ptr<const snapshot> m_snapshot;  // reset whenever m_entries changes
+        mutable std::mutex m_mutex;
+    };
+}
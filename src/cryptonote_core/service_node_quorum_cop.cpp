@@ -32,6 +32,7 @@
 #include "cryptonote_config.h"
 #include "cryptonote_core.h"
 #include "version.h"
+#include "common/threadpool.h"
 
 #undef XEQ_DEFAULT_LOG_CATEGORY
 #define XEQ_DEFAULT_LOG_CATEGORY "quorum_cop"
@@ -150,17 +151,12 @@ namespace service_nodes
 		return result;
 	}
 
-	bool quorum_cop::handle_uptime_proof(const cryptonote::NOTIFY_UPTIME_PROOF::request &proof, bool &my_uptime_proof_confirmation)
+	bool quorum_cop::handle_uptime_proof(const cryptonote::NOTIFY_UPTIME_PROOF::request &proof)
 	{
-		crypto::public_key my_pubkey;
-		crypto::secret_key my_seckey;
-
 		uint64_t now = time(nullptr);
 
 		uint64_t timestamp = proof.timestamp;
 		const crypto::public_key& pubkey = proof.pubkey;
-		const crypto::signature& sig = proof.sig;
-
 
 		if ((timestamp < now - UPTIME_PROOF_BUFFER_IN_SECONDS) || (timestamp > now + UPTIME_PROOF_BUFFER_IN_SECONDS))
 			return false;
@@ -168,27 +164,94 @@ namespace service_nodes
 		if (!m_core.is_service_node(pubkey) )
 			return false;    
 
-		if(pubkey == my_pubkey)
+		CRITICAL_REGION_LOCAL(m_lock);
+		auto it = m_uptime_proof_seen.find(pubkey);
+		if (it != m_uptime_proof_seen.end() && it->second >= now - (UPTIME_PROOF_FREQUENCY_IN_SECONDS / 2))
+			return false; // already received one uptime proof for this node recently.
+
+		// Signatures are only checked later, so a proof queued first may be forged: the
+		// distinct proofs of a node are queued and the first valid one is accepted. Copies
+		// relayed by other peers are dropped.
+		const auto range = m_uptime_proof_queue.equal_range(pubkey);
+		size_t queued_for_node = 0;
+		for (auto queued = range.first; queued != range.second; ++queued, ++queued_for_node)
+		{
+			if (queued->second.sig == proof.sig)
+				return false;
+		}
+
+		// Forged proofs mustn't grow the queue without bound, so past the limits a proof is
+		// only kept if it is valid, and then it is the only one of its node worth keeping
+		if (queued_for_node >= UPTIME_PROOF_MAX_QUEUED_PER_NODE || m_uptime_proof_queue.size() >= UPTIME_PROOF_MAX_QUEUED)
 		{
-			my_uptime_proof_confirmation = true;
-			MGINFO("Received uptime-proof confirmation back from network for Service Node (yours): " << proof.pubkey);
+			if (!crypto::check_signature(make_hash(pubkey, timestamp), pubkey, proof.sig))
+			{
+				LOG_PRINT_L1("Invalid uptime proof signature from " << pubkey);
+				return false;
+			}
+			m_uptime_proof_queue.erase(range.first, range.second);
 		}
-		else 
+		m_uptime_proof_queue.emplace(pubkey, proof);
+		return true;
+	}
+
+	std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request> quorum_cop::verify_uptime_proofs(std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request>& rejected)
+	{
+		std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request> proofs;
 		{
-			my_uptime_proof_confirmation = false;
-   			LOG_PRINT_L2("Accepted uptime proof from " << proof.pubkey);
+			CRITICAL_REGION_LOCAL(m_lock);
+			proofs.reserve(m_uptime_proof_queue.size());
+			for (auto& kv_pair : m_uptime_proof_queue)
+				proofs.push_back(std::move(kv_pair.second));
+			m_uptime_proof_queue.clear();
 		}
 
+		std::vector<crypto::signature_check> checks(proofs.size());
+		for (size_t i = 0; i < proofs.size(); ++i)
+			checks[i] = { make_hash(proofs[i].pubkey, proofs[i].timestamp), proofs[i].pubkey, proofs[i].sig };
+
+		const size_t batches = (checks.size() + UPTIME_PROOF_VERIFY_BATCH_SIZE - 1) / UPTIME_PROOF_VERIFY_BATCH_SIZE;
+		std::vector<std::vector<bool>> results(batches);
+		tools::threadpool& tpool = tools::threadpool::getInstance();
+		tools::threadpool::waiter waiter;
+		for (size_t b = 0; b < batches; ++b)
+		{
+			tpool.submit(&waiter, [&checks, &results, b]() {
+				const auto begin = checks.begin() + b * UPTIME_PROOF_VERIFY_BATCH_SIZE;
+				const auto end = checks.begin() + std::min(checks.size(), (b + 1) * UPTIME_PROOF_VERIFY_BATCH_SIZE);
+				crypto::check_signatures(std::vector<crypto::signature_check>(begin, end), &results[b]);
+			}, true);
+		}
+		waiter.wait(&tpool);
+
+		uint64_t now = time(nullptr);
+		std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request> accepted;
 		CRITICAL_REGION_LOCAL(m_lock);
-		if (m_uptime_proof_seen[pubkey] >= now - (UPTIME_PROOF_FREQUENCY_IN_SECONDS / 2))
-			return false; // already received one uptime proof for this node recently.
+		for (size_t i = 0; i < proofs.size(); ++i)
+		{
+			if (!results[i / UPTIME_PROOF_VERIFY_BATCH_SIZE][i % UPTIME_PROOF_VERIFY_BATCH_SIZE])
+			{
+				LOG_PRINT_L1("Invalid uptime proof signature from " << proofs[i].pubkey);
+				rejected.push_back(std::move(proofs[i]));
+				continue;
+			}
 
-		crypto::hash hash = make_hash(pubkey, timestamp);
-		if (!crypto::check_signature(hash, pubkey, sig))
-			return false;
+			uint64_t& seen = m_uptime_proof_seen[proofs[i].pubkey];
+			if (seen >= now - (UPTIME_PROOF_FREQUENCY_IN_SECONDS / 2))
+			{
+				rejected.push_back(std::move(proofs[i]));
+				continue;
+			}
+			seen = now;
+			accepted.push_back(std::move(proofs[i]));
+		}
+		return accepted;
+	}
 
-		m_uptime_proof_seen[pubkey] = now;
-		return true;
+	size_t quorum_cop::get_queued_uptime_proof_count() const
+	{
+		CRITICAL_REGION_LOCAL(m_lock);
+		return m_uptime_proof_queue.size();
 	}
 
 	void generate_uptime_proof_request(const crypto::public_key& pubkey, const crypto::secret_key& seckey, cryptonote::NOTIFY_UPTIME_PROOF::request& req)
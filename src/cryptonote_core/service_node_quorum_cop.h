@@ -50,7 +50,11 @@ namespace service_nodes
 		void block_added(const cryptonote::block& block, const std::vector<cryptonote::transaction>& txs) override;
 		void blockchain_detached(uint64_t height) override;
 
-		bool handle_uptime_proof(const cryptonote::NOTIFY_UPTIME_PROOF::request &proof, bool &my_uptime_proof_confirmation);
+		/// Queues a proof from a current service node for verify_uptime_proofs; false if it is rejected outright
+		bool handle_uptime_proof(const cryptonote::NOTIFY_UPTIME_PROOF::request &proof);
+		/// Checks the signatures of the queued proofs in batches on the threadpool and returns the accepted ones, adding the others to rejected
+		std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request> verify_uptime_proofs(std::vector<cryptonote::NOTIFY_UPTIME_PROOF::request>& rejected);
+		size_t get_queued_uptime_proof_count() const;
 
 		static const uint64_t REORG_SAFETY_BUFFER_IN_BLOCKS = 20;
 		static_assert(REORG_SAFETY_BUFFER_IN_BLOCKS < deregister_vote::VOTE_LIFETIME_BY_HEIGHT,
@@ -66,6 +70,7 @@ namespace service_nodes
 
 		using timestamp = uint64_t;
 		std::unordered_map<crypto::public_key, timestamp> m_uptime_proof_seen;
+		std::unordered_multimap<crypto::public_key, cryptonote::NOTIFY_UPTIME_PROOF::request> m_uptime_proof_queue; // distinct proofs of a node, as any of them may be forged, up to UPTIME_PROOF_MAX_QUEUED_PER_NODE
 		mutable epee::critical_section m_lock;
 	};
 	void generate_uptime_proof_request(const crypto::public_key& pubkey, const crypto::secret_key& seckey, cryptonote::NOTIFY_UPTIME_PROOF::request& req);
@@ -22,6 +22,18 @@ namespace service_nodes {
   constexpr size_t DECOMMISSIONED_REDISTRIBUTION_LOWER_PERCENTILE = 0;
   constexpr size_t STEALING_SWARM_UPPER_PERCENTILE  = 75;
 
+  constexpr uint64_t ROLLBACK_EVENT_EXPIRATION_BLOCKS = 30;
+  // How often the per-block state deltas older than the rollback/quorum window are pruned from the db
+  constexpr uint64_t STATE_DELTA_COMPACTION_INTERVAL  = 100;
+  // How often a full snapshot of the list is written to the db, and how many are kept
+  constexpr uint64_t STATE_SNAPSHOT_INTERVAL          = 10000;
+  constexpr uint64_t STATE_SNAPSHOTS_KEPT             = 2;
+  // Uptime proofs are queued and their signatures checked this many at a time
+  constexpr size_t UPTIME_PROOF_VERIFY_BATCH_SIZE     = 64;
+  // Past either limit a proof's signature is checked as it arrives instead of being queued unchecked
+  constexpr size_t UPTIME_PROOF_MAX_QUEUED_PER_NODE   = 4;
+  constexpr size_t UPTIME_PROOF_MAX_QUEUED            = 16 * UPTIME_PROOF_VERIFY_BATCH_SIZE;
+
   using swarm_id_t = uint64_t;
   constexpr swarm_id_t UNASSIGNED_SWARM_ID          = UINT64_MAX;
 
@@ -34,6 +46,17 @@ switch(nettype) {
 }
 }
 
+inline uint64_t get_deregister_lifetime(uint8_t hard_fork_version)
+{
+  return hard_fork_version >= 8 ? uint64_t{deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT_V2} : uint64_t{deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT};
+}
+
+/// Whether a deregister voted at deregister_height may be in the block at height, as checked by Blockchain::check_tx_inputs
+inline bool is_deregister_in_lifetime(uint8_t hard_fork_version, uint64_t deregister_height, uint64_t height)
+{
+  return deregister_height < height && height - deregister_height < get_deregister_lifetime(hard_fork_version);
+}
+
 inline uint64_t get_min_node_contribution(uint8_t hard_fork_version, uint64_t staking_requirement, uint64_t total_reserved)
 {
   return hard_fork_version >= 12 ? MIN_POOL_STAKERS_V12 * COIN : hard_fork_version > 9 ? std::min(staking_requirement - total_reserved, staking_requirement / MAX_NUMBER_OF_CONTRIBUTORS_V2) : std::min(staking_requirement - total_reserved, staking_requirement / MAX_NUMBER_OF_CONTRIBUTORS);
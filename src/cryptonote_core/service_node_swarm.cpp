@@ -1,5 +1,7 @@
 #include "service_node_swarm.h"
 
+#include <stdexcept>
+
 #undef XEQ_DEFAULT_LOG_CATEGORY
 #define XEQ_DEFAULT_LOG_CATEGORY "service_nodes"
 
@@ -158,7 +160,7 @@ namespace service_nodes
     }
   }
 
-  prod_static void calc_swarm_sizes(const swarm_snode_map_t &swarm_to_snodes, std::vector<swarm_size> &sorted_swarm_sizes)
+  prod_static void calc_swarm_sizes(const swarm_snode_map_t &swarm_to_snodes, std::vector<swarm_size> &sorted_swarm_sizes, bool ties_by_swarm_id)
   {
     sorted_swarm_sizes.clear();
     sorted_swarm_sizes.reserve(swarm_to_snodes.size());
@@ -166,21 +168,28 @@ namespace service_nodes
     {
       sorted_swarm_sizes.push_back({entry.first, entry.second.size()});
     }
-    std::sort(sorted_swarm_sizes.begin(),
-              sorted_swarm_sizes.end(),
-              [](const swarm_size &a, const swarm_size &b) {
-                return a.size < b.size;
-              });
+    if (ties_by_swarm_id)
+      std::sort(sorted_swarm_sizes.begin(),
+                sorted_swarm_sizes.end(),
+                [](const swarm_size &a, const swarm_size &b) {
+                  return a.size < b.size || (a.size == b.size && a.swarm_id < b.swarm_id);
+                });
+    else
+      std::sort(sorted_swarm_sizes.begin(),
+                sorted_swarm_sizes.end(),
+                [](const swarm_size &a, const swarm_size &b) {
+                  return a.size < b.size;
+                });
   }
 
   /// Assign each snode from snode_pubkeys into the FILL_SWARM_LOWER_PERCENTILE percentile of swarms
   /// and run the excess/threshold logic after each assignment to ensure new swarms are generated when required.
-  prod_static void assign_snodes(const std::vector<crypto::public_key> &snode_pubkeys, swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt, size_t percentile)
+  prod_static void assign_snodes(const std::vector<crypto::public_key> &snode_pubkeys, swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt, size_t percentile, bool ties_by_swarm_id)
   {
     std::vector<swarm_size> sorted_swarm_sizes;
     for (const auto &sn_pk : snode_pubkeys)
     {
-      calc_swarm_sizes(swarm_to_snodes, sorted_swarm_sizes);
+      calc_swarm_sizes(swarm_to_snodes, sorted_swarm_sizes, ties_by_swarm_id);
       const size_t percentile_index = percentile * (sorted_swarm_sizes.size() - 1) / 100;
       const size_t percentile_value = sorted_swarm_sizes.at(percentile_index).size;
       /// Find last occurence of percentile_value
@@ -202,7 +211,7 @@ namespace service_nodes
     }
   }
 
-  void calc_swarm_changes(swarm_snode_map_t &swarm_to_snodes, uint64_t seed)
+  void calc_swarm_changes(swarm_snode_map_t &swarm_to_snodes, uint64_t seed, bool ties_by_swarm_id)
   {
 
     if (swarm_to_snodes.size() == 0)
@@ -231,7 +240,7 @@ namespace service_nodes
     }
 
     /// 1. Assign new registered snodes
-    assign_snodes(unassigned_snodes, swarm_to_snodes, mersenne_twister, FILL_SWARM_LOWER_PERCENTILE);
+    assign_snodes(unassigned_snodes, swarm_to_snodes, mersenne_twister, FILL_SWARM_LOWER_PERCENTILE, ties_by_swarm_id);
     LOG_PRINT_L2("After assignment:");
     for (const auto &entry : swarm_to_snodes)
     {
@@ -241,7 +250,7 @@ namespace service_nodes
     /// 2. *Robin Hood Round* steal snodes from wealthy swarms and give them to the poor
     {
       std::vector<swarm_size> sorted_swarm_sizes;
-      calc_swarm_sizes(swarm_to_snodes, sorted_swarm_sizes);
+      calc_swarm_sizes(swarm_to_snodes, sorted_swarm_sizes, ties_by_swarm_id);
       bool insufficient_excess = false;
       for (const auto& swarm : sorted_swarm_sizes)
       {
@@ -301,7 +310,7 @@ namespace service_nodes
         /// Remove swarm from map
         swarm_to_snodes.erase(it);
         /// Assign snodes to the 0 percentile, i.e. the smallest swarms
-        assign_snodes(decommissioned_snodes, swarm_to_snodes, mersenne_twister, DECOMMISSIONED_REDISTRIBUTION_LOWER_PERCENTILE);
+        assign_snodes(decommissioned_snodes, swarm_to_snodes, mersenne_twister, DECOMMISSIONED_REDISTRIBUTION_LOWER_PERCENTILE, ties_by_swarm_id);
       }
     }
 
@@ -312,4 +321,371 @@ namespace service_nodes
       LOG_PRINT_L2(entry.first << ": " << entry.second.size());
     }
   }
+
+  static bool pubkey_less(const crypto::public_key &a, const crypto::public_key &b)
+  {
+    return memcmp(&a, &b, sizeof(a)) < 0;
+  }
+
+  void swarm_index::set(const crypto::public_key& pubkey, swarm_id_t swarm_id)
+  {
+    const auto it = m_node_swarms.find(pubkey);
+    if (it != m_node_swarms.end())
+    {
+      if (it->second == swarm_id)
+        return;
+      erase_node(it->second, pubkey);
+      it->second = swarm_id;
+    }
+    else
+    {
+      m_node_swarms.emplace(pubkey, swarm_id);
+    }
+    insert_node(swarm_id, pubkey);
+  }
+
+  void swarm_index::remove(const crypto::public_key& pubkey)
+  {
+    const auto it = m_node_swarms.find(pubkey);
+    if (it == m_node_swarms.end())
+      return;
+    erase_node(it->second, pubkey);
+    m_node_swarms.erase(it);
+  }
+
+  void swarm_index::clear()
+  {
+    m_swarms.clear();
+    m_unassigned.clear();
+    m_node_swarms.clear();
+    m_swarms_by_size.clear();
+    m_starving.clear();
+    m_excess = 0;
+  }
+
+  swarm_snode_map_t swarm_index::get_swarms() const
+  {
+    swarm_snode_map_t swarms(m_swarms.begin(), m_swarms.end());
+    if (!m_unassigned.empty())
+      swarms[UNASSIGNED_SWARM_ID] = m_unassigned;
+    return swarms;
+  }
+
+  /// Outside of calc_changes the nodes of a swarm are kept sorted
+  void swarm_index::insert_node(swarm_id_t swarm_id, const crypto::public_key& pubkey)
+  {
+    if (swarm_id == UNASSIGNED_SWARM_ID)
+    {
+      m_unassigned.insert(std::upper_bound(m_unassigned.begin(), m_unassigned.end(), pubkey, pubkey_less), pubkey);
+      return;
+    }
+
+    auto it = m_swarms.find(swarm_id);
+    if (it == m_swarms.end())
+    {
+      it = m_swarms.emplace(swarm_id, std::vector<crypto::public_key>()).first;
+      index_size(swarm_id, 0);
+    }
+    std::vector<crypto::public_key>& snodes = it->second;
+    snodes.insert(std::upper_bound(snodes.begin(), snodes.end(), pubkey, pubkey_less), pubkey);
+    resize(swarm_id, snodes.size() - 1, snodes.size());
+  }
+
+  void swarm_index::erase_node(swarm_id_t swarm_id, const crypto::public_key& pubkey)
+  {
+    std::vector<crypto::public_key>& snodes = swarm_id == UNASSIGNED_SWARM_ID ? m_unassigned : m_swarms.at(swarm_id);
+    const auto it = std::lower_bound(snodes.begin(), snodes.end(), pubkey, pubkey_less);
+    if (it == snodes.end() || *it != pubkey)
+      return;
+    snodes.erase(it);
+
+    if (swarm_id == UNASSIGNED_SWARM_ID)
+      return;
+    resize(swarm_id, snodes.size() + 1, snodes.size());
+    if (snodes.empty())
+      erase_swarm(swarm_id);
+  }
+
+  void swarm_index::index_size(swarm_id_t swarm_id, size_t size)
+  {
+    std::vector<swarm_id_t>& ids = m_swarms_by_size[size];
+    ids.insert(std::lower_bound(ids.begin(), ids.end(), swarm_id), swarm_id);
+    if (size < MIN_SWARM_SIZE)
+      m_starving.insert(swarm_id);
+    if (size > EXCESS_BASE)
+      m_excess += size - EXCESS_BASE;
+  }
+
+  void swarm_index::unindex_size(swarm_id_t swarm_id, size_t size)
+  {
+    const auto bucket = m_swarms_by_size.find(size);
+    std::vector<swarm_id_t>& ids = bucket->second;
+    ids.erase(std::lower_bound(ids.begin(), ids.end(), swarm_id));
+    if (ids.empty())
+      m_swarms_by_size.erase(bucket);
+    if (size < MIN_SWARM_SIZE)
+      m_starving.erase(swarm_id);
+    if (size > EXCESS_BASE)
+      m_excess -= size - EXCESS_BASE;
+  }
+
+  void swarm_index::resize(swarm_id_t swarm_id, size_t old_size, size_t new_size)
+  {
+    unindex_size(swarm_id, old_size);
+    index_size(swarm_id, new_size);
+  }
+
+  void swarm_index::erase_swarm(swarm_id_t swarm_id)
+  {
+    const auto it = m_swarms.find(swarm_id);
+    unindex_size(swarm_id, it->second.size());
+    m_swarms.erase(it);
+  }
+
+  /// The swarm at position in calc_swarm_sizes order
+  swarm_size swarm_index::get_sorted_swarm(size_t position) const
+  {
+    for (const auto &entry : m_swarms_by_size)
+    {
+      if (position < entry.second.size())
+        return {entry.second[position], entry.first};
+      position -= entry.second.size();
+    }
+    throw std::out_of_range("swarm position out of range");
+  }
+
+  size_t swarm_index::count_swarms_up_to(size_t size) const
+  {
+    size_t count = 0;
+    for (auto it = m_swarms_by_size.begin(); it != m_swarms_by_size.end() && it->first <= size; ++it)
+      count += it->second.size();
+    return count;
+  }
+
+  /// Size and excess of the pool get_excess_pool would build
+  void swarm_index::get_excess_pool_size(size_t threshold, size_t& pool_size, size_t& excess) const
+  {
+    pool_size = 0;
+    if (threshold < MIN_SWARM_SIZE)
+      return;
+
+    excess = 0;
+    for (auto it = m_swarms_by_size.upper_bound(threshold); it != m_swarms_by_size.end(); ++it)
+    {
+      excess += (it->first - MIN_SWARM_SIZE) * it->second.size();
+      pool_size += it->first * it->second.size();
+    }
+  }
+
+  /// The entry at position in the pool get_excess_pool would build
+  excess_pool_snode swarm_index::get_excess_pool_snode(size_t threshold, size_t position) const
+  {
+    for (const auto &entry : m_swarms)
+    {
+      if (entry.second.size() <= threshold)
+        continue;
+      if (position < entry.second.size())
+        return {entry.second[position], entry.first};
+      position -= entry.second.size();
+    }
+    throw std::out_of_range("excess pool position out of range");
+  }
+
+  /// Within calc_changes nodes move the way calc_swarm_changes moves them, unsorted
+  void swarm_index::move_out(swarm_id_t swarm_id, const crypto::public_key& pubkey)
+  {
+    std::vector<crypto::public_key>& snodes = m_swarms.at(swarm_id);
+    snodes.erase(std::remove(snodes.begin(), snodes.end(), pubkey), snodes.end());
+    resize(swarm_id, snodes.size() + 1, snodes.size());
+    m_touched.insert(swarm_id);
+    m_moved_from.emplace(pubkey, swarm_id);
+  }
+
+  void swarm_index::move_in(swarm_id_t swarm_id, const crypto::public_key& pubkey)
+  {
+    std::vector<crypto::public_key>& snodes = m_swarms.at(swarm_id);
+    snodes.push_back(pubkey);
+    resize(swarm_id, snodes.size() - 1, snodes.size());
+    m_touched.insert(swarm_id);
+    m_node_swarms[pubkey] = swarm_id;
+  }
+
+  void swarm_index::assign_snodes(const std::vector<crypto::public_key>& snode_pubkeys, std::mt19937_64& mt, size_t percentile)
+  {
+    for (const auto &sn_pk : snode_pubkeys)
+    {
+      const size_t percentile_index = percentile * (m_swarms.size() - 1) / 100;
+      const size_t percentile_value = get_sorted_swarm(percentile_index).size;
+      /// Last position of percentile_value
+      const size_t upper_index = count_swarms_up_to(percentile_value) - 1;
+      const size_t random_idx = uniform_distribution_portable(mt, upper_index + 1);
+      move_in(get_sorted_swarm(random_idx).swarm_id, sn_pk);
+      /// run the excess/threshold round after each additional snode
+      create_new_swarm_from_excess(mt);
+    }
+  }
+
+  void swarm_index::create_new_swarm_from_excess(std::mt19937_64& mt)
+  {
+    if (!m_starving.empty())
+      return;
+
+    while (m_excess >= NEW_SWARM_SIZE + m_swarms.size() * IDEAL_SWARM_MARGIN)
+    {
+      LOG_PRINT_L2("New swarm creation");
+      std::vector<crypto::public_key> new_swarm_snodes;
+      new_swarm_snodes.reserve(NEW_SWARM_SIZE);
+      while (new_swarm_snodes.size() < NEW_SWARM_SIZE)
+      {
+        size_t pool_size, excess;
+        get_excess_pool_size(EXCESS_BASE, pool_size, excess);
+        if (pool_size == 0)
+        {
+          MERROR("Error while getting excess pool for new swarm creation");
+          m_lost.insert(m_lost.end(), new_swarm_snodes.begin(), new_swarm_snodes.end());
+          return;
+        }
+        const excess_pool_snode random_excess_snode = get_excess_pool_snode(EXCESS_BASE, uniform_distribution_portable(mt, pool_size));
+        new_swarm_snodes.push_back(random_excess_snode.public_key);
+        move_out(random_excess_snode.swarm_id, random_excess_snode.public_key);
+      }
+      const auto new_swarm_id = get_new_swarm_id(m_swarms);
+      if (!m_swarms.emplace(new_swarm_id, std::vector<crypto::public_key>()).second)
+      {
+        m_lost.insert(m_lost.end(), new_swarm_snodes.begin(), new_swarm_snodes.end());
+        continue;
+      }
+      index_size(new_swarm_id, 0);
+      for (const auto &sn_pk : new_swarm_snodes)
+        move_in(new_swarm_id, sn_pk);
+      LOG_PRINT_L2("Created new swarm from excess: " << new_swarm_id);
+    }
+  }
+
+  /// Same steps as calc_swarm_changes, which is what the results are tested against
+  void swarm_index::calc_changes(uint64_t seed, std::vector<std::pair<crypto::public_key, swarm_id_t>>& changes)
+  {
+    changes.clear();
+    if (m_swarms.empty() && m_unassigned.empty())
+      return;
+
+    std::mt19937_64 mersenne_twister(seed);
+
+    std::vector<crypto::public_key> unassigned_snodes;
+    std::swap(unassigned_snodes, m_unassigned);
+    for (const auto &sn_pk : unassigned_snodes)
+      m_moved_from.emplace(sn_pk, UNASSIGNED_SWARM_ID);
+
+    LOG_PRINT_L3("calc_swarm_changes. swarms: " << m_swarms.size() << ", regs: " << unassigned_snodes.size());
+
+    /// 0. Ensure there is always 1 swarm
+    if (m_swarms.empty())
+    {
+      const auto new_swarm_id = get_new_swarm_id({});
+      m_swarms.emplace(new_swarm_id, std::vector<crypto::public_key>());
+      index_size(new_swarm_id, 0);
+      m_touched.insert(new_swarm_id);
+      LOG_PRINT_L2("Created initial swarm " << new_swarm_id);
+    }
+
+    /// 1. Assign new registered snodes
+    assign_snodes(unassigned_snodes, mersenne_twister, FILL_SWARM_LOWER_PERCENTILE);
+    LOG_PRINT_L2("After assignment: " << m_swarms.size() << " swarms");
+
+    /// 2. *Robin Hood Round* steal snodes from wealthy swarms and give them to the poor
+    if (!m_starving.empty())
+    {
+      std::vector<swarm_size> sorted_swarm_sizes;
+      sorted_swarm_sizes.reserve(m_swarms.size());
+      for (const auto &entry : m_swarms_by_size)
+        for (const swarm_id_t swarm_id : entry.second)
+          sorted_swarm_sizes.push_back({swarm_id, entry.first});
+
+      bool insufficient_excess = false;
+      for (const auto& swarm : sorted_swarm_sizes)
+      {
+        /// we have processed all the starving swarms
+        if (swarm.size >= MIN_SWARM_SIZE)
+          break;
+
+        const auto& poor_swarm_snodes = m_swarms.at(swarm.swarm_id);
+        do
+        {
+          const size_t percentile_index = STEALING_SWARM_UPPER_PERCENTILE * (sorted_swarm_sizes.size() - 1) / 100;
+          /// -1 since we will only consider swarm sizes strictly above percentile_value
+          size_t percentile_value = sorted_swarm_sizes.at(percentile_index).size - 1;
+          percentile_value = std::max(MIN_SWARM_SIZE, percentile_value);
+          size_t pool_size, excess;
+          get_excess_pool_size(percentile_value, pool_size, excess);
+          /// If we can't save the swarm, don't bother continuing
+          const size_t deficit = MIN_SWARM_SIZE - poor_swarm_snodes.size();
+          insufficient_excess = (excess < deficit);
+          if (insufficient_excess)
+            break;
+          const excess_pool_snode excess_snode = get_excess_pool_snode(percentile_value, uniform_distribution_portable(mersenne_twister, pool_size));
+          move_out(excess_snode.swarm_id, excess_snode.public_key);
+          move_in(swarm.swarm_id, excess_snode.public_key);
+          LOG_PRINT_L2("Stolen 1 snode from " << excess_snode.public_key << " and donated to " << swarm.swarm_id);
+        } while (poor_swarm_snodes.size() < MIN_SWARM_SIZE);
+
+        if (insufficient_excess)
+          break;
+      }
+    }
+
+    /// 3. New swarm creation
+    create_new_swarm_from_excess(mersenne_twister);
+
+    /// 4. If there is a swarm with less than MIN_SWARM_SIZE, decommission that swarm.
+    if (m_swarms.size() > 1)
+    {
+      while (!m_starving.empty())
+      {
+        const swarm_id_t swarm_id = *m_starving.begin();
+        MWARNING("swarm " << swarm_id << " is DECOMMISSIONED");
+        std::vector<crypto::public_key> decommissioned_snodes;
+        std::swap(decommissioned_snodes, m_swarms.at(swarm_id));
+        unindex_size(swarm_id, decommissioned_snodes.size());
+        m_swarms.erase(swarm_id);
+        for (const auto &sn_pk : decommissioned_snodes)
+          m_moved_from.emplace(sn_pk, swarm_id);
+        /// Assign snodes to the 0 percentile, i.e. the smallest swarms
+        assign_snodes(decommissioned_snodes, mersenne_twister, DECOMMISSIONED_REDISTRIBUTION_LOWER_PERCENTILE);
+      }
+    }
+
+    /// Back to sorted swarms without empty ones, as they would be rebuilt from the infos
+    for (const swarm_id_t swarm_id : m_touched)
+    {
+      const auto it = m_swarms.find(swarm_id);
+      if (it == m_swarms.end())
+        continue;
+      if (it->second.empty())
+        erase_swarm(swarm_id);
+      else
+        std::sort(it->second.begin(), it->second.end(), pubkey_less);
+    }
+
+    /// Nodes dropped on an error keep the swarm they had
+    for (const auto &sn_pk : m_lost)
+    {
+      const swarm_id_t swarm_id = m_moved_from.at(sn_pk);
+      m_node_swarms[sn_pk] = swarm_id;
+      insert_node(swarm_id, sn_pk);
+    }
+
+    for (const auto &entry : m_moved_from)
+    {
+      const swarm_id_t swarm_id = m_node_swarms.at(entry.first);
+      if (swarm_id != entry.second)
+        changes.emplace_back(entry.first, swarm_id);
+    }
+    std::sort(changes.begin(), changes.end(), [](const std::pair<crypto::public_key, swarm_id_t> &a, const std::pair<crypto::public_key, swarm_id_t> &b) {
+      return a.second < b.second || (a.second == b.second && pubkey_less(a.first, b.first));
+    });
+
+    m_moved_from.clear();
+    m_touched.clear();
+    m_lost.clear();
+  }
 }
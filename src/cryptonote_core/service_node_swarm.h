@@ -3,6 +3,8 @@
 #include "service_node_rules.h"
 
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 #include <random>
 
@@ -17,15 +19,72 @@ namespace service_nodes {
         swarm_id_t swarm_id;
     };
 
-    void calc_swarm_changes(swarm_snode_map_t& swarm_to_snodes, uint64_t seed);
+    /// Reference implementation, rebuilding everything it works from on each step.
+    /// Swarms of equal size are left in whatever order std::sort puts them,
+    /// as deployed nodes do, unless ties_by_swarm_id; swarm_index's ordering
+    /// also needs the nodes of each swarm sorted by pubkey.
+    void calc_swarm_changes(swarm_snode_map_t& swarm_to_snodes, uint64_t seed, bool ties_by_swarm_id = false);
+
+    /// The swarm of every service node, kept between blocks together with the
+    /// swarm sizes and excess the assignment works from, so that a block costs
+    /// in proportion to the nodes it registers or removes rather than to the
+    /// whole network. calc_changes gives the same assignment as
+    /// calc_swarm_changes on get_swarms() with ties_by_swarm_id, which is not
+    /// the assignment of older nodes, so it is only used from
+    /// HF_VERSION_SWARM_INDEX.
+    class swarm_index
+    {
+    public:
+        /// Puts a node in swarm_id, adding it if unknown
+        void set(const crypto::public_key& pubkey, swarm_id_t swarm_id);
+        void remove(const crypto::public_key& pubkey);
+        void clear();
+
+        /// Assigns the unassigned nodes and rebalances the swarms; changes gets every node whose swarm changed
+        void calc_changes(uint64_t seed, std::vector<std::pair<crypto::public_key, swarm_id_t>>& changes);
+
+        /// All the swarms with their nodes sorted by pubkey, unassigned nodes under UNASSIGNED_SWARM_ID
+        swarm_snode_map_t get_swarms() const;
+
+    private:
+        void insert_node(swarm_id_t swarm_id, const crypto::public_key& pubkey);
+        void erase_node(swarm_id_t swarm_id, const crypto::public_key& pubkey);
+        void index_size(swarm_id_t swarm_id, size_t size);
+        void unindex_size(swarm_id_t swarm_id, size_t size);
+        void resize(swarm_id_t swarm_id, size_t old_size, size_t new_size);
+        void erase_swarm(swarm_id_t swarm_id);
+
+        swarm_size get_sorted_swarm(size_t position) const;
+        size_t count_swarms_up_to(size_t size) const;
+        void get_excess_pool_size(size_t threshold, size_t& pool_size, size_t& excess) const;
+        excess_pool_snode get_excess_pool_snode(size_t threshold, size_t position) const;
+
+        void move_out(swarm_id_t swarm_id, const crypto::public_key& pubkey);
+        void move_in(swarm_id_t swarm_id, const crypto::public_key& pubkey);
+        void assign_snodes(const std::vector<crypto::public_key>& snode_pubkeys, std::mt19937_64& mt, size_t percentile);
+        void create_new_swarm_from_excess(std::mt19937_64& mt);
+
+        std::map<swarm_id_t, std::vector<crypto::public_key>> m_swarms;
+        std::vector<crypto::public_key> m_unassigned;
+        std::unordered_map<crypto::public_key, swarm_id_t> m_node_swarms;
+        /// Swarm ids by swarm size, each list sorted
+        std::map<size_t, std::vector<swarm_id_t>> m_swarms_by_size;
+        std::set<swarm_id_t> m_starving;
+        size_t m_excess = 0;
+
+        /// Only used while calc_changes runs
+        std::unordered_map<crypto::public_key, swarm_id_t> m_moved_from;
+        std::set<swarm_id_t> m_touched;
+        std::vector<crypto::public_key> m_lost;
+    };
 
 #ifdef UNIT_TEST
     size_t calc_excess(const swarm_snode_map_t &swarm_to_snodes);
     size_t calc_threshold(const swarm_snode_map_t &swarm_to_snodes);
     crypto::public_key steal_from_excess_pool(swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt);
     void create_new_swarm_from_excess(swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt);
-    void calc_swarm_sizes(const swarm_snode_map_t &swarm_to_snodes, std::vector<swarm_size> &sorted_swarm_sizes);
-    void assign_snodes(const std::vector<crypto::public_key> &snode_pubkeys, swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt, size_t percentile);
+    void calc_swarm_sizes(const swarm_snode_map_t &swarm_to_snodes, std::vector<swarm_size> &sorted_swarm_sizes, bool ties_by_swarm_id);
+    void assign_snodes(const std::vector<crypto::public_key> &snode_pubkeys, swarm_snode_map_t &swarm_to_snodes, std::mt19937_64 &mt, size_t percentile, bool ties_by_swarm_id);
     void get_excess_pool(size_t threshold, const swarm_snode_map_t& swarm_to_snodes, std::vector<excess_pool_snode>& pool_snodes, size_t& excess);
     const excess_pool_snode& pick_from_excess_pool(const std::vector<excess_pool_snode>& excess_pool, std::mt19937_64 &mt);
     void remove_excess_snode_from_swarm(const excess_pool_snode& excess_snode, swarm_snode_map_t &swarm_to_snodes);
@@ -0,0 +1,116 @@
+#include "service_node_winner.h"
+#include "service_node_list.h"
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "service_nodes"
+
+namespace service_nodes
+{
+  bool winner_index::entry::operator<(const entry& other) const
+  {
+    if (height != other.height) return height < other.height;
+    if (index != other.index) return index < other.index;
+    return memcmp(&pubkey, &other.pubkey, sizeof(pubkey)) < 0;
+  }
+
+  void winner_index::update(const crypto::public_key& pubkey, const service_node_info* info)
+  {
+    auto it = m_nodes.find(pubkey);
+    if (it != m_nodes.end())
+    {
+      const node_state& old_state = it->second;
+      if (old_state.valid) m_valid.erase(old_state.waiting_since);
+      if (old_state.fully_funded) m_fully_funded.erase(old_state.waiting_since);
+      if (old_state.fully_funded && !old_state.valid) --m_funded_but_invalid;
+      if (!info)
+      {
+        m_nodes.erase(it);
+        return;
+      }
+    }
+    else if (!info)
+    {
+      return;
+    }
+
+    node_state& state = m_nodes[pubkey];
+    state.waiting_since = { info->last_reward_block_height, info->last_reward_transaction_index, pubkey };
+    state.valid = info->is_valid();
+    state.fully_funded = info->is_fully_funded();
+    if (state.valid) m_valid.insert(state.waiting_since);
+    if (state.fully_funded) m_fully_funded.insert(state.waiting_since);
+    if (state.fully_funded && !state.valid) ++m_funded_but_invalid;
+  }
+
+  void winner_index::clear()
+  {
+    m_nodes.clear();
+    m_valid.clear();
+    m_fully_funded.clear();
+    m_funded_but_invalid = 0;
+  }
+
+  crypto::public_key winner_index::select(const service_nodes_infos_t& infos, uint8_t hard_fork_version) const
+  {
+    // At HF12 a fully funded but not valid node only qualifies if no
+    // over-portioned node precedes it in the map's iteration order, which an
+    // ordered index can't tell; such nodes are rare, so scan when they exist.
+    if (hard_fork_version == 12 && m_funded_but_invalid > 0)
+      return select_winner_by_scan(infos, hard_fork_version);
+
+    // Before HF10 only fully funded nodes qualify, after it valid ones do too
+    const entry* best = nullptr;
+    if (!m_fully_funded.empty())
+      best = &*m_fully_funded.begin();
+    if (hard_fork_version > 9 && !m_valid.empty() && (!best || *m_valid.begin() < *best))
+      best = &*m_valid.begin();
+
+    if (!best)
+      return crypto::null_pkey;
+
+    // The scan keeps the first of equally old nodes in iteration order rather
+    // than the lowest pubkey; defer to it in that (practically unseen) case.
+    const auto tied = [best](const std::set<entry>& candidates) {
+      for (const entry& e : candidates)
+      {
+        if (e.height != best->height || e.index != best->index) return false;
+        if (e.pubkey != best->pubkey) return true;
+      }
+      return false;
+    };
+    if (tied(m_fully_funded) || (hard_fork_version > 9 && tied(m_valid)))
+      return select_winner_by_scan(infos, hard_fork_version);
+
+    return best->pubkey;
+  }
+
+  crypto::public_key select_winner_by_scan(const service_nodes_infos_t& infos, uint8_t hard_fork_version)
+  {
+    auto oldest_waiting = std::pair<uint64_t, uint32_t>(std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint32_t>::max());
+    crypto::public_key key = crypto::null_pkey;
+    bool overPortioned = false;
+    for (const auto& info : infos)
+    {
+      if(hard_fork_version == 12)
+      {
+        uint64_t amount_operator_needs_to_stake = portions_to_amount(info.second.portions_for_operator, info.second.staking_requirement);
+
+        if(info.second.total_contributed < amount_operator_needs_to_stake)
+        {
+          overPortioned = true;
+        }
+      }
+
+      if ((info.second.is_valid() && hard_fork_version > 9) || (info.second.is_fully_funded() && !overPortioned))
+      {
+        auto waiting_since = std::make_pair(info.second.last_reward_block_height, info.second.last_reward_transaction_index);
+        if (waiting_since < oldest_waiting)
+        {
+          oldest_waiting = waiting_since;
+          key = info.first;
+        }
+      }
+    }
+    return key;
+  }
+}
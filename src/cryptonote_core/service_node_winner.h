@@ -0,0 +1,49 @@
+#pragma once
+
+#include "crypto/crypto.h"
+
+#include <set>
+#include <unordered_map>
+
+namespace service_nodes {
+    struct service_node_info;
+
+    using service_nodes_infos_t = std::unordered_map<crypto::public_key, service_node_info>;
+
+    /// Service nodes ordered by the (block height, tx index) they have been
+    /// waiting for a reward since, so that the next winner is found in
+    /// O(log N) instead of scanning every node.
+    class winner_index
+    {
+    public:
+        /// Re-indexes a node after its info changed; info is null when the node was removed
+        void update(const crypto::public_key& pubkey, const service_node_info* info);
+        void clear();
+
+        /// Same result as select_winner_by_scan(infos, hard_fork_version), where infos
+        /// must be the map this index has been kept in sync with
+        crypto::public_key select(const service_nodes_infos_t& infos, uint8_t hard_fork_version) const;
+
+    private:
+        struct entry {
+            uint64_t height;
+            uint32_t index;
+            crypto::public_key pubkey;
+            bool operator<(const entry& other) const;
+        };
+
+        struct node_state {
+            entry waiting_since;
+            bool valid;
+            bool fully_funded;
+        };
+
+        std::unordered_map<crypto::public_key, node_state> m_nodes;
+        std::set<entry> m_valid;
+        std::set<entry> m_fully_funded;
+        size_t m_funded_but_invalid = 0;
+    };
+
+    /// Reference implementation, linear in the number of nodes
+    crypto::public_key select_winner_by_scan(const service_nodes_infos_t& infos, uint8_t hard_fork_version);
+}
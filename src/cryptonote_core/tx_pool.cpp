@@ -40,6 +40,7 @@
 #include "blockchain.h"
 #include "blockchain_db/locked_txn.h"
 #include "blockchain_db/blockchain_db.h"
+#include "service_node_rules.h"
 #include "common/boost_serialization_helper.h"
 #include "int-util.h"
 #include "misc_language.h"
@@ -119,7 +120,166 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_cookie(0), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false)
+  block_template_txs::block_template_txs(): m_params(), m_valid(false), m_full(false), m_total_weight(0), m_max_total_weight(0), m_fee(0), m_best_coinbase(0), m_has_lowest(false)
+  {
+  }
+  //---------------------------------------------------------------------------------
+  bool block_template_txs::valid(const params &p) const
+  {
+    return m_valid && p.prev_id == m_params.prev_id && p.median_weight == m_params.median_weight
+      && p.already_generated_coins == m_params.already_generated_coins && p.height == m_params.height && p.version == m_params.version;
+  }
+  //---------------------------------------------------------------------------------
+  bool block_template_txs::get_base_reward(size_t weight, uint64_t &reward) const
+  {
+    miner_reward_context block_reward_context = {};
+    block_reward_parts reward_parts = {};
+    if (!get_equilibria_block_reward(m_params.median_weight, weight, m_params.already_generated_coins, m_params.version, reward_parts, block_reward_context, m_params.height, MAINNET))
+      return false;
+    reward = reward_parts.base_miner;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool block_template_txs::reset(const params &p)
+  {
+    m_params = p;
+    m_valid = false;
+    m_full = false;
+    m_tx_hashes.clear();
+    m_ids.clear();
+    m_key_images.clear();
+    m_total_weight = 0;
+    m_fee = 0;
+    m_has_lowest = false;
+
+    //baseline empty block
+    if (!get_base_reward(0, m_best_coinbase))
+    {
+      MERROR("Failed to get block reward for empty block");
+      return false;
+    }
+
+    size_t max_total_weight_pre_v5 = (130 * p.median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    size_t max_total_weight_v5 = 2 * p.median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    m_max_total_weight = p.version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
+    m_valid = true;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool block_template_txs::fits(size_t weight, uint64_t fee, uint64_t &coinbase)
+  {
+    // Can not exceed maximum block weight
+    if (m_max_total_weight < m_total_weight + weight)
+    {
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      return false;
+    }
+
+    // start using the optimal filling algorithm from v5
+    if (m_params.version >= SERVICE_NODE_VERSION)
+    {
+      uint64_t block_reward;
+      if (!get_base_reward(m_total_weight + weight, block_reward))
+      {
+        LOG_PRINT_L2("  would exceed maximum block weight");
+        return false;
+      }
+      coinbase = block_reward + m_fee + fee;
+      if (coinbase < template_accept_threshold(m_best_coinbase))
+      {
+        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        return false;
+      }
+    }
+    else
+    {
+      // If we've exceeded the penalty free weight,
+      // stop including more tx
+      if (m_total_weight > m_params.median_weight)
+      {
+        LOG_PRINT_L2("  would exceed median block weight");
+        m_full = true;
+        return false;
+      }
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool block_template_txs::add(const tx_by_fee_and_receive_time_entry &entry, size_t weight, uint64_t fee, const transaction_prefix &tx, const std::function<bool()> &ready, bool filling)
+  {
+    if (!m_valid)
+      return false;
+    const crypto::hash &id = entry.second;
+    LOG_PRINT_L2("Considering " << id << ", weight " << weight << ", current block weight " << m_total_weight << "/" << m_max_total_weight << ", current coinbase " << print_money(m_best_coinbase));
+
+    // picking in fee order would have got to this tx before some of the
+    // picked ones, which might then not have fitted
+    const bool ranks_above = !filling && m_has_lowest && txCompare()(entry, m_lowest);
+
+    uint64_t coinbase = 0;
+    if (!fits(weight, fee, coinbase))
+    {
+      if (ranks_above)
+      {
+        MDEBUG("Tx " << id << " ranks above picked txes but doesn't fit, picking block template txes again");
+        m_valid = false;
+      }
+      return false;
+    }
+
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images
+    if (!ready())
+    {
+      LOG_PRINT_L2("  not ready to go");
+      return false;
+    }
+    for (const txin_v &in: tx.vin)
+    {
+      CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, itk, false);
+      if (m_key_images.count(itk.k_image))
+      {
+        LOG_PRINT_L2("  key images already seen");
+        if (ranks_above)
+          m_valid = false;
+        return false;
+      }
+    }
+    for (const txin_v &in: tx.vin)
+      m_key_images.insert(boost::get<txin_to_key>(in).k_image);
+
+    m_tx_hashes.push_back(id);
+    m_ids.insert(id);
+    m_total_weight += weight;
+    m_fee += fee;
+    m_best_coinbase = coinbase;
+    if (!m_has_lowest || txCompare()(m_lowest, entry))
+    {
+      m_lowest = entry;
+      m_has_lowest = true;
+    }
+    LOG_PRINT_L2("  added, new block weight " << m_total_weight << "/" << m_max_total_weight << ", coinbase " << print_money(m_best_coinbase));
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void block_template_txs::remove(const crypto::hash &id)
+  {
+    if (m_valid && m_ids.find(id) != m_ids.end())
+      m_valid = false;
+  }
+  //---------------------------------------------------------------------------------
+  void block_template_txs::get(block &bl, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward) const
+  {
+    bl.tx_hashes.insert(bl.tx_hashes.end(), m_tx_hashes.begin(), m_tx_hashes.end());
+    total_weight = m_total_weight;
+    fee = m_fee;
+    expected_reward = m_best_coinbase;
+  }
+  //---------------------------------------------------------------------------------
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_cookie(0), m_chain_generation(1), m_inputs_generation(1), m_inputs_hf_version(0),
+    m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_mine_stem_txes(false)
   {
 
   }
@@ -136,10 +296,13 @@ namespace cryptonote
      return false;
    }
 
-   std::vector<transaction> pool_txs;
-   get_transactions(pool_txs);
-   for (const transaction& pool_tx : pool_txs)
+   CRITICAL_REGION_LOCAL(m_transactions_lock);
+   for (const auto& entry : m_txs)
    {
+     // stem and local deregisters aren't taken as duplicates, as when they were read from the db
+     if (!entry.second.meta.matches(relay_category::broadcasted))
+       continue;
+     const transaction& pool_tx = entry.second.tx;
 	      if (pool_tx.type != txtype::deregister)
        continue;
 
@@ -281,15 +444,13 @@ namespace cryptonote
         memset(meta.padding, 0, sizeof(meta.padding));
         try
         {
-          if (kept_by_block)
-            m_parsed_tx_cache.insert(std::make_pair(id, tx));
           CRITICAL_REGION_LOCAL1(m_blockchain);
           LockedTXN lock(m_blockchain.get_db());
           if (!insert_key_images(tx, id, tx_relay))
             return false;
 
           m_blockchain.add_txpool_tx(id, blob, meta);
-          m_txs_by_fee_and_receive_time.emplace(std::tuple<bool, double, std::time_t>(tx.is_deregister_tx(), fee / (double)(tx_weight), receive_time), id);
+          add_to_block_template(id, add_pool_tx(id, meta, blob.size(), tx));
           lock.commit();
         }
         catch (const std::exception &e)
@@ -310,14 +471,14 @@ namespace cryptonote
     {
       try
       {
-        if (kept_by_block)
-          m_parsed_tx_cache.insert(std::make_pair(id, tx));
         CRITICAL_REGION_LOCAL1(m_blockchain);
         LockedTXN lock(m_blockchain.get_db());
 
-        const bool existing_tx = m_blockchain.get_txpool_tx_meta(id, meta);
+        const auto existing = m_txs.find(id);
+        const bool existing_tx = existing != m_txs.end();
         if (existing_tx)
         {
+          meta = existing->second.meta;
           /* If Dandelion++ loop. Do not use txes in the `local` state in the
              loop detection - txes in that state should be outgoing over i2p/tor
              then routed back via public dandelion++ stem. Pretend to be
@@ -352,7 +513,7 @@ namespace cryptonote
 
           m_blockchain.remove_txpool_tx(id);
           m_blockchain.add_txpool_tx(id, blob, meta);
-          m_txs_by_fee_and_receive_time.emplace(std::tuple<bool, double, std::time_t>(tx.is_deregister_tx(), fee / (double)(tx_weight), receive_time), id);
+          add_to_block_template(id, add_pool_tx(id, meta, blob.size(), tx));
         }
         lock.commit();
       }
@@ -425,33 +586,30 @@ namespace cryptonote
         break;
       try
       {
-        const crypto::hash &txid = it->second;
-        txpool_tx_meta_t meta;
-        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+        const crypto::hash txid = it->second;
+        const auto ptx = m_txs.find(txid);
+        if (ptx == m_txs.end())
         {
           MERROR("Failed to find tx_meta in txpool");
           return;
         }
+        const txpool_tx_meta_t &meta = ptx->second.meta;
         // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
         if (meta.kept_by_block)
         {
           --it;
           continue;
         }
-        cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
-        cryptonote::transaction_prefix tx;
-        if (!parse_and_validate_tx_prefix_from_blob(txblob, tx))
-        {
-          MERROR("Failed to parse tx from txpool");
-          return;
-        }
         // remove first, in case this throws, so key images aren't removed
-        MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << std::get<1>(it->first));
+        const double fee_per_byte = std::get<1>(it->first);
+        const uint64_t weight = meta.weight;
+        MINFO("Pruning tx " << txid << " from txpool: weight: " << weight << ", fee/byte: " << fee_per_byte);
         m_blockchain.remove_txpool_tx(txid);
-        m_txpool_weight -= meta.weight;
-        remove_transaction_keyimages(tx, txid);
-        MINFO("Pruned tx " << txid << " from txpool: weight: " <<  meta.weight << ", fee/byte: " << std::get<1>(it->first));
-        m_txs_by_fee_and_receive_time.erase(it--);
+        m_txpool_weight -= weight;
+        remove_transaction_keyimages(ptx->second.tx, txid);
+        --it;
+        remove_pool_tx(ptx);
+        MINFO("Pruned tx " << txid << " from txpool: weight: " << weight << ", fee/byte: " << fee_per_byte);
         changed = true;
       }
       catch (const std::exception &e)
@@ -488,7 +646,7 @@ namespace cryptonote
 
       const bool new_or_previously_private =
         kei_image_set.insert(id).second ||
-        !m_blockchain.txpool_tx_matches_category(id, relay_category::legacy);
+        !tx_matches_category(id, relay_category::legacy);
       CHECK_AND_ASSERT_MES(new_or_previously_private, false, "internal error: try to insert duplicate iterator in key_image set");
     }
     ++m_cookie;
@@ -533,32 +691,19 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    auto sorted_it = find_tx_in_sorted_container(id);
+    const auto ptx = m_txs.find(id);
+    if (ptx == m_txs.end())
+    {
+      MERROR("Failed to find tx_meta in txpool");
+      return false;
+    }
 
     try
     {
       LockedTXN lock(m_blockchain.get_db());
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(id, meta))
-      {
-        MERROR("Failed to find tx_meta in txpool");
-        return false;
-      }
+      const txpool_tx_meta_t &meta = ptx->second.meta;
       txblob = m_blockchain.get_txpool_tx_blob(id, relay_category::all);
-      auto ci = m_parsed_tx_cache.find(id);
-      if (ci != m_parsed_tx_cache.end())
-      {
-        tx = ci->second;
-      }
-      else if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(txblob, tx) : parse_and_validate_tx_from_blob(txblob, tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        return false;
-      }
-      else
-      {
-        tx.set_hash(id);
-      }
+      tx = ptx->second.tx;
       tx_weight = meta.weight;
       fee = meta.fee;
       relayed = meta.relayed;
@@ -578,8 +723,7 @@ namespace cryptonote
       return false;
     }
 
-    if (sorted_it != m_txs_by_fee_and_receive_time.end())
-      m_txs_by_fee_and_receive_time.erase(sorted_it);
+    remove_pool_tx(ptx);
     ++m_cookie;
     return true;
   }
@@ -588,33 +732,19 @@ namespace cryptonote
   {
     PERF_TIMER(get_transaction_info);
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+
+    const auto ptx = m_txs.find(txid);
+    if (ptx == m_txs.end())
+    {
+      MERROR("Failed to find tx in txpool");
+      return false;
+    }
 
     try
     {
-      LockedTXN lock(m_blockchain.get_db());
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(txid, meta))
-      {
-        MERROR("Failed to find tx in txpool");
-        return false;
-      }
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
-      auto ci = m_parsed_tx_cache.find(txid);
-      if (ci != m_parsed_tx_cache.end())
-      {
-        td.tx = ci->second;
-      }
-      else if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(txblob, td.tx) : parse_and_validate_tx_from_blob(txblob, td.tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        return false;
-      }
-      else
-      {
-        td.tx.set_hash(txid);
-      }
-      td.blob_size = txblob.size();
+      const txpool_tx_meta_t &meta = ptx->second.meta;
+      td.tx = ptx->second.tx;
+      td.blob_size = ptx->second.blob_size;
       td.weight = meta.weight;
       td.fee = meta.fee;
       td.max_used_block_id = meta.max_used_block_id;
@@ -642,12 +772,14 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    m_blockchain.for_all_txpool_txes([this, &hashes, &txes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
-      const auto tx_relay_method = meta.get_relay_method();
+    const std::unordered_set<crypto::hash> known(hashes.begin(), hashes.end());
+    for (const auto &entry: m_txs)
+    {
+      const crypto::hash &txid = entry.first;
+      const auto tx_relay_method = entry.second.meta.get_relay_method();
       if (tx_relay_method != relay_method::block && tx_relay_method != relay_method::fluff)
-        return true;
-      const auto i = std::find(hashes.begin(), hashes.end(), txid);
-      if (i == hashes.end())
+        continue;
+      if (known.find(txid) == known.end())
       {
         cryptonote::blobdata bd;
         try
@@ -655,18 +787,17 @@ namespace cryptonote
           if (!m_blockchain.get_txpool_tx_blob(txid, bd, cryptonote::relay_category::broadcasted))
           {
             MERROR("Failed to get blob for txpool transaction " << txid);
-            return true;
+            continue;
           }
           txes.emplace_back(std::move(bd));
         }
         catch (const std::exception &e)
         {
           MERROR("Failed to get blob for txpool transaction " << txid << ": " << e.what());
-          return true;
+          continue;
         }
       }
-      return true;
-    }, false);
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -675,13 +806,97 @@ namespace cryptonote
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
   }
   //---------------------------------------------------------------------------------
-  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
+  tx_memory_pool::pool_tx &tx_memory_pool::add_pool_tx(const crypto::hash &id, const txpool_tx_meta_t &meta, size_t blob_size, transaction tx)
   {
-    return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    const auto existing = m_txs.find(id);
+    if (existing != m_txs.end())
+      remove_pool_tx(existing);
+
+    pool_tx &ptx = m_txs[id];
+    ptx.meta = meta;
+    ptx.blob_size = blob_size;
+    ptx.tx = std::move(tx);
+    ptx.tx.set_hash(id);
+    ptx.sorted = m_txs_by_fee_and_receive_time.emplace(std::tuple<bool, double, std::time_t>(ptx.tx.is_deregister_tx(), meta.fee / (double)meta.weight, meta.receive_time), id).first;
+    ptx.by_receive_time = m_txs_by_receive_time.emplace(meta.receive_time, id);
+    ptx.ready_generation = 0;
+    ptx.ready = false;
+    ptx.inputs_generation = 0;
+    return ptx;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_pool_tx(pool_tx_container::iterator it)
+  {
+    m_block_template_txs.remove(it->first);
+    m_input_cache.erase(it->first);
+    m_txs_by_fee_and_receive_time.erase(it->second.sorted);
+    m_txs_by_receive_time.erase(it->second.by_receive_time);
+    m_txs.erase(it);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_pool_tx(const crypto::hash &id, pool_tx &ptx, const txpool_tx_meta_t &meta)
+  {
+    // the ordering keys don't change once a tx is in the pool
+    m_blockchain.update_txpool_tx(id, meta);
+    ptx.meta = meta;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::tx_matches_category(const crypto::hash &id, relay_category category) const
+  {
+    const auto it = m_txs.find(id);
+    return it != m_txs.end() && it->second.meta.matches(category);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_block_template_candidate(const txpool_tx_meta_t &meta) const
+  {
+    if (!meta.matches(relay_category::legacy) && !(m_mine_stem_txes && meta.get_relay_method() == relay_method::stem))
+      return false;
+    return !meta.pruned;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_pool_tx_ready(const crypto::hash &id, pool_tx &ptx)
+  {
+    if (ptx.ready_generation == m_chain_generation)
+      return ptx.ready;
+
+    txpool_tx_meta_t meta = ptx.meta;
+    bool ready = false;
+    try
+    {
+      // a deregister becomes invalid as blocks are added, once it's too old or its node was
+      // deregistered by another one, which key images don't show: it's checked in full each time
+      const bool inputs_valid = ptx.inputs_generation == m_inputs_generation && !ptx.tx.is_deregister_tx();
+      ready = is_transaction_ready_to_go(meta, id, ptx.tx, inputs_valid);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to check transaction readiness: " << e.what());
+      // continue, not fatal
+    }
+    if (memcmp(&ptx.meta, &meta, sizeof(meta)))
+    {
+      try
+      {
+        update_pool_tx(id, ptx, meta);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to update tx meta: " << e.what());
+        // continue, not fatal
+      }
+    }
+    ptx.ready = ready;
+    ptx.ready_generation = m_chain_generation;
+    if (ready)
+      ptx.inputs_generation = m_inputs_generation;
+    return ready;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_to_block_template(const crypto::hash &id, pool_tx &ptx)
+  {
+    if (!is_block_template_candidate(ptx.meta))
+      return;
+    m_block_template_txs.add(*ptx.sorted, ptx.meta.weight, ptx.meta.fee, ptx.tx, [this, &id, &ptx]() { return is_pool_tx_ready(id, ptx); }, false);
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -689,51 +904,40 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    std::list<std::pair<crypto::hash, uint64_t>> remove;
-    m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
-      uint64_t tx_age = time(nullptr) - meta.receive_time;
+    std::list<crypto::hash> remove;
+    const uint64_t now = time(nullptr);
+    const uint64_t min_livetime = std::min<uint64_t>({CRYPTONOTE_MEMPOOL_TX_LIVETIME, CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME, MEMPOOL_PRUNE_DEREGISTER_LIFETIME});
+    // oldest first, so only the txes old enough to have timed out are looked at
+    for (const auto &entry: m_txs_by_receive_time)
+    {
+      if (entry.first >= now || now - entry.first <= min_livetime)
+        break;
+      const uint64_t tx_age = now - entry.first;
+      const crypto::hash &txid = entry.second;
+      const txpool_tx_meta_t &meta = m_txs.find(txid)->second.meta;
 
       if((tx_age > CRYPTONOTE_MEMPOOL_TX_LIVETIME && !meta.kept_by_block) ||
          (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && meta.kept_by_block) || (meta.is_deregister && tx_age > MEMPOOL_PRUNE_DEREGISTER_LIFETIME))
       {
         LOG_PRINT_L1("Tx " << txid << " removed from tx pool due to outdated, age: " << tx_age );
-        auto sorted_it = find_tx_in_sorted_container(txid);
-        if (sorted_it == m_txs_by_fee_and_receive_time.end())
-        {
-          LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-        }
-        else
-        {
-          m_txs_by_fee_and_receive_time.erase(sorted_it);
-        }
         m_timed_out_transactions.insert(txid);
-        remove.push_back(std::make_pair(txid, meta.weight));
+        remove.push_back(txid);
       }
-      return true;
-    }, false, relay_category::all);
+    }
 
     if (!remove.empty())
     {
       LockedTXN lock(m_blockchain.get_db());
-      for (const std::pair<crypto::hash, uint64_t> &entry: remove)
+      for (const crypto::hash &txid: remove)
       {
-        const crypto::hash &txid = entry.first;
         try
         {
-          cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
-          cryptonote::transaction_prefix tx;
-          if (!parse_and_validate_tx_prefix_from_blob(bd, tx))
-          {
-            MERROR("Failed to parse tx from txpool");
-            // continue
-          }
-          else
-          {
-            // remove first, so we only remove key images if the tx removal succeeds
-            m_blockchain.remove_txpool_tx(txid);
-            m_txpool_weight -= entry.second;
-            remove_transaction_keyimages(tx, txid);
-          }
+          const auto ptx = m_txs.find(txid);
+          // remove first, so we only remove key images if the tx removal succeeds
+          m_blockchain.remove_txpool_tx(txid);
+          m_txpool_weight -= ptx->second.meta.weight;
+          remove_transaction_keyimages(ptx->second.tx, txid);
+          remove_pool_tx(ptx);
         }
         catch (const std::exception &e)
         {
@@ -753,16 +957,20 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
-    txs.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *){
+    for (const auto &entry: m_txs)
+    {
+      const crypto::hash &txid = entry.first;
+      const txpool_tx_meta_t &meta = entry.second.meta;
+      if (!meta.matches(relay_category::relayable))
+        continue;
 
       // 0 fee transactions are never relayed
       if(!meta.pruned && meta.fee > 0 && !meta.do_not_relay && !meta.is_deregister)
       {
         if (!meta.dandelionpp_stem && now - meta.last_relayed_time <= get_relay_delay(now, meta.receive_time))
-          return true;
+          continue;
         if (meta.dandelionpp_stem && meta.last_relayed_time < now) // for dandelion++ stem, this value is the embargo timeout
-          return true;
+          continue;
 
         // if the tx is older than half the max lifetime, we don't re-relay it, to avoid a problem
         // mentioned by smooth where nodes would flush txes at slightly different times, causing
@@ -781,8 +989,7 @@ namespace cryptonote
           }
         }
       }
-      return true;
-    }, false, relay_category::relayable);
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -798,9 +1005,11 @@ namespace cryptonote
     {
       try
       {
-        txpool_tx_meta_t meta;
-        if (m_blockchain.get_txpool_tx_meta(hash, meta))
+        const auto ptx = m_txs.find(hash);
+        if (ptx != m_txs.end())
         {
+          txpool_tx_meta_t meta = ptx->second.meta;
+          const bool was_candidate = is_block_template_candidate(meta);
           // txes can be received as "stem" or "fluff" in either order
           meta.upgrade_relay_method(method);
           meta.relayed = true;
@@ -810,7 +1019,9 @@ namespace cryptonote
           else
             meta.last_relayed_time = std::chrono::system_clock::to_time_t(now);
 
-          m_blockchain.update_txpool_tx(hash, meta);
+          update_pool_tx(hash, ptx->second, meta);
+          if (!was_candidate)
+            add_to_block_template(hash, ptx->second);
         }
       }
       catch (const std::exception &e)
@@ -825,66 +1036,61 @@ namespace cryptonote
   size_t tx_memory_pool::get_transactions_count(bool include_sensitive) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count(include_sensitive);
+    if (include_sensitive)
+      return m_txs.size();
+    return std::count_if(m_txs.begin(), m_txs.end(), [](const pool_tx_container::value_type &entry) {
+      return entry.second.meta.matches(relay_category::broadcasted);
+    });
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_sensitive) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_sensitive));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      transaction tx;
-      if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, tx) : parse_and_validate_tx_from_blob(*bd, tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
-      }
-      tx.set_hash(txid);
-      txs.push_back(std::move(tx));
-      return true;
-    }, true, category);
+    txs.reserve(m_txs.size());
+    for (const auto &entry: m_txs)
+      if (entry.second.meta.matches(category))
+        txs.push_back(entry.second.tx);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_sensitive) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_sensitive));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      txs.push_back(txid);
-      return true;
-    }, false, category);
+    txs.reserve(m_txs.size());
+    for (const auto &entry: m_txs)
+      if (entry.second.meta.matches(category))
+        txs.push_back(entry.first);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_sensitive) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
-    backlog.reserve(m_blockchain.get_txpool_tx_count(include_sensitive));
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
-      return true;
-    }, false, category);
+    backlog.reserve(m_txs.size());
+    for (const auto &entry: m_txs)
+    {
+      const txpool_tx_meta_t &meta = entry.second.meta;
+      if (meta.matches(category))
+        backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
+    }
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_sensitive) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
     const relay_category category = include_sensitive ? relay_category::all : relay_category::broadcasted;
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_sensitive);
+    stats.txs_total = get_transactions_count(include_sensitive);
     std::vector<uint32_t> weights;
     weights.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    for (const auto &entry: m_txs)
+    {
+      const txpool_tx_meta_t &meta = entry.second.meta;
+      if (!meta.matches(category))
+        continue;
       weights.push_back(meta.weight);
       stats.bytes_total += meta.weight;
       if (!stats.bytes_min || meta.weight < stats.bytes_min)
@@ -905,8 +1111,7 @@ namespace cryptonote
       agebytes[age].bytes += meta.weight;
       if (meta.double_spend_seen)
         ++stats.num_double_spends;
-      return true;
-    }, false, category);
+    }
 
     stats.bytes_med = epee::misc_utils::median(weights);
     if (stats.txs_total > 1)
@@ -966,21 +1171,21 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     const relay_category category = include_sensitive_data ? relay_category::all : relay_category::broadcasted;
-    const size_t count = m_blockchain.get_txpool_tx_count(include_sensitive_data);
+    const size_t count = get_transactions_count(include_sensitive_data);
     tx_infos.reserve(count);
     key_image_infos.reserve(count);
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      tx_info txi;
-      txi.id_hash = epee::string_tools::pod_to_hex(txid);
-      txi.tx_blob = *bd;
-      transaction tx;
-      if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, tx) : parse_and_validate_tx_from_blob(*bd, tx)))
+    // the blobs are streamed from the db, the parsed txes come from memory
+    m_blockchain.for_all_txpool_txes([this, &tx_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+      const auto ptx = m_txs.find(txid);
+      if (ptx == m_txs.end())
       {
-        MERROR("Failed to parse tx from txpool");
-        // continue
+        MERROR("Tx " << txid << " is in the txpool db but not in memory");
         return true;
       }
-      tx.set_hash(txid);
+      tx_info txi;
+      txi.id_hash = epee::string_tools::pod_to_hex(txid);
+      txi.tx_blob = *bd;
+      transaction tx = ptx->second.tx; // serializing needs a mutable tx
       txi.tx_json = obj_to_json_str(tx);
       txi.blob_size = bd->size();
       txi.weight = meta.weight;
@@ -1008,7 +1213,7 @@ namespace cryptonote
       ki.id_hash = epee::string_tools::pod_to_hex(k_image);
       for (const crypto::hash& tx_id_hash : kei_image_set)
       {
-        if (m_blockchain.txpool_tx_matches_category(tx_id_hash, category))
+        if (tx_matches_category(tx_id_hash, category))
           ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
       }
 
@@ -1022,20 +1227,19 @@ namespace cryptonote
   bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool>& tx_infos, cryptonote::rpc::key_images_with_tx_hashes& key_image_infos) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const size_t count = get_transactions_count(false);
+    tx_infos.reserve(count);
+    key_image_infos.reserve(count);
+    for (const auto &entry: m_txs)
+    {
+      const crypto::hash &txid = entry.first;
+      const txpool_tx_meta_t &meta = entry.second.meta;
+      if (!meta.matches(relay_category::broadcasted))
+        continue;
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
-      if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, txi.tx) : parse_and_validate_tx_from_blob(*bd, txi.tx)))
-      {
-        MERROR("Failed to parse tx from txpool");
-        // continue
-        return true;
-      }
-      txi.tx.set_hash(txid);
-      txi.blob_size = bd->size();
+      txi.tx = entry.second.tx;
+      txi.blob_size = entry.second.blob_size;
       txi.weight = meta.weight;
       txi.fee = meta.fee;
       txi.kept_by_block = meta.kept_by_block;
@@ -1048,16 +1252,15 @@ namespace cryptonote
       txi.last_relayed_time = meta.dandelionpp_stem ? 0 : meta.last_relayed_time;
       txi.do_not_relay = meta.do_not_relay;
       txi.double_spend_seen = meta.double_spend_seen;
-      tx_infos.push_back(txi);
-      return true;
-    }, true, relay_category::broadcasted);
+      tx_infos.push_back(std::move(txi));
+    }
 
     for (const key_images_container::value_type& kee : m_spent_key_images) {
       std::vector<crypto::hash> tx_hashes;
       const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
       for (const crypto::hash& tx_id_hash : kei_image_set)
       {
-        if (m_blockchain.txpool_tx_matches_category(tx_id_hash, relay_category::broadcasted))
+        if (tx_matches_category(tx_id_hash, relay_category::broadcasted))
           tx_hashes.push_back(tx_id_hash);
       }
 
@@ -1081,7 +1284,7 @@ namespace cryptonote
       if (found != m_spent_key_images.end())
       {
         for (const crypto::hash& tx_hash : found->second)
-          is_spent |= m_blockchain.txpool_tx_matches_category(tx_hash, relay_category::broadcasted);
+          is_spent |= tx_matches_category(tx_hash, relay_category::broadcasted);
       }
       spent.push_back(is_spent);
     }
@@ -1106,8 +1309,25 @@ namespace cryptonote
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    m_input_cache.clear();
-    m_parsed_tx_cache.clear();
+    // valid inputs of pool txes are checked again cheaply from the cache,
+    // anything else would be checked in full anyway. Deregisters are too, as
+    // new blocks can make them invalid without spending anything
+    for (auto i = m_input_cache.begin(); i != m_input_cache.end(); )
+    {
+      const auto ptx = i->second.valid ? m_txs.find(i->first) : m_txs.end();
+      if (ptx != m_txs.end() && !ptx->second.tx.is_deregister_tx())
+        ++i;
+      else
+        i = m_input_cache.erase(i);
+    }
+    ++m_chain_generation;
+    const uint8_t hf_version = m_blockchain.get_current_hard_fork_version();
+    if (hf_version != m_inputs_hf_version)
+    {
+      ++m_inputs_generation;
+      m_inputs_hf_version = hf_version;
+    }
+    m_block_template_txs.invalidate();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1115,15 +1335,16 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_input_cache.clear();
-    m_parsed_tx_cache.clear();
+    ++m_chain_generation;
+    ++m_inputs_generation;
+    m_block_template_txs.invalidate();
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id, relay_category tx_category) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_db().txpool_has_tx(id, tx_category);
+    return tx_matches_category(id, tx_category);
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx, const crypto::hash& txid) const
@@ -1149,7 +1370,7 @@ namespace cryptonote
       // See `insert_key_images`.
       if (1 < found->second.size() || *(found->second.cbegin()) != txid)
         return true;
-      return m_blockchain.txpool_tx_matches_category(txid, relay_category::legacy);
+      return tx_matches_category(txid, relay_category::legacy);
     }
     return false;
   }
@@ -1164,57 +1385,100 @@ namespace cryptonote
     m_transactions_lock.unlock();
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::input_cache_entry_valid(const input_cache_entry &entry, const transaction &tx) const
+  {
+    if (entry.inputs_generation != m_inputs_generation)
+      return false;
+    if (entry.chain_generation == m_chain_generation)
+      return true;
+    // a failure may be fixed by the new blocks, eg an output being unlocked,
+    // and a deregister may be too old or its node deregistered already
+    if (!entry.valid || tx.is_deregister_tx())
+      return false;
+    if (entry.max_used_block_height >= m_blockchain.get_current_blockchain_height() || m_blockchain.get_block_id_by_height(entry.max_used_block_height) != entry.max_used_block_id)
+      return false;
+    return !m_blockchain.have_tx_keyimges_as_spent(tx);
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block) const
   {
     if (!kept_by_block)
     {
-      const std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>>::const_iterator i = m_input_cache.find(txid);
-      if (i != m_input_cache.end())
+      const auto i = m_input_cache.find(txid);
+      if (i != m_input_cache.end() && input_cache_entry_valid(i->second, get_tx()))
       {
-        max_used_block_height = std::get<2>(i->second);
-        max_used_block_id = std::get<3>(i->second);
-        tvc = std::get<1>(i->second);
-        return std::get<0>(i->second);
+        i->second.chain_generation = m_chain_generation;
+        max_used_block_height = i->second.max_used_block_height;
+        max_used_block_id = i->second.max_used_block_id;
+        tvc = i->second.tvc;
+        return i->second.valid;
       }
     }
     bool ret = m_blockchain.check_tx_inputs(get_tx(), max_used_block_height, max_used_block_id, tvc, kept_by_block);
     if (!kept_by_block)
-      m_input_cache.insert(std::make_pair(txid, std::make_tuple(ret, tvc, max_used_block_height, max_used_block_id)));
+      m_input_cache[txid] = {ret, tvc, max_used_block_height, max_used_block_id, m_chain_generation, m_inputs_generation};
     return ret;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const
+  void tx_memory_pool::precheck_tx_inputs(const std::vector<std::pair<transaction*, crypto::hash>> &txs)
   {
-    struct transction_parser
+    PERF_TIMER(precheck_tx_inputs);
+    std::vector<Blockchain::tx_inputs_check> checks;
+    std::vector<crypto::hash> ids;
+    uint64_t chain_generation, inputs_generation;
     {
-      transction_parser(const cryptonote::blobdata &txblob, const crypto::hash &txid, transaction &tx): txblob(txblob), txid(txid), tx(tx), parsed(false) {}
-      cryptonote::transaction &operator()()
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      for (const auto &tx: txs)
       {
-        if (!parsed)
-        {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
-            throw std::runtime_error("failed to parse transaction blob");
-          tx.set_hash(txid);
-          parsed = true;
-        }
-        return tx;
+        const auto i = m_input_cache.find(tx.second);
+        if (i != m_input_cache.end() && i->second.chain_generation == m_chain_generation && i->second.inputs_generation == m_inputs_generation)
+          continue;
+        checks.push_back({tx.first, false, 0, crypto::null_hash, tx_verification_context{}});
+        ids.push_back(tx.second);
       }
-      const cryptonote::blobdata &txblob;
-      const crypto::hash &txid;
-      transaction &tx;
-      bool parsed;
-    } lazy_tx(txblob, txid, tx);
+      chain_generation = m_chain_generation;
+      inputs_generation = m_inputs_generation;
+    }
+    if (checks.empty())
+      return;
+
+    // blocks may be added or popped meanwhile, the generations taken before
+    // make add_tx check the results again in that case
+    m_blockchain.check_txs_inputs(checks);
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    for (size_t n = 0; n < checks.size(); ++n)
+    {
+      const Blockchain::tx_inputs_check &check = checks[n];
+      m_input_cache[ids[n]] = {check.valid, check.tvc, check.max_used_block_height, check.max_used_block_id, chain_generation, inputs_generation};
+    }
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const transaction &tx, bool inputs_valid) const
+  {
+    // the inputs check expands the RingCT data in the tx it's given, which
+    // mustn't be the pool's, so it's given a copy if it needs one
+    std::unique_ptr<transaction> checked_tx;
+    const auto get_checked_tx = [&tx, &checked_tx]()->cryptonote::transaction& {
+      if (!checked_tx)
+        checked_tx.reset(new transaction(tx));
+      return *checked_tx;
+    };
 
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
-    if(txd.max_used_block_id == null_hash)
+    if (inputs_valid)
+    {
+      // blocks were only added since, which can't make valid inputs invalid
+    }
+    else if(txd.max_used_block_id == null_hash)
     {//not checked, lets try to check
 
       if(txd.last_failed_id != null_hash && m_blockchain.get_current_blockchain_height() > txd.last_failed_height && txd.last_failed_id == m_blockchain.get_block_id_by_height(txd.last_failed_height))
         return false;//we already sure that this tx is broken for this height
 
       tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+      if(!check_tx_inputs(get_checked_tx, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
       {
         txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
         txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1231,7 +1495,7 @@ namespace cryptonote
           return false;
         //check ring signature again, it is possible (with very small chance) that this transaction become again valid
         tx_verification_context tvc;
-        if(!check_tx_inputs([&lazy_tx]()->cryptonote::transaction&{ return lazy_tx(); }, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
+        if(!check_tx_inputs(get_checked_tx, txid, txd.max_used_block_height, txd.max_used_block_id, tvc))
         {
           txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
           txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
@@ -1240,7 +1504,7 @@ namespace cryptonote
       }
     }
     //if we here, transaction seems valid, but, anyway, check for key_images collisions with blockchain, just to be sure
-    if(m_blockchain.have_tx_keyimges_as_spent(lazy_tx()))
+    if(m_blockchain.have_tx_keyimges_as_spent(tx))
     {
       txd.double_spend_seen = true;
       return false;
@@ -1255,11 +1519,7 @@ namespace cryptonote
       tx_extra_service_node_deregister deregister;
       if (get_service_node_deregister_from_tx_extra(tx.extra, deregister))
       {
-        uint64_t delta_height = curr_height - deregister.block_height;
-        const size_t hard_fork_version = m_blockchain.get_hard_fork_version(curr_height);
-        const auto deregister_lifetime = hard_fork_version >= 9 ? service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT_V2 : service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT;
-
-        if (delta_height <= deregister_lifetime)
+        if (service_nodes::is_deregister_in_lifetime(m_blockchain.get_current_hard_fork_version(), deregister.block_height, curr_height))
         {
           failed_ready_check = false;
         }
@@ -1318,21 +1578,22 @@ namespace cryptonote
       {
         for (const crypto::hash &txid: it->second)
         {
-          txpool_tx_meta_t meta;
-          if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+          const auto ptx = m_txs.find(txid);
+          if (ptx == m_txs.end())
           {
             MERROR("Failed to find tx meta in txpool");
             // continue, not fatal
             continue;
           }
-          if (!meta.double_spend_seen)
+          if (!ptx->second.meta.double_spend_seen)
           {
             MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
+            txpool_tx_meta_t meta = ptx->second.meta;
             meta.double_spend_seen = true;
             changed = true;
             try
             {
-              m_blockchain.update_txpool_tx(txid, meta);
+              update_pool_tx(txid, ptx->second, meta);
             }
             catch (const std::exception &e)
             {
@@ -1352,19 +1613,16 @@ namespace cryptonote
   {
     std::stringstream ss;
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
+    for (const auto &entry: m_txs)
+    {
+      const crypto::hash &txid = entry.first;
+      const txpool_tx_meta_t &meta = entry.second.meta;
       ss << "id: " << txid << std::endl;
       if (!short_format) {
-        cryptonote::transaction tx;
-        if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(*txblob, tx) : parse_and_validate_tx_from_blob(*txblob, tx)))
-        {
-          MERROR("Failed to parse tx from txpool");
-          return true; // continue
-        }
+        cryptonote::transaction tx = entry.second.tx;
         ss << obj_to_json_str(tx) << std::endl;
       }
-      ss << "blob_size: " << (short_format ? "-" : std::to_string(txblob->size())) << std::endl
+      ss << "blob_size: " << (short_format ? "-" : std::to_string(entry.second.blob_size)) << std::endl
         << "weight: " << meta.weight << std::endl
         << "fee: " << print_money(meta.fee) << std::endl
         << "kept_by_block: " << (meta.kept_by_block ? 'T' : 'F') << std::endl
@@ -1374,8 +1632,7 @@ namespace cryptonote
         << "max_used_block_id: " << meta.max_used_block_id << std::endl
         << "last_failed_height: " << meta.last_failed_height << std::endl
         << "last_failed_id: " << meta.last_failed_id << std::endl;
-      return true;
-    }, !short_format, relay_category::all);
+    }
 
     return ss.str();
   }
@@ -1386,144 +1643,40 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    uint64_t best_coinbase = 0, coinbase = 0;
-    total_weight = 0;
-    fee = 0;
-    uint64_t height = m_blockchain.get_current_blockchain_height();
-
-    //baseline empty block
-	miner_reward_context block_reward_context = {};
-
-	block_reward_parts reward_parts = {};
-    if (!get_equilibria_block_reward(median_weight, total_weight, already_generated_coins, version, reward_parts, block_reward_context, height, MAINNET))
+    const block_template_txs::params params{bl.prev_id, median_weight, already_generated_coins, m_blockchain.get_current_blockchain_height(), version};
+    if (!m_block_template_txs.valid(params))
     {
-      MERROR("Failed to get block reward for empty block");
-      return false;
-    }
-	best_coinbase = reward_parts.base_miner;
-
-
-    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
-    std::unordered_set<crypto::key_image> k_images;
-
-    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
-
-    LockedTXN lock(m_blockchain.get_db());
-
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
-    {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
-      {
-        MERROR("  failed to find tx meta");
-        continue;
-      }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase) << ", relay method " << (unsigned)meta.get_relay_method());
-
-      if (!meta.matches(relay_category::legacy) && !(m_mine_stem_txes && meta.get_relay_method() == relay_method::stem))
-      {
-        LOG_PRINT_L2("  tx relay method is " << (unsigned)meta.get_relay_method());
-        continue;
-      }
-      if (meta.pruned)
-      {
-        LOG_PRINT_L2(" tx is pruned");
-        continue;
-      }
+      if (!m_block_template_txs.reset(params))
+        return false;
 
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
-      {
-        LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
-      }
+      LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
 
-      // start using the optimal filling algorithm from v5
-      if (version >= SERVICE_NODE_VERSION)
+      LockedTXN lock(m_blockchain.get_db());
+      for (const auto &entry: m_txs_by_fee_and_receive_time)
       {
-		  block_reward_parts reward_parts_other = {};
-		  if (!get_equilibria_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, version, reward_parts_other, block_reward_context, height, MAINNET))
-
+        const auto ptx = m_txs.find(entry.second);
+        if (ptx == m_txs.end())
         {
-          LOG_PRINT_L2("  would exceed maximum block weight");
+          MERROR("  failed to find tx meta");
           continue;
         }
-		uint64_t block_reward = reward_parts_other.base_miner;
-        coinbase = block_reward + fee + meta.fee;
-        if (coinbase < template_accept_threshold(best_coinbase))
+        const txpool_tx_meta_t &meta = ptx->second.meta;
+        if (!is_block_template_candidate(meta))
         {
-          LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+          LOG_PRINT_L2("  tx " << entry.second << " relay method is " << (unsigned)meta.get_relay_method() << (meta.pruned ? ", pruned" : ""));
           continue;
         }
-      }
-      else
-      {
-        // If we've exceeded the penalty free weight,
-        // stop including more tx
-        if (total_weight > median_weight)
-        {
-          LOG_PRINT_L2("  would exceed median block weight");
+        m_block_template_txs.add(entry, meta.weight, meta.fee, ptx->second.tx, [this, &ptx]() { return is_pool_tx_ready(ptx->first, ptx->second); }, true);
+        if (m_block_template_txs.full())
           break;
-        }
-      }
-
-      // "local" and "stem" txes are filtered above
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second, relay_category::all);
-
-      cryptonote::transaction tx;
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
-      try
-      {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
-      }
-      catch (const std::exception &e)
-      {
-        MERROR("Failed to check transaction readiness: " << e.what());
-        // continue, not fatal
-      }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
-      {
-        try
-	{
-	  m_blockchain.update_txpool_tx(sorted_it->second, meta);
-	}
-        catch (const std::exception &e)
-	{
-	  MERROR("Failed to update tx meta: " << e.what());
-	  // continue, not fatal
-	}
-      }
-      if (!ready)
-      {
-        LOG_PRINT_L2("  not ready to go");
-        continue;
-      }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
-        continue;
       }
-
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+      lock.commit();
     }
-    lock.commit();
 
-    expected_reward = best_coinbase;
+    total_weight = 0;
+    m_block_template_txs.get(bl, total_weight, fee, expected_reward);
     LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
-        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
+        << total_weight << ", coinbase " << print_money(expected_reward)
         << " (including " << print_money(fee) << " in fees)");
     return true;
   }
@@ -1536,7 +1689,10 @@ namespace cryptonote
     std::unordered_set<crypto::hash> remove;
 
     m_txpool_weight = 0;
-    m_blockchain.for_all_txpool_txes([this, &remove, tx_weight_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+    for (const auto &entry: m_txs)
+    {
+      const crypto::hash &txid = entry.first;
+      const txpool_tx_meta_t &meta = entry.second.meta;
       m_txpool_weight += meta.weight;
       if (meta.weight > tx_weight_limit) {
         LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.weight << " bytes), removing it from pool");
@@ -1546,8 +1702,7 @@ namespace cryptonote
         LOG_PRINT_L1("Transaction " << txid << " is in the blockchain, removing it from pool");
         remove.insert(txid);
       }
-      return true;
-    }, false, relay_category::all);
+    }
 
     size_t n_removed = 0;
     if (!remove.empty())
@@ -1557,26 +1712,12 @@ namespace cryptonote
       {
         try
         {
-          cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid, relay_category::all);
-          cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(txblob, tx)) // remove pruned ones on startup, they're meant to be temporary
-          {
-            MERROR("Failed to parse tx from txpool");
-            continue;
-          }
+          const auto ptx = m_txs.find(txid);
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
-          m_txpool_weight -= get_transaction_weight(tx, txblob.size());
-          remove_transaction_keyimages(tx, txid);
-          auto sorted_it = find_tx_in_sorted_container(txid);
-          if (sorted_it == m_txs_by_fee_and_receive_time.end())
-          {
-            LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-          }
-          else
-          {
-            m_txs_by_fee_and_receive_time.erase(sorted_it);
-          }
+          m_txpool_weight -= ptx->second.meta.weight;
+          remove_transaction_keyimages(ptx->second.tx, txid);
+          remove_pool_tx(ptx);
           ++n_removed;
         }
         catch (const std::exception &e)
@@ -1598,7 +1739,10 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
+    m_txs.clear();
     m_txs_by_fee_and_receive_time.clear();
+    m_txs_by_receive_time.clear();
+    m_block_template_txs.invalidate();
     m_spent_key_images.clear();
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
@@ -1612,7 +1756,7 @@ namespace cryptonote
         if (!!kept != !!meta.kept_by_block)
           return true;
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_prefix_from_blob(*bd, tx))
+        if (!(meta.pruned ? parse_and_validate_tx_base_from_blob(*bd, tx) : parse_and_validate_tx_from_blob(*bd, tx)))
         {
           MWARNING("Failed to parse tx from txpool, removing");
           remove.push_back(txid);
@@ -1623,7 +1767,7 @@ namespace cryptonote
           MFATAL("Failed to insert key images from txpool tx");
           return false;
         }
-		m_txs_by_fee_and_receive_time.emplace(std::tuple<bool, double, std::time_t>(tx.is_deregister_tx(), meta.fee / (double)meta.weight, meta.receive_time), txid);
+        add_pool_tx(txid, meta, bd->size(), std::move(tx));
 
         m_txpool_weight += meta.weight;
         return true;
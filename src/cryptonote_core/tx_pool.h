@@ -31,6 +31,8 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <functional>
+#include <map>
 #include <set>
 #include <tuple>
 #include <unordered_map>
@@ -64,19 +66,128 @@ namespace cryptonote
   class txCompare
   {
   public:
+    //! deregisters first, then highest fee, then oldest, then by hash
     bool operator()(const tx_by_fee_and_receive_time_entry& a, const tx_by_fee_and_receive_time_entry& b) const
     {
-		std::string ahash(a.second.data, sizeof(a.second.data));
-		std::string bhash(b.second.data, sizeof(b.second.data));
-		//      prioritize      deregister             fee                   arrival time      hash
-		return std::make_tuple(!std::get<0>(a.first), -std::get<1>(a.first), std::get<2>(a.first), ahash)
-			< std::make_tuple(!std::get<0>(b.first), -std::get<1>(b.first), std::get<2>(b.first), bhash);
+      if (std::get<0>(a.first) != std::get<0>(b.first))
+        return std::get<0>(a.first);
+      if (std::get<1>(a.first) != std::get<1>(b.first))
+        return std::get<1>(a.first) > std::get<1>(b.first);
+      if (std::get<2>(a.first) != std::get<2>(b.first))
+        return std::get<2>(a.first) < std::get<2>(b.first);
+      return memcmp(a.second.data, b.second.data, sizeof(a.second.data)) < 0;
     }
   };
 
   //! container for sorting transactions by fee per unit size
   typedef std::set<tx_by_fee_and_receive_time_entry, txCompare> sorted_tx_container;
 
+  /**
+   * @brief the pool transactions picked for the next block template
+   *
+   * Picking them walks the whole pool in fee order, which is too slow to do
+   * for each template request when the pool is large. So the pick is kept,
+   * and transactions arriving in the pool are appended to it if they fit.
+   * It is made again from scratch when a picked transaction leaves the
+   * pool, when one arrives which ranks above some picked ones but does not
+   * fit, and when the chain or the block weight median changes.
+   *
+   * Templates for different miner addresses share the pick, only their
+   * coinbase differs.
+   */
+  class block_template_txs
+  {
+  public:
+    //! what the pick depends on, besides the pool
+    struct params
+    {
+      crypto::hash prev_id;
+      size_t median_weight;
+      uint64_t already_generated_coins;
+      uint64_t height;
+      uint8_t version;
+    };
+
+    block_template_txs();
+
+    /**
+     * @brief check whether the pick can be used for a template
+     *
+     * @param p the template's parameters
+     *
+     * @return true if the pick was made for these parameters and is still up to date
+     */
+    bool valid(const params &p) const;
+
+    /**
+     * @brief start a new, empty pick
+     *
+     * @param p the template's parameters
+     *
+     * @return false if the reward of an empty block can't be found
+     */
+    bool reset(const params &p);
+
+    /**
+     * @brief drop the pick, so it is made again for the next template
+     */
+    void invalidate() { m_valid = false; }
+
+    /**
+     * @brief check whether no more transactions can go in, before v5
+     */
+    bool full() const { return m_full; }
+
+    /**
+     * @brief consider a transaction for the pick
+     *
+     * @param entry the transaction's entry in the fee ordering
+     * @param weight the transaction's weight
+     * @param fee the transaction's fee
+     * @param tx the transaction, for its key images
+     * @param ready checks whether the transaction can go in a block, only called if it fits
+     * @param filling true when making a new pick from each pool tx in fee order,
+     *        false for a transaction arriving in the pool
+     *
+     * @return true if the transaction was added to the pick
+     */
+    bool add(const tx_by_fee_and_receive_time_entry &entry, size_t weight, uint64_t fee, const transaction_prefix &tx, const std::function<bool()> &ready, bool filling);
+
+    /**
+     * @brief drop the pick if it has a transaction leaving the pool
+     *
+     * @param id the transaction's hash
+     */
+    void remove(const crypto::hash &id);
+
+    /**
+     * @brief fill a block template from the pick
+     *
+     * @param bl the block to add the picked transaction hashes to
+     * @param total_weight return-by-reference the weight of the picked transactions
+     * @param fee return-by-reference the fees of the picked transactions
+     * @param expected_reward return-by-reference the coinbase of the block
+     */
+    void get(block &bl, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward) const;
+
+  private:
+    bool get_base_reward(size_t weight, uint64_t &reward) const;
+    bool fits(size_t weight, uint64_t fee, uint64_t &coinbase);
+
+    params m_params;
+    bool m_valid;
+    bool m_full;  //!< before v5, the median was reached and picking stopped
+    std::vector<crypto::hash> m_tx_hashes;  //!< in the order they were picked
+    std::unordered_set<crypto::hash> m_ids;
+    std::unordered_set<crypto::key_image> m_key_images;
+    size_t m_total_weight;
+    size_t m_max_total_weight;
+    uint64_t m_fee;
+    uint64_t m_best_coinbase;
+    bool m_has_lowest;
+    tx_by_fee_and_receive_time_entry m_lowest;  //!< the picked tx ranking last in the fee ordering
+  };
+
   /**
    * @brief Transaction pool, handles transactions which are not part of a block
    *
@@ -129,6 +240,18 @@ namespace cryptonote
      */
     bool add_tx(transaction &tx, tx_verification_context& tvc, relay_method tx_relay, bool relayed, uint8_t version);
 
+    /**
+     * @brief checks the inputs of transactions before they are added
+     *
+     * The inputs are checked in parallel, without the pool lock, and the
+     * results cached so add_tx only has the key image checks and the
+     * insertion left to do. Transactions kept by block are not cached, so
+     * this is only useful for transactions from the network or local clients.
+     *
+     * @param txs the transactions and their hashes
+     */
+    void precheck_tx_inputs(const std::vector<std::pair<transaction*, crypto::hash>> &txs);
+
     /**
      * @brief takes a transaction with the given hash from the pool
      *
@@ -534,12 +657,12 @@ namespace cryptonote
      *
      * @param txd the transaction to check (and info about it)
      * @param txid the txid of the transaction to check
-     * @param txblob the transaction blob to check
-     * @param tx the parsed transaction, if successful
+     * @param tx the transaction to check
+     * @param inputs_valid true if the inputs were found valid on an ancestor of the top block, with the same hard fork version
      *
      * @return true if the transaction is good to go, otherwise false
      */
-    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction&tx) const;
+    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const transaction &tx, bool inputs_valid = false) const;
 
     /**
      * @brief mark all transactions double spending the one passed
@@ -574,20 +697,107 @@ namespace cryptonote
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
-    //TODO: look into doing this better
     //!< container for transactions organized by fee per size and receive time
     sorted_tx_container m_txs_by_fee_and_receive_time;
 
+    //! transactions in the pool, oldest first
+    typedef std::multimap<uint64_t, crypto::hash> tx_by_receive_time_container;
+    tx_by_receive_time_container m_txs_by_receive_time;
+
+    /**
+     * @brief a transaction in the pool, as kept in memory
+     *
+     * The db only persists the pool across restarts: each change to a
+     * transaction's metadata is written through to it, but lookups are
+     * answered from here, with the transaction already parsed.
+     */
+    struct pool_tx
+    {
+      txpool_tx_meta_t meta;  //!< the transaction's metadata, as in the db
+      size_t blob_size;  //!< the size of the blob in the db
+      transaction tx;  //!< the parsed transaction, only its base if pruned
+      sorted_tx_container::iterator sorted;  //!< the entry in m_txs_by_fee_and_receive_time
+      tx_by_receive_time_container::iterator by_receive_time;  //!< the entry in m_txs_by_receive_time
+      uint64_t ready_generation;  //!< the m_chain_generation `ready` was found at
+      bool ready;  //!< whether the tx can go in a block on top of the chain
+      uint64_t inputs_generation;  //!< the m_inputs_generation the inputs were last found valid at
+    };
+    typedef std::unordered_map<crypto::hash, pool_tx> pool_tx_container;
+
+    //! all transactions in the pool, whatever their relay category
+    pool_tx_container m_txs;
+
     std::atomic<uint64_t> m_cookie; //!< incremented at each change
 
     /**
-     * @brief get an iterator to a transaction in the sorted container
+     * @brief add a transaction to the in-memory index, replacing any with the same id
      *
-     * @param id the hash of the transaction to look for
+     * The caller writes the transaction to the db.
      *
-     * @return an iterator, possibly to the end of the container if not found
+     * @return the added entry
      */
-    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
+    pool_tx &add_pool_tx(const crypto::hash &id, const txpool_tx_meta_t &meta, size_t blob_size, transaction tx);
+
+    /**
+     * @brief remove a transaction from the in-memory index
+     *
+     * The caller removes the transaction from the db.
+     */
+    void remove_pool_tx(pool_tx_container::iterator it);
+
+    /**
+     * @brief update a transaction's metadata, in the db and in memory
+     */
+    void update_pool_tx(const crypto::hash &id, pool_tx &ptx, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief check whether a transaction is in the pool and in a relay category
+     */
+    bool tx_matches_category(const crypto::hash &id, relay_category category) const;
+
+    /**
+     * @brief check whether a transaction may be mined, going by its metadata only
+     */
+    bool is_block_template_candidate(const txpool_tx_meta_t &meta) const;
+
+    /**
+     * @brief check if a pool transaction can go in a block on top of the chain
+     *
+     * The result is kept until the chain changes. The inputs are only
+     * checked again when blocks are popped or the hard fork version changes.
+     */
+    bool is_pool_tx_ready(const crypto::hash &id, pool_tx &ptx);
+
+    /**
+     * @brief consider a transaction just added to the pool for the block template
+     */
+    void add_to_block_template(const crypto::hash &id, pool_tx &ptx);
+
+    block_template_txs m_block_template_txs;  //!< the pick for the next block template
+    uint64_t m_chain_generation;  //!< incremented when blocks are added or popped
+    uint64_t m_inputs_generation;  //!< incremented when blocks are popped or the hard fork version changes
+    uint8_t m_inputs_hf_version;  //!< the hard fork version at m_inputs_generation
+
+    //! a Blockchain::check_tx_inputs result
+    struct input_cache_entry
+    {
+      bool valid;
+      tx_verification_context tvc;
+      uint64_t max_used_block_height;
+      crypto::hash max_used_block_id;
+      uint64_t chain_generation;  //!< m_chain_generation when the inputs were last checked
+      uint64_t inputs_generation;  //!< m_inputs_generation when the inputs were checked
+    };
+
+    /**
+     * @brief check whether inputs found valid before blocks were added still are
+     *
+     * Ring members are never removed by adding blocks, so the inputs stay
+     * valid as long as the block with the newest ring member is still in the
+     * chain and no key image was spent by the new blocks. Deregisters have
+     * no key images and go invalid with age, so they're checked again.
+     */
+    bool input_cache_entry_valid(const input_cache_entry &entry, const transaction &tx) const;
 
     //! cache/call Blockchain::check_tx_inputs results
     bool check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
@@ -604,9 +814,7 @@ namespace cryptonote
     size_t m_txpool_weight;
     bool m_mine_stem_txes;
 
-    mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
-
-    std::unordered_map<crypto::hash, transaction> m_parsed_tx_cache;
+    mutable std::unordered_map<crypto::hash, input_cache_entry> m_input_cache;
   };
 }
 
@@ -40,6 +40,14 @@
 #undef XEQ_DEFAULT_LOG_CATEGORY
 #define XEQ_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+#define SPAN_SAMPLE_DECAY 0.8 // weight of older spans in a peer's rate and latency, per span received
+#define SPAN_MIN_SAMPLES 2 // spans received from a peer before sizing its spans from its rate
+#define SPAN_LATENCY_FACTOR 4.0f // span download times, relative to the latency
+#define SPAN_TARGET_MIN_SECONDS 2.0f
+#define SPAN_TARGET_MAX_SECONDS 5.0f
+#define SPAN_OVERDUE_FACTOR 2.0f // relative to the time a span is expected to take
+#define SPAN_OVERDUE_MIN_SECONDS 1.0f
+
 namespace std {
   static_assert(sizeof(size_t) <= sizeof(boost::uuids::uuid), "boost::uuids::uuid too small");
   template<> struct hash<boost::uuids::uuid> {
@@ -57,7 +65,10 @@ void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_comp
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
+  const uint64_t nblocks = bcel.size();
   blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
+  if (rate > 0.0f)
+    add_span_sample(connection_id, nblocks, size, size / rate);
   if (has_hashes)
   {
     for (const crypto::hash &h: hashes)
@@ -113,6 +124,13 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
       erase_block(j);
     }
   }
+  for (auto i = peer_stats.begin(); i != peer_stats.end(); )
+  {
+    if (live_connections.find(i->first) == live_connections.end())
+      i = peer_stats.erase(i);
+    else
+      ++i;
+  }
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::vector<crypto::hash> *hashes)
@@ -304,6 +322,7 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     return std::make_pair(0, 0);
   }
   MDEBUG("Reserving span " << span_start_height << " - " << (span_start_height + span_length - 1) << " for " << connection_id);
+  peer_stats[connection_id].stats.span_blocks = span_length;
   add_blocks(span_start_height, span_length, connection_id, time);
   set_span_hashes(span_start_height, connection_id, hashes);
   return std::make_pair(span_start_height, span_length);
@@ -538,4 +557,123 @@ bool block_queue::foreach(std::function<bool(const span&)> f) const
   return true;
 }
 
+size_t block_queue::get_num_filled_blocks_prefix() const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  size_t nblocks = 0;
+  for (const auto &span: blocks)
+  {
+    if (span.blocks.empty())
+      break;
+    nblocks += span.nblocks;
+  }
+  return nblocks;
+}
+
+void block_queue::add_span_sample(const boost::uuids::uuid &connection_id, uint64_t nblocks, size_t size, float seconds)
+{
+  if (nblocks == 0 || size == 0 || seconds <= 0.0f)
+    return;
+
+  peer_samples &p = peer_stats[connection_id];
+  p.weight = p.weight * SPAN_SAMPLE_DECAY + 1;
+  p.size = p.size * SPAN_SAMPLE_DECAY + size;
+  p.time = p.time * SPAN_SAMPLE_DECAY + seconds;
+  p.size_squared = p.size_squared * SPAN_SAMPLE_DECAY + (double)size * size;
+  p.size_time = p.size_time * SPAN_SAMPLE_DECAY + size * seconds;
+  p.nblocks = p.nblocks * SPAN_SAMPLE_DECAY + nblocks;
+
+  // least squares fit of time = latency + size / rate, which needs spans of different sizes:
+  // if they're too alike, or the fit makes no sense, the latency is taken as part of the rate
+  const double mean_size = p.size / p.weight, mean_time = p.time / p.weight;
+  const double size_variance = p.size_squared / p.weight - mean_size * mean_size;
+  const double covariance = p.size_time / p.weight - mean_size * mean_time;
+  double seconds_per_byte = 0.0, latency = 0.0;
+  if (size_variance > 0.01 * mean_size * mean_size && covariance > 0.0)
+  {
+    seconds_per_byte = covariance / size_variance;
+    latency = mean_time - seconds_per_byte * mean_size;
+  }
+  if (seconds_per_byte <= 0.0 || latency < 0.0)
+  {
+    seconds_per_byte = mean_time / mean_size;
+    latency = 0.0;
+  }
+
+  peer_sync_stats &stats = p.stats;
+  stats.rate = 1.0 / seconds_per_byte;
+  stats.latency = latency;
+  stats.block_size = p.size / p.nblocks;
+  stats.nblocks += nblocks;
+  ++stats.nspans;
+  MTRACE("Sync stats for " << connection_id << ": " << stats.rate / 1024 << " kB/s, latency " << stats.latency << " s, " << stats.block_size << " bytes/block");
+}
+
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_blocks, uint64_t min_blocks, uint64_t max_blocks) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  uint64_t nblocks = default_blocks;
+  const auto i = peer_stats.find(connection_id);
+  if (i != peer_stats.end() && i->second.stats.nspans >= SPAN_MIN_SAMPLES)
+  {
+    // long enough for the latency not to eat into the rate, short enough for a slow
+    // peer not to hold up the next span for long
+    const peer_sync_stats &stats = i->second.stats;
+    const float seconds = std::min(SPAN_TARGET_MAX_SECONDS, std::max(SPAN_TARGET_MIN_SECONDS, SPAN_LATENCY_FACTOR * stats.latency));
+    nblocks = stats.rate * seconds / std::max(stats.block_size, 1.0f) + 0.5f;
+  }
+  return std::max(min_blocks, std::min(max_blocks, nblocks));
+}
+
+float block_queue::get_expected_span_time_internal(const boost::uuids::uuid &connection_id, uint64_t nblocks) const
+{
+  const auto i = peer_stats.find(connection_id);
+  if (i == peer_stats.end() || i->second.stats.nspans < SPAN_MIN_SAMPLES)
+    return -1.0f;
+  const peer_sync_stats &stats = i->second.stats;
+  return stats.latency + nblocks * stats.block_size / stats.rate;
+}
+
+float block_queue::get_expected_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  return get_expected_span_time_internal(connection_id, nblocks);
+}
+
+bool block_queue::is_next_span_overdue(const boost::uuids::uuid &connection_id, boost::posix_time::ptime time) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  if (blocks.empty())
+    return false;
+  const span &next = *blocks.begin();
+  if (!next.blocks.empty() || next.connection_id == connection_id || next.time == boost::date_time::min_date_time)
+    return false;
+
+  const float expected = get_expected_span_time_internal(next.connection_id, next.nblocks);
+  const float ours = get_expected_span_time_internal(connection_id, next.nblocks);
+  if (expected < 0.0f || ours < 0.0f || ours > expected)
+    return false;
+  const float dt = (time - next.time).total_microseconds() / 1e6f;
+  if (dt < std::max(SPAN_OVERDUE_MIN_SECONDS, SPAN_OVERDUE_FACTOR * expected))
+    return false;
+  MDEBUG("Next span " << next.start_block_height << " is overdue from " << next.connection_id << " after " << dt << " seconds, expected " << expected << ", " << connection_id << " expected " << ours);
+  return true;
+}
+
+void block_queue::add_overdue_span(const boost::uuids::uuid &connection_id)
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  ++peer_stats[connection_id].stats.noverdue;
+}
+
+bool block_queue::get_peer_sync_stats(const boost::uuids::uuid &connection_id, peer_sync_stats &stats) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_stats.find(connection_id);
+  if (i == peer_stats.end())
+    return false;
+  stats = i->second.stats;
+  return true;
+}
+
 }
@@ -33,7 +33,9 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
+#include <boost/functional/hash.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/uuid/uuid.hpp>
 
@@ -67,6 +69,17 @@ namespace cryptonote
     };
     typedef std::set<span> block_map;
 
+    struct peer_sync_stats
+    {
+      float rate; // bytes/s once a response starts coming
+      float latency; // seconds before a response starts coming
+      float block_size; // bytes
+      uint64_t span_blocks; // in the last span reserved
+      uint64_t nblocks;
+      uint64_t nspans;
+      uint64_t noverdue; // spans asked from another peer as they were overdue
+    };
+
   public:
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -96,15 +109,31 @@ namespace cryptonote
     bool foreach(std::function<bool(const span&)> f) const;
     bool requested(const crypto::hash &hash) const;
     bool have(const crypto::hash &hash) const;
+    size_t get_num_filled_blocks_prefix() const;
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_blocks, uint64_t min_blocks, uint64_t max_blocks) const;
+    float get_expected_span_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const;
+    bool is_next_span_overdue(const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::posix_time::microsec_clock::universal_time()) const;
+    void add_overdue_span(const boost::uuids::uuid &connection_id);
+    bool get_peer_sync_stats(const boost::uuids::uuid &connection_id, peer_sync_stats &stats) const;
 
   private:
+    struct peer_samples
+    {
+      // decayed sums over the spans received, to fit time = latency + size / rate
+      double weight, size, time, size_squared, size_time, nblocks;
+      peer_sync_stats stats;
+    };
+
     void erase_block(block_map::iterator j);
     inline bool requested_internal(const crypto::hash &hash) const;
+    void add_span_sample(const boost::uuids::uuid &connection_id, uint64_t nblocks, size_t size, float seconds);
+    float get_expected_span_time_internal(const boost::uuids::uuid &connection_id, uint64_t nblocks) const;
 
   private:
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
     std::unordered_set<crypto::hash> have_blocks;
+    std::unordered_map<boost::uuids::uuid, peer_samples, boost::hash<boost::uuids::uuid>> peer_stats;
   };
 }
@@ -144,22 +144,27 @@ namespace cryptonote
       {
         KV_SERIALIZE(txs)
       }
-      else
+      else if (is_store)
       {
-        std::vector<blobdata> txs;
-        if (is_store)
+        // straight into the storage, without copying the blobs to a temporary list first
+        auto it = this_ref.txs.begin();
+        if (it != this_ref.txs.end())
         {
-          txs.reserve(this_ref.txs.size());
-          for (const auto &e: this_ref.txs) txs.push_back(e.blob);
+          auto hval_array = stg.insert_first_value("txs", blobdata(it->blob), hparent_section);
+          if (!hval_array)
+            return false;
+          while (++it != this_ref.txs.end())
+            stg.insert_next_value(hval_array, blobdata(it->blob));
         }
+      }
+      else
+      {
+        std::vector<blobdata> txs;
         epee::serialization::selector<is_store>::serialize(txs, stg, hparent_section, "txs");
-        if (!is_store)
-        {
-          block_complete_entry &self = const_cast<block_complete_entry&>(this_ref);
-          self.txs.clear();
-          self.txs.reserve(txs.size());
-          for (auto &e: txs) self.txs.push_back({std::move(e), crypto::null_hash});
-        }
+        block_complete_entry &self = const_cast<block_complete_entry&>(this_ref);
+        self.txs.clear();
+        self.txs.reserve(txs.size());
+        for (auto &e: txs) self.txs.push_back({std::move(e), crypto::null_hash});
       }
     END_KV_SERIALIZE_MAP()
 
@@ -420,5 +425,43 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<request_t> request;
   };
 
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_SN_GOSSIP_INVENTORY
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 13;
+
+    struct request_t
+    {
+      uint64_t salt;
+      std::vector<uint64_t> short_ids; // of the uptime proofs and deregister votes not yet sent to the peer, keyed by salt
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(salt)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(short_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_SN_GOSSIP_REQUEST
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 14;
+
+    struct request_t
+    {
+      std::vector<uint64_t> short_ids; // from the peer's inventory, answered with NOTIFY_UPTIME_PROOF and NOTIFY_NEW_DEREGISTER_VOTE
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(short_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
     
 }
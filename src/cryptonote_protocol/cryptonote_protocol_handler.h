@@ -44,6 +44,7 @@
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
 #include "block_queue.h"
+#include "sn_gossip.h"
 #include "common/perf_timer.h"
 #include "cryptonote_basic/connection_context.h"
 #include <boost/circular_buffer.hpp>
@@ -95,6 +96,8 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
       HANDLE_NOTIFY_T2(NOTIFY_GET_TXPOOL_COMPLEMENT, &cryptonote_protocol_handler::handle_notify_get_txpool_complement)
+      HANDLE_NOTIFY_T2(NOTIFY_SN_GOSSIP_INVENTORY, &cryptonote_protocol_handler::handle_notify_sn_gossip_inventory)
+      HANDLE_NOTIFY_T2(NOTIFY_SN_GOSSIP_REQUEST, &cryptonote_protocol_handler::handle_notify_sn_gossip_request)
 
     END_INVOKE_MAP2()
 
@@ -133,6 +136,8 @@ namespace cryptonote
 		int handle_notify_new_deregister_vote(int command, NOTIFY_NEW_DEREGISTER_VOTE::request& arg, cryptonote_connection_context& context);
 		int handle_uptime_proof(int command, NOTIFY_UPTIME_PROOF::request& arg, cryptonote_connection_context& context);
     int handle_notify_get_txpool_complement(int command, NOTIFY_GET_TXPOOL_COMPLEMENT::request& arg, cryptonote_connection_context& context);
+    int handle_notify_sn_gossip_inventory(int command, NOTIFY_SN_GOSSIP_INVENTORY::request& arg, cryptonote_connection_context& context);
+    int handle_notify_sn_gossip_request(int command, NOTIFY_SN_GOSSIP_REQUEST::request& arg, cryptonote_connection_context& context);
 
     template<class T>
     bool relay_to_synchronized_peers(typename T::request& arg, cryptonote_connection_context& exclude_context)
@@ -165,6 +170,7 @@ namespace cryptonote
 		virtual bool relay_deregister_votes(NOTIFY_NEW_DEREGISTER_VOTE::request& arg, cryptonote_connection_context& exclude_context);
 		//----------------- uptime proof ---------------------------------------
     virtual bool relay_uptime_proof(NOTIFY_UPTIME_PROOF::request& arg, cryptonote_connection_context& exclude_context);
+    virtual void on_uptime_proofs_rejected(const std::vector<NOTIFY_UPTIME_PROOF::request>& proofs);
     virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const boost::uuids::uuid& source, epee::net_utils::zone zone, relay_method tx_relay);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
@@ -183,6 +189,7 @@ namespace cryptonote
     void notify_new_stripe(cryptonote_connection_context &context, uint32_t stripe);
     void skip_unneeded_hashes(cryptonote_connection_context& context, bool check_block_queue) const;
     bool request_txpool_complement(cryptonote_connection_context &context);
+    bool relay_sn_gossip();
 
     t_core& m_core;
 
@@ -198,6 +205,8 @@ namespace cryptonote
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
     epee::math_helper::once_a_time_milliseconds<100> m_standby_checker;
     epee::math_helper::once_a_time_seconds<101> m_sync_search_checker;
+    epee::math_helper::once_a_time_milliseconds<P2P_SN_GOSSIP_INTERVAL> m_sn_gossip_relayer;
+    sn_gossip m_sn_gossip;
     std::atomic<unsigned int> m_max_out_peers;
     tools::PerformanceTimer m_sync_timer, m_add_timer;
     uint64_t m_last_add_end_time;
@@ -64,7 +64,9 @@
   MCINFO(XEQ_DEFAULT_LOG_CATEGORY, context << "[" << epee::string_tools::to_string_hex(context.m_pruning_seed) << "] state: " << x << " in state " << cryptonote::get_protocol_state_string(context.m_state))
 
 #define BLOCK_QUEUE_NSPANS_THRESHOLD 10 // chunks of N blocks
+#define BLOCK_QUEUE_READY_BLOCKS_PER_THREAD 4 // blocks ready to add, so adding them keeps all threads busy
 #define BLOCK_QUEUE_SIZE_THRESHOLD (100*1024*1024) // MB
+#define BLOCK_QUEUE_SIZE_HARD_CAP_FACTOR 2 // the queue may only grow past its size threshold up to this many times it, to keep blocks ready
 #define BLOCK_QUEUE_FORCE_DOWNLOAD_NEAR_BLOCKS 1000
 #define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD_STANDBY (5 * 1000000) // microseconds
 #define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD (30 * 1000000) // microseconds
@@ -794,31 +796,11 @@ namespace cryptonote
   int t_cryptonote_protocol_handler<t_core>::handle_uptime_proof(int command, NOTIFY_UPTIME_PROOF::request& arg, cryptonote_connection_context& context)
  {
     MLOG_P2P_MESSAGE("Received NOTIFY_UPTIME_PROOF");
-    // NOTE: Don't relay your own uptime proof, otherwise we have the following situation
-
-    // Node1 sends uptime ->
-    // Node2 receives uptime and relays it back to Node1 for acknowledgement ->
-    // Node1 receives it, handle_uptime_proof returns true to acknowledge, Node1 tries to resend to the same peers again
-
-    // Instead, if we receive our own uptime proof, then acknowledge but don't
-    // send on. If the we are missing an uptime proof it will have been
-    // submitted automatically by the daemon itself instead of
-    // using my own proof relayed by other nodes.
-
+    // The proof is queued and checked in a batch with others; the core relays it once accepted,
+    // and it's not asked for from other peers meanwhile
     (void)context;
-    bool my_uptime_proof_confirmation = false;
-    if (m_core.handle_uptime_proof(arg, my_uptime_proof_confirmation))
-    {
-      if (!my_uptime_proof_confirmation)
-      {
-        // NOTE: The default exclude context contains the peer who sent us this
-        // uptime proof, we want to ensure we relay it back so they know that the
-        // peer they relayed to received their uptime and confirm it, so send in an
-        // empty context so we don't omit the source peer from the relay back.
-        cryptonote_connection_context empty_context = {};
-        relay_uptime_proof(arg, empty_context);
-      }
-    }
+    if (m_core.handle_uptime_proof(arg))
+      m_sn_gossip.add_pending(sn_gossip::get_id(arg));
     return 1;
  }
  //------------------------------------------------------------------------------------------------------------------------
@@ -992,6 +974,54 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_sn_gossip_inventory(int command, NOTIFY_SN_GOSSIP_INVENTORY::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_SN_GOSSIP_INVENTORY (" << arg.short_ids.size() << " short ids)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received uptime proof and deregister vote inventory while syncing, ignored");
+      return 1;
+    }
+
+    NOTIFY_SN_GOSSIP_REQUEST::request r;
+    if (!m_sn_gossip.handle_inventory(context.m_connection_id, arg, r))
+    {
+      LOG_PRINT_CCONTEXT_L1("Invalid uptime proof and deregister vote inventory, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    if (!r.short_ids.empty())
+    {
+      MLOG_P2P_MESSAGE("-->>NOTIFY_SN_GOSSIP_REQUEST: short_ids.size()=" << r.short_ids.size());
+      post_notify<NOTIFY_SN_GOSSIP_REQUEST>(r, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_sn_gossip_request(int command, NOTIFY_SN_GOSSIP_REQUEST::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_SN_GOSSIP_REQUEST (" << arg.short_ids.size() << " short ids)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    std::vector<NOTIFY_UPTIME_PROOF::request> proofs;
+    NOTIFY_NEW_DEREGISTER_VOTE::request votes;
+    m_sn_gossip.handle_request(context.m_connection_id, arg, proofs, votes.votes);
+
+    MLOG_P2P_MESSAGE("-->>NOTIFY_UPTIME_PROOF/NOTIFY_NEW_DEREGISTER_VOTE: " << proofs.size() << " proofs, " << votes.votes.size() << " votes");
+    for (NOTIFY_UPTIME_PROOF::request &proof: proofs)
+      post_notify<NOTIFY_UPTIME_PROOF>(proof, context);
+    if (!votes.votes.empty())
+      post_notify<NOTIFY_NEW_DEREGISTER_VOTE>(votes, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
@@ -1484,7 +1514,16 @@ namespace cryptonote
           std::vector<block> pblocks;
           if (!m_core.prepare_handle_incoming_blocks(blocks, pblocks))
           {
-            LOG_ERROR_CCONTEXT("Failure in prepare_handle_incoming_blocks");
+            // the span's blocks don't parse, or don't match the fast sync hashes
+            if (!m_p2p->for_connection(span_connection_id, [&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t f)->bool{
+              LOG_ERROR_CCONTEXT("Failure in prepare_handle_incoming_blocks, dropping connection");
+              drop_connection(context, true, true);
+              return 1;
+            }))
+              LOG_ERROR_CCONTEXT("span connection id not found");
+
+            // in case the peer had dropped beforehand, remove the span anyway so other threads can wake up and get it
+            m_block_queue.remove_spans(span_connection_id, start_height);
             return 1;
           }
           if (!pblocks.empty() && pblocks.size() != blocks.size())
@@ -1715,6 +1754,7 @@ skip:
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    m_sn_gossip_relayer.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::relay_sn_gossip, this));
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1852,6 +1892,14 @@ skip:
           return true;
         }
 
+        // the peer's measured rate and latency say it should have been received by now
+        if (m_block_queue.is_next_span_overdue(context.m_connection_id, now))
+        {
+          MDEBUG(context << " we should download it as it's overdue after " << dt/1e6);
+          m_block_queue.add_overdue_span(connection_id);
+          return true;
+        }
+
         // in standby, be ready to double download early since we're idling anyway
         // let the fastest peer trigger first
         long threshold;
@@ -2038,7 +2086,9 @@ skip:
         const uint32_t peer_stripe = tools::get_pruning_stripe(context.m_pruning_seed);
         const uint32_t local_stripe = tools::get_pruning_stripe(m_core.get_blockchain_pruning_seed());
         const size_t block_queue_size_threshold = m_block_download_max_size ? m_block_download_max_size : BLOCK_QUEUE_SIZE_THRESHOLD;
-        bool queue_proceed = nspans < BLOCK_QUEUE_NSPANS_THRESHOLD || size < block_queue_size_threshold;
+        const size_t nready = m_block_queue.get_num_filled_blocks_prefix();
+        bool queue_proceed = (nspans < BLOCK_QUEUE_NSPANS_THRESHOLD || size < block_queue_size_threshold) ||
+            (nready < tools::get_max_concurrency() * BLOCK_QUEUE_READY_BLOCKS_PER_THREAD && size < block_queue_size_threshold * BLOCK_QUEUE_SIZE_HARD_CAP_FACTOR);
         // get rid of blocks we already requested, or already have
         skip_unneeded_hashes(context, true);
         uint64_t next_needed_height = m_block_queue.get_next_needed_height(bc_height);
@@ -2123,7 +2173,7 @@ skip:
         if (context.m_state != cryptonote_connection_context::state_standby)
         {
           if (!queue_proceed)
-            LOG_DEBUG_CC(context, "Block queue is " << nspans << " and " << size << ", pausing");
+            LOG_DEBUG_CC(context, "Block queue is " << nspans << " and " << size << " with " << nready << " blocks ready, pausing");
           else if (!stripe_proceed_main && !stripe_proceed_secondary)
             LOG_DEBUG_CC(context, "We do not have the stripe required to download another block, pausing");
           context.m_state = cryptonote_connection_context::state_standby;
@@ -2144,7 +2194,9 @@ skip:
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
       size_t count = 0;
-      const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t default_count = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t count_limit = m_block_queue.get_span_size(context.m_connection_id, default_count,
+          std::min<size_t>(default_count, tools::get_max_concurrency()), CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT);
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
       if (force_next_span)
       {
@@ -2605,16 +2657,80 @@ skip:
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_deregister_votes(NOTIFY_NEW_DEREGISTER_VOTE::request& arg, cryptonote_connection_context& exclude_context)
  {
-   bool result = relay_to_synchronized_peers<NOTIFY_NEW_DEREGISTER_VOTE>(arg, exclude_context);
+   // sent to peers by relay_sn_gossip
+   m_sn_gossip.add_deregister_votes(arg.votes, exclude_context.m_connection_id);
    m_core.set_deregister_votes_relayed(arg.votes);
-   return result;
+   return true;
  }
  //------------------------------------------------------------------------------------------------------------------------
  template<class t_core>
  bool t_cryptonote_protocol_handler<t_core>::relay_uptime_proof(NOTIFY_UPTIME_PROOF::request& arg, cryptonote_connection_context& exclude_context)
  {
-    bool result = relay_to_synchronized_peers<NOTIFY_UPTIME_PROOF>(arg, exclude_context);
-    return result;
+    // sent to peers by relay_sn_gossip
+    m_sn_gossip.add_uptime_proof(arg, exclude_context.m_connection_id);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::on_uptime_proofs_rejected(const std::vector<NOTIFY_UPTIME_PROOF::request>& proofs)
+  {
+    for (const NOTIFY_UPTIME_PROOF::request &proof: proofs)
+      m_sn_gossip.remove_pending(sn_gossip::get_id(proof));
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_sn_gossip()
+  {
+    m_sn_gossip.prune();
+
+    struct notification
+    {
+      int command;
+      std::string blob;
+      epee::net_utils::zone zone;
+      boost::uuids::uuid connection_id;
+    };
+    std::vector<notification> notifications;
+    m_p2p->for_each_connection([&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool
+    {
+      if (context.m_state <= cryptonote_connection_context::state_synchronizing || !peer_id)
+        return true;
+
+      const epee::net_utils::zone zone = context.m_remote_address.get_zone();
+      if (support_flags & P2P_SUPPORT_FLAG_SN_GOSSIP)
+      {
+        NOTIFY_SN_GOSSIP_INVENTORY::request inventory;
+        if (m_sn_gossip.get_inventory(context.m_connection_id, inventory))
+        {
+          MLOG_P2P_MESSAGE("-->>NOTIFY_SN_GOSSIP_INVENTORY: short_ids.size()=" << inventory.short_ids.size());
+          notifications.push_back({NOTIFY_SN_GOSSIP_INVENTORY::ID, std::string(), zone, context.m_connection_id});
+          epee::serialization::store_t_to_binary(inventory, notifications.back().blob);
+        }
+      }
+      else
+      {
+        std::vector<NOTIFY_UPTIME_PROOF::request> proofs;
+        NOTIFY_NEW_DEREGISTER_VOTE::request votes;
+        if (m_sn_gossip.get_unsent(context.m_connection_id, proofs, votes.votes))
+        {
+          for (NOTIFY_UPTIME_PROOF::request &proof: proofs)
+          {
+            notifications.push_back({NOTIFY_UPTIME_PROOF::ID, std::string(), zone, context.m_connection_id});
+            epee::serialization::store_t_to_binary(proof, notifications.back().blob);
+          }
+          if (!votes.votes.empty())
+          {
+            notifications.push_back({NOTIFY_NEW_DEREGISTER_VOTE::ID, std::string(), zone, context.m_connection_id});
+            epee::serialization::store_t_to_binary(votes, notifications.back().blob);
+          }
+        }
+      }
+      return true;
+    });
+
+    for (const notification &n: notifications)
+      m_p2p->relay_notify_to_list(n.command, epee::strspan<uint8_t>(n.blob), {{n.zone, n.connection_id}});
+    return true;
   }
  //------------------------------------------------------------------------------------------------------------------------
  template<class t_core>
@@ -2749,6 +2865,7 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+    m_sn_gossip.remove_peer(context.m_connection_id);
     MLOG_PEER_STATE("closed");
   }
 
@@ -42,6 +42,7 @@ namespace cryptonote
   {
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)=0;
     virtual bool relay_uptime_proof(NOTIFY_UPTIME_PROOF::request& arg, cryptonote_connection_context& exclude_context)=0;
+    virtual void on_uptime_proofs_rejected(const std::vector<NOTIFY_UPTIME_PROOF::request>& proofs)=0;
     virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const boost::uuids::uuid& source, epee::net_utils::zone zone, relay_method tx_relay)=0;
     //virtual bool request_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)=0;
     virtual bool relay_deregister_votes(NOTIFY_NEW_DEREGISTER_VOTE::request& arg, cryptonote_connection_context& exclude_context)=0;
@@ -68,6 +69,9 @@ namespace cryptonote
     {
       return false;
     }
+    virtual void on_uptime_proofs_rejected(const std::vector<NOTIFY_UPTIME_PROOF::request>& proofs)
+    {
+    }
 
   };
 }
@@ -0,0 +1,280 @@
+#include "sn_gossip.h"
+#include "crypto/crypto.h"
+#include "misc_log_ex.h"
+
+#include <cstring>
+
+#undef XEQ_DEFAULT_LOG_CATEGORY
+#define XEQ_DEFAULT_LOG_CATEGORY "cn.sn_gossip"
+
+namespace cryptonote
+{
+  sn_gossip::sn_gossip(): m_salt(crypto::rand<uint64_t>())
+  {
+  }
+
+  crypto::hash sn_gossip::get_id(const NOTIFY_UPTIME_PROOF::request &proof)
+  {
+    char buf[3 * sizeof(uint16_t) + sizeof(uint64_t) + sizeof(crypto::public_key) + sizeof(crypto::signature)];
+    char *ptr = buf;
+    const auto append = [&ptr](const void *data, size_t size) { memcpy(ptr, data, size); ptr += size; };
+    append(&proof.snode_version_major, sizeof(proof.snode_version_major));
+    append(&proof.snode_version_minor, sizeof(proof.snode_version_minor));
+    append(&proof.snode_version_patch, sizeof(proof.snode_version_patch));
+    append(&proof.timestamp, sizeof(proof.timestamp));
+    append(&proof.pubkey, sizeof(proof.pubkey));
+    append(&proof.sig, sizeof(proof.sig));
+    return crypto::cn_fast_hash(buf, sizeof(buf));
+  }
+
+  crypto::hash sn_gossip::get_id(const service_nodes::deregister_vote &vote)
+  {
+    static_assert(sizeof(vote) == sizeof(vote.block_height) + sizeof(vote.service_node_index) + sizeof(vote.voters_quorum_index) + sizeof(vote.signature), "deregister_vote has padding");
+    return crypto::cn_fast_hash(&vote, sizeof(vote));
+  }
+
+  uint64_t sn_gossip::get_short_id(uint64_t salt, const crypto::hash &id)
+  {
+    char buf[sizeof(salt) + sizeof(id)];
+    memcpy(buf, &salt, sizeof(salt));
+    memcpy(buf + sizeof(salt), &id, sizeof(id));
+    const crypto::hash h = crypto::cn_fast_hash(buf, sizeof(buf));
+    uint64_t short_id;
+    memcpy(&short_id, &h, sizeof(short_id));
+    return short_id;
+  }
+
+  bool sn_gossip::add(const crypto::hash &id, item &&i, const boost::uuids::uuid &source)
+  {
+    if (!source.is_nil())
+      m_peers[source].known[id] = i.added;
+
+    auto it = m_items.find(id);
+    if (it != m_items.end())
+    {
+      if (it->second.accepted || !i.accepted)
+        return false;
+      i.short_id = it->second.short_id;
+      it->second = std::move(i);
+      m_short_ids.emplace(it->second.short_id, id);
+      return true;
+    }
+
+    if (m_items.size() >= P2P_SN_GOSSIP_MAX_ITEMS)
+    {
+      MWARNING("Too many uptime proofs and deregister votes to relay, dropping " << id);
+      return false;
+    }
+    i.short_id = get_short_id(m_salt, id);
+    if (i.accepted)
+      m_short_ids.emplace(i.short_id, id);
+    for (auto &peer: m_peers)
+      if (peer.second.has_salt)
+        peer.second.short_ids.emplace(get_short_id(peer.second.salt, id), id);
+    m_items.emplace(id, std::move(i));
+    return true;
+  }
+
+  bool sn_gossip::add_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof, const boost::uuids::uuid &source)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    item i{};
+    i.accepted = true;
+    i.is_proof = true;
+    i.proof = proof;
+    i.added = time(NULL);
+    return add(get_id(proof), std::move(i), source);
+  }
+
+  void sn_gossip::add_deregister_votes(const std::vector<service_nodes::deregister_vote> &votes, const boost::uuids::uuid &source)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const std::time_t now = time(NULL);
+    for (const service_nodes::deregister_vote &vote: votes)
+    {
+      item i{};
+      i.accepted = true;
+      i.is_proof = false;
+      i.vote = vote;
+      i.added = now;
+      add(get_id(vote), std::move(i), source);
+    }
+  }
+
+  void sn_gossip::add_pending(const crypto::hash &id)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    item i{};
+    i.accepted = false;
+    i.added = time(NULL);
+    add(id, std::move(i), boost::uuids::uuid{});
+  }
+
+  void sn_gossip::remove_pending(const crypto::hash &id)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const auto it = m_items.find(id);
+    if (it == m_items.end() || it->second.accepted)
+      return;
+    for (auto &peer: m_peers)
+    {
+      if (!peer.second.has_salt)
+        continue;
+      const auto peer_id = peer.second.short_ids.find(get_short_id(peer.second.salt, id));
+      if (peer_id != peer.second.short_ids.end() && peer_id->second == id)
+        peer.second.short_ids.erase(peer_id);
+    }
+    m_items.erase(it);
+  }
+
+  bool sn_gossip::get_inventory(const boost::uuids::uuid &peer, NOTIFY_SN_GOSSIP_INVENTORY::request &inventory)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const std::time_t now = time(NULL);
+    peer_state &p = m_peers[peer];
+    inventory.salt = m_salt;
+    inventory.short_ids.clear();
+    for (const auto &i: m_items)
+      if (i.second.accepted && p.known.emplace(i.first, now).second)
+        inventory.short_ids.push_back(i.second.short_id);
+    return !inventory.short_ids.empty();
+  }
+
+  bool sn_gossip::get_unsent(const boost::uuids::uuid &peer, std::vector<NOTIFY_UPTIME_PROOF::request> &proofs, std::vector<service_nodes::deregister_vote> &votes)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const std::time_t now = time(NULL);
+    peer_state &p = m_peers[peer];
+    proofs.clear();
+    votes.clear();
+    for (const auto &i: m_items)
+    {
+      if (!i.second.accepted || !p.known.emplace(i.first, now).second)
+        continue;
+      if (i.second.is_proof)
+        proofs.push_back(i.second.proof);
+      else
+        votes.push_back(i.second.vote);
+    }
+    return !proofs.empty() || !votes.empty();
+  }
+
+  void sn_gossip::reindex(peer_state &peer, uint64_t salt)
+  {
+    peer.has_salt = true;
+    peer.salt = salt;
+    peer.short_ids.clear();
+    peer.short_ids.reserve(m_items.size());
+    for (const auto &i: m_items)
+      peer.short_ids.emplace(get_short_id(salt, i.first), i.first);
+  }
+
+  bool sn_gossip::handle_inventory(const boost::uuids::uuid &peer, const NOTIFY_SN_GOSSIP_INVENTORY::request &inventory, NOTIFY_SN_GOSSIP_REQUEST::request &request)
+  {
+    if (inventory.short_ids.size() > P2P_SN_GOSSIP_MAX_ITEMS)
+    {
+      MWARNING("Peer sent an inventory of " << inventory.short_ids.size() << " uptime proofs and deregister votes");
+      return false;
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const std::time_t now = time(NULL);
+    peer_state &p = m_peers[peer];
+    if (!p.has_salt)
+      reindex(p, inventory.salt);
+    else if (p.salt != inventory.salt)
+    {
+      // the whole index would have to be hashed again for each inventory
+      MWARNING("Peer changed its uptime proof and deregister vote inventory salt");
+      return false;
+    }
+
+    request.short_ids.clear();
+    for (uint64_t short_id: inventory.short_ids)
+    {
+      const auto it = p.short_ids.find(short_id);
+      if (it != p.short_ids.end())
+        p.known[it->second] = now;
+      else
+        request.short_ids.push_back(short_id);
+    }
+    return true;
+  }
+
+  void sn_gossip::handle_request(const boost::uuids::uuid &peer, const NOTIFY_SN_GOSSIP_REQUEST::request &request, std::vector<NOTIFY_UPTIME_PROOF::request> &proofs, std::vector<service_nodes::deregister_vote> &votes)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    proofs.clear();
+    votes.clear();
+    const auto p = m_peers.find(peer);
+    if (p == m_peers.end())
+      return;
+    for (uint64_t short_id: request.short_ids)
+    {
+      const auto id = m_short_ids.find(short_id);
+      if (id == m_short_ids.end() || !p->second.known.count(id->second))
+        continue;
+      const auto i = m_items.find(id->second);
+      if (i == m_items.end() || !i->second.accepted)
+        continue;
+      if (i->second.is_proof)
+        proofs.push_back(i->second.proof);
+      else
+        votes.push_back(i->second.vote);
+      if (proofs.size() + votes.size() >= P2P_SN_GOSSIP_MAX_ITEMS)
+        break;
+    }
+  }
+
+  void sn_gossip::remove_peer(const boost::uuids::uuid &peer)
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_peers.erase(peer);
+  }
+
+  void sn_gossip::prune()
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    const std::time_t now = time(NULL);
+    for (auto i = m_items.begin(); i != m_items.end(); )
+    {
+      if (i->second.added + P2P_SN_GOSSIP_LIFETIME > now)
+      {
+        ++i;
+        continue;
+      }
+      const auto id = m_short_ids.find(i->second.short_id);
+      if (id != m_short_ids.end() && id->second == i->first)
+        m_short_ids.erase(id);
+      for (auto &peer: m_peers)
+      {
+        if (!peer.second.has_salt)
+          continue;
+        const auto peer_id = peer.second.short_ids.find(get_short_id(peer.second.salt, i->first));
+        if (peer_id != peer.second.short_ids.end() && peer_id->second == i->first)
+          peer.second.short_ids.erase(peer_id);
+      }
+      i = m_items.erase(i);
+    }
+
+    // peers are told about items after they're added, so this doesn't make
+    // them be told again
+    for (auto &peer: m_peers)
+    {
+      auto &known = peer.second.known;
+      for (auto i = known.begin(); i != known.end(); )
+      {
+        if (i->second + P2P_SN_GOSSIP_LIFETIME > now)
+          ++i;
+        else
+          i = known.erase(i);
+      }
+    }
+  }
+
+  size_t sn_gossip::size() const
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_items.size();
+  }
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include "crypto/hash.h"
+#include "cryptonote_protocol_defs.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief the uptime proofs and deregister votes relayed to peers
+   *
+   * Rather than flooding each proof and vote to every peer as it arrives,
+   * they are relayed on a timer. Peers supporting it are sent an inventory
+   * of short ids of what they haven't sent or been told about yet, and ask
+   * for the ones they miss. Other peers get the full proofs and votes they
+   * haven't seen yet.
+   *
+   * Short ids are 64 bits of the hash of an id and a random salt, chosen
+   * by each node for its inventories, so ids colliding for one node don't
+   * for others.
+   *
+   * Proofs and votes are kept for P2P_SN_GOSSIP_LIFETIME after they're
+   * added, and what peers know for as long, by prune. All the functions are
+   * thread safe.
+   */
+  class sn_gossip
+  {
+  public:
+    sn_gossip();
+
+    //! the id of an uptime proof
+    static crypto::hash get_id(const NOTIFY_UPTIME_PROOF::request &proof);
+
+    //! the id of a deregister vote
+    static crypto::hash get_id(const service_nodes::deregister_vote &vote);
+
+    //! the short id of an id, for a salt
+    static uint64_t get_short_id(uint64_t salt, const crypto::hash &id);
+
+    /**
+     * @brief adds an uptime proof that was accepted, to be relayed
+     *
+     * @param proof the proof
+     * @param source the peer it came from, which isn't told about it, or nil
+     *
+     * @return false if the proof was already added
+     */
+    bool add_uptime_proof(const NOTIFY_UPTIME_PROOF::request &proof, const boost::uuids::uuid &source);
+
+    /**
+     * @brief adds deregister votes that were accepted, to be relayed
+     *
+     * @param votes the votes
+     * @param source the peer they came from, which isn't told about them, or nil
+     */
+    void add_deregister_votes(const std::vector<service_nodes::deregister_vote> &votes, const boost::uuids::uuid &source);
+
+    /**
+     * @brief notes a proof or vote was received but not accepted yet
+     *
+     * It won't be asked for again from other peers until it expires.
+     *
+     * @param id the proof's or vote's id
+     */
+    void add_pending(const crypto::hash &id);
+
+    /**
+     * @brief forgets a proof or vote which was pending but got rejected
+     *
+     * So it doesn't take the place of accepted ones until it expires. If it
+     * was accepted meanwhile, it's kept.
+     *
+     * @param id the proof's or vote's id
+     */
+    void remove_pending(const crypto::hash &id);
+
+    /**
+     * @brief makes the next inventory for a peer
+     *
+     * The peer is then taken to know about everything in it.
+     *
+     * @param peer the peer's connection id
+     * @param inventory return-by-reference the inventory
+     *
+     * @return false if there is nothing new for the peer
+     */
+    bool get_inventory(const boost::uuids::uuid &peer, NOTIFY_SN_GOSSIP_INVENTORY::request &inventory);
+
+    /**
+     * @brief gets the proofs and votes a peer not supporting inventories wasn't sent yet
+     *
+     * The peer is then taken to know about all of them.
+     *
+     * @param peer the peer's connection id
+     * @param proofs return-by-reference the proofs
+     * @param votes return-by-reference the votes
+     *
+     * @return false if there is nothing new for the peer
+     */
+    bool get_unsent(const boost::uuids::uuid &peer, std::vector<NOTIFY_UPTIME_PROOF::request> &proofs, std::vector<service_nodes::deregister_vote> &votes);
+
+    /**
+     * @brief handles a peer's inventory
+     *
+     * @param peer the peer's connection id
+     * @param inventory the inventory
+     * @param request return-by-reference the short ids of what is missing
+     *
+     * @return false if the inventory is larger than the peer can hold
+     */
+    bool handle_inventory(const boost::uuids::uuid &peer, const NOTIFY_SN_GOSSIP_INVENTORY::request &inventory, NOTIFY_SN_GOSSIP_REQUEST::request &request);
+
+    /**
+     * @brief handles a peer asking for proofs and votes from an inventory
+     *
+     * Short ids which weren't sent to the peer, or aren't held anymore, are
+     * ignored.
+     *
+     * @param peer the peer's connection id
+     * @param request the short ids asked for
+     * @param proofs return-by-reference the proofs asked for
+     * @param votes return-by-reference the votes asked for
+     */
+    void handle_request(const boost::uuids::uuid &peer, const NOTIFY_SN_GOSSIP_REQUEST::request &request, std::vector<NOTIFY_UPTIME_PROOF::request> &proofs, std::vector<service_nodes::deregister_vote> &votes);
+
+    /**
+     * @brief forgets about a peer whose connection was closed
+     *
+     * @param peer the peer's connection id
+     */
+    void remove_peer(const boost::uuids::uuid &peer);
+
+    /**
+     * @brief drops expired proofs and votes, and what peers know of them
+     */
+    void prune();
+
+    //! the number of proofs and votes held, including pending ones
+    size_t size() const;
+
+  private:
+    struct item
+    {
+      bool accepted;  //!< false while pending
+      bool is_proof;
+      NOTIFY_UPTIME_PROOF::request proof;
+      service_nodes::deregister_vote vote;
+      std::time_t added;
+      uint64_t short_id;  //!< with m_salt
+    };
+
+    struct peer_state
+    {
+      std::unordered_map<crypto::hash, std::time_t> known;  //!< ids the peer sent or was told about
+      bool has_salt = false;
+      uint64_t salt = 0;  //!< of the peer's inventories
+      std::unordered_map<uint64_t, crypto::hash> short_ids;  //!< of the items held, with salt
+    };
+
+    bool add(const crypto::hash &id, item &&i, const boost::uuids::uuid &source);
+    void reindex(peer_state &peer, uint64_t salt);
+
+    mutable boost::mutex m_mutex;
+    const uint64_t m_salt;
+    std::unordered_map<crypto::hash, item> m_items;
+    std::unordered_map<uint64_t, crypto::hash> m_short_ids;  //!< of the items held, with m_salt
+    std::unordered_map<boost::uuids::uuid, peer_state, boost::hash<boost::uuids::uuid>> m_peers;
+  };
+}
@@ -2327,7 +2327,9 @@ bool t_rpc_command_executor::sync_info()
       tools::success_msg_writer() << address << "  " << p.info.peer_id << "  " <<
           epee::string_tools::pad_string(p.info.state, 16) << "  " <<
           epee::string_tools::pad_string(epee::string_tools::to_string_hex(p.info.pruning_seed), 8) << "  " << p.info.height << "  "  <<
-          p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued";
+          p.info.current_download << " kB/s, " << nblocks << " blocks / " << size/1e6 << " MB queued, " <<
+          p.download_rate / 1024 << " kB/s / " << p.latency << " ms measured, spans of " << p.span_blocks << " blocks, " <<
+          p.spans_downloaded << " spans / " << p.blocks_downloaded << " blocks downloaded, " << p.spans_overdue << " overdue";
     }
 
     uint64_t total_size = 0;
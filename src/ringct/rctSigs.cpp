@@ -1090,35 +1090,49 @@ namespace rct {
 
     //ver RingCT simple
     //assumes only post-rct style inputs (at least for max anonymity)
-    bool verRctNonSemanticsSimple(const rctSig & rv) {
+    //all the MLSAGs of all the rctSigs are checked in one go, so a block's
+    //worth of transactions keeps every thread busy, not just the inputs of one
+    bool verRctNonSemanticsSimple(const std::vector<const rctSig*> & rvv) {
       try
       {
         PERF_TIMER(verRctNonSemanticsSimple);
-        CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof || rv.type == RCTTypeBulletproof2,
-            false, "verRctNonSemanticsSimple called on non simple rctSig");
-        const bool bulletproof = is_rct_bulletproof(rv.type);
-        // semantics check is early, and mixRing/MGs aren't resolved yet
-        if (bulletproof)
-          CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
-        else
-          CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
-
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
 
-        std::deque<bool> results(threads);
         tools::threadpool& tpool = tools::threadpool::getInstance();
         tools::threadpool::waiter waiter;
+        std::deque<bool> results;
+        keyV messages;
+        size_t inputs = 0, offset = 0;
 
-        const keyV &pseudoOuts = bulletproof ? rv.p.pseudoOuts : rv.pseudoOuts;
+        messages.reserve(rvv.size());
+        for (const rctSig *rvp: rvv)
+        {
+          CHECK_AND_ASSERT_MES(rvp, false, "rctSig pointer is NULL");
+          const rctSig &rv = *rvp;
+          CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof || rv.type == RCTTypeBulletproof2,
+              false, "verRctNonSemanticsSimple called on non simple rctSig");
+          const bool bulletproof = is_rct_bulletproof(rv.type);
+          // semantics check is early, and mixRing/MGs aren't resolved yet
+          if (bulletproof)
+            CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
+          else
+            CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
 
-        const key message = get_pre_mlsag_hash(rv, hw::get_device("default"));
+          messages.push_back(get_pre_mlsag_hash(rv, hw::get_device("default")));
+          inputs += rv.mixRing.size();
+        }
 
-        results.clear();
-        results.resize(rv.mixRing.size());
-        for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
-          tpool.submit(&waiter, [&, i] {
-              results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
-          });
+        results.resize(inputs);
+        for (size_t n = 0; n < rvv.size(); ++n)
+        {
+          const rctSig &rv = *rvv[n];
+          const key &message = messages[n];
+          const keyV &pseudoOuts = is_rct_bulletproof(rv.type) ? rv.p.pseudoOuts : rv.pseudoOuts;
+          for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
+            tpool.submit(&waiter, [&, i, offset] {
+                results[i+offset] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+            });
+          }
+          offset += rv.mixRing.size();
         }
         waiter.wait(&tpool);
 
@@ -1144,6 +1158,11 @@ namespace rct {
       }
     }
 
+    bool verRctNonSemanticsSimple(const rctSig & rv)
+    {
+      return verRctNonSemanticsSimple(std::vector<const rctSig*>(1, &rv));
+    }
+
     //RingCT protocol
     //genRct: 
     //   creates an rctSig with all data necessary to verify the rangeProofs and that the signer owns one of the
@@ -480,6 +480,32 @@ namespace cryptonote
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     if (restricted)
       res.database_size = round_up(res.database_size, 5ull* 1024 * 1024 * 1024);
+    res.quorum_cache_size = restricted ? 0 : m_core.get_quorum_cache_memory_usage();
+    if (restricted)
+      res.pow_cache_hits = res.pow_cache_misses = 0;
+    else
+      m_core.get_blockchain_storage().get_pow_cache_stats(res.pow_cache_hits, res.pow_cache_misses);
+    if (restricted)
+      res.db_validate_time = res.db_write_time = res.db_sync_time = res.db_sync_wait_time = 0;
+    else
+    {
+      const Blockchain::db_commit_stats stats = m_core.get_blockchain_storage().get_commit_stats();
+      res.db_validate_time = stats.validate_time;
+      res.db_write_time = stats.write_time;
+      res.db_sync_time = stats.sync_time;
+      res.db_sync_wait_time = stats.sync_wait_time;
+    }
+    if (restricted)
+      res.db_growth_rate = res.db_resizes = res.db_resizes_deferred = res.db_resize_stall_time = res.db_resize_max_stall_time = 0;
+    else
+    {
+      const db_resize_stats stats = m_core.get_blockchain_storage().get_db().get_resize_stats();
+      res.db_growth_rate = stats.growth_rate;
+      res.db_resizes = stats.resizes;
+      res.db_resizes_deferred = stats.deferred;
+      res.db_resize_stall_time = stats.stall_time;
+      res.db_resize_max_stall_time = stats.max_stall_time;
+    }
     res.update_available = restricted ? false : m_core.is_update_available();
     res.version = restricted ? "" : XEQ_VERSION_FULL;
 
@@ -568,8 +594,8 @@ namespace cryptonote
     {
       res.blocks.resize(res.blocks.size()+1);
       res.blocks.back().pruned = req.prune;
-      res.blocks.back().block = bd.first.first;
       size += bd.first.first.size();
+      res.blocks.back().block = std::move(bd.first.first);
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
       ntxes += bd.second.size();
       res.output_indices.back().indices.reserve(1 + bd.second.size());
@@ -3134,9 +3160,23 @@ namespace cryptonote
     res.target_height = m_core.get_target_blockchain_height();
     res.next_needed_pruning_seed = m_p2p.get_payload_object().get_next_needed_pruning_stripe().second;
 
+    const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
     for (const auto &c: m_p2p.get_payload_object().get_connections())
+    {
       res.peers.push_back({c});
-    const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+      boost::uuids::uuid connection_id;
+      cryptonote::block_queue::peer_sync_stats stats;
+      if (epee::string_tools::hex_to_pod(c.connection_id, connection_id) && block_queue.get_peer_sync_stats(connection_id, stats))
+      {
+        COMMAND_RPC_SYNC_INFO::peer &p = res.peers.back();
+        p.download_rate = stats.rate + 0.5f;
+        p.latency = stats.latency * 1000 + 0.5f;
+        p.span_blocks = stats.span_blocks;
+        p.blocks_downloaded = stats.nblocks;
+        p.spans_downloaded = stats.nspans;
+        p.spans_overdue = stats.noverdue;
+      }
+    }
     block_queue.foreach([&](const cryptonote::block_queue::span &span) {
       const std::string span_connection_id = epee::string_tools::pod_to_hex(span.connection_id);
       uint32_t speed = (uint32_t)(100.0f * block_queue.get_speed(span.connection_id) + 0.5f);
@@ -3191,7 +3231,7 @@ namespace cryptonote
       const uint64_t req_to_height = req.to_height ? req.to_height : (m_core.get_current_blockchain_height() - 1);
       for (uint64_t amount: req.amounts)
       {
-        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, [this](uint64_t height) { return m_core.get_blockchain_storage().get_db().get_block_hash_from_height(height); }, req.cumulative, m_core.get_current_blockchain_height());
+        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, req.cumulative);
         if (!data)
         {
           error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
@@ -3239,7 +3279,7 @@ namespace cryptonote
       const uint64_t req_to_height = req.to_height ? req.to_height : (m_core.get_current_blockchain_height() - 1);
       for (uint64_t amount: req.amounts)
       {
-        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, [this](uint64_t height) { return m_core.get_blockchain_storage().get_db().get_block_hash_from_height(height); }, req.cumulative, m_core.get_current_blockchain_height());
+        auto data = rpc::RpcHandler::get_output_distribution([this](uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) { return m_core.get_output_distribution(amount, from, to, start_height, distribution, base); }, amount, req.from_height, req_to_height, req.cumulative);
         if (!data)
         {
           res.status = "Failed to get output distribution";
@@ -3754,18 +3794,19 @@ namespace cryptonote
     std::vector<crypto::hash> missed_txs;
     m_core.get_transactions(blk.tx_hashes, txs, missed_txs);
 
-    for(auto tx : txs)
+    for(const auto& tx : txs)
     {
+      const cryptonote::tx_extra_index extra(tx.extra);
       bool is_tx = false;
       crypto::public_key pubkey;
-      if (!cryptonote::get_service_node_pubkey_from_tx_extra(tx.extra, pubkey))
+      if (!cryptonote::get_service_node_pubkey_from_tx_extra(extra, pubkey))
       {
         continue;
       }
 
       {
         tx_extra_service_node_register registration;
-        if(cryptonote::get_service_node_register_from_tx_extra(tx.extra, registration))
+        if(cryptonote::get_service_node_register_from_tx_extra(extra, registration))
         {
           cryptonote::account_public_address address = cryptonote::account_public_address{ registration.m_public_spend_keys[0], registration.m_public_view_keys[0] };
           COMMAND_RPC_ON_GET_STAKED_TXS::response::registration_tx reg_tx;
@@ -3774,7 +3815,7 @@ namespace cryptonote
           reg_tx.amount_open = service_nodes::get_staking_requirement(m_core.get_nettype(), m_core.get_current_blockchain_height()) - reg_tx.amount;
           reg_tx.node_key = epee::string_tools::pod_to_hex(pubkey);
 
-          uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(tx.extra);
+          uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(extra);
           res.burnt_xeq += burned_amount;
           res.reg_txs.push_back(reg_tx);
           is_tx = true;
@@ -3785,10 +3826,10 @@ namespace cryptonote
 
 	    	cryptonote::account_public_address address;
 
-        if (cryptonote::get_service_node_contributor_from_tx_extra(tx.extra, address))
+        if (cryptonote::get_service_node_contributor_from_tx_extra(extra, address))
         {
             crypto::secret_key tx_key;
-            if (!cryptonote::get_tx_secret_key_from_tx_extra(tx.extra, tx_key))
+            if (!cryptonote::get_tx_secret_key_from_tx_extra(extra, tx_key))
               continue;
 
             crypto::key_derivation derivation;
@@ -3811,7 +3852,7 @@ namespace cryptonote
             stake_tx.amount = transferred;
             stake_tx.address = cryptonote::get_account_address_as_str(nettype(), false/*is_subaddress*/, address);
             stake_tx.node_key = epee::string_tools::pod_to_hex(pubkey);
-            uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(tx.extra);
+            uint64_t burned_amount = cryptonote::get_burned_amount_from_tx_extra(extra);
             res.burnt_xeq += burned_amount;
             res.staked_txs.push_back(stake_tx);
         }
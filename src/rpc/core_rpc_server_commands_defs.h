@@ -91,7 +91,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 1
+#define CORE_RPC_VERSION_MINOR 6
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -1166,6 +1166,18 @@ namespace cryptonote
       uint64_t height_without_bootstrap;
       bool was_bootstrap_ever_used;
       uint64_t database_size;
+      uint64_t quorum_cache_size;
+      uint64_t pow_cache_hits;
+      uint64_t pow_cache_misses;
+      uint64_t db_validate_time;
+      uint64_t db_write_time;
+      uint64_t db_sync_time;
+      uint64_t db_sync_wait_time;
+      uint64_t db_growth_rate;
+      uint64_t db_resizes;
+      uint64_t db_resizes_deferred;
+      uint64_t db_resize_stall_time;
+      uint64_t db_resize_max_stall_time;
       bool update_available;
       std::string version;
 
@@ -1204,6 +1216,18 @@ namespace cryptonote
         KV_SERIALIZE(height_without_bootstrap)
         KV_SERIALIZE(was_bootstrap_ever_used)
         KV_SERIALIZE(database_size)
+        KV_SERIALIZE_OPT(quorum_cache_size, (uint64_t)0)
+        KV_SERIALIZE_OPT(pow_cache_hits, (uint64_t)0)
+        KV_SERIALIZE_OPT(pow_cache_misses, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_validate_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_write_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_sync_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_sync_wait_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_growth_rate, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_resizes, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_resizes_deferred, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_resize_stall_time, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_resize_max_stall_time, (uint64_t)0)
         KV_SERIALIZE(update_available)
         KV_SERIALIZE(version)
       END_KV_SERIALIZE_MAP()
@@ -2682,9 +2706,21 @@ namespace cryptonote
     struct peer
     {
       connection_info info;
+      uint64_t download_rate; // bytes/s, measured from its spans
+      uint32_t latency; // ms
+      uint64_t span_blocks;
+      uint64_t blocks_downloaded;
+      uint64_t spans_downloaded;
+      uint64_t spans_overdue;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(info)
+        KV_SERIALIZE_OPT(download_rate, (uint64_t)0)
+        KV_SERIALIZE_OPT(latency, (uint32_t)0)
+        KV_SERIALIZE_OPT(span_blocks, (uint64_t)0)
+        KV_SERIALIZE_OPT(blocks_downloaded, (uint64_t)0)
+        KV_SERIALIZE_OPT(spans_downloaded, (uint64_t)0)
+        KV_SERIALIZE_OPT(spans_overdue, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -228,7 +228,7 @@ bool tests::proxy_core::handle_incoming_block(const cryptonote::blobdata& block_
 
     return true;
 }
-bool tests::proxy_core::handle_uptime_proof(uint64_t timestamp, const crypto::public_key& pubkey, const crypto::signature& sig)
+bool tests::proxy_core::handle_uptime_proof(const cryptonote::NOTIFY_UPTIME_PROOF::request &proof)
 {
   // TODO: add tests for core uptime proof checking.
   return false; // never relay these for tests.
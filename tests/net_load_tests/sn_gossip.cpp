@@ -0,0 +1,332 @@
+// Copyright (c) 2014-2019, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+
+#include <deque>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "misc_log_ex.h"
+#include "net/levin_base.h"
+#include "storages/portable_storage_template_helper.h"
+#include "cryptonote_protocol/sn_gossip.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  const size_t NODE_COUNT = 50;
+  const size_t PEER_COUNT = 8;
+  const size_t PROOF_COUNT = 500;
+  const size_t VOTE_COUNT = 100;
+  const size_t MAX_TICKS = 100;
+
+  template<typename T>
+  size_t message_size(const T &msg)
+  {
+    std::string blob;
+    epee::serialization::store_t_to_binary(msg, blob);
+    return blob.size() + sizeof(epee::levin::bucket_head2);
+  }
+
+  boost::uuids::uuid node_id(size_t node)
+  {
+    boost::uuids::uuid id{};
+    ++node;
+    memcpy(id.data, &node, sizeof(node));
+    return id;
+  }
+
+  struct network
+  {
+    std::vector<std::vector<size_t>> peers;
+    std::vector<NOTIFY_UPTIME_PROOF::request> proofs;
+    std::vector<service_nodes::deregister_vote> votes;
+    std::vector<size_t> proof_sources, vote_sources;
+  };
+
+  network make_network()
+  {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<size_t> node(0, NODE_COUNT - 1);
+    std::uniform_int_distribution<unsigned> byte(0, 255);
+
+    network net;
+    std::vector<std::set<size_t>> links(NODE_COUNT);
+    for (size_t i = 0; i < NODE_COUNT; ++i)
+    {
+      // a ring so everything is reachable, then random links up to about PEER_COUNT each
+      links[i].insert((i + 1) % NODE_COUNT);
+      links[(i + 1) % NODE_COUNT].insert(i);
+      while (links[i].size() < PEER_COUNT)
+      {
+        const size_t j = node(rng);
+        if (j == i)
+          continue;
+        links[i].insert(j);
+        links[j].insert(i);
+      }
+    }
+    for (const auto &l: links)
+      net.peers.emplace_back(l.begin(), l.end());
+
+    for (size_t i = 0; i < PROOF_COUNT; ++i)
+    {
+      NOTIFY_UPTIME_PROOF::request proof;
+      proof.snode_version_major = 3;
+      proof.snode_version_minor = 0;
+      proof.snode_version_patch = 0;
+      proof.timestamp = 1500000000 + i;
+      for (size_t n = 0; n < sizeof(proof.pubkey); ++n)
+        proof.pubkey.data[n] = byte(rng);
+      for (size_t n = 0; n < sizeof(proof.sig); ++n)
+        reinterpret_cast<unsigned char*>(&proof.sig)[n] = byte(rng);
+      net.proofs.push_back(proof);
+      net.proof_sources.push_back(node(rng));
+    }
+    for (size_t i = 0; i < VOTE_COUNT; ++i)
+    {
+      service_nodes::deregister_vote vote{};
+      vote.block_height = 100000 + i / 10;
+      vote.service_node_index = i % 10;
+      vote.voters_quorum_index = byte(rng) % 10;
+      for (size_t n = 0; n < sizeof(vote.signature); ++n)
+        reinterpret_cast<unsigned char*>(&vote.signature)[n] = byte(rng);
+      net.votes.push_back(vote);
+      net.vote_sources.push_back(node(rng));
+    }
+    return net;
+  }
+
+  // what relay_to_synchronized_peers did: every proof and vote is sent to
+  // every peer as it's accepted, and proofs back to where they came from too
+  size_t run_flood(const network &net, std::vector<std::unordered_set<crypto::hash>> &held)
+  {
+    struct message { size_t to, from; bool is_proof; size_t index; };
+    std::deque<message> messages;
+    size_t bytes = 0;
+
+    const auto accept = [&](size_t node, size_t from, bool is_proof, size_t index) {
+      for (size_t peer: net.peers[node])
+      {
+        if (!is_proof && peer == from)
+          continue;
+        messages.push_back({peer, node, is_proof, index});
+      }
+    };
+
+    held.assign(NODE_COUNT, {});
+    for (size_t i = 0; i < net.proofs.size(); ++i)
+    {
+      held[net.proof_sources[i]].insert(sn_gossip::get_id(net.proofs[i]));
+      accept(net.proof_sources[i], NODE_COUNT, true, i);
+    }
+    for (size_t i = 0; i < net.votes.size(); ++i)
+    {
+      held[net.vote_sources[i]].insert(sn_gossip::get_id(net.votes[i]));
+      accept(net.vote_sources[i], NODE_COUNT, false, i);
+    }
+
+    while (!messages.empty())
+    {
+      const message m = messages.front();
+      messages.pop_front();
+      if (m.is_proof)
+      {
+        bytes += message_size(net.proofs[m.index]);
+        if (held[m.to].insert(sn_gossip::get_id(net.proofs[m.index])).second)
+          accept(m.to, m.from, true, m.index);
+      }
+      else
+      {
+        NOTIFY_NEW_DEREGISTER_VOTE::request r;
+        r.votes.push_back(net.votes[m.index]);
+        bytes += message_size(r);
+        if (held[m.to].insert(sn_gossip::get_id(net.votes[m.index])).second)
+          accept(m.to, m.from, false, m.index);
+      }
+    }
+    return bytes;
+  }
+
+  // what the protocol handler does now, every P2P_SN_GOSSIP_INTERVAL
+  size_t run_gossip(const network &net, bool inventories, std::vector<std::unordered_set<crypto::hash>> &held, size_t &ticks)
+  {
+    struct received { bool is_proof; NOTIFY_UPTIME_PROOF::request proof; service_nodes::deregister_vote vote; size_t from; };
+    std::vector<std::unique_ptr<sn_gossip>> nodes;
+    std::vector<std::vector<received>> inboxes(NODE_COUNT);
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < NODE_COUNT; ++i)
+      nodes.emplace_back(new sn_gossip());
+    held.assign(NODE_COUNT, {});
+    for (size_t i = 0; i < net.proofs.size(); ++i)
+    {
+      held[net.proof_sources[i]].insert(sn_gossip::get_id(net.proofs[i]));
+      nodes[net.proof_sources[i]]->add_uptime_proof(net.proofs[i], boost::uuids::uuid{});
+    }
+    for (size_t i = 0; i < net.votes.size(); ++i)
+    {
+      held[net.vote_sources[i]].insert(sn_gossip::get_id(net.votes[i]));
+      nodes[net.vote_sources[i]]->add_deregister_votes({net.votes[i]}, boost::uuids::uuid{});
+    }
+
+    const auto deliver = [&](size_t to, size_t from, const std::vector<NOTIFY_UPTIME_PROOF::request> &proofs, const NOTIFY_NEW_DEREGISTER_VOTE::request &votes) {
+      for (const NOTIFY_UPTIME_PROOF::request &proof: proofs)
+      {
+        bytes += message_size(proof);
+        nodes[to]->add_pending(sn_gossip::get_id(proof));
+        inboxes[to].push_back({true, proof, {}, from});
+      }
+      if (!votes.votes.empty())
+      {
+        bytes += message_size(votes);
+        for (const service_nodes::deregister_vote &vote: votes.votes)
+          inboxes[to].push_back({false, {}, vote, from});
+      }
+    };
+
+    for (ticks = 0; ticks < MAX_TICKS; ++ticks)
+    {
+      // the core accepts what was received since the last relay, and hands it back to relay
+      for (size_t i = 0; i < NODE_COUNT; ++i)
+      {
+        for (const received &r: inboxes[i])
+        {
+          if (r.is_proof && held[i].insert(sn_gossip::get_id(r.proof)).second)
+            nodes[i]->add_uptime_proof(r.proof, node_id(r.from));
+          else if (!r.is_proof && held[i].insert(sn_gossip::get_id(r.vote)).second)
+            nodes[i]->add_deregister_votes({r.vote}, node_id(r.from));
+        }
+        inboxes[i].clear();
+      }
+
+      const size_t bytes_before = bytes;
+      for (size_t i = 0; i < NODE_COUNT; ++i)
+      {
+        for (size_t j: net.peers[i])
+        {
+          std::vector<NOTIFY_UPTIME_PROOF::request> proofs;
+          NOTIFY_NEW_DEREGISTER_VOTE::request votes;
+          if (inventories)
+          {
+            NOTIFY_SN_GOSSIP_INVENTORY::request inventory;
+            if (!nodes[i]->get_inventory(node_id(j), inventory))
+              continue;
+            bytes += message_size(inventory);
+            NOTIFY_SN_GOSSIP_REQUEST::request request;
+            EXPECT_TRUE(nodes[j]->handle_inventory(node_id(i), inventory, request));
+            if (request.short_ids.empty())
+              continue;
+            bytes += message_size(request);
+            nodes[i]->handle_request(node_id(j), request, proofs, votes.votes);
+          }
+          else if (!nodes[i]->get_unsent(node_id(j), proofs, votes.votes))
+            continue;
+          deliver(j, i, proofs, votes);
+        }
+      }
+
+      bool pending = false;
+      for (const auto &inbox: inboxes)
+        pending |= !inbox.empty();
+      if (bytes == bytes_before && !pending)
+        break;
+    }
+    return bytes;
+  }
+
+  void check_all_held(const network &net, const std::vector<std::unordered_set<crypto::hash>> &held)
+  {
+    for (size_t i = 0; i < NODE_COUNT; ++i)
+    {
+      ASSERT_EQ(held[i].size(), net.proofs.size() + net.votes.size());
+    }
+  }
+}
+
+TEST(sn_gossip, inventories_use_less_bandwidth_than_flooding)
+{
+  const network net = make_network();
+  std::vector<std::unordered_set<crypto::hash>> held;
+  size_t ticks;
+
+  const size_t flood_bytes = run_flood(net, held);
+  check_all_held(net, held);
+
+  const size_t batched_bytes = run_gossip(net, false, held, ticks);
+  check_all_held(net, held);
+  ASSERT_LT(ticks, MAX_TICKS);
+
+  const size_t inventory_bytes = run_gossip(net, true, held, ticks);
+  check_all_held(net, held);
+  ASSERT_LT(ticks, MAX_TICKS);
+
+  MGINFO(NODE_COUNT << " nodes, " << net.proofs.size() << " uptime proofs and " << net.votes.size() << " deregister votes relayed with "
+    << flood_bytes << " bytes flooding, " << batched_bytes << " bytes batched, " << inventory_bytes << " bytes with inventories, in " << ticks << " relays");
+  ASSERT_LT(inventory_bytes, flood_bytes / 2);
+}
+
+TEST(sn_gossip, rejected_pending_proofs_are_asked_for_again)
+{
+  const network net = make_network();
+  const NOTIFY_UPTIME_PROOF::request &proof = net.proofs[0];
+  const crypto::hash id = sn_gossip::get_id(proof);
+  sn_gossip node, peer1, peer2;
+  peer1.add_uptime_proof(proof, boost::uuids::uuid{});
+  peer2.add_uptime_proof(proof, boost::uuids::uuid{});
+
+  // pending, so not asked for
+  node.add_pending(id);
+  ASSERT_EQ(node.size(), 1);
+  NOTIFY_SN_GOSSIP_INVENTORY::request inventory;
+  NOTIFY_SN_GOSSIP_REQUEST::request request;
+  ASSERT_TRUE(peer1.get_inventory(node_id(0), inventory));
+  ASSERT_TRUE(node.handle_inventory(node_id(1), inventory, request));
+  ASSERT_TRUE(request.short_ids.empty());
+
+  // rejected, so asked for from the next peer
+  node.remove_pending(id);
+  ASSERT_EQ(node.size(), 0);
+  ASSERT_TRUE(peer2.get_inventory(node_id(0), inventory));
+  ASSERT_TRUE(node.handle_inventory(node_id(2), inventory, request));
+  ASSERT_EQ(request.short_ids.size(), 1);
+
+  // accepted meanwhile, so kept
+  node.add_pending(id);
+  node.add_uptime_proof(proof, node_id(2));
+  node.remove_pending(id);
+  ASSERT_EQ(node.size(), 1);
+}
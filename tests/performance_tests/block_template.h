@@ -0,0 +1,128 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <deque>
+#include <random>
+#include <unordered_map>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/tx_pool.h"
+
+// A tx arriving in a pool of `pool_size` txes, with the oldest leaving, then
+// a block template asked for: either picking txes from the whole pool in fee
+// order, as fill_block_template used to for every template, or adding the
+// new tx to the pick kept between templates. Checking txes are ready to go is
+// left out, the pool caches it per block either way.
+template<size_t pool_size, bool incremental>
+class test_block_template
+{
+public:
+  static const size_t loop_count = incremental ? 1000 : 20;
+
+  bool init()
+  {
+    m_rng.seed(pool_size);
+    m_params = {crypto::null_hash, 300000, 3000000000000000000, 400000, cryptonote::network_version_8};
+    for (size_t n = 0; n < pool_size; ++n)
+      add_tx();
+    return pick();
+  }
+
+  bool test()
+  {
+    m_sorted.erase(m_txs[m_by_receive_time.front()].entry);
+    m_txs.erase(m_by_receive_time.front());
+    m_picks.remove(m_by_receive_time.front());
+    m_by_receive_time.pop_front();
+
+    const fake_tx& tx = add_tx();
+    if (incremental)
+      m_picks.add(tx.entry, tx.weight, tx.fee, tx.tx, []() { return true; }, false);
+    if (!incremental || !m_picks.valid(m_params))
+      if (!pick())
+        return false;
+
+    cryptonote::block bl;
+    size_t total_weight;
+    uint64_t fee, expected_reward;
+    m_picks.get(bl, total_weight, fee, expected_reward);
+    return !bl.tx_hashes.empty();
+  }
+
+private:
+  struct fake_tx
+  {
+    cryptonote::tx_by_fee_and_receive_time_entry entry;
+    size_t weight;
+    uint64_t fee;
+    cryptonote::transaction_prefix tx;
+  };
+
+  const fake_tx& add_tx()
+  {
+    crypto::hash id;
+    for (size_t i = 0; i < sizeof(id.data); ++i)
+      id.data[i] = m_rng();
+    cryptonote::txin_to_key in;
+    for (size_t i = 0; i < sizeof(in.k_image.data); ++i)
+      in.k_image.data[i] = m_rng();
+
+    fake_tx& tx = m_txs[id];
+    tx.weight = 1500 + m_rng() % 2000;
+    tx.fee = tx.weight * (1 + m_rng() % 100) * 1000;
+    tx.entry = {std::make_tuple(false, tx.fee / (double)tx.weight, (std::time_t)m_time++), id};
+    tx.tx.vin.push_back(in);
+    m_sorted.insert(tx.entry);
+    m_by_receive_time.push_back(id);
+    return tx;
+  }
+
+  bool pick()
+  {
+    if (!m_picks.reset(m_params))
+      return false;
+    for (const auto& entry : m_sorted)
+    {
+      const fake_tx& tx = m_txs[entry.second];
+      m_picks.add(entry, tx.weight, tx.fee, tx.tx, []() { return true; }, true);
+      if (m_picks.full())
+        break;
+    }
+    return true;
+  }
+
+  std::mt19937_64 m_rng;
+  uint64_t m_time = 0;
+  std::unordered_map<crypto::hash, fake_tx> m_txs;
+  cryptonote::sorted_tx_container m_sorted;
+  std::deque<crypto::hash> m_by_receive_time;
+  cryptonote::block_template_txs::params m_params;
+  cryptonote::block_template_txs m_picks;
+};
@@ -68,3 +68,32 @@ public:
 private:
   data_t m_data;
 };
+
+// cn_gpu on one of the kernels, registered for those the CPU supports
+template<cn_kernel kernel>
+class test_cn_gpu_kernel
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool init()
+  {
+    if (!cn_gpu_hash::kernel_available(kernel))
+      return false;
+
+    for (size_t i = 0; i < sizeof(m_data); ++i)
+      m_data[i] = i * 29;
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hash;
+    m_ctx.hash(m_data, sizeof(m_data), hash.data, kernel);
+    return true;
+  }
+
+private:
+  uint8_t m_data[76];
+  cn_gpu_hash m_ctx;
+};
@@ -53,11 +53,17 @@
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
 #include "rct_mlsag.h"
+#include "rct_batch_verify.h"
 #include "equality.h"
 #include "range_proof.h"
 #include "bulletproof.h"
 #include "crypto_ops.h"
 #include "multiexp.h"
+#include "service_node_store.h"
+#include "service_node_reads.h"
+#include "service_node_swarms.h"
+#include "block_template.h"
+#include "tx_extra_index.h"
 
 namespace po = boost::program_options;
 
@@ -199,6 +205,10 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE0(filter, p, test_sc_reduce32);
   TEST_PERFORMANCE1(filter, p, test_signature, false);
   TEST_PERFORMANCE1(filter, p, test_signature, true);
+  TEST_PERFORMANCE2(filter, p, test_check_signatures, 16, false);
+  TEST_PERFORMANCE2(filter, p, test_check_signatures, 16, true);
+  TEST_PERFORMANCE2(filter, p, test_check_signatures, 256, false);
+  TEST_PERFORMANCE2(filter, p, test_check_signatures, 256, true);
 
   TEST_PERFORMANCE2(filter, p, test_wallet2_expand_subaddresses, 50, 200);
 
@@ -206,12 +216,23 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 1);
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 2);
   TEST_PERFORMANCE1(filter, p, test_cn_slow_hash, 4);
+  TEST_PERFORMANCE1(filter, p, test_cn_gpu_kernel, cn_kernel::soft);
+  if (cn_gpu_hash::kernel_available(cn_kernel::aes))
+    TEST_PERFORMANCE1(filter, p, test_cn_gpu_kernel, cn_kernel::aes);
+  if (cn_gpu_hash::kernel_available(cn_kernel::avx2))
+    TEST_PERFORMANCE1(filter, p, test_cn_gpu_kernel, cn_kernel::avx2);
+  if (cn_gpu_hash::kernel_available(cn_kernel::avx512))
+    TEST_PERFORMANCE1(filter, p, test_cn_gpu_kernel, cn_kernel::avx512);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 16384);
 
   TEST_PERFORMANCE2(filter, p, test_ringct_mlsag, 11, false);
   TEST_PERFORMANCE2(filter, p, test_ringct_mlsag, 11, true);
 
+  TEST_PERFORMANCE3(filter, p, test_rct_batch_verify, 20, 2, 1);
+  TEST_PERFORMANCE3(filter, p, test_rct_batch_verify, 20, 2, 4);
+  TEST_PERFORMANCE3(filter, p, test_rct_batch_verify, 20, 2, 16);
+
   TEST_PERFORMANCE2(filter, p, test_equality, memcmp32, true);
   TEST_PERFORMANCE2(filter, p, test_equality, memcmp32, false);
   TEST_PERFORMANCE2(filter, p, test_equality, verify32, false);
@@ -544,6 +565,30 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE3(filter, p, test_multiexp, multiexp_pippenger, 4096, 9);
 #endif
 
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 100, true);
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 100, false);
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 1000, true);
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 1000, false);
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 5000, true);
+  TEST_PERFORMANCE2(filter, p, test_service_node_store, 5000, false);
+
+  TEST_PERFORMANCE2(filter, p, test_service_node_reads, false, false);
+  TEST_PERFORMANCE2(filter, p, test_service_node_reads, true, true);
+  TEST_PERFORMANCE2(filter, p, test_service_node_reads, true, false);
+
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 10000, false);
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 10000, true);
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 25000, false);
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 25000, true);
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 50000, false);
+  TEST_PERFORMANCE2(filter, p, test_swarm_changes, 50000, true);
+
+  TEST_PERFORMANCE2(filter, p, test_block_template, 10000, false);
+  TEST_PERFORMANCE2(filter, p, test_block_template, 10000, true);
+
+  TEST_PERFORMANCE1(filter, p, test_tx_extra_lookups, false);
+  TEST_PERFORMANCE1(filter, p, test_tx_extra_lookups, true);
+
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
   return 0;
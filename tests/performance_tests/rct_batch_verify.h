@@ -0,0 +1,95 @@
+// Copyright (c) 2014-2019, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "ringct/rctSigs.h"
+#include "common/threadpool.h"
+#include "device/device.hpp"
+
+// Verifies the MLSAGs of a block of n_txes transactions, each spending
+// n_inputs with a ring of 11, as Blockchain::handle_block_to_main_chain
+// does: all of them in one batch on a threadpool of the given size.
+template<size_t n_txes, size_t n_inputs, unsigned threads>
+class test_rct_batch_verify
+{
+public:
+  static const size_t loop_count = 10;
+  static const size_t mixin = 10;
+
+  ~test_rct_batch_verify()
+  {
+    tools::threadpool &tpool = tools::threadpool::getInstance();
+    tpool.destroy();
+    tpool.create(0);
+  }
+
+  bool init()
+  {
+    tools::threadpool &tpool = tools::threadpool::getInstance();
+    tpool.destroy();
+    tpool.create(threads);
+
+    const rct::RCTConfig rct_config { rct::RangeProofPaddedBulletproof, 2 };
+    rcts.resize(n_txes);
+    for (size_t n = 0; n < n_txes; ++n)
+    {
+      rct::ctkeyV sc, pc;
+      rct::ctkey sctmp, pctmp;
+      std::vector<rct::xmr_amount> inamounts, outamounts;
+      rct::keyV destinations, amount_keys;
+      rct::key Sk, Pk;
+      for (size_t i = 0; i < n_inputs; ++i)
+      {
+        inamounts.push_back(1000);
+        std::tie(sctmp, pctmp) = rct::ctskpkGen(inamounts.back());
+        sc.push_back(sctmp);
+        pc.push_back(pctmp);
+      }
+      for (size_t i = 0; i < 2; ++i)
+      {
+        outamounts.push_back(n_inputs * 1000 / 2 - 5);
+        amount_keys.push_back(rct::hash_to_scalar(rct::zero()));
+        rct::skpkGen(Sk, Pk);
+        destinations.push_back(Pk);
+      }
+      rcts[n] = rct::genRctSimple(rct::zero(), sc, pc, destinations, inamounts, outamounts, amount_keys, NULL, NULL, 10, mixin, rct_config, hw::get_device("default"));
+      rcts_ptrs.push_back(&rcts[n]);
+    }
+    return rct::verRctNonSemanticsSimple(rcts_ptrs);
+  }
+
+  bool test()
+  {
+    return rct::verRctNonSemanticsSimple(rcts_ptrs);
+  }
+
+private:
+  std::vector<rct::rctSig> rcts;
+  std::vector<const rct::rctSig*> rcts_ptrs;
+};
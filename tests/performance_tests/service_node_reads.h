@@ -0,0 +1,228 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include <boost/thread/recursive_mutex.hpp>
+
+#include "blockchain_db/testdb.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/service_node_deregister.h"
+#include "cryptonote_core/service_node_list.h"
+#include "cryptonote_core/tx_pool.h"
+#include "serialization/binary_utils.h"
+
+// Service node queries (as made by RPC and uptime proof handling) against a
+// service_node_list loaded with a few thousand nodes, either idle or while
+// another thread keeps importing blocks through block_added.
+//
+// With locked, each query and each imported block take one mutex, as reads
+// and block_added shared m_sn_mutex before the list published its state:
+// that is the baseline the lock-free reads are measured against.
+template<bool importing, bool locked>
+class test_service_node_reads
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t nodes = 2000;
+  static const size_t lookups = 100;
+  static const uint64_t start_height = 100;
+  static const size_t warmup_blocks = 10;
+  static const uint8_t hf_version = 19;
+
+  test_service_node_reads()
+    : m_mempool(m_blockchain)
+    , m_service_node_list(m_blockchain)
+    , m_blockchain(m_mempool, m_service_node_list, m_deregister_vote_pool)
+  {
+  }
+
+  ~test_service_node_reads()
+  {
+    m_stop = true;
+    if (m_importer.joinable())
+      m_importer.join();
+    // the db goes away with the blockchain, before the list stores itself
+    m_service_node_list.set_db_pointer(nullptr);
+  }
+
+  bool init()
+  {
+    service_nodes::service_node_list::data_members_for_serialization data;
+    for (size_t n = 0; n < nodes; ++n)
+    {
+      service_nodes::service_node_list::node_info_for_serialization entry;
+      entry.key = rand_pubkey();
+      entry.info = make_info(n);
+      data.infos.push_back(entry);
+      m_pubkeys.push_back(entry.key);
+    }
+    data.height = start_height;
+
+    std::string blob;
+    if (!::serialization::dump_binary(data, blob))
+      return false;
+
+    m_db = new chain_db(blob);
+    m_service_node_list.set_db_pointer(m_db);
+    m_blockchain.hook_init(m_service_node_list);
+    static const std::pair<uint8_t, uint64_t> hard_forks[] = { std::make_pair((uint8_t)hf_version, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0) };
+    static const cryptonote::test_options options = { hard_forks, 0 };
+    if (!m_blockchain.init(m_db, cryptonote::FAKECHAIN, true, &options, 1))
+      return false;
+    if (m_service_node_list.get_state()->infos.size() != nodes)
+      return false;
+
+    // so there are quorums to look up
+    for (size_t i = 0; i < warmup_blocks; ++i)
+      import_block();
+
+    if (importing)
+      m_importer = std::thread([this]() { while (!m_stop) import_block(); });
+    return true;
+  }
+
+  bool test()
+  {
+    size_t found = 0;
+    for (size_t i = 0; i < lookups; ++i)
+    {
+      const crypto::public_key& pubkey = m_pubkeys[(m_next++ * 7919) % nodes];
+      std::unique_lock<boost::recursive_mutex> lock = lock_list();
+      found += m_service_node_list.is_service_node(pubkey);
+    }
+
+    std::unique_lock<boost::recursive_mutex> lock = lock_list();
+    const uint64_t height = m_service_node_list.get_state()->height - 1;
+    const std::shared_ptr<const service_nodes::quorum_state> quorum = m_service_node_list.get_quorum_state(height);
+    return found == lookups && quorum && !quorum->quorum_nodes.empty();
+  }
+
+private:
+  // Just enough of a chain for Blockchain and the list: blocks only have
+  // heights and hashes, and the list comes from a stored state blob.
+  class chain_db : public cryptonote::BaseTestDB
+  {
+  public:
+    chain_db(const std::string& service_node_data) : m_height(start_height), m_service_node_data(service_node_data) { m_open = true; }
+
+    virtual uint64_t height() const override { return m_height; }
+    virtual uint8_t get_hard_fork_version(uint64_t height) const override { return hf_version; }
+    virtual cryptonote::block get_top_block() const override
+    {
+      cryptonote::block b = {};
+      b.major_version = hf_version;
+      return b;
+    }
+    virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const override
+    {
+      crypto::hash hash = crypto::null_hash;
+      *(uint64_t*)&hash = height + 1;
+      return hash;
+    }
+    virtual bool get_service_node_data(std::string& data) override
+    {
+      data = m_service_node_data;
+      return true;
+    }
+
+    void add_block() { ++m_height; }
+
+  private:
+    std::atomic<uint64_t> m_height; // bumped by the importer while readers ask
+    const std::string m_service_node_data;
+  };
+
+  static crypto::public_key rand_pubkey()
+  {
+    crypto::public_key pkey;
+    crypto::secret_key skey;
+    crypto::generate_keys(pkey, skey);
+    return pkey;
+  }
+
+  static service_nodes::service_node_info make_info(size_t n)
+  {
+    service_nodes::service_node_info info = {};
+    info.version = service_nodes::service_node_info::version_1_swarms;
+    // stakes unlock after a few dozen blocks on FAKECHAIN, so the nodes are
+    // registered past any height the importer gets to, to never expire
+    info.registration_height = std::numeric_limits<uint64_t>::max() / 2;
+    info.last_reward_block_height = n;
+    info.last_reward_transaction_index = 0;
+    info.staking_requirement = 100000 * COIN;
+    info.total_contributed = info.staking_requirement;
+    info.total_reserved = info.staking_requirement;
+    info.swarm_id = n / service_nodes::IDEAL_SWARM_SIZE;
+    service_nodes::service_node_info::contribution contribution(info.staking_requirement, { rand_pubkey(), rand_pubkey() });
+    contribution.amount = contribution.reserved;
+    info.contributors.push_back(contribution);
+    info.operator_address = contribution.address;
+    return info;
+  }
+
+  std::unique_lock<boost::recursive_mutex> lock_list()
+  {
+    return locked ? std::unique_lock<boost::recursive_mutex>(m_list_mutex) : std::unique_lock<boost::recursive_mutex>();
+  }
+
+  // As Blockchain does once a block is stored: each block rewards the
+  // current winner, changing one node and adding a quorum.
+  void import_block()
+  {
+    std::unique_lock<boost::recursive_mutex> lock = lock_list();
+    const uint64_t height = m_db->height();
+    cryptonote::block b = {};
+    b.major_version = hf_version;
+    cryptonote::txin_gen in;
+    in.height = height;
+    b.miner_tx.vin.push_back(in);
+    cryptonote::add_service_node_winner_to_tx_extra(b.miner_tx.extra, m_service_node_list.select_winner());
+    m_db->add_block();
+    m_service_node_list.block_added(b, {});
+  }
+
+  service_nodes::deregister_vote_pool m_deregister_vote_pool;
+  cryptonote::tx_memory_pool m_mempool;
+  service_nodes::service_node_list m_service_node_list;
+  cryptonote::Blockchain m_blockchain;
+  chain_db* m_db = nullptr; // owned by m_blockchain
+  std::vector<crypto::public_key> m_pubkeys;
+  boost::recursive_mutex m_list_mutex;
+  std::atomic<bool> m_stop{false};
+  std::thread m_importer;
+  size_t m_next = 0;
+};
@@ -0,0 +1,196 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <boost/filesystem.hpp>
+#include "crypto/crypto.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+#include "cryptonote_core/service_node_list.h"
+#include "serialization/binary_utils.h"
+
+// Per-block persistence cost of the service node list on a throwaway lmdb:
+// the full state blob that used to be rewritten on every block, against the
+// delta and info rows of a block touching a few nodes. Each call is one block's
+// batch txn, committed without fsync so the page writes are what gets measured.
+template<size_t nodes, bool full>
+class test_service_node_store
+{
+public:
+  static const size_t loop_count = nodes < 1000 ? 1000 : 100;
+  static const size_t quorum_count = 60;
+  static const size_t changed_nodes = 3;
+
+  typedef service_nodes::service_node_list list;
+
+  test_service_node_store(): m_dir(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()), m_db(new cryptonote::BlockchainLMDB()) {}
+
+  ~test_service_node_store()
+  {
+    if (m_db->is_open())
+      m_db->close();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_dir, ec);
+  }
+
+  bool init()
+  {
+    for (size_t n = 0; n < nodes; ++n)
+    {
+      list::node_info_for_serialization entry;
+      entry.key = rand_pubkey();
+      entry.info = make_info(n);
+      m_full.infos.push_back(entry);
+    }
+
+    for (size_t h = 0; h < quorum_count; ++h)
+    {
+      list::quorum_state_for_serialization quorum;
+      quorum.height = h;
+      for (size_t i = 0; i < std::min(nodes, service_nodes::QUORUM_SIZE); ++i)
+        quorum.state.quorum_nodes.push_back(m_full.infos[i].key);
+      for (size_t i = 0; i < std::min(nodes, service_nodes::MIN_NODES_TO_TEST); ++i)
+        quorum.state.nodes_to_test.push_back(m_full.infos[nodes - 1 - i].key);
+      m_full.quorum_states.push_back(quorum);
+    }
+
+    for (size_t h = 0; h < service_nodes::ROLLBACK_EVENT_EXPIRATION_BLOCKS; ++h)
+      for (size_t i = 0; i < changed_nodes; ++i)
+        m_full.events.push_back(list::rollback_change(h, m_full.infos[i].key, m_full.infos[i].info));
+    m_full.height = quorum_count;
+
+    m_delta.height = quorum_count;
+    m_delta.quorum_states.push_back(m_full.quorum_states.back());
+    for (size_t i = 0; i < changed_nodes; ++i)
+      m_delta.events.push_back(list::rollback_change(quorum_count, m_full.infos[i].key, m_full.infos[i].info));
+
+    try
+    {
+      m_db->open(m_dir.string(), DBF_FAST);
+
+      // Both layouts start from a stored list, as on a synced node
+      m_db->batch_start();
+      if (full)
+      {
+        std::string blob;
+        if (!::serialization::dump_binary(m_full, blob))
+          return false;
+        m_db->set_service_node_data(blob);
+      }
+      else
+      {
+        for (auto& entry : m_full.infos)
+        {
+          std::string blob;
+          if (!::serialization::dump_binary(entry.info, blob))
+            return false;
+          m_db->set_service_node_info(entry.key, blob);
+        }
+      }
+      m_db->batch_stop();
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "Failed to set up the service node store db: " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::string blob;
+    std::vector<std::string> info_blobs;
+    if (full)
+    {
+      ++m_full.height;
+      if (!::serialization::dump_binary(m_full, blob))
+        return false;
+    }
+    else
+    {
+      ++m_delta.height;
+      if (!::serialization::dump_binary(m_delta, blob))
+        return false;
+      info_blobs.resize(changed_nodes);
+      for (size_t i = 0; i < changed_nodes; ++i)
+        if (!::serialization::dump_binary(m_full.infos[i].info, info_blobs[i]))
+          return false;
+    }
+
+    m_db->batch_start();
+    if (full)
+    {
+      m_db->set_service_node_data(blob);
+    }
+    else
+    {
+      m_db->set_service_node_block_delta(m_delta.height, blob);
+      for (size_t i = 0; i < changed_nodes; ++i)
+        m_db->set_service_node_info(m_full.infos[i].key, info_blobs[i]);
+    }
+    m_db->batch_stop();
+    return true;
+  }
+
+private:
+  static crypto::public_key rand_pubkey()
+  {
+    crypto::public_key pkey;
+    crypto::secret_key skey;
+    crypto::generate_keys(pkey, skey);
+    return pkey;
+  }
+
+  static service_nodes::service_node_info make_info(size_t n)
+  {
+    service_nodes::service_node_info info = {};
+    info.version = service_nodes::service_node_info::version_1_swarms;
+    info.registration_height = n;
+    info.last_reward_block_height = n;
+    info.last_reward_transaction_index = 0;
+    info.staking_requirement = 100000 * COIN;
+    info.total_contributed = info.staking_requirement;
+    info.total_reserved = info.staking_requirement;
+    info.swarm_id = n / service_nodes::IDEAL_SWARM_SIZE;
+    for (size_t c = 0; c < 4; ++c)
+    {
+      service_nodes::service_node_info::contribution contribution(info.staking_requirement / 4, { rand_pubkey(), rand_pubkey() });
+      contribution.amount = contribution.reserved;
+      info.contributors.push_back(contribution);
+    }
+    info.operator_address = info.contributors[0].address;
+    return info;
+  }
+
+  list::data_members_for_serialization m_full;
+  list::block_delta_for_serialization m_delta;
+  boost::filesystem::path m_dir;
+  std::unique_ptr<cryptonote::BlockchainDB> m_db;
+};
@@ -0,0 +1,116 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+
+#include "crypto/crypto.h"
+#include "cryptonote_core/service_node_swarm.h"
+
+// One block's worth of swarm updates on a network of `nodes` service nodes,
+// with a few registrations and expiries: either rebuilding the swarms from
+// every node and running calc_swarm_changes, as update_swarms does before
+// HF_VERSION_SWARM_INDEX, or through the swarm_index kept between blocks.
+template<size_t nodes, bool incremental>
+class test_swarm_changes
+{
+public:
+  static const size_t loop_count = incremental ? 1000 : 50;
+  static const size_t changes_per_block = 3;
+
+  bool init()
+  {
+    m_rng.seed(nodes);
+    for (size_t n = 0; n < nodes; ++n)
+      m_index.set(register_node(), service_nodes::UNASSIGNED_SWARM_ID);
+
+    // The starting swarms come from the index either way; assigning a whole
+    // network one node at a time through the reference would take minutes
+    std::vector<std::pair<crypto::public_key, service_nodes::swarm_id_t>> changes;
+    m_index.calc_changes(m_rng(), changes);
+    for (const auto& change : changes)
+      m_nodes[change.first] = change.second;
+    m_pubkeys.reserve(m_nodes.size());
+    for (const auto& node : m_nodes)
+      m_pubkeys.push_back(node.first);
+    return true;
+  }
+
+  bool test()
+  {
+    for (size_t i = 0; i < changes_per_block; ++i)
+    {
+      const size_t expired = m_rng() % m_pubkeys.size();
+      m_nodes.erase(m_pubkeys[expired]);
+      if (incremental)
+        m_index.remove(m_pubkeys[expired]);
+      m_pubkeys[expired] = register_node();
+      if (incremental)
+        m_index.set(m_pubkeys[expired], service_nodes::UNASSIGNED_SWARM_ID);
+    }
+
+    const uint64_t seed = m_rng();
+    if (incremental)
+    {
+      std::vector<std::pair<crypto::public_key, service_nodes::swarm_id_t>> changes;
+      m_index.calc_changes(seed, changes);
+      for (const auto& change : changes)
+        m_nodes[change.first] = change.second;
+    }
+    else
+    {
+      service_nodes::swarm_snode_map_t swarms;
+      for (const auto& node : m_nodes)
+        swarms[node.second].push_back(node.first);
+      service_nodes::calc_swarm_changes(swarms, seed);
+      for (const auto& swarm : swarms)
+        for (const crypto::public_key& pubkey : swarm.second)
+          m_nodes[pubkey] = swarm.first;
+    }
+    return m_nodes.size() == nodes;
+  }
+
+private:
+  crypto::public_key register_node()
+  {
+    crypto::public_key pubkey;
+    for (size_t i = 0; i < sizeof(pubkey.data); ++i)
+      pubkey.data[i] = m_rng();
+    m_nodes[pubkey] = service_nodes::UNASSIGNED_SWARM_ID;
+    return pubkey;
+  }
+
+  std::mt19937_64 m_rng;
+  std::unordered_map<crypto::public_key, service_nodes::swarm_id_t> m_nodes;
+  std::vector<crypto::public_key> m_pubkeys;
+  service_nodes::swarm_index m_index;
+};
@@ -66,3 +66,37 @@ private:
   crypto::hash message;
   crypto::signature m_signature;
 };
+
+template<size_t batch, bool batched>
+class test_check_signatures
+{
+public:
+  static const size_t loop_count = 10000 / batch;
+
+  bool init()
+  {
+    for (size_t i = 0; i < batch; ++i)
+    {
+      crypto::signature_check check;
+      crypto::secret_key sec;
+      crypto::generate_keys(check.pub, sec);
+      check.prefix_hash = crypto::rand<crypto::hash>();
+      crypto::generate_signature(check.prefix_hash, check.pub, sec, check.sig);
+      m_checks.push_back(check);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    if (batched)
+      return crypto::check_signatures(m_checks);
+    for (const crypto::signature_check& check : m_checks)
+      if (!crypto::check_signature(check.prefix_hash, check.pub, check.sig))
+        return false;
+    return true;
+  }
+
+private:
+  std::vector<crypto::signature_check> m_checks;
+};
@@ -0,0 +1,81 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+
+// The tx_extra lookups block import makes for a staking transaction, either
+// parsing the extra for each lookup or parsing it once into a tx_extra_index.
+template<bool indexed>
+class test_tx_extra_lookups
+{
+public:
+  static const size_t loop_count = 100000;
+
+  bool init()
+  {
+    crypto::public_key pkey;
+    crypto::secret_key skey;
+    crypto::generate_keys(pkey, skey);
+
+    cryptonote::account_public_address address = { pkey, pkey };
+    crypto::signature signature = {};
+    cryptonote::add_tx_pub_key_to_extra(m_extra, pkey);
+    cryptonote::add_service_node_pubkey_to_tx_extra(m_extra, pkey);
+    cryptonote::add_service_node_contributor_to_tx_extra(m_extra, address);
+    cryptonote::add_tx_secret_key_to_tx_extra(m_extra, skey);
+    if (!cryptonote::add_service_node_register_to_tx_extra(m_extra, { address, address }, STAKING_PORTIONS / 2, { STAKING_PORTIONS / 2, STAKING_PORTIONS / 2 }, 0, signature))
+      return false;
+    return cryptonote::add_burned_amount_to_tx_extra(m_extra, COIN);
+  }
+
+  bool test()
+  {
+    return indexed ? lookup(cryptonote::tx_extra_index(m_extra)) : lookup(m_extra);
+  }
+
+private:
+  template<typename Extra>
+  static bool lookup(const Extra& extra)
+  {
+    crypto::public_key pubkey;
+    cryptonote::tx_extra_service_node_register registration;
+    cryptonote::account_public_address address;
+    crypto::secret_key key;
+    return cryptonote::get_service_node_pubkey_from_tx_extra(extra, pubkey) &&
+      cryptonote::get_service_node_register_from_tx_extra(extra, registration) &&
+      cryptonote::get_service_node_contributor_from_tx_extra(extra, address) &&
+      cryptonote::get_tx_secret_key_from_tx_extra(extra, key) &&
+      cryptonote::get_burned_amount_from_tx_extra(extra) == COIN &&
+      cryptonote::get_tx_pub_key_from_extra(extra) != crypto::null_pkey;
+  }
+
+  std::vector<uint8_t> m_extra;
+};
@@ -85,3 +85,94 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+static void add_span(cryptonote::block_queue &bq, uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, size_t block_size, float rate, float latency)
+{
+  const size_t size = nblocks * block_size;
+  const float seconds = latency + size / rate;
+  bq.add_blocks(height, std::vector<cryptonote::block_complete_entry>(nblocks), connection_id, size / seconds, size);
+}
+
+TEST(block_queue, sync_stats)
+{
+  cryptonote::block_queue bq;
+  cryptonote::block_queue::peer_sync_stats stats;
+  ASSERT_FALSE(bq.get_peer_sync_stats(uuid1(), stats));
+
+  uint64_t height = 0;
+  for (uint64_t nblocks: {10, 40, 20, 80, 30})
+  {
+    add_span(bq, height, nblocks, uuid1(), 1000, 100000.0f, 0.5f);
+    height += nblocks;
+  }
+  ASSERT_TRUE(bq.get_peer_sync_stats(uuid1(), stats));
+  ASSERT_NEAR(stats.rate, 100000.0f, 1000.0f);
+  ASSERT_NEAR(stats.latency, 0.5f, 0.01f);
+  ASSERT_NEAR(stats.block_size, 1000.0f, 1.0f);
+  ASSERT_EQ(stats.nblocks, 180);
+  ASSERT_EQ(stats.nspans, 5);
+  ASSERT_EQ(stats.noverdue, 0);
+
+  // spans all alike leave no way to tell latency from rate
+  for (int i = 0; i < 5; ++i)
+  {
+    add_span(bq, height, 20, uuid2(), 1000, 100000.0f, 0.5f);
+    height += 20;
+  }
+  ASSERT_TRUE(bq.get_peer_sync_stats(uuid2(), stats));
+  ASSERT_NEAR(stats.rate, 20000.0f / 0.7f, 100.0f);
+  ASSERT_EQ(stats.latency, 0.0f);
+
+  bq.add_overdue_span(uuid2());
+  ASSERT_TRUE(bq.get_peer_sync_stats(uuid2(), stats));
+  ASSERT_EQ(stats.noverdue, 1);
+
+  bq.flush_stale_spans({uuid1()});
+  ASSERT_TRUE(bq.get_peer_sync_stats(uuid1(), stats));
+  ASSERT_FALSE(bq.get_peer_sync_stats(uuid2(), stats));
+}
+
+TEST(block_queue, span_size)
+{
+  cryptonote::block_queue bq;
+
+  // not enough spans yet
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 4, 100), 20);
+  add_span(bq, 0, 20, uuid1(), 10000, 1000000.0f, 0.1f);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 4, 100), 20);
+
+  // fast peer: capped
+  add_span(bq, 20, 40, uuid1(), 10000, 1000000.0f, 0.1f);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 4, 100), 100);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 4, 1000), 200);
+
+  // slow peer: at least the minimum
+  add_span(bq, 60, 20, uuid2(), 10000, 10000.0f, 0.1f);
+  add_span(bq, 80, 40, uuid2(), 10000, 10000.0f, 0.1f);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 4, 100), 4);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 1, 100), 2);
+
+  ASSERT_NEAR(bq.get_expected_span_time(uuid1(), 100), 1.1f, 0.01f);
+  ASSERT_NEAR(bq.get_expected_span_time(uuid2(), 100), 100.1f, 0.5f);
+}
+
+TEST(block_queue, next_span_overdue)
+{
+  cryptonote::block_queue bq;
+  const boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+  add_span(bq, 1000, 20, uuid1(), 10000, 1000000.0f, 0.1f);
+  add_span(bq, 1020, 40, uuid1(), 10000, 1000000.0f, 0.1f);
+  add_span(bq, 1060, 20, uuid2(), 10000, 100000.0f, 0.1f);
+  add_span(bq, 1080, 40, uuid2(), 10000, 100000.0f, 0.1f);
+
+  // 20 blocks from uuid2 are expected to take 2.1 seconds
+  bq.add_blocks(0, 20, uuid2(), t0);
+  ASSERT_FALSE(bq.is_next_span_overdue(uuid1(), t0 + boost::posix_time::seconds(1)));
+  ASSERT_TRUE(bq.is_next_span_overdue(uuid1(), t0 + boost::posix_time::seconds(5)));
+  ASSERT_FALSE(bq.is_next_span_overdue(uuid2(), t0 + boost::posix_time::seconds(5)));
+
+  // a slower peer isn't asked
+  bq.flush_spans(uuid2());
+  bq.add_blocks(0, 20, uuid1(), t0);
+  ASSERT_FALSE(bq.is_next_span_overdue(uuid2(), t0 + boost::posix_time::seconds(60)));
+}
@@ -28,8 +28,11 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 #include <cstdio>
 #include <iostream>
+#include <memory>
+#include <set>
 #include <chrono>
 #include <thread>
 
@@ -251,6 +254,93 @@ TYPED_TEST(BlockchainDBTest, OpenAndClose)
   ASSERT_NO_THROW(this->m_db->close());
 }
 
+TYPED_TEST(BlockchainDBTest, ResizeStats)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_resize_stats before = this->m_db->get_resize_stats();
+  ASSERT_GT(before.used_size, 0);
+  ASSERT_LE(before.used_size, before.map_size);
+  ASSERT_EQ(before.resizes, 0);
+  ASSERT_EQ(before.stall_time, 0);
+
+  ASSERT_TRUE(this->m_db->batch_start(2, 8192));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_NO_THROW(this->m_db->batch_stop());
+
+  db_resize_stats after = this->m_db->get_resize_stats();
+  ASSERT_GT(after.used_size, before.used_size);
+  ASSERT_LE(after.used_size, after.map_size);
+
+  ASSERT_NO_THROW(this->m_db->close());
+}
+
+TYPED_TEST(BlockchainDBTest, ResizeAhead)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // resizes need 1 GiB free on the disk, even though the file is sparse
+  if (boost::filesystem::space(tempPath).available < (2ull << 30))
+  {
+    std::cerr << "Not enough free disk space to test resizing" << std::endl;
+    ASSERT_NO_THROW(this->m_db->close());
+    return;
+  }
+
+  TypeParam *db = static_cast<TypeParam*>(this->m_db);
+  const db_resize_stats before = db->get_resize_stats();
+
+  // the map has room for what's wanted
+  ASSERT_FALSE(db->grow_map_ahead(0));
+
+  // more is wanted than is free, but a txn stays open past the longest stall
+  {
+    mdb_txn_safe active_txn;
+    ASSERT_FALSE(db->grow_map_ahead(before.map_size));
+  }
+  db_resize_stats stats = db->get_resize_stats();
+  ASSERT_EQ(stats.map_size, before.map_size);
+  ASSERT_EQ(stats.deferred, 1);
+  ASSERT_EQ(stats.resizes, 0);
+
+  // a txn finishing within it holds the resize up until it's done
+  std::unique_ptr<mdb_txn_safe> txn(new mdb_txn_safe());
+  std::thread reader([&txn]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    txn.reset();
+  });
+  const bool grown = db->grow_map_ahead(before.map_size);
+  reader.join();
+  ASSERT_TRUE(grown);
+  stats = db->get_resize_stats();
+  ASSERT_GE(stats.map_size, 2 * before.map_size);
+  ASSERT_EQ(stats.deferred, 1);
+  ASSERT_EQ(stats.resizes, 1);
+  ASSERT_GT(stats.max_stall_time, 0);
+
+  // it can now be written to past the old size
+  ASSERT_TRUE(db->batch_start(2, 8192));
+  ASSERT_NO_THROW(db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(db->batch_stop());
+
+  ASSERT_NO_THROW(this->m_db->close());
+}
+
 TYPED_TEST(BlockchainDBTest, AddBlock)
 {
 
@@ -341,4 +431,145 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1].first), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, ServiceNodeSnapshots)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+
+  db_wtxn_guard guard(this->m_db);
+
+  uint64_t height = 100;
+  std::string data;
+  ASSERT_FALSE(this->m_db->get_service_node_snapshot(height, data));
+
+  ASSERT_NO_THROW(this->m_db->set_service_node_snapshot(10, "ten"));
+  ASSERT_NO_THROW(this->m_db->set_service_node_snapshot(20, "twenty"));
+  ASSERT_NO_THROW(this->m_db->set_service_node_snapshot(30, "thirty"));
+
+  // the newest snapshot at or below the requested height is returned
+  height = 25;
+  ASSERT_TRUE(this->m_db->get_service_node_snapshot(height, data));
+  ASSERT_EQ(20, height);
+  ASSERT_EQ("twenty", data);
+
+  height = 30;
+  ASSERT_TRUE(this->m_db->get_service_node_snapshot(height, data));
+  ASSERT_EQ(30, height);
+  ASSERT_EQ("thirty", data);
+
+  height = 1000;
+  ASSERT_TRUE(this->m_db->get_service_node_snapshot(height, data));
+  ASSERT_EQ(30, height);
+
+  height = 5;
+  ASSERT_FALSE(this->m_db->get_service_node_snapshot(height, data));
+
+  // clearing the current state leaves snapshots alone
+  ASSERT_NO_THROW(this->m_db->clear_service_node_deltas());
+  ASSERT_NO_THROW(this->m_db->remove_service_node_snapshots(0, 30));
+  height = 29;
+  ASSERT_FALSE(this->m_db->get_service_node_snapshot(height, data));
+  height = 30;
+  ASSERT_TRUE(this->m_db->get_service_node_snapshot(height, data));
+  ASSERT_EQ("thirty", data);
+}
+
+TYPED_TEST(BlockchainDBTest, PowCache)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+
+  db_wtxn_guard guard(this->m_db);
+
+  crypto::hash id_a, id_b, pow_a, pow_b, pow;
+  memset(&id_a, 0x11, sizeof(id_a));
+  memset(&id_b, 0x22, sizeof(id_b));
+  memset(&pow_a, 0xaa, sizeof(pow_a));
+  memset(&pow_b, 0xbb, sizeof(pow_b));
+
+  ASSERT_FALSE(this->m_db->get_pow_cache_entry(10, id_a, pow));
+
+  // two competing blocks at the same height
+  ASSERT_NO_THROW(this->m_db->add_pow_cache_entry(10, id_a, pow_a));
+  ASSERT_NO_THROW(this->m_db->add_pow_cache_entry(10, id_b, pow_b));
+  ASSERT_NO_THROW(this->m_db->add_pow_cache_entry(10, id_b, pow_b));
+  ASSERT_NO_THROW(this->m_db->add_pow_cache_entry(20, id_a, pow_a));
+
+  ASSERT_TRUE(this->m_db->get_pow_cache_entry(10, id_a, pow));
+  ASSERT_HASH_EQ(pow_a, pow);
+  ASSERT_TRUE(this->m_db->get_pow_cache_entry(10, id_b, pow));
+  ASSERT_HASH_EQ(pow_b, pow);
+  ASSERT_FALSE(this->m_db->get_pow_cache_entry(20, id_b, pow));
+  ASSERT_FALSE(this->m_db->get_pow_cache_entry(11, id_a, pow));
+
+  ASSERT_NO_THROW(this->m_db->remove_pow_cache_entries(0, 20));
+  ASSERT_FALSE(this->m_db->get_pow_cache_entry(10, id_a, pow));
+  ASSERT_FALSE(this->m_db->get_pow_cache_entry(10, id_b, pow));
+  ASSERT_TRUE(this->m_db->get_pow_cache_entry(20, id_a, pow));
+  ASSERT_HASH_EQ(pow_a, pow);
+}
+
+TYPED_TEST(BlockchainDBTest, OutputKeys)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  db_wtxn_guard guard(this->m_db);
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::set<uint64_t> amounts{0};
+  for (const auto &b: this->m_blocks)
+    for (const auto &out: b.first.miner_tx.vout)
+      amounts.insert(out.amount);
+
+  // every output, last first, with the first of each amount asked for twice
+  std::vector<std::pair<uint64_t, uint64_t>> keys;
+  for (uint64_t amount: amounts)
+  {
+    const uint64_t n = this->m_db->get_num_outputs(amount);
+    for (uint64_t i = 0; i < n; ++i)
+      keys.emplace_back(amount, i);
+    if (n > 0)
+      keys.emplace_back(amount, 0);
+  }
+  ASSERT_FALSE(keys.empty());
+  std::reverse(keys.begin(), keys.end());
+
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_keys(keys, outputs));
+  ASSERT_EQ(keys.size(), outputs.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    const output_data_t od = this->m_db->get_output_key(keys[i].first, keys[i].second);
+    ASSERT_EQ(od.pubkey, outputs[i].pubkey);
+    ASSERT_EQ(od.height, outputs[i].height);
+    ASSERT_EQ(od.commitment, outputs[i].commitment);
+  }
+
+  // a missing output throws, or ends a partial result
+  const uint64_t amount = keys[0].first;
+  keys.insert(keys.begin() + 1, std::make_pair(amount, this->m_db->get_num_outputs(amount)));
+  ASSERT_THROW(this->m_db->get_output_keys(keys, outputs), OUTPUT_DNE);
+  ASSERT_NO_THROW(this->m_db->get_output_keys(keys, outputs, true));
+  ASSERT_EQ(1, outputs.size());
+}
+
 }  // anonymous namespace
@@ -0,0 +1,147 @@
+// Copyright (c) 2019, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "gtest/gtest.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "blockchain_db/testdb.h"
+
+namespace
+{
+
+class TestDB: public cryptonote::BaseTestDB
+{
+public:
+  TestDB(): syncs(0), fail_syncs(false), hold_syncs(false), batches_committed(0), batches_aborted(0) { m_open = true; }
+
+  virtual void sync() override
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (hold_syncs)
+      cond.wait(lock);
+    ++syncs;
+    if (fail_syncs)
+      throw std::runtime_error("sync failed");
+  }
+  virtual void batch_stop() override { ++batches_committed; }
+  virtual void batch_abort() override { ++batches_aborted; }
+
+  void hold(bool held)
+  {
+    boost::lock_guard<boost::mutex> lock(mutex);
+    hold_syncs = held;
+    cond.notify_all();
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable cond;
+  size_t syncs;
+  bool fail_syncs;
+  bool hold_syncs;
+  size_t batches_committed;
+  size_t batches_aborted;
+};
+
+// the objects Blockchain is built with, in the order core makes them
+struct test_blockchain
+{
+  test_blockchain(): txpool(bc), service_node_list(bc), bc(txpool, service_node_list, deregister_vote_pool), db(new TestDB())
+  {
+    static const std::pair<uint8_t, uint64_t> hard_forks[] = { std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0) };
+    static const cryptonote::test_options options = { hard_forks, 0 };
+    initialized = bc.init(db, cryptonote::FAKECHAIN, true, &options, 0, NULL);
+    bc.set_user_options(1, true, 1, cryptonote::db_sync, true);
+  }
+
+  service_nodes::deregister_vote_pool deregister_vote_pool;
+  cryptonote::tx_memory_pool txpool;
+  service_nodes::service_node_list service_node_list;
+  cryptonote::Blockchain bc;
+  TestDB *db; // owned by bc
+  bool initialized;
+};
+
+}
+
+TEST(blockchain_sync, background_sync)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+  ASSERT_TRUE(chain.bc.wait_for_background_sync());
+  ASSERT_TRUE(chain.bc.start_background_sync());
+  ASSERT_TRUE(chain.bc.wait_for_background_sync());
+  ASSERT_EQ(chain.db->syncs, 1);
+}
+
+TEST(blockchain_sync, one_background_sync_at_a_time)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+  chain.db->hold(true);
+  ASSERT_TRUE(chain.bc.start_background_sync());
+  ASSERT_FALSE(chain.bc.start_background_sync());
+  chain.db->hold(false);
+  ASSERT_TRUE(chain.bc.wait_for_background_sync());
+  ASSERT_EQ(chain.db->syncs, 1);
+  ASSERT_TRUE(chain.bc.start_background_sync());
+  ASSERT_TRUE(chain.bc.wait_for_background_sync());
+  ASSERT_EQ(chain.db->syncs, 2);
+}
+
+TEST(blockchain_sync, background_sync_failure_reported_once)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+  chain.db->fail_syncs = true;
+  ASSERT_TRUE(chain.bc.start_background_sync());
+  ASSERT_FALSE(chain.bc.wait_for_background_sync());
+  ASSERT_TRUE(chain.bc.wait_for_background_sync());
+}
+
+TEST(blockchain_sync, batch_aborted_after_failed_sync)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+  chain.db->fail_syncs = true;
+  ASSERT_TRUE(chain.bc.start_background_sync());
+
+  // as prepare_handle_incoming_blocks leaves it for cleanup
+  chain.txpool.lock();
+  ASSERT_FALSE(chain.bc.cleanup_handle_incoming_blocks());
+  ASSERT_EQ(chain.db->batches_committed, 0);
+  ASSERT_EQ(chain.db->batches_aborted, 1);
+
+  chain.db->fail_syncs = false;
+  chain.txpool.lock();
+  ASSERT_TRUE(chain.bc.cleanup_handle_incoming_blocks());
+  ASSERT_EQ(chain.db->batches_committed, 1);
+  ASSERT_EQ(chain.db->batches_aborted, 1);
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2019, Ryo Currency Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+#include <vector>
+
+#include "crypto/pow_hash/cn_slow_hash.hpp"
+
+namespace
+{
+  const cn_kernel kernels[] = {cn_kernel::soft, cn_kernel::aes, cn_kernel::avx2, cn_kernel::avx512};
+
+  std::vector<uint8_t> make_input(size_t size, uint8_t seed)
+  {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < data.size(); ++i)
+      data[i] = seed + i * 29;
+    return data;
+  }
+
+  // Every kernel the CPU supports has to give the same hashes as the software one
+  template <typename hash_t>
+  void check_kernels()
+  {
+    hash_t ctx;
+    for (size_t size : {43, 76, 200})
+    {
+      for (uint8_t seed = 0; seed < 2; ++seed)
+      {
+        const std::vector<uint8_t> data = make_input(size, seed);
+        uint8_t expected[32];
+        ctx.hash(data.data(), data.size(), expected, cn_kernel::soft);
+        for (cn_kernel kernel : kernels)
+        {
+          if (!hash_t::kernel_available(kernel))
+            continue;
+          uint8_t actual[32];
+          ctx.hash(data.data(), data.size(), actual, kernel);
+          ASSERT_EQ(0, memcmp(expected, actual, 32)) << "kernel " << static_cast<int>(kernel) << ", size " << size;
+        }
+
+        uint8_t actual[32];
+        ctx.hash(data.data(), data.size(), actual);
+        ASSERT_EQ(0, memcmp(expected, actual, 32));
+      }
+    }
+  }
+}
+
+TEST(cn_slow_hash, kernels_match_v1)
+{
+  check_kernels<cn_v1_hash>();
+}
+
+TEST(cn_slow_hash, kernels_match_v7l)
+{
+  check_kernels<cn_v7l_hash>();
+}
+
+TEST(cn_slow_hash, kernels_match_gpu)
+{
+  check_kernels<cn_gpu_hash>();
+}
+
+TEST(cn_slow_hash, best_kernel_available)
+{
+  ASSERT_TRUE(cn_gpu_hash::kernel_available(cn_kernel::soft));
+  ASSERT_TRUE(cn_gpu_hash::kernel_available(cn_gpu_hash::best_kernel()));
+}
@@ -99,3 +99,35 @@ TEST(Crypto, verify_32)
     }
   }
 }
+
+TEST(Crypto, check_signatures)
+{
+  std::vector<crypto::signature_check> checks;
+  for (size_t i = 0; i < 20; ++i)
+  {
+    crypto::secret_key sec;
+    crypto::signature_check check;
+    crypto::generate_keys(check.pub, sec);
+    check.prefix_hash = crypto::rand<crypto::hash>();
+    crypto::generate_signature(check.prefix_hash, check.pub, sec, check.sig);
+    checks.push_back(check);
+  }
+
+  std::vector<bool> results;
+  ASSERT_TRUE(crypto::check_signatures({}, &results));
+  ASSERT_TRUE(results.empty());
+  ASSERT_TRUE(crypto::check_signatures(checks, &results));
+  ASSERT_EQ(results, std::vector<bool>(checks.size(), true));
+
+  // a wrong message, a wrong key and a malformed scalar
+  checks[3].prefix_hash = crypto::rand<crypto::hash>();
+  checks[7].pub = checks[8].pub;
+  memset(&checks[15].sig.r, 0xff, sizeof(checks[15].sig.r));
+  ASSERT_FALSE(crypto::check_signatures(checks, &results));
+  ASSERT_EQ(checks.size(), results.size());
+  for (size_t i = 0; i < checks.size(); ++i)
+  {
+    ASSERT_EQ(crypto::check_signature(checks[i].prefix_hash, checks[i].pub, checks[i].sig), results[i]);
+    ASSERT_EQ(i != 3 && i != 7 && i != 15, results[i]);
+  }
+}
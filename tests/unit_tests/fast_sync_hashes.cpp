@@ -0,0 +1,226 @@
+// Copyright (c) 2019, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+#include "file_io_utils.h"
+#include "cryptonote_core/blockchain.h"
+
+namespace
+{
+  typedef std::vector<std::pair<crypto::hash, crypto::hash>> block_hashes;
+
+  crypto::hash make_hash(uint8_t n)
+  {
+    crypto::hash h;
+    memset(h.data, n, sizeof(h.data));
+    return h;
+  }
+
+  void append_uint32(std::string &data, uint32_t v)
+  {
+    for (int i = 0; i < 4; ++i)
+      data.push_back((v >> (8 * i)) & 0xff);
+  }
+
+  void append_hash(std::string &data, const crypto::hash &h)
+  {
+    data.append(h.data, sizeof(h.data));
+  }
+
+  // the compiled-in format, or the fast sync file format if txs_hashes isn't empty
+  std::string make_data(const block_hashes &hashes, const std::vector<crypto::hash> &txs_hashes)
+  {
+    std::string data;
+    if (!txs_hashes.empty())
+    {
+      data = FAST_SYNC_FILE_MAGIC;
+      append_uint32(data, FAST_SYNC_FILE_VERSION);
+    }
+    append_uint32(data, hashes.size());
+    for (size_t n = 0; n < hashes.size(); ++n)
+    {
+      append_hash(data, hashes[n].first);
+      append_hash(data, hashes[n].second);
+      if (!txs_hashes.empty())
+        append_hash(data, txs_hashes[n]);
+    }
+    return data;
+  }
+
+  bool parse(const std::string &data, block_hashes &hashes, std::vector<crypto::hash> &txs_hashes)
+  {
+    return cryptonote::Blockchain::parse_block_hashes({reinterpret_cast<const unsigned char*>(data.data()), data.size()}, hashes, txs_hashes);
+  }
+
+  class fast_sync_file : public ::testing::Test
+  {
+  protected:
+    fast_sync_file(): path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string()) {}
+    ~fast_sync_file() { boost::system::error_code ec; boost::filesystem::remove(path, ec); }
+
+    const std::string path;
+  };
+}
+
+TEST(parse_block_hashes, legacy)
+{
+  const block_hashes expected{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes{make_hash(5)};
+  ASSERT_TRUE(parse(make_data(expected, {}), hashes, txs_hashes));
+  ASSERT_EQ(hashes, expected);
+  ASSERT_TRUE(txs_hashes.empty());
+}
+
+TEST(parse_block_hashes, with_txs)
+{
+  const block_hashes expected{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  const std::vector<crypto::hash> expected_txs{make_hash(5), make_hash(6)};
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes;
+  ASSERT_TRUE(parse(make_data(expected, expected_txs), hashes, txs_hashes));
+  ASSERT_EQ(hashes, expected);
+  ASSERT_EQ(txs_hashes, expected_txs);
+}
+
+TEST(parse_block_hashes, empty)
+{
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes;
+  ASSERT_TRUE(parse("", hashes, txs_hashes));
+  ASSERT_TRUE(hashes.empty());
+  ASSERT_TRUE(parse(make_data({}, {}), hashes, txs_hashes));
+  ASSERT_TRUE(hashes.empty());
+}
+
+TEST(parse_block_hashes, truncated)
+{
+  const block_hashes expected{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  const std::vector<crypto::hash> expected_txs{make_hash(5), make_hash(6)};
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes;
+
+  // in the version
+  const std::string magic = FAST_SYNC_FILE_MAGIC;
+  ASSERT_FALSE(parse(magic + "\x01", hashes, txs_hashes));
+
+  // in the hashes
+  std::string data = make_data(expected, {});
+  data.pop_back();
+  ASSERT_FALSE(parse(data, hashes, txs_hashes));
+  data = make_data(expected, expected_txs);
+  data.resize(data.size() - sizeof(crypto::hash));
+  ASSERT_FALSE(parse(data, hashes, txs_hashes));
+}
+
+TEST(parse_block_hashes, size_mismatch)
+{
+  const block_hashes expected{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  const std::vector<crypto::hash> expected_txs{make_hash(5), make_hash(6)};
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes;
+
+  ASSERT_FALSE(parse(make_data(expected, {}) + '\0', hashes, txs_hashes));
+
+  // a fast sync file header before compiled-in format hashes
+  std::string data = FAST_SYNC_FILE_MAGIC;
+  append_uint32(data, FAST_SYNC_FILE_VERSION);
+  data += make_data(expected, {});
+  ASSERT_FALSE(parse(data, hashes, txs_hashes));
+
+  // too many blocks for any data to hold
+  data = FAST_SYNC_FILE_MAGIC;
+  append_uint32(data, FAST_SYNC_FILE_VERSION);
+  append_uint32(data, 0xffffffff);
+  append_hash(data, make_hash(1));
+  ASSERT_FALSE(parse(data, hashes, txs_hashes));
+}
+
+TEST(parse_block_hashes, unknown_version)
+{
+  std::string data = make_data({{make_hash(1), make_hash(2)}}, {make_hash(3)});
+  data[sizeof(FAST_SYNC_FILE_MAGIC) - 1] ^= 0xff;
+  block_hashes hashes;
+  std::vector<crypto::hash> txs_hashes;
+  ASSERT_FALSE(parse(data, hashes, txs_hashes));
+}
+
+TEST_F(fast_sync_file, extends_embedded_hashes)
+{
+  block_hashes hashes{{make_hash(1), make_hash(2)}};
+  std::vector<crypto::hash> txs_hashes;
+  const block_hashes file_hashes{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  const std::vector<crypto::hash> file_txs_hashes{make_hash(5), make_hash(6)};
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path, make_data(file_hashes, file_txs_hashes)));
+
+  ASSERT_TRUE(cryptonote::Blockchain::load_fast_sync_file(path, hashes, txs_hashes));
+  ASSERT_EQ(hashes, file_hashes);
+  ASSERT_EQ(txs_hashes, file_txs_hashes);
+}
+
+TEST_F(fast_sync_file, shorter_than_embedded_hashes)
+{
+  const block_hashes embedded{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  block_hashes hashes = embedded;
+  std::vector<crypto::hash> txs_hashes;
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path, make_data({embedded[0]}, {make_hash(5)})));
+
+  ASSERT_TRUE(cryptonote::Blockchain::load_fast_sync_file(path, hashes, txs_hashes));
+  ASSERT_EQ(hashes, embedded);
+  ASSERT_EQ(txs_hashes, std::vector<crypto::hash>({make_hash(5), crypto::null_hash}));
+}
+
+TEST_F(fast_sync_file, disagrees_with_embedded_hashes)
+{
+  const block_hashes embedded{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(4)}};
+  block_hashes hashes = embedded;
+  std::vector<crypto::hash> txs_hashes;
+  const block_hashes file_hashes{{make_hash(1), make_hash(2)}, {make_hash(3), make_hash(7)}, {make_hash(8), make_hash(9)}};
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path, make_data(file_hashes, {make_hash(5), make_hash(6), make_hash(10)})));
+
+  ASSERT_FALSE(cryptonote::Blockchain::load_fast_sync_file(path, hashes, txs_hashes));
+  ASSERT_EQ(hashes, embedded);
+  ASSERT_TRUE(txs_hashes.empty());
+}
+
+TEST_F(fast_sync_file, invalid)
+{
+  const block_hashes embedded{{make_hash(1), make_hash(2)}};
+  block_hashes hashes = embedded;
+  std::vector<crypto::hash> txs_hashes;
+
+  ASSERT_FALSE(cryptonote::Blockchain::load_fast_sync_file(path, hashes, txs_hashes));
+
+  std::string data = make_data({embedded[0], {make_hash(3), make_hash(4)}}, {make_hash(5), make_hash(6)});
+  data.pop_back();
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path, data));
+  ASSERT_FALSE(cryptonote::Blockchain::load_fast_sync_file(path, hashes, txs_hashes));
+  ASSERT_EQ(hashes, embedded);
+  ASSERT_TRUE(txs_hashes.empty());
+}
@@ -33,6 +33,7 @@
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/output_distribution.h"
 #include "blockchain_db/testdb.h"
 
 static const uint64_t test_distribution[32] = {
@@ -72,62 +73,87 @@ public:
   uint64_t blockchain_height;
 };
 
+// two outputs of 1000 every 10 blocks
+class HistogramTestDB: public TestDB
+{
+public:
+  HistogramTestDB(): TestDB(test_distribution_size - 1), persisted(0) {}
+
+  bool get_output_height_histogram(uint64_t amount, std::vector<std::pair<uint64_t, uint64_t>> &histogram) const override
+  {
+    histogram.clear();
+    if (amount == 1000)
+      for (uint64_t h = 0; h < blockchain_height; h += 10)
+        histogram.emplace_back(h, 2);
+    return false;
+  }
+
+  void add_output_height_histogram(uint64_t amount, const std::vector<std::pair<uint64_t, uint64_t>> &histogram) override
+  {
+    ++persisted;
+  }
+
+  size_t persisted;
+};
+
 }
 
+// the objects Blockchain is built with, in the order core makes them
+struct test_blockchain
+{
+  test_blockchain(): txpool(bc), service_node_list(bc), bc(txpool, service_node_list, deregister_vote_pool) {}
+
+  service_nodes::deregister_vote_pool deregister_vote_pool;
+  cryptonote::tx_memory_pool txpool;
+  service_nodes::service_node_list service_node_list;
+  cryptonote::Blockchain bc;
+};
+
 bool get_output_distribution(uint64_t amount, uint64_t from, uint64_t to, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base)
 {
-  std::unique_ptr<cryptonote::Blockchain> bc;
-  cryptonote::tx_memory_pool txpool(*bc);
-  bc.reset(new cryptonote::Blockchain(txpool));
+  test_blockchain chain;
   struct get_test_options {
     const std::pair<uint8_t, uint64_t> hard_forks[2];
     const cryptonote::test_options test_options = {
-      hard_forks
+      hard_forks,
+      0
     };
     get_test_options():hard_forks{std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0)}{}
   } opts;
-  cryptonote::Blockchain *blockchain = bc.get();
-  bool r = blockchain->init(new TestDB(test_distribution_size), cryptonote::FAKECHAIN, true, &opts.test_options, 0, NULL);
-  return r && bc->get_output_distribution(amount, from, to, start_height, distribution, base);
-}
-
-crypto::hash get_block_hash(uint64_t height)
-{
-  crypto::hash hash = crypto::null_hash;
-  *((uint64_t*)&hash) = height;
-  return hash;
+  bool r = chain.bc.init(new TestDB(test_distribution_size), cryptonote::FAKECHAIN, true, &opts.test_options, 0, NULL);
+  return r && chain.bc.get_output_distribution(amount, from, to, start_height, distribution, base);
 }
 
 TEST(output_distribution, extend)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 29, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 29, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 2);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({5, 0}));
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 29, ::get_block_hash, true, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 29, true);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 2);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({55, 55}));
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 30, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 30, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 3);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({5, 0, 2}));
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 30, ::get_block_hash, true, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 30, true);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 3);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({55, 55, 57}));
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 31, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 31, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 4);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({5, 0, 2, 3}));
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 31, ::get_block_hash, true, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 28, 31, true);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 4);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({55, 55, 57, 60}));
@@ -137,7 +163,7 @@ TEST(output_distribution, one)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 0, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 0, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 1);
   ASSERT_EQ(res->distribution.back(), 0);
@@ -147,7 +173,7 @@ TEST(output_distribution, full_cumulative)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 31, ::get_block_hash, true, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 31, true);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 32);
   ASSERT_EQ(res->distribution.back(), 60);
@@ -157,7 +183,7 @@ TEST(output_distribution, full_noncumulative)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 31, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 0, 31, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 32);
   for (size_t i = 0; i < 32; ++i)
@@ -168,7 +194,7 @@ TEST(output_distribution, part_cumulative)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 4, 8, ::get_block_hash, true, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 4, 8, true);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 5);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({0, 1, 6, 7, 11}));
@@ -178,8 +204,51 @@ TEST(output_distribution, part_noncumulative)
 {
   boost::optional<cryptonote::rpc::output_distribution_data> res;
 
-  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 4, 8, ::get_block_hash, false, test_distribution_size);
+  res = cryptonote::rpc::RpcHandler::get_output_distribution(::get_output_distribution, 0, 4, 8, false);
   ASSERT_TRUE(res != boost::none);
   ASSERT_EQ(res->distribution.size(), 5);
   ASSERT_EQ(res->distribution, std::vector<uint64_t>({0, 1, 5, 1, 4}));
 }
+
+TEST(output_distribution, follows_blocks)
+{
+  HistogramTestDB db;
+  cryptonote::output_distribution od;
+  uint64_t start_height, base;
+  std::vector<uint64_t> distribution;
+  cryptonote::block b;
+
+  od.init(&db);
+  ASSERT_FALSE(od.get(0, 28, 31, start_height, distribution, base));
+  ASSERT_TRUE(od.get(0, 28, 30, start_height, distribution, base));
+  ASSERT_EQ(distribution, std::vector<uint64_t>({55, 55, 57}));
+  // not built until the next block
+  ASSERT_FALSE(od.get(1000, 5, 30, start_height, distribution, base));
+
+  db.blockchain_height = test_distribution_size;
+  od.block_added(test_distribution_size - 1, b, {});
+  ASSERT_EQ(db.persisted, 1);
+  ASSERT_TRUE(od.get(0, 28, 31, start_height, distribution, base));
+  ASSERT_EQ(start_height, 28);
+  ASSERT_EQ(base, 50);
+  ASSERT_EQ(distribution, std::vector<uint64_t>({55, 55, 57, 60}));
+  ASSERT_TRUE(od.get(1000, 5, 0, start_height, distribution, base));
+  ASSERT_EQ(distribution.size(), 27);
+  ASSERT_EQ(distribution[0], 2);
+  ASSERT_EQ(distribution[4], 2);
+  ASSERT_EQ(distribution[5], 4);
+  ASSERT_EQ(distribution[25], 8);
+  ASSERT_EQ(distribution.back(), 8);
+
+  // a block spending or creating outputs of that amount drops the histogram
+  cryptonote::transaction tx;
+  tx.version = cryptonote::txversion::v1;
+  tx.vout.resize(1);
+  tx.vout[0].amount = 1000;
+  db.blockchain_height = test_distribution_size - 1;
+  od.block_popped(test_distribution_size - 1, b, {tx});
+  ASSERT_FALSE(od.get(1000, 5, 0, start_height, distribution, base));
+  ASSERT_FALSE(od.get(0, 28, 31, start_height, distribution, base));
+  ASSERT_TRUE(od.get(0, 28, 30, start_height, distribution, base));
+  ASSERT_EQ(distribution, std::vector<uint64_t>({55, 55, 57}));
+}
@@ -1089,3 +1089,54 @@ TEST(ringct, aggregated)
 
   ASSERT_TRUE(verRctSemanticsSimple(sp));
 }
+
+static std::vector<rctSig> make_sample_simple_rct_sig_batch(size_t n_sigs)
+{
+  std::vector<rctSig> s(n_sigs);
+  for (size_t n = 0; n < n_sigs; ++n)
+  {
+    // differing input counts, so each sig's MGs land at a different offset
+    static const uint64_t inputs[] = {1000, 1000, 1000};
+    static const uint64_t outputs[] = {500, 1500};
+    const size_t n_inputs = 1 + n % NELTS(inputs);
+    const uint64_t out_amounts[] = {outputs[0], n_inputs * 1000 - outputs[0]};
+    s[n] = make_sample_simple_rct_sig(n_inputs, inputs, NELTS(out_amounts), out_amounts, 0);
+  }
+  return s;
+}
+
+static std::vector<const rctSig*> to_pointers(const std::vector<rctSig> &s)
+{
+  std::vector<const rctSig*> sp;
+  for (const rctSig &sig: s)
+    sp.push_back(&sig);
+  return sp;
+}
+
+TEST(ringct, aggregated_non_semantics)
+{
+  const std::vector<rctSig> s = make_sample_simple_rct_sig_batch(8);
+  ASSERT_TRUE(verRctNonSemanticsSimple(to_pointers(s)));
+  for (const rctSig &sig: s)
+    ASSERT_TRUE(verRctNonSemanticsSimple(sig));
+}
+
+TEST(ringct, aggregated_non_semantics_reject_bad_mg)
+{
+  std::vector<rctSig> s = make_sample_simple_rct_sig_batch(8);
+  s[5].p.MGs.back().ss[0][0] = skGen();
+  ASSERT_FALSE(verRctNonSemanticsSimple(to_pointers(s)));
+  ASSERT_FALSE(verRctNonSemanticsSimple(s[5]));
+  s.erase(s.begin() + 5);
+  ASSERT_TRUE(verRctNonSemanticsSimple(to_pointers(s)));
+}
+
+TEST(ringct, aggregated_non_semantics_reject_bad_pseudo_out)
+{
+  std::vector<rctSig> s = make_sample_simple_rct_sig_batch(8);
+  s[7].pseudoOuts.back() = scalarmultBase(skGen());
+  ASSERT_FALSE(verRctNonSemanticsSimple(to_pointers(s)));
+  ASSERT_FALSE(verRctNonSemanticsSimple(s[7]));
+  s.pop_back();
+  ASSERT_TRUE(verRctNonSemanticsSimple(to_pointers(s)));
+}
@@ -0,0 +1,275 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <random>
+#include "gtest/gtest.h"
+#include "cryptonote_core/service_node_list.h"
+#include "cryptonote_core/service_node_quorum_cache.h"
+#include "cryptonote_core/service_node_rules.h"
+
+namespace
+{
+  crypto::public_key random_pubkey(std::mt19937_64& rng)
+  {
+    crypto::public_key key;
+    for (size_t i = 0; i < sizeof(key.data); ++i)
+      key.data[i] = rng();
+    return key;
+  }
+
+  crypto::hash random_hash(std::mt19937_64& rng)
+  {
+    crypto::hash hash;
+    for (size_t i = 0; i < sizeof(hash.data); ++i)
+      hash.data[i] = rng();
+    return hash;
+  }
+
+  void sort_pubkeys(std::vector<crypto::public_key>& pubkeys)
+  {
+    std::sort(pubkeys.begin(), pubkeys.end(), [](const crypto::public_key& a, const crypto::public_key& b) {
+      return memcmp(&a, &b, sizeof(a)) < 0;
+    });
+  }
+
+  // The quorum as service_node_list drew it before the cache existed
+  service_nodes::quorum_state reference_quorum(std::vector<crypto::public_key> pubkeys, const crypto::hash& block_hash)
+  {
+    sort_pubkeys(pubkeys);
+
+    std::vector<size_t> indexes(pubkeys.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    uint64_t seed = 0;
+    std::memcpy(&seed, block_hash.data, sizeof(seed));
+    service_nodes::xeq_shuffle(indexes, seed);
+
+    service_nodes::quorum_state state;
+    const size_t quorum_size = std::min(pubkeys.size(), service_nodes::QUORUM_SIZE);
+    for (size_t i = 0; i < quorum_size; ++i)
+      state.quorum_nodes.push_back(pubkeys[indexes[i]]);
+
+    const size_t remaining = pubkeys.size() - quorum_size;
+    const size_t to_test = std::max(remaining / service_nodes::NTH_OF_THE_NETWORK_TO_TEST, std::min(service_nodes::MIN_NODES_TO_TEST, remaining));
+    for (size_t i = 0; i < to_test; ++i)
+      state.nodes_to_test.push_back(pubkeys[indexes[quorum_size + i]]);
+    return state;
+  }
+
+  void check_equal(const service_nodes::quorum_state& expected, const std::shared_ptr<const service_nodes::quorum_state>& actual)
+  {
+    ASSERT_TRUE(actual != nullptr);
+    ASSERT_EQ(expected.quorum_nodes, actual->quorum_nodes);
+    ASSERT_EQ(expected.nodes_to_test, actual->nodes_to_test);
+  }
+}
+
+TEST(service_node_quorum_cache, matches_reference_shuffle)
+{
+  std::mt19937_64 rng(1);
+  for (size_t count : {0, 1, 5, 10, 11, 60, 300})
+  {
+    std::vector<crypto::public_key> pubkeys;
+    for (size_t i = 0; i < count; ++i)
+      pubkeys.push_back(random_pubkey(rng));
+    const crypto::hash block_hash = random_hash(rng);
+
+    service_nodes::quorum_cache cache;
+    cache.add(100, block_hash, pubkeys);
+    check_equal(reference_quorum(pubkeys, block_hash), cache.get(100));
+  }
+}
+
+TEST(service_node_quorum_cache, active_changes)
+{
+  std::mt19937_64 rng(2);
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 100; ++i)
+    pubkeys.push_back(random_pubkey(rng));
+
+  service_nodes::quorum_cache cache;
+  cache.add(10, random_hash(rng), pubkeys);
+  cache.add(11, random_hash(rng), pubkeys);
+
+  std::vector<crypto::public_key> added, removed;
+  ASSERT_FALSE(cache.get_active_changes(10, added, removed));
+  ASSERT_TRUE(cache.get_active_changes(11, added, removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_TRUE(removed.empty());
+
+  const crypto::public_key gone = pubkeys[7];
+  const crypto::public_key joined = random_pubkey(rng);
+  pubkeys.erase(pubkeys.begin() + 7);
+  pubkeys.push_back(joined);
+  cache.add(12, random_hash(rng), pubkeys);
+  ASSERT_TRUE(cache.get_active_changes(12, added, removed));
+  ASSERT_EQ(std::vector<crypto::public_key>{joined}, added);
+  ASSERT_EQ(std::vector<crypto::public_key>{gone}, removed);
+
+  std::vector<crypto::public_key> active;
+  ASSERT_TRUE(cache.get_active_pubkeys(12, active));
+  sort_pubkeys(active);
+  sort_pubkeys(pubkeys);
+  ASSERT_EQ(pubkeys, active);
+}
+
+TEST(service_node_quorum_cache, computed_and_removed)
+{
+  std::mt19937_64 rng(3);
+  service_nodes::quorum_state state;
+  state.quorum_nodes.push_back(random_pubkey(rng));
+  state.nodes_to_test.push_back(random_pubkey(rng));
+
+  service_nodes::quorum_cache cache;
+  cache.add_computed(5, state);
+  for (uint64_t height = 6; height < 10; ++height)
+    cache.add(height, random_hash(rng), { random_pubkey(rng) });
+  check_equal(state, cache.get(5));
+
+  std::vector<crypto::public_key> active;
+  ASSERT_FALSE(cache.get_active_pubkeys(5, active));
+
+  cache.remove_below(6);
+  cache.remove_from(9);
+  ASSERT_TRUE(cache.get(5) == nullptr);
+  ASSERT_TRUE(cache.get(9) == nullptr);
+  ASSERT_EQ((std::vector<uint64_t>{6, 7, 8}), cache.get_heights());
+}
+
+TEST(service_node_quorum_cache, table_rebuild_keeps_quorums)
+{
+  std::mt19937_64 rng(4);
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 50; ++i)
+    pubkeys.push_back(random_pubkey(rng));
+
+  const uint64_t window = 20;
+  service_nodes::quorum_cache cache;
+  std::map<uint64_t, service_nodes::quorum_state> expected;
+  for (uint64_t height = 0; height < 200; ++height)
+  {
+    // Replace a few nodes every block so that old keys pile up in the table
+    for (size_t i = 0; i < 3; ++i)
+      pubkeys[rng() % pubkeys.size()] = random_pubkey(rng);
+    const crypto::hash block_hash = random_hash(rng);
+    cache.add(height, block_hash, pubkeys);
+    expected[height] = reference_quorum(pubkeys, block_hash);
+    if (height % 2)
+      cache.get(height);
+
+    if (height >= window)
+    {
+      cache.remove_below(height - window);
+      expected.erase(expected.begin(), expected.lower_bound(height - window));
+    }
+  }
+
+  ASSERT_GT(cache.get_epoch(), 0);
+  for (const auto& kv_pair : expected)
+    check_equal(kv_pair.second, cache.get(kv_pair.first));
+}
+
+TEST(service_node_quorum_cache, snapshot_is_immutable)
+{
+  std::mt19937_64 rng(5);
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 30; ++i)
+    pubkeys.push_back(random_pubkey(rng));
+
+  service_nodes::quorum_cache cache;
+  std::map<uint64_t, service_nodes::quorum_state> expected;
+  for (uint64_t height = 0; height < 10; ++height)
+  {
+    pubkeys[rng() % pubkeys.size()] = random_pubkey(rng);
+    const crypto::hash block_hash = random_hash(rng);
+    cache.add(height, block_hash, pubkeys);
+    expected[height] = reference_quorum(pubkeys, block_hash);
+  }
+
+  const std::shared_ptr<const service_nodes::quorum_cache::snapshot> snapshot = cache.get_snapshot();
+  ASSERT_EQ(snapshot, cache.get_snapshot());
+
+  // a reorg replacing the top heights, and the window moving on
+  cache.remove_from(8);
+  for (uint64_t height = 8; height < 12; ++height)
+    cache.add(height, random_hash(rng), { random_pubkey(rng) });
+  cache.remove_below(2);
+  ASSERT_NE(snapshot, cache.get_snapshot());
+
+  for (const auto& kv_pair : expected)
+    check_equal(kv_pair.second, snapshot->get(kv_pair.first));
+  ASSERT_TRUE(snapshot->get(10) == nullptr);
+  ASSERT_TRUE(cache.get(0) == nullptr);
+}
+
+TEST(service_node_quorum_cache, quorum_kept_across_calls)
+{
+  std::mt19937_64 rng(6);
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 30; ++i)
+    pubkeys.push_back(random_pubkey(rng));
+
+  service_nodes::quorum_cache cache;
+  const crypto::hash block_hash = random_hash(rng);
+  cache.add(0, block_hash, pubkeys);
+  const service_nodes::quorum_state expected = reference_quorum(pubkeys, block_hash);
+  check_equal(expected, cache.get(0));
+  check_equal(expected, cache.get(0));
+  check_equal(expected, cache.get_snapshot()->get(0));
+}
+
+TEST(service_node_quorum_cache, table_rebuild_keeps_computed_quorums)
+{
+  std::mt19937_64 rng(7);
+  service_nodes::quorum_state state;
+  for (size_t i = 0; i < service_nodes::QUORUM_SIZE; ++i)
+    state.quorum_nodes.push_back(random_pubkey(rng));
+  for (size_t i = 0; i < service_nodes::MIN_NODES_TO_TEST; ++i)
+    state.nodes_to_test.push_back(random_pubkey(rng));
+
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 50; ++i)
+    pubkeys.push_back(random_pubkey(rng));
+
+  // The computed height is above the window, so it outlives the table rebuilds
+  service_nodes::quorum_cache cache;
+  cache.add_computed(1000, state);
+  for (uint64_t height = 0; height < 200; ++height)
+  {
+    for (size_t i = 0; i < 3; ++i)
+      pubkeys[rng() % pubkeys.size()] = random_pubkey(rng);
+    cache.add(height, random_hash(rng), pubkeys);
+    if (height >= 20)
+      cache.remove_below(height - 20);
+  }
+
+  ASSERT_GT(cache.get_epoch(), 0);
+  check_equal(state, cache.get(1000));
+}
@@ -0,0 +1,51 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <random>
+#include "gtest/gtest.h"
+
+#include "gtest/gtest.h"
+#include "cryptonote_core/service_node_rules.h"
+
+TEST(service_node_rules, deregister_lifetime)
+{
+  for (uint8_t hf_version: {7, 8, 9})
+  {
+    const uint64_t lifetime = service_nodes::get_deregister_lifetime(hf_version);
+    const uint64_t expected = hf_version >= 8 ? uint64_t{service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT_V2} : uint64_t{service_nodes::deregister_vote::DEREGISTER_LIFETIME_BY_HEIGHT};
+    ASSERT_EQ(lifetime, expected);
+
+    // the block after the vote's up to the last one less than the lifetime after it
+    const uint64_t vote_height = 1000;
+    ASSERT_FALSE(service_nodes::is_deregister_in_lifetime(hf_version, vote_height, vote_height));
+    ASSERT_TRUE(service_nodes::is_deregister_in_lifetime(hf_version, vote_height, vote_height + 1));
+    ASSERT_TRUE(service_nodes::is_deregister_in_lifetime(hf_version, vote_height, vote_height + lifetime - 1));
+    ASSERT_FALSE(service_nodes::is_deregister_in_lifetime(hf_version, vote_height, vote_height + lifetime));
+    ASSERT_FALSE(service_nodes::is_deregister_in_lifetime(hf_version, vote_height + 1, vote_height));
+  }
+}
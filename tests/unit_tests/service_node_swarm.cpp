@@ -0,0 +1,184 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include "gtest/gtest.h"
+#include "cryptonote_core/service_node_swarm.h"
+
+namespace
+{
+  crypto::public_key random_pubkey(std::mt19937_64& rng)
+  {
+    crypto::public_key key;
+    for (size_t i = 0; i < sizeof(key.data); ++i)
+      key.data[i] = rng();
+    return key;
+  }
+
+  // What update_swarms used to do: rebuild the swarms from every node, run
+  // calc_swarm_changes, and read the nodes' swarms back
+  void reference_changes(std::unordered_map<crypto::public_key, service_nodes::swarm_id_t>& nodes, uint64_t seed)
+  {
+    service_nodes::swarm_snode_map_t swarms;
+    for (const auto& node : nodes)
+      swarms[node.second].push_back(node.first);
+    for (auto& swarm : swarms)
+      std::sort(swarm.second.begin(), swarm.second.end(), [](const crypto::public_key& a, const crypto::public_key& b) {
+        return memcmp(&a, &b, sizeof(a)) < 0;
+      });
+    service_nodes::calc_swarm_changes(swarms, seed, true);
+    for (const auto& swarm : swarms)
+      for (const crypto::public_key& pubkey : swarm.second)
+        nodes[pubkey] = swarm.first;
+  }
+
+  void check_matches_reference(size_t initial_nodes, size_t blocks, size_t max_changes, uint64_t rng_seed)
+  {
+    std::mt19937_64 rng(rng_seed);
+    std::unordered_map<crypto::public_key, service_nodes::swarm_id_t> nodes;
+    service_nodes::swarm_index index;
+    for (size_t i = 0; i < initial_nodes; ++i)
+    {
+      const crypto::public_key pubkey = random_pubkey(rng);
+      nodes[pubkey] = service_nodes::UNASSIGNED_SWARM_ID;
+      index.set(pubkey, service_nodes::UNASSIGNED_SWARM_ID);
+    }
+
+    for (size_t block = 0; block < blocks; ++block)
+    {
+      // Registrations and expiries, with some blocks losing more than they gain
+      const size_t registrations = rng() % (max_changes + 1);
+      const size_t expiries = std::min(nodes.size(), size_t(rng() % (max_changes + 2)));
+      for (size_t i = 0; i < expiries; ++i)
+      {
+        auto it = nodes.begin();
+        std::advance(it, rng() % nodes.size());
+        index.remove(it->first);
+        nodes.erase(it);
+      }
+      for (size_t i = 0; i < registrations; ++i)
+      {
+        const crypto::public_key pubkey = random_pubkey(rng);
+        nodes[pubkey] = service_nodes::UNASSIGNED_SWARM_ID;
+        index.set(pubkey, service_nodes::UNASSIGNED_SWARM_ID);
+      }
+
+      const uint64_t seed = rng();
+      std::unordered_map<crypto::public_key, service_nodes::swarm_id_t> before = nodes;
+      reference_changes(nodes, seed);
+
+      std::vector<std::pair<crypto::public_key, service_nodes::swarm_id_t>> changes;
+      index.calc_changes(seed, changes);
+      for (const auto& change : changes)
+      {
+        ASSERT_NE(before.at(change.first), change.second);
+        before[change.first] = change.second;
+      }
+      ASSERT_EQ(nodes, before) << "block " << block;
+
+      size_t indexed = 0;
+      for (const auto& swarm : index.get_swarms())
+      {
+        ASSERT_FALSE(swarm.second.empty());
+        for (const crypto::public_key& pubkey : swarm.second)
+          ASSERT_EQ(nodes.at(pubkey), swarm.first);
+        indexed += swarm.second.size();
+      }
+      ASSERT_EQ(nodes.size(), indexed);
+    }
+  }
+}
+
+TEST(service_node_swarm, matches_reference_from_scratch)
+{
+  check_matches_reference(0, 300, 8, 1);
+}
+
+TEST(service_node_swarm, matches_reference_with_churn)
+{
+  check_matches_reference(500, 200, 30, 2);
+}
+
+TEST(service_node_swarm, matches_reference_shrinking)
+{
+  // Expiries outpace registrations so that swarms starve and get decommissioned
+  std::mt19937_64 rng(3);
+  std::unordered_map<crypto::public_key, service_nodes::swarm_id_t> nodes;
+  service_nodes::swarm_index index;
+  for (size_t i = 0; i < 400; ++i)
+  {
+    const crypto::public_key pubkey = random_pubkey(rng);
+    nodes[pubkey] = service_nodes::UNASSIGNED_SWARM_ID;
+    index.set(pubkey, service_nodes::UNASSIGNED_SWARM_ID);
+  }
+
+  while (nodes.size() > 10)
+  {
+    for (size_t i = 0; i < 7; ++i)
+    {
+      auto it = nodes.begin();
+      std::advance(it, rng() % nodes.size());
+      index.remove(it->first);
+      nodes.erase(it);
+    }
+
+    const uint64_t seed = rng();
+    reference_changes(nodes, seed);
+    std::vector<std::pair<crypto::public_key, service_nodes::swarm_id_t>> changes;
+    index.calc_changes(seed, changes);
+
+    for (const auto& swarm : index.get_swarms())
+      for (const crypto::public_key& pubkey : swarm.second)
+        ASSERT_EQ(nodes.at(pubkey), swarm.first);
+  }
+}
+
+TEST(service_node_swarm, rollback)
+{
+  std::mt19937_64 rng(4);
+  service_nodes::swarm_index index;
+  std::vector<crypto::public_key> pubkeys;
+  for (size_t i = 0; i < 100; ++i)
+  {
+    pubkeys.push_back(random_pubkey(rng));
+    index.set(pubkeys.back(), service_nodes::UNASSIGNED_SWARM_ID);
+  }
+  std::vector<std::pair<crypto::public_key, service_nodes::swarm_id_t>> changes;
+  index.calc_changes(5, changes);
+  ASSERT_EQ(100, changes.size());
+  const service_nodes::swarm_snode_map_t swarms = index.get_swarms();
+
+  // Undoing the changes brings back the unassigned nodes, the way rolling back the infos does
+  for (const auto& change : changes)
+    index.set(change.first, service_nodes::UNASSIGNED_SWARM_ID);
+  ASSERT_EQ(1, index.get_swarms().size());
+  index.calc_changes(5, changes);
+  ASSERT_EQ(swarms, index.get_swarms());
+}
@@ -0,0 +1,146 @@
+// Copyright (c)      2018, The Loki Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <random>
+#include "gtest/gtest.h"
+#include "cryptonote_config.h"
+#include "cryptonote_core/service_node_list.h"
+#include "cryptonote_core/service_node_winner.h"
+
+namespace
+{
+  crypto::public_key random_pubkey(std::mt19937_64& rng)
+  {
+    crypto::public_key key;
+    for (size_t i = 0; i < sizeof(key.data); ++i)
+      key.data[i] = rng();
+    return key;
+  }
+
+  service_nodes::service_node_info random_info(std::mt19937_64& rng)
+  {
+    // Small ranges so that ties, unfunded, invalid and over-portioned nodes all show up
+    service_nodes::service_node_info info;
+    info.registration_height = rng() % 50;
+    info.last_reward_block_height = info.registration_height + rng() % 20;
+    info.last_reward_transaction_index = rng() % 3;
+    info.staking_requirement = 1000;
+    info.portions_for_operator = rng() % 2 ? STAKING_PORTIONS : STAKING_PORTIONS / 4;
+    info.total_reserved = 250 + rng() % 800;
+    info.total_contributed = rng() % 1100;
+    return info;
+  }
+
+  void check_matches_scan(const service_nodes::winner_index& index, const service_nodes::service_nodes_infos_t& infos)
+  {
+    for (uint8_t hf = 9; hf <= 18; ++hf)
+      ASSERT_EQ(index.select(infos, hf), service_nodes::select_winner_by_scan(infos, hf)) << "hard fork " << (int)hf;
+  }
+}
+
+TEST(service_node_winner, empty)
+{
+  service_nodes::winner_index index;
+  service_nodes::service_nodes_infos_t infos;
+  ASSERT_EQ(index.select(infos, 16), crypto::null_pkey);
+}
+
+TEST(service_node_winner, oldest_waiting_wins)
+{
+  std::mt19937_64 rng(1);
+  service_nodes::winner_index index;
+  service_nodes::service_nodes_infos_t infos;
+  crypto::public_key oldest;
+  for (uint64_t i = 0; i < 10; ++i)
+  {
+    const crypto::public_key key = random_pubkey(rng);
+    service_nodes::service_node_info& info = infos[key];
+    info = random_info(rng);
+    info.last_reward_block_height = 100 - i;
+    info.total_contributed = info.total_reserved = info.staking_requirement;
+    index.update(key, &info);
+    oldest = key;
+  }
+  ASSERT_EQ(index.select(infos, 16), oldest);
+
+  infos.erase(oldest);
+  index.update(oldest, nullptr);
+  ASSERT_NE(index.select(infos, 16), oldest);
+  check_matches_scan(index, infos);
+}
+
+TEST(service_node_winner, random_updates_match_scan)
+{
+  std::mt19937_64 rng(42);
+  service_nodes::winner_index index;
+  service_nodes::service_nodes_infos_t infos;
+  std::vector<crypto::public_key> keys;
+
+  for (size_t round = 0; round < 2000; ++round)
+  {
+    const size_t action = rng() % 4;
+    if (action == 0 && !keys.empty())
+    {
+      const size_t i = rng() % keys.size();
+      infos.erase(keys[i]);
+      index.update(keys[i], nullptr);
+      keys[i] = keys.back();
+      keys.pop_back();
+    }
+    else if (action == 1 && !keys.empty())
+    {
+      // A reward moves the node to the back of the queue
+      const crypto::public_key& key = keys[rng() % keys.size()];
+      service_nodes::service_node_info& info = infos[key];
+      info.last_reward_block_height += 1 + rng() % 20;
+      info.last_reward_transaction_index = rng() % 3;
+      index.update(key, &info);
+    }
+    else if (action == 2 && !keys.empty())
+    {
+      const crypto::public_key& key = keys[rng() % keys.size()];
+      service_nodes::service_node_info& info = infos[key];
+      info.total_contributed += rng() % 300;
+      index.update(key, &info);
+    }
+    else
+    {
+      const crypto::public_key key = random_pubkey(rng);
+      keys.push_back(key);
+      service_nodes::service_node_info& info = infos[key];
+      info = random_info(rng);
+      index.update(key, &info);
+    }
+    check_matches_scan(index, infos);
+  }
+
+  index.clear();
+  for (const auto& info : infos)
+    index.update(info.first, &info.second);
+  check_matches_scan(index, infos);
+}
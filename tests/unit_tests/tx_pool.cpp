@@ -0,0 +1,212 @@
+// Copyright (c) 2019, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <unordered_map>
+#include "gtest/gtest.h"
+#include "string_tools.h"
+#include "crypto/crypto.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+namespace
+{
+
+struct temp_dir
+{
+  temp_dir(): path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()) {}
+  ~temp_dir() { boost::system::error_code ec; boost::filesystem::remove_all(path, ec); }
+  boost::filesystem::path path;
+};
+
+// the objects Blockchain is built with, in the order core makes them, on a
+// throwaway lmdb so the pool's txpool db writes can be read back
+struct test_blockchain
+{
+  test_blockchain(): txpool(bc), service_node_list(bc), bc(txpool, service_node_list, deregister_vote_pool), initialized(false)
+  {
+    static const std::pair<uint8_t, uint64_t> hard_forks[] = { std::make_pair((uint8_t)1, (uint64_t)0), std::make_pair((uint8_t)0, (uint64_t)0) };
+    static const cryptonote::test_options options = { hard_forks, 0 };
+    cryptonote::BlockchainDB *db = new cryptonote::BlockchainLMDB();
+    try
+    {
+      db->open(dir.path.string());
+    }
+    catch (const std::exception &e)
+    {
+      delete db;
+      return;
+    }
+    initialized = bc.init(db, cryptonote::FAKECHAIN, true, &options, 0, NULL) && txpool.init();
+  }
+
+  temp_dir dir; // removed after bc closes the db
+  service_nodes::deregister_vote_pool deregister_vote_pool;
+  cryptonote::tx_memory_pool txpool;
+  service_nodes::service_node_list service_node_list;
+  cryptonote::Blockchain bc;
+  bool initialized;
+};
+
+// a v1 tx spending an output the chain doesn't have, which the pool only
+// takes as kept by block
+cryptonote::transaction make_tx(uint64_t fee)
+{
+  cryptonote::transaction tx;
+  tx.version = cryptonote::txversion::v1;
+  tx.unlock_time = 0;
+
+  cryptonote::keypair in_key = cryptonote::keypair::generate(hw::get_device("default"));
+  cryptonote::txin_to_key in;
+  in.amount = 1000 + fee;
+  in.key_offsets.push_back(0);
+  crypto::generate_key_image(in_key.pub, in_key.sec, in.k_image);
+  tx.vin.push_back(in);
+
+  cryptonote::tx_out out;
+  out.amount = 1000;
+  out.target = cryptonote::txout_to_key(cryptonote::keypair::generate(hw::get_device("default")).pub);
+  tx.vout.push_back(out);
+
+  tx.signatures.resize(1);
+  tx.signatures[0].resize(1);
+  tx.invalidate_hashes();
+  return tx;
+}
+
+bool add_kept_tx(cryptonote::tx_memory_pool &txpool, cryptonote::transaction tx)
+{
+  cryptonote::tx_verification_context tvc{};
+  return txpool.add_tx(tx, tvc, cryptonote::relay_method::block, true, 1) && tvc.m_added_to_pool;
+}
+
+// the pool's view of its txes, and the db's, must be the same
+void check_pool_matches_db(const cryptonote::tx_memory_pool &txpool, const cryptonote::Blockchain &bc, const std::vector<cryptonote::transaction> &expected)
+{
+  std::unordered_map<crypto::hash, cryptonote::blobdata> expected_blobs;
+  for (const cryptonote::transaction &tx: expected)
+    expected_blobs.emplace(cryptonote::get_transaction_hash(tx), cryptonote::tx_to_blob(tx));
+
+  ASSERT_EQ(txpool.get_transactions_count(true), expected.size());
+  ASSERT_EQ(bc.get_txpool_tx_count(true), expected.size());
+
+  std::vector<crypto::hash> hashes;
+  txpool.get_transaction_hashes(hashes, true);
+  ASSERT_EQ(hashes.size(), expected.size());
+  for (const crypto::hash &hash: hashes)
+  {
+    ASSERT_EQ(expected_blobs.count(hash), 1);
+    ASSERT_TRUE(txpool.have_tx(hash, cryptonote::relay_category::all));
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> db_weights_and_fees;
+  size_t db_txes = 0;
+  ASSERT_TRUE(bc.for_all_txpool_txes([&](const crypto::hash &txid, const cryptonote::txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+    const auto i = expected_blobs.find(txid);
+    if (i == expected_blobs.end() || i->second != *bd)
+      return false;
+    db_weights_and_fees.emplace_back(meta.weight, meta.fee);
+    ++db_txes;
+    return true;
+  }, true, cryptonote::relay_category::all));
+  ASSERT_EQ(db_txes, expected.size());
+
+  std::vector<cryptonote::tx_backlog_entry> backlog;
+  txpool.get_transaction_backlog(backlog, true);
+  std::vector<std::pair<uint64_t, uint64_t>> weights_and_fees;
+  for (const cryptonote::tx_backlog_entry &entry: backlog)
+    weights_and_fees.emplace_back(entry.weight, entry.fee);
+  std::sort(weights_and_fees.begin(), weights_and_fees.end());
+  std::sort(db_weights_and_fees.begin(), db_weights_and_fees.end());
+  ASSERT_EQ(weights_and_fees, db_weights_and_fees);
+}
+
+}
+
+TEST(tx_pool, db_write_through)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+  check_pool_matches_db(chain.txpool, chain.bc, {});
+
+  const cryptonote::transaction tx0 = make_tx(100), tx1 = make_tx(200);
+  ASSERT_TRUE(add_kept_tx(chain.txpool, tx0));
+  ASSERT_TRUE(add_kept_tx(chain.txpool, tx1));
+  check_pool_matches_db(chain.txpool, chain.bc, {tx0, tx1});
+
+  // mined
+  cryptonote::transaction tx;
+  cryptonote::blobdata blob;
+  size_t weight;
+  uint64_t fee;
+  bool relayed, do_not_relay, double_spend_seen, pruned;
+  ASSERT_TRUE(chain.txpool.take_tx(cryptonote::get_transaction_hash(tx0), tx, blob, weight, fee, relayed, do_not_relay, double_spend_seen, pruned));
+  ASSERT_EQ(blob, cryptonote::tx_to_blob(tx0));
+  ASSERT_EQ(fee, 100);
+  check_pool_matches_db(chain.txpool, chain.bc, {tx1});
+  ASSERT_FALSE(chain.txpool.take_tx(cryptonote::get_transaction_hash(tx0), tx, blob, weight, fee, relayed, do_not_relay, double_spend_seen, pruned));
+
+  // back in the pool when its block is switched away
+  ASSERT_TRUE(add_kept_tx(chain.txpool, tx0));
+  check_pool_matches_db(chain.txpool, chain.bc, {tx0, tx1});
+}
+
+TEST(tx_pool, reloaded_from_db)
+{
+  test_blockchain chain;
+  ASSERT_TRUE(chain.initialized);
+
+  const cryptonote::transaction tx0 = make_tx(100), tx1 = make_tx(200);
+  ASSERT_TRUE(add_kept_tx(chain.txpool, tx0));
+  ASSERT_TRUE(add_kept_tx(chain.txpool, tx1));
+
+  // a restarted pool only has the db to go on
+  ASSERT_TRUE(chain.txpool.init());
+  check_pool_matches_db(chain.txpool, chain.bc, {tx0, tx1});
+
+  // and it still knows which key images its txes spend
+  cryptonote::transaction tx2 = make_tx(300);
+  tx2.vin[0] = tx0.vin[0];
+  tx2.invalidate_hashes();
+  cryptonote::tx_verification_context tvc{};
+  ASSERT_TRUE(chain.txpool.add_tx(tx2, tvc, cryptonote::relay_method::block, true, 1));
+  check_pool_matches_db(chain.txpool, chain.bc, {tx0, tx1, tx2});
+  std::vector<cryptonote::tx_info> infos;
+  std::vector<cryptonote::spent_key_image_info> key_images;
+  ASSERT_TRUE(chain.txpool.get_transactions_and_spent_keys_info(infos, key_images, true));
+  ASSERT_EQ(key_images.size(), 2);
+  const std::string spent_twice = epee::string_tools::pod_to_hex(boost::get<cryptonote::txin_to_key>(tx0.vin[0]).k_image);
+  for (const cryptonote::spent_key_image_info &ki: key_images)
+    ASSERT_EQ(ki.txs_hashes.size(), ki.id_hash == spent_twice ? 2 : 1);
+  for (const cryptonote::tx_info &info: infos)
+    ASSERT_EQ(info.double_spend_seen, info.id_hash == epee::string_tools::pod_to_hex(cryptonote::get_transaction_hash(tx2)));
+}